@@ -0,0 +1,279 @@
+/*
+ * Copyright 2016, Intel Corporation
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *      * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *
+ *      * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in
+ *       the documentation and/or other materials provided with the
+ *       distribution.
+ *
+ *      * Neither the name of the copyright holder nor the names of its
+ *        contributors may be used to endorse or promote products derived
+ *        from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * obj_direct.c -- pmemobj_direct benchmark definition
+ *
+ * The objects are allocated in a number of pools and dereferenced in turns,
+ * so that with more than one pool every pmemobj_direct call has to find
+ * another pool than the previous one.
+ */
+
+#include <assert.h>
+#include <errno.h>
+#include <limits.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "libpmemobj.h"
+#include "benchmark.h"
+
+#define LAYOUT_NAME "obj_direct"
+
+/*
+ * The number of times to repeat the operation, used to get more accurate
+ * results, because the operation time was minimal compared to the framework
+ * overhead.
+ */
+#define OPERATION_REPEAT_COUNT 10000
+
+/*
+ * prog_args - command line parsed arguments
+ */
+struct prog_args {
+	unsigned pools;		/* number of pools */
+	unsigned objects;	/* number of objects in each pool */
+};
+
+/*
+ * obj_bench - variables used in benchmark, passed within functions
+ */
+struct obj_bench {
+	struct prog_args *pa;		/* prog_args structure */
+	PMEMobjpool **pops;		/* persistent pool handles */
+	char **paths;			/* paths of the pools */
+	PMEMoid *oids;			/* objects of the pools, interleaved */
+	size_t noids;			/* number of the objects */
+};
+
+/*
+ * direct_pools_close -- (internal) closes and removes the pools
+ */
+static void
+direct_pools_close(struct obj_bench *ob, unsigned npools)
+{
+	for (unsigned i = 0; i < npools; ++i) {
+		pmemobj_close(ob->pops[i]);
+
+		/* the first pool file is removed by the framework */
+		if (i != 0)
+			unlink(ob->paths[i]);
+		free(ob->paths[i]);
+	}
+}
+
+/*
+ * direct_pool_create -- (internal) creates the pool with the given index
+ *	and allocates its objects
+ */
+static int
+direct_pool_create(struct benchmark_args *args, struct obj_bench *ob,
+	unsigned idx)
+{
+	unsigned nobjs = ob->pa->objects;
+
+	size_t len = strlen(args->fname) + sizeof(".4294967295");
+	ob->paths[idx] = malloc(len);
+	if (ob->paths[idx] == NULL) {
+		perror("malloc");
+		return -1;
+	}
+
+	if (idx == 0)
+		snprintf(ob->paths[idx], len, "%s", args->fname);
+	else
+		snprintf(ob->paths[idx], len, "%s.%u", args->fname, idx);
+
+	size_t psize = PMEMOBJ_MIN_POOL + 2 * nobjs * (args->dsize + 64);
+	ob->pops[idx] = pmemobj_create(ob->paths[idx], LAYOUT_NAME, psize,
+			args->fmode);
+	if (ob->pops[idx] == NULL) {
+		fprintf(stderr, "%s\n", pmemobj_errormsg());
+		free(ob->paths[idx]);
+		return -1;
+	}
+
+	for (unsigned i = 0; i < nobjs; ++i) {
+		PMEMoid *oid = &ob->oids[i * ob->pa->pools + idx];
+		if (pmemobj_zalloc(ob->pops[idx], oid, args->dsize, 0)) {
+			perror("pmemobj_zalloc");
+			goto err;
+		}
+	}
+
+	return 0;
+
+err:
+	pmemobj_close(ob->pops[idx]);
+	if (idx != 0)
+		unlink(ob->paths[idx]);
+	free(ob->paths[idx]);
+	return -1;
+}
+
+/*
+ * direct_init -- benchmark initialization
+ */
+static int
+direct_init(struct benchmark *bench, struct benchmark_args *args)
+{
+	assert(bench != NULL);
+	assert(args != NULL);
+	assert(args->opts != NULL);
+
+	struct obj_bench *ob = malloc(sizeof(struct obj_bench));
+	if (ob == NULL) {
+		perror("malloc");
+		return -1;
+	}
+	pmembench_set_priv(bench, ob);
+
+	ob->pa = args->opts;
+	ob->noids = (size_t)ob->pa->pools * ob->pa->objects;
+	ob->pops = calloc(ob->pa->pools, sizeof(PMEMobjpool *));
+	ob->paths = calloc(ob->pa->pools, sizeof(char *));
+	ob->oids = calloc(ob->noids, sizeof(PMEMoid));
+	if (ob->pops == NULL || ob->paths == NULL || ob->oids == NULL) {
+		perror("calloc");
+		goto err;
+	}
+
+	for (unsigned i = 0; i < ob->pa->pools; ++i) {
+		if (direct_pool_create(args, ob, i)) {
+			direct_pools_close(ob, i);
+			goto err;
+		}
+	}
+
+	return 0;
+
+err:
+	free(ob->oids);
+	free(ob->paths);
+	free(ob->pops);
+	free(ob);
+	return -1;
+}
+
+/*
+ * direct_exit -- benchmark clean up
+ */
+static int
+direct_exit(struct benchmark *bench, struct benchmark_args *args)
+{
+	struct obj_bench *ob = pmembench_get_priv(bench);
+
+	direct_pools_close(ob, ob->pa->pools);
+
+	free(ob->oids);
+	free(ob->paths);
+	free(ob->pops);
+	free(ob);
+
+	return 0;
+}
+
+/*
+ * direct_op -- dereferences the consecutive objects
+ */
+static int
+direct_op(struct benchmark *bench, struct operation_info *info)
+{
+	struct obj_bench *ob = pmembench_get_priv(bench);
+	size_t idx = (size_t)info->index * OPERATION_REPEAT_COUNT;
+	unsigned sum = 0;
+
+	for (int i = 0; i < OPERATION_REPEAT_COUNT; i++) {
+		char *ptr = pmemobj_direct(ob->oids[idx++ % ob->noids]);
+		sum += (unsigned char)*ptr;
+	}
+
+	/* the objects are zeroed */
+	return sum == 0 ? 0 : -1;
+}
+
+/* structure defining command line arguments */
+static struct benchmark_clo direct_clo[] = {
+	{
+		.opt_short	= 'p',
+		.opt_long	= "pools",
+		.descr		= "Number of pools from which the objects are"
+					" dereferenced in turns",
+		.def		= "1",
+		.off		= clo_field_offset(struct prog_args, pools),
+		.type		= CLO_TYPE_UINT,
+		.type_uint	= {
+			.size	= clo_field_size(struct prog_args, pools),
+			.base	= CLO_INT_BASE_DEC,
+			.min	= 1,
+			.max	= 1024
+		}
+	},
+	{
+		.opt_short	= 'o',
+		.opt_long	= "objects",
+		.descr		= "Number of objects in each pool",
+		.def		= "1024",
+		.off		= clo_field_offset(struct prog_args, objects),
+		.type		= CLO_TYPE_UINT,
+		.type_uint	= {
+			.size	= clo_field_size(struct prog_args, objects),
+			.base	= CLO_INT_BASE_DEC,
+			.min	= 1,
+			.max	= UINT_MAX
+		}
+	},
+};
+
+/*
+ * stores information about direct benchmark
+ */
+static struct benchmark_info direct_info = {
+	.name		= "obj_direct",
+	.brief		= "Benchmark for pmemobj_direct",
+	.init		= direct_init,
+	.exit		= direct_exit,
+	.multithread	= true,
+	.multiops	= true,
+	.operation	= direct_op,
+	.measure_time	= true,
+	.clos		= direct_clo,
+	.nclos		= ARRAY_SIZE(direct_clo),
+	.opts_size	= sizeof(struct prog_args),
+	.rm_file	= true,
+	.allow_poolset	= false,
+};
+
+REGISTER_BENCHMARK(direct_info);
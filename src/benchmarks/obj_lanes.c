@@ -36,6 +36,8 @@
 
 #include <assert.h>
 #include <errno.h>
+#include <stdbool.h>
+#include <stdio.h>
 #include <unistd.h>
 
 #include "libpmemobj.h"
@@ -54,6 +56,7 @@
  */
 struct prog_args {
 	char *lane_section_name;	/* lane section to be held */
+	bool print_stats;	/* if set, print NUMA locality of the lanes */
 };
 
 /*
@@ -123,6 +126,25 @@ err:
 	return -1;
 }
 
+/*
+ * print_lane_stats -- prints how many times the lanes were taken by threads
+ *	running on their NUMA node and on the other nodes
+ */
+static void
+print_lane_stats(struct obj_bench *ob)
+{
+	struct lane_stats s;
+	lane_get_stats(ob->pop, &s);
+
+	uint64_t nholds = s.local_hits + s.remote_hits;
+	double local_rate = nholds ?
+		(double)s.local_hits * 100.0 / nholds : 0.0;
+
+	printf("local lane hits: %lu remote lane hits: %lu "
+		"local-rate[%%]: %.2f\n",
+		s.local_hits, s.remote_hits, local_rate);
+}
+
 /*
  * lanes_exit -- benchmark clean up
  */
@@ -131,6 +153,9 @@ lanes_exit(struct benchmark *bench, struct benchmark_args *args)
 {
 	struct obj_bench *ob = pmembench_get_priv(bench);
 
+	if (ob->pa->print_stats)
+		print_lane_stats(ob);
+
 	pmemobj_close(ob->pop);
 	free(ob);
 
@@ -167,6 +192,16 @@ static struct benchmark_clo lanes_clo[] = {
 							lane_section_name),
 		.def		= "allocator",
 	},
+	{
+		.opt_short	= 'S',
+		.opt_long	= "stats",
+		.descr		= "Print the number of lanes taken by threads"
+					" on the lane's NUMA node and on other"
+					" nodes",
+		.off		= clo_field_offset(struct prog_args,
+							print_stats),
+		.type		= CLO_TYPE_FLAG
+	},
 };
 
 /*
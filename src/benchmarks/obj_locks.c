@@ -88,7 +88,8 @@ struct prog_args {
 	bool run_id_increment;	/* increment run_id after each lock/unlock */
 	uint64_t runid_initial_value;	/* initial value of run_id */
 	char *lock_mode;	/* "1by1" or "all-lock" */
-	char *lock_type;	/* "mutex", "rwlock" or "ram-mutex" */
+	char *lock_type;	/* "mutex", "rwlock", "volatile-mutex", */
+				/* "spin-mutex" or "bias-rwlock" */
 	bool use_rdlock;	/* use read lock, instead of write lock */
 };
 
@@ -107,6 +108,8 @@ typedef union lock_union {
 	PMEMmutex pm_mutex;
 	PMEMrwlock pm_rwlock;
 	PMEM_volatile_mutex pm_vmutex;
+	PMEMspinmutex pm_spinmutex;
+	PMEMbiasrwlock pm_biasrwlock;
 	pthread_mutex_t pt_mutex;
 	pthread_rwlock_t pt_rwlock;
 } lock_t;
@@ -139,6 +142,8 @@ enum benchmark_mode {
 	BENCH_MODE_MUTEX,	/* PMEMmutex vs. pthread_mutex_t */
 	BENCH_MODE_RWLOCK,	/* PMEMrwlock vs. pthread_rwlock_t */
 	BENCH_MODE_VOLATILE_MUTEX, /* PMEMmutex with pthread mutex in RAM */
+	BENCH_MODE_SPINMUTEX,	/* PMEMspinmutex */
+	BENCH_MODE_BIASRWLOCK,	/* PMEMbiasrwlock */
 	BENCH_MODE_MAX
 };
 
@@ -496,10 +501,84 @@ op_bench_vmutex(struct mutex_bench *mb)
 	return 0;
 }
 
+/*
+ * init_bench_zeroed -- allocate the zeroed lock objects, which are
+ * initialized at their first use
+ */
+static int
+init_bench_zeroed(struct mutex_bench *mb)
+{
+	POBJ_ZALLOC(mb->pop, &D_RW(mb->root)->locks, lock_t,
+			mb->pa->n_locks * sizeof(lock_t));
+	if (TOID_IS_NULL(D_RO(mb->root)->locks)) {
+		perror("POBJ_ZALLOC");
+		return -1;
+	}
+
+	mb->locks = D_RW(D_RW(mb->root)->locks);
+
+	return 0;
+}
+
+/*
+ * exit_bench_zeroed -- release the memory of the lock objects
+ */
+static int
+exit_bench_zeroed(struct mutex_bench *mb)
+{
+	POBJ_FREE(&D_RW(mb->root)->locks);
+
+	return 0;
+}
+
+/*
+ * op_bench_spinmutex -- lock and unlock the adaptive mutex object
+ */
+static int
+op_bench_spinmutex(struct mutex_bench *mb)
+{
+	if (mb->lock_mode == OP_MODE_1BY1)
+		BENCH_OPERATION_1BY1(pmemobj_spinmutex_lock,
+			pmemobj_spinmutex_unlock, mb, PMEMspinmutex, mb->pop);
+	else
+		BENCH_OPERATION_ALL_LOCK(pmemobj_spinmutex_lock,
+			pmemobj_spinmutex_unlock, mb, PMEMspinmutex, mb->pop);
+
+	if (mb->pa->run_id_increment)
+		mb->pop->run_id += 2; /* must be a multiple of 2 */
+
+	return 0;
+}
+
+/*
+ * op_bench_biasrwlock -- lock and unlock the reader-biased rwlock object
+ */
+static int
+op_bench_biasrwlock(struct mutex_bench *mb)
+{
+	if (mb->lock_mode == OP_MODE_1BY1)
+		BENCH_OPERATION_1BY1(!mb->pa->use_rdlock ?
+			pmemobj_biasrwlock_wrlock : pmemobj_biasrwlock_rdlock,
+			pmemobj_biasrwlock_unlock, mb, PMEMbiasrwlock,
+			mb->pop);
+	else
+		BENCH_OPERATION_ALL_LOCK(!mb->pa->use_rdlock ?
+			pmemobj_biasrwlock_wrlock : pmemobj_biasrwlock_rdlock,
+			pmemobj_biasrwlock_unlock, mb, PMEMbiasrwlock,
+			mb->pop);
+
+	if (mb->pa->run_id_increment)
+		mb->pop->run_id += 2; /* must be a multiple of 2 */
+
+	return 0;
+}
+
 struct bench_ops benchmark_ops[BENCH_MODE_MAX] = {
 	{ init_bench_mutex, exit_bench_mutex, op_bench_mutex },
 	{ init_bench_rwlock, exit_bench_rwlock, op_bench_rwlock },
-	{ init_bench_vmutex, exit_bench_vmutex, op_bench_vmutex }
+	{ init_bench_vmutex, exit_bench_vmutex, op_bench_vmutex },
+	{ init_bench_zeroed, exit_bench_zeroed, op_bench_spinmutex },
+	{ init_bench_zeroed, exit_bench_zeroed, op_bench_biasrwlock }
 };
 
 /*
@@ -530,6 +609,10 @@ parse_benchmark_mode(const char *arg)
 		return &benchmark_ops[BENCH_MODE_RWLOCK];
 	else if (strcmp(arg, "volatile-mutex") == 0)
 		return &benchmark_ops[BENCH_MODE_VOLATILE_MUTEX];
+	else if (strcmp(arg, "spin-mutex") == 0)
+		return &benchmark_ops[BENCH_MODE_SPINMUTEX];
+	else if (strcmp(arg, "bias-rwlock") == 0)
+		return &benchmark_ops[BENCH_MODE_BIASRWLOCK];
 	else
 		return NULL;
 }
@@ -715,8 +798,9 @@ static struct benchmark_clo locks_clo[] = {
 	{
 		.opt_short	= 'b',
 		.opt_long	= "bench_type",
-		.descr		= "The Benchmark type: mutex, rwlock or "
-					"volatile-mutex",
+		.descr		= "The Benchmark type: mutex, rwlock, "
+					"volatile-mutex, spin-mutex or "
+					"bias-rwlock",
 		.type		= CLO_TYPE_STR,
 		.off		= clo_field_offset(struct prog_args, lock_type),
 		.def		= "mutex",
@@ -725,7 +809,8 @@ static struct benchmark_clo locks_clo[] = {
 		.opt_short	= 'R',
 		.opt_long	= "rdlock",
 		.descr		= "Select read over write lock, only valid "
-					"when lock_type is \"rwlock\"",
+					"when lock_type is \"rwlock\" or "
+					"\"bias-rwlock\"",
 		.type		= CLO_TYPE_FLAG,
 		.off		= clo_field_offset(struct prog_args,
 							use_rdlock),
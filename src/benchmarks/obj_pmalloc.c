@@ -67,6 +67,7 @@ struct prog_args {
 	size_t minsize;		/* minimum size for random allocation size */
 	bool use_random_size;	/* if set, use random size allocations */
 	unsigned seed;		/* PRNG seed */
+	bool print_stats;	/* if set, print allocation cache statistics */
 };
 
 POBJ_LAYOUT_BEGIN(pmalloc_layout);
@@ -242,6 +243,23 @@ pmalloc_op(struct benchmark *bench, struct operation_info *info)
 	return 0;
 }
 
+/*
+ * print_cache_stats -- prints statistics of the per-thread allocation caches
+ */
+static void
+print_cache_stats(struct obj_bench *ob)
+{
+	struct palloc_cache_stats s;
+	pmalloc_get_cache_stats(ob->pop, &s);
+
+	uint64_t nallocs = s.hits + s.misses;
+	double hit_rate = nallocs ? (double)s.hits * 100.0 / nallocs : 0.0;
+
+	printf("cache hits: %lu misses: %lu hit-rate[%%]: %.2f "
+		"refills: %lu refilled-blocks: %lu\n",
+		s.hits, s.misses, hit_rate, s.refills, s.refilled_blocks);
+}
+
 /*
  * pmalloc_exit -- the end of the pmalloc benchmark. Frees the memory allocated
  * during pmalloc_op and performs the common exit operations.
@@ -251,6 +269,9 @@ pmalloc_exit(struct benchmark *bench, struct benchmark_args *args)
 {
 	struct obj_bench *ob = pmembench_get_priv(bench);
 
+	if (ob->pa->print_stats)
+		print_cache_stats(ob);
+
 	for (size_t i = 0; i < args->n_ops_per_thread * args->n_threads; i++) {
 		if (ob->offs[i])
 			pfree(ob->pop, &ob->offs[i]);
@@ -345,6 +366,15 @@ static struct benchmark_clo pmalloc_clo[] = {
 			.max	= UINT_MAX,
 		}
 	},
+	{
+		.opt_short	= 's',
+		.opt_long	= "stats",
+		.descr		= "Print statistics of the per-thread"
+					" allocation caches",
+		.off		= clo_field_offset(struct prog_args,
+							print_stats),
+		.type		= CLO_TYPE_FLAG
+	},
 };
 
 /*
@@ -0,0 +1,353 @@
+/*
+ * Copyright 2016, Intel Corporation
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *      * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *
+ *      * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in
+ *       the documentation and/or other materials provided with the
+ *       distribution.
+ *
+ *      * Neither the name of the copyright holder nor the names of its
+ *        contributors may be used to endorse or promote products derived
+ *        from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * obj_recovery.c -- pool recovery benchmark definition
+ *
+ * Before each operation a child process opens the pool, starts a number of
+ * threads which leave their transactions unfinished and exits in the middle
+ * of them. The operation is the opening of the pool, which has to recover
+ * all of the interrupted transactions.
+ */
+
+#include <assert.h>
+#include <errno.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "libpmemobj.h"
+#include "benchmark.h"
+
+#define LAYOUT_NAME "obj_recovery"
+
+/* room for the runs from which each of the threads allocates */
+#define WRITER_HEAP_OVERHEAD (1 << 20)
+
+/*
+ * prog_args - command line parsed arguments
+ */
+struct prog_args {
+	unsigned writers;	/* threads with transactions at the crash */
+	unsigned ranges;	/* ranges snapshotted by each transaction */
+	unsigned recovery_threads; /* PMEMOBJ_RECOVERY_THREADS, 0 - default */
+};
+
+/*
+ * obj_bench - variables used in benchmark, passed within functions
+ */
+struct obj_bench {
+	PMEMobjpool *pop;		/* persistent pool handle */
+	struct prog_args *pa;		/* prog_args structure */
+	size_t dsize;			/* size of each snapshotted range */
+	unsigned next_idx;		/* index of the next thread's slice */
+	unsigned nstarted;		/* threads waiting for the crash */
+	pthread_mutex_t crash_lock;	/* held until the crash */
+};
+
+/*
+ * crash_worker -- (internal) snapshots and modifies its part of the root
+ *	object and allocates objects in a transaction which never finishes
+ */
+static void *
+crash_worker(void *arg)
+{
+	struct obj_bench *ob = arg;
+	unsigned idx = __sync_fetch_and_add(&ob->next_idx, 1);
+	size_t slice = ob->dsize * ob->pa->ranges;
+
+	PMEMoid root = pmemobj_root(ob->pop, slice * ob->pa->writers);
+	char *data = (char *)pmemobj_direct(root) + slice * idx;
+
+	TX_BEGIN(ob->pop) {
+		for (unsigned r = 0; r < ob->pa->ranges; ++r) {
+			char *range = data + r * ob->dsize;
+			pmemobj_tx_add_range_direct(range, ob->dsize);
+			memset(range, r, ob->dsize);
+
+			pmemobj_tx_alloc(ob->dsize, 0);
+		}
+
+		__sync_fetch_and_add(&ob->nstarted, 1);
+
+		/* wait for the crash */
+		pthread_mutex_lock(&ob->crash_lock);
+	} TX_ONABORT {
+		fprintf(stderr, "transaction aborted\n");
+		_exit(1);
+	} TX_END
+
+	return NULL;
+}
+
+/*
+ * crash -- (internal) runs the workload in a child process which exits
+ *	while all of the transactions are in progress
+ */
+static int
+crash(struct benchmark_args *args, struct obj_bench *ob)
+{
+	pid_t pid = fork();
+	if (pid < 0) {
+		perror("fork");
+		return -1;
+	}
+
+	if (pid == 0) {
+		ob->pop = pmemobj_open(args->fname, LAYOUT_NAME);
+		if (ob->pop == NULL) {
+			fprintf(stderr, "%s\n", pmemobj_errormsg());
+			_exit(1);
+		}
+
+		ob->next_idx = 0;
+		ob->nstarted = 0;
+		pthread_mutex_init(&ob->crash_lock, NULL);
+		pthread_mutex_lock(&ob->crash_lock);
+
+		pthread_t thread;
+		for (unsigned i = 0; i < ob->pa->writers; ++i) {
+			if (pthread_create(&thread, NULL, crash_worker, ob)) {
+				perror("pthread_create");
+				_exit(1);
+			}
+		}
+
+		while (__sync_fetch_and_add(&ob->nstarted, 0) !=
+				ob->pa->writers)
+			sched_yield();
+
+		/* simulate a crash */
+		_exit(0);
+	}
+
+	int status;
+	if (waitpid(pid, &status, 0) != pid) {
+		perror("waitpid");
+		return -1;
+	}
+
+	if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+		fprintf(stderr, "workload process failed\n");
+		return -1;
+	}
+
+	return 0;
+}
+
+/*
+ * recovery_init -- benchmark initialization
+ */
+static int
+recovery_init(struct benchmark *bench, struct benchmark_args *args)
+{
+	assert(bench != NULL);
+	assert(args != NULL);
+	assert(args->opts != NULL);
+
+	struct obj_bench *ob = malloc(sizeof(struct obj_bench));
+	if (ob == NULL) {
+		perror("malloc");
+		return -1;
+	}
+	pmembench_set_priv(bench, ob);
+
+	ob->pa = args->opts;
+	ob->dsize = args->dsize;
+
+	if (ob->pa->recovery_threads != 0) {
+		char nthreads[16];
+		snprintf(nthreads, sizeof(nthreads), "%u",
+			ob->pa->recovery_threads);
+		setenv("PMEMOBJ_RECOVERY_THREADS", nthreads, 1);
+	} else {
+		unsetenv("PMEMOBJ_RECOVERY_THREADS");
+	}
+
+	/* the snapshots, the new objects and the undo logs */
+	size_t psize = args->is_poolset ? 0 : PMEMOBJ_MIN_POOL +
+		ob->pa->writers * (4 * ob->pa->ranges * args->dsize +
+		WRITER_HEAP_OVERHEAD);
+
+	/* create pmemobj pool */
+	ob->pop = pmemobj_create(args->fname, LAYOUT_NAME, psize,
+			args->fmode);
+	if (ob->pop == NULL) {
+		fprintf(stderr, "%s\n", pmemobj_errormsg());
+		goto err;
+	}
+
+	pmemobj_close(ob->pop);
+	ob->pop = NULL;
+
+	return 0;
+
+err:
+	free(ob);
+	return -1;
+}
+
+/*
+ * recovery_exit -- benchmark clean up
+ */
+static int
+recovery_exit(struct benchmark *bench, struct benchmark_args *args)
+{
+	struct obj_bench *ob = pmembench_get_priv(bench);
+
+	unsetenv("PMEMOBJ_RECOVERY_THREADS");
+	free(ob);
+
+	return 0;
+}
+
+/*
+ * recovery_op_init -- leaves the pool with interrupted transactions
+ */
+static int
+recovery_op_init(struct benchmark *bench, struct operation_info *info)
+{
+	struct obj_bench *ob = pmembench_get_priv(bench);
+
+	return crash(info->args, ob);
+}
+
+/*
+ * recovery_op -- opens, and so recovers, the pool
+ */
+static int
+recovery_op(struct benchmark *bench, struct operation_info *info)
+{
+	struct obj_bench *ob = pmembench_get_priv(bench);
+
+	ob->pop = pmemobj_open(info->args->fname, LAYOUT_NAME);
+	if (ob->pop == NULL) {
+		fprintf(stderr, "%s\n", pmemobj_errormsg());
+		return -1;
+	}
+
+	return 0;
+}
+
+/*
+ * recovery_op_exit -- closes the recovered pool
+ */
+static int
+recovery_op_exit(struct benchmark *bench, struct operation_info *info)
+{
+	struct obj_bench *ob = pmembench_get_priv(bench);
+
+	pmemobj_close(ob->pop);
+	ob->pop = NULL;
+
+	return 0;
+}
+
+/* structure defining command line arguments */
+static struct benchmark_clo recovery_clo[] = {
+	{
+		.opt_short	= 'w',
+		.opt_long	= "writers",
+		.descr		= "Number of threads in the middle of a"
+					" transaction at the time of the crash",
+		.def		= "64",
+		.off		= clo_field_offset(struct prog_args, writers),
+		.type		= CLO_TYPE_UINT,
+		.type_uint	= {
+			.size	= clo_field_size(struct prog_args, writers),
+			.base	= CLO_INT_BASE_DEC,
+			.min	= 1,
+			.max	= UINT_MAX
+		}
+	},
+	{
+		.opt_short	= 'r',
+		.opt_long	= "ranges",
+		.descr		= "Number of data-size ranges snapshotted and"
+					" objects allocated by each"
+					" transaction",
+		.def		= "64",
+		.off		= clo_field_offset(struct prog_args, ranges),
+		.type		= CLO_TYPE_UINT,
+		.type_uint	= {
+			.size	= clo_field_size(struct prog_args, ranges),
+			.base	= CLO_INT_BASE_DEC,
+			.min	= 1,
+			.max	= UINT_MAX
+		}
+	},
+	{
+		.opt_short	= 'R',
+		.opt_long	= "recovery-threads",
+		.descr		= "Number of threads recovering the pool,"
+					" 0 for the library default",
+		.def		= "0",
+		.off		= clo_field_offset(struct prog_args,
+							recovery_threads),
+		.type		= CLO_TYPE_UINT,
+		.type_uint	= {
+			.size	= clo_field_size(struct prog_args,
+							recovery_threads),
+			.base	= CLO_INT_BASE_DEC,
+			.min	= 0,
+			.max	= UINT_MAX
+		}
+	},
+};
+
+/*
+ * stores information about recovery benchmark
+ */
+static struct benchmark_info recovery_info = {
+	.name		= "obj_recovery",
+	.brief		= "Benchmark for pool recovery after a crash",
+	.init		= recovery_init,
+	.exit		= recovery_exit,
+	.multithread	= false,
+	.multiops	= true,
+	.op_init	= recovery_op_init,
+	.operation	= recovery_op,
+	.op_exit	= recovery_op_exit,
+	.measure_time	= true,
+	.clos		= recovery_clo,
+	.nclos		= ARRAY_SIZE(recovery_clo),
+	.opts_size	= sizeof(struct prog_args),
+	.rm_file	= true,
+	.allow_poolset	= true,
+};
+
+REGISTER_BENCHMARK(recovery_info);
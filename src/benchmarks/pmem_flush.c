@@ -49,6 +49,8 @@
 #define PAGE_4K ((uintptr_t)1 << 12)
 #define PAGE_2M ((uintptr_t)1 << 21)
 
+#define MAX_RANGES 64
+
 /*
  * align_addr -- round addr down to given boundary
  */
@@ -85,6 +87,7 @@ struct pmem_args
 	char *operation;	/* msync, dummy_msync, persist, ... */
 	char *mode;		/* stat, seq, rand */
 	bool no_warmup;		/* don't do warmup */
+	unsigned ranges;	/* number of ranges for vector operations */
 };
 
 /*
@@ -193,6 +196,42 @@ flush_persist(struct pmem_bench *pmb, void *addr, size_t len)
 	return 0;
 }
 
+/*
+ * flush_persist_ranges -- split the data into ranges and flush each of them
+ * using pmem_persist()
+ */
+static int
+flush_persist_ranges(struct pmem_bench *pmb, void *addr, size_t len)
+{
+	unsigned ranges = pmb->pargs->ranges;
+	size_t range_len = len / ranges;
+
+	for (unsigned i = 0; i < ranges; i++)
+		pmem_persist((char *)addr + i * range_len, range_len);
+	return 0;
+}
+
+/*
+ * flush_persistv -- split the data into ranges and flush all of them
+ * using a single pmem_persistv()
+ */
+static int
+flush_persistv(struct pmem_bench *pmb, void *addr, size_t len)
+{
+	unsigned ranges = pmb->pargs->ranges;
+	size_t range_len = len / ranges;
+	struct iovec iov[MAX_RANGES];
+
+	/* reverse order, the way ranges usually come from callers */
+	for (unsigned i = 0; i < ranges; i++) {
+		iov[i].iov_base = (char *)addr + (ranges - 1 - i) * range_len;
+		iov[i].iov_len = range_len;
+	}
+
+	pmem_persistv(iov, (int)ranges);
+	return 0;
+}
+
 /*
  * flush_persist_4K -- always flush entire 4K page(s) using pmem_persist()
  */
@@ -340,6 +379,8 @@ struct op {
 static struct op ops[] = {
 	{ "noop", flush_noop },
 	{ "persist", flush_persist },
+	{ "persist_ranges", flush_persist_ranges },
+	{ "persistv", flush_persistv },
 	{ "persist_4K", flush_persist_4K },
 	{ "persist_2M", flush_persist_2M },
 	{ "msync", flush_msync },
@@ -394,6 +435,11 @@ pmem_flush_init(struct benchmark *bench, struct benchmark_args *args)
 	}
 	pmb->func_op = ops[i].func_op;
 
+	if (args->dsize < pmb->pargs->ranges) {
+		fprintf(stderr, "data size smaller than number of ranges\n");
+		goto err_free_pmb;
+	}
+
 	pmb->n_offsets = args->n_ops_per_thread * args->n_threads;
 
 	pmb->fsize = pmb->n_offsets * args->dsize + (2 * PAGE_2M);
@@ -535,12 +581,28 @@ static struct benchmark_clo pmem_flush_clo[] = {
 		.type		= CLO_TYPE_FLAG,
 		.off		= clo_field_offset(struct pmem_args, no_warmup),
 	},
+	{
+		.opt_short	= 0,
+		.opt_long	= "ranges",
+		.descr		= "Number of ranges the data is split into by "
+				"persist_ranges and persistv operations",
+		.type		= CLO_TYPE_UINT,
+		.off		= clo_field_offset(struct pmem_args, ranges),
+		.def		= "1",
+		.type_uint	= {
+			.size	= clo_field_size(struct pmem_args, ranges),
+			.base	= CLO_INT_BASE_DEC,
+			.min	= 1,
+			.max	= MAX_RANGES,
+		},
+	},
 };
 
 /* Stores information about benchmark. */
 static struct benchmark_info pmem_flush_bench = {
 	.name		= "pmem_flush",
-	.brief		= "Benchmark for pmem_msync() and pmem_persist()",
+	.brief		= "Benchmark for pmem_msync(), pmem_persist() and "
+				"pmem_persistv()",
 	.init		= pmem_flush_init,
 	.exit		= pmem_flush_exit,
 	.multithread	= true,
@@ -44,6 +44,8 @@
 #include <sys/mman.h>
 
 #include "benchmark.h"
+#include "cpu.h"
+#include "pmem.h"
 
 #define FLUSH_ALIGN 64
 
@@ -107,6 +109,19 @@ struct pmem_args
 	 * function is used, otherwise pmem_flush() is performed.
 	 */
 	bool persist;
+
+	/*
+	 * Non-temporal store variant used by pmem_memcpy_nodrain():
+	 * auto, sse2, avx or avx512f. The "auto" variant is the one
+	 * picked by libpmem at initialization time.
+	 */
+	char *movnt;
+
+	/*
+	 * Overrides the threshold for using non-temporal stores in the
+	 * selected movnt variant, -1 keeps the value chosen by libpmem.
+	 */
+	int movnt_threshold;
 };
 
 /*
@@ -161,7 +176,14 @@ struct pmem_bench
 	 * The actual operation performed based on benchmark specific
 	 * arguments.
 	 */
-	int (*func_op) (void *dest, void *source, size_t len);
+	int (*func_op) (struct pmem_bench *pmb, void *dest, void *source,
+		size_t len);
+
+	/*
+	 * pmem_memcpy_nodrain() or one of its non-temporal store variants,
+	 * depending on the "--movnt" argument.
+	 */
+	void *(*memcpy_nodrain) (void *pmemdest, const void *src, size_t len);
 };
 
 /*
@@ -221,6 +243,47 @@ parse_op_mode(const char *arg)
 		return OP_MODE_UNKNOWN;
 }
 
+/*
+ * movnt_variant -- implementation of pmem_memcpy_nodrain() which can be
+ * selected using the "--movnt" argument
+ */
+struct movnt_variant {
+	const char *name;
+	int (*is_supported) (void);
+	void *(*memcpy_nodrain) (void *pmemdest, const void *src, size_t len);
+};
+
+/*
+ * movnt_always -- the variant does not depend on any optional CPU feature
+ */
+static int
+movnt_always(void)
+{
+	return 1;
+}
+
+static struct movnt_variant movnt_variants[] = {
+	{"auto", movnt_always, pmem_memcpy_nodrain},
+	{"sse2", movnt_always, memmove_nodrain_movnt_sse2},
+	{"avx", is_cpu_avx_present, memmove_nodrain_movnt_avx},
+	{"avx512f", is_cpu_avx512f_present, memmove_nodrain_movnt_avx512f},
+};
+
+/*
+ * parse_movnt_variant -- parses command line "--movnt" argument
+ * and returns the matching variant or NULL if it is not known.
+ */
+static struct movnt_variant *
+parse_movnt_variant(const char *arg)
+{
+	for (size_t i = 0; i < ARRAY_SIZE(movnt_variants); i++) {
+		if (strcmp(arg, movnt_variants[i].name) == 0)
+			return &movnt_variants[i];
+	}
+
+	return NULL;
+}
+
 /* structure to define command line arguments */
 static struct benchmark_clo pmem_memcpy_clo[] = {
 	{
@@ -290,6 +353,32 @@ static struct benchmark_clo pmem_memcpy_clo[] = {
 		.type		= CLO_TYPE_FLAG,
 		.off		= clo_field_offset(struct pmem_args, persist),
 		.def		= "true"
+	},
+	{
+		.opt_short	= 0,
+		.opt_long	= "movnt",
+		.descr		= "Non-temporal store variant - auto, sse2, "
+				"avx, avx512f",
+		.type		= CLO_TYPE_STR,
+		.off		= clo_field_offset(struct pmem_args, movnt),
+		.def		= "auto",
+	},
+	{
+		.opt_short	= 0,
+		.opt_long	= "movnt-threshold",
+		.descr		= "Threshold for non-temporal stores "
+				"(-1 - chosen by libpmem)",
+		.type		= CLO_TYPE_INT,
+		.off		= clo_field_offset(struct pmem_args,
+					movnt_threshold),
+		.def		= "-1",
+		.type_int	= {
+			.size	= clo_field_size(struct pmem_args,
+					movnt_threshold),
+			.base	= CLO_INT_BASE_DEC,
+			.min	= -1,
+			.max	= INT_MAX,
+		},
 	}
 };
 
@@ -346,7 +435,7 @@ assign_mode_func(char *option)
  * followed by pmem_flush().
  */
 static int
-libc_memcpy(void *dest, void *source, size_t len)
+libc_memcpy(struct pmem_bench *pmb, void *dest, void *source, size_t len)
 {
 	memcpy(dest, source, len);
 
@@ -360,7 +449,8 @@ libc_memcpy(void *dest, void *source, size_t len)
  * followed by pmem_persist().
  */
 static int
-libc_memcpy_persist(void *dest, void *source, size_t len)
+libc_memcpy_persist(struct pmem_bench *pmb, void *dest, void *source,
+	size_t len)
 {
 	memcpy(dest, source, len);
 
@@ -374,20 +464,24 @@ libc_memcpy_persist(void *dest, void *source, size_t len)
  * function without pmem_persist().
  */
 static int
-libpmem_memcpy_nodrain(void *dest, void *source, size_t len)
+libpmem_memcpy_nodrain(struct pmem_bench *pmb, void *dest, void *source,
+	size_t len)
 {
-	pmem_memcpy_nodrain(dest, source, len);
+	pmb->memcpy_nodrain(dest, source, len);
 
 	return 0;
 }
 
 /*
- * libpmem_memcpy_persist -- copy using libpmem pmem_memcpy_persist() function.
+ * libpmem_memcpy_persist -- copy using libpmem pmem_memcpy_nodrain() function
+ * followed by pmem_drain(), which is what pmem_memcpy_persist() does.
  */
 static int
-libpmem_memcpy_persist(void *dest, void *source, size_t len)
+libpmem_memcpy_persist(struct pmem_bench *pmb, void *dest, void *source,
+	size_t len)
 {
-	pmem_memcpy_persist(dest, source, len);
+	pmb->memcpy_nodrain(dest, source, len);
+	pmem_drain();
 
 	return 0;
 }
@@ -530,6 +624,38 @@ pmem_memcpy_init(struct benchmark *bench, struct benchmark_args *args)
 		goto err_unmap;
 	}
 
+	struct movnt_variant *movnt = parse_movnt_variant(pmb->pargs->movnt);
+	if (movnt == NULL) {
+		fprintf(stderr, "wrong movnt parameter -- '%s'",
+						pmb->pargs->movnt);
+		ret = -1;
+		goto err_unmap;
+	}
+
+	if (!movnt->is_supported()) {
+		fprintf(stderr, "movnt variant '%s' not supported by the CPU",
+						movnt->name);
+		ret = -1;
+		goto err_unmap;
+	}
+
+	pmb->memcpy_nodrain = movnt->memcpy_nodrain;
+
+	if (pmb->pargs->movnt_threshold >= 0) {
+		/*
+		 * The threshold can be changed only in the private copy
+		 * of libpmem, which implements the explicit variants.
+		 */
+		if (movnt->memcpy_nodrain == pmem_memcpy_nodrain) {
+			fprintf(stderr, "movnt-threshold requires an explicit "
+					"movnt variant");
+			ret = -1;
+			goto err_unmap;
+		}
+
+		Movnt_threshold = (size_t)pmb->pargs->movnt_threshold;
+	}
+
 	if (pmb->pargs->memcpy) {
 		pmb->func_op = pmb->pargs->persist ?
 					libc_memcpy_persist : libc_memcpy;
@@ -579,7 +705,7 @@ pmem_memcpy_operation(struct benchmark *bench, struct operation_info *info)
 		+ pmb->pargs->dest_off;
 	size_t len = pmb->pargs->chunk_size;
 
-	pmb->func_op(dest, source, len);
+	pmb->func_op(pmb, dest, source, len);
 	return 0;
 }
 
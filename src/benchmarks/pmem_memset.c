@@ -43,13 +43,16 @@
 #include <sys/mman.h>
 
 #include "benchmark.h"
+#include "cpu.h"
+#include "pmem.h"
 
 #define MAX_OFFSET 63
 #define CONST_B 0xFF
 
 struct memset_bench;
 
-typedef int (*operation_fn) (void *dest, int c, size_t len);
+typedef int (*operation_fn) (struct memset_bench *mb, void *dest, int c,
+	size_t len);
 
 /*
  * memset_args -- benchmark specific command line options
@@ -63,6 +66,7 @@ struct memset_args
 	size_t chunk_size;	/* elementary chunk size */
 	size_t dest_off;	/* destination address offset */
 	unsigned seed;		/* seed for random numbers */
+	char *movnt;		/* non-temporal store variant */
 };
 
 /*
@@ -76,11 +80,54 @@ struct memset_bench {
 	size_t fsize;		/* file size */
 	void *pmem_addr;	/* mapped file address */
 	operation_fn func_op;	/* operation function */
+
+	/* pmem_memset_nodrain() or one of its non-temporal store variants */
+	void *(*memset_nodrain) (void *pmemdest, int c, size_t len);
 };
 
 struct memset_worker {
 };
 
+/*
+ * movnt_variant -- implementation of pmem_memset_nodrain() which can be
+ * selected using the "--movnt" argument
+ */
+struct movnt_variant {
+	const char *name;
+	int (*is_supported) (void);
+	void *(*memset_nodrain) (void *pmemdest, int c, size_t len);
+};
+
+/*
+ * movnt_always -- the variant does not depend on any optional CPU feature
+ */
+static int
+movnt_always(void)
+{
+	return 1;
+}
+
+static struct movnt_variant movnt_variants[] = {
+	{"auto", movnt_always, pmem_memset_nodrain},
+	{"sse2", movnt_always, memset_nodrain_movnt_sse2},
+	{"avx", is_cpu_avx_present, memset_nodrain_movnt_avx},
+	{"avx512f", is_cpu_avx512f_present, memset_nodrain_movnt_avx512f},
+};
+
+/*
+ * parse_movnt_variant -- parse non-temporal store variant from string
+ */
+static struct movnt_variant *
+parse_movnt_variant(const char *arg)
+{
+	for (size_t i = 0; i < ARRAY_SIZE(movnt_variants); i++) {
+		if (strcmp(arg, movnt_variants[i].name) == 0)
+			return &movnt_variants[i];
+	}
+
+	return NULL;
+}
+
 static struct benchmark_clo memset_clo[] = {
 	{
 		.opt_short	= 'M',
@@ -142,6 +189,15 @@ static struct benchmark_clo memset_clo[] = {
 			.max	= UINT_MAX,
 		},
 	},
+	{
+		.opt_short	= 0,
+		.opt_long	= "movnt",
+		.descr		= "Non-temporal store variant - auto, sse2, "
+				"avx, avx512f",
+		.def		= "auto",
+		.off		= clo_field_offset(struct memset_args, movnt),
+		.type		= CLO_TYPE_STR,
+	},
 };
 
 /*
@@ -228,12 +284,14 @@ do_warmup(struct memset_bench *mb, size_t nops)
 
 /*
  * libpmem_memset_persist -- perform operation using libpmem
- * pmem_memset_persist().
+ * pmem_memset_nodrain() followed by pmem_drain(), which is what
+ * pmem_memset_persist() does.
  */
 static int
-libpmem_memset_persist(void *dest, int c, size_t len)
+libpmem_memset_persist(struct memset_bench *mb, void *dest, int c, size_t len)
 {
-	pmem_memset_persist(dest, c, len);
+	mb->memset_nodrain(dest, c, len);
+	pmem_drain();
 
 	return 0;
 }
@@ -243,9 +301,9 @@ libpmem_memset_persist(void *dest, int c, size_t len)
  * pmem_memset_nodrain().
  */
 static int
-libpmem_memset_nodrain(void *dest, int c, size_t len)
+libpmem_memset_nodrain(struct memset_bench *mb, void *dest, int c, size_t len)
 {
-	pmem_memset_nodrain(dest, c, len);
+	mb->memset_nodrain(dest, c, len);
 
 	return 0;
 }
@@ -255,7 +313,7 @@ libpmem_memset_nodrain(void *dest, int c, size_t len)
  * followed by pmem_persist().
  */
 static int
-libc_memset_persist(void *dest, int c, size_t len)
+libc_memset_persist(struct memset_bench *mb, void *dest, int c, size_t len)
 {
 	memset(dest, c, len);
 
@@ -269,7 +327,7 @@ libc_memset_persist(void *dest, int c, size_t len)
  * followed by pmem_flush().
  */
 static int
-libc_memset(void *dest, int c, size_t len)
+libc_memset(struct memset_bench *mb, void *dest, int c, size_t len)
 {
 	memset(dest, c, len);
 
@@ -301,7 +359,7 @@ memset_op(struct benchmark *bench, struct operation_info *info)
 	int c = mb->const_b;
 	size_t len = mb->pargs->chunk_size;
 
-	mb->func_op(dest, c, len);
+	mb->func_op(mb, dest, c, len);
 
 	return 0;
 }
@@ -359,6 +417,23 @@ memset_init(struct benchmark *bench, struct benchmark_args *args)
 		goto err_free_offsets;
 	}
 
+	struct movnt_variant *movnt = parse_movnt_variant(mb->pargs->movnt);
+	if (movnt == NULL) {
+		fprintf(stderr, "Invalid movnt argument '%s'",
+			mb->pargs->movnt);
+		ret = -1;
+		goto err_unmap;
+	}
+
+	if (!movnt->is_supported()) {
+		fprintf(stderr, "movnt variant '%s' not supported by the CPU",
+			movnt->name);
+		ret = -1;
+		goto err_unmap;
+	}
+
+	mb->memset_nodrain = movnt->memset_nodrain;
+
 	if (mb->pargs->memset)
 		mb->func_op = (mb->pargs->persist) ?
 				libc_memset_persist : libc_memset;
@@ -374,6 +449,8 @@ memset_init(struct benchmark *bench, struct benchmark_args *args)
 
 	return 0;
 
+err_unmap:
+	pmem_unmap(mb->pmem_addr, mb->fsize);
 err_free_offsets:
 	free(mb->offsets);
 err_free_mb:
@@ -93,6 +93,8 @@ enum type_mode {
  * obj_size	: Size of each allocated object
  *
  * n_ops	: Number of operations
+ *
+ * pool_size	: Minimum size of each pool
  */
 struct pobj_args {
 	char *type_num;
@@ -103,6 +105,7 @@ struct pobj_args {
 	bool one_obj;
 	size_t obj_size;
 	size_t n_ops;
+	size_t pool_size;
 };
 
 /*
@@ -240,6 +243,22 @@ static struct benchmark_clo pobj_open_clo[] = {
 			.max	= UINT_MAX,
 		},
 	},
+	{
+		.opt_short	= 'p',
+		.opt_long	= "pool-size",
+		.type		= CLO_TYPE_UINT,
+		.descr		= "Minimum size of each pool",
+		.off		= clo_field_offset(struct pobj_args,
+						pool_size),
+		.def		= "0",
+		.type_uint	= {
+			.size	= clo_field_size(struct pobj_args,
+						pool_size),
+			.base	= CLO_INT_BASE_DEC|CLO_INT_BASE_HEX,
+			.min	= 0,
+			.max	= SIZE_MAX,
+		},
+	},
 };
 
 /*
@@ -406,6 +425,8 @@ pobj_init(struct benchmark *bench, struct benchmark_args *args)
 	size_t psize = n_objs * args->dsize * args->n_threads * FACTOR;
 	if (psize < PMEMOBJ_MIN_POOL)
 		psize = PMEMOBJ_MIN_POOL;
+	if (psize < bench_priv->args_priv->pool_size)
+		psize = bench_priv->args_priv->pool_size;
 
 	/* assign type_number determining function */
 	bench_priv->type_mode =
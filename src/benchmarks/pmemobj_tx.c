@@ -44,6 +44,7 @@
 
 #include "libpmemobj.h"
 #include "benchmark.h"
+#include "tx.h"
 
 #define LAYOUT_NAME "benchmark"
 #define FACTOR 4
@@ -93,6 +94,8 @@ struct obj_tx_args {
 	 *		  one transaction.
 	 *		- range - fields of one object are added to undo
 	 *		  log many times in one transaction.
+	 *		- overlap - overlapping fields of one object are added
+	 *		  to undo log many times in one transaction.
 	 *		- all-obj - all objects are added to undo log in
 	 *		  one transaction.
 	 *		- range-nested - fields of one object are added to undo
@@ -127,6 +130,7 @@ struct obj_tx_args {
 	unsigned min_rsize;	/* minimum reallocation size */
 	unsigned rsize;		/* reallocation size */
 	bool change_type;	/* change type number in reallocation */
+	bool print_stats;	/* print statistics of the undo buffers */
 	size_t obj_size;	/* size of each allocated object */
 	size_t n_ops;		/* number of operations */
 	int parse_mode;		/* type of parsing function */
@@ -230,6 +234,14 @@ static struct benchmark_clo obj_tx_clo[] = {
 			.max	= UINT_MAX,
 		},
 	},
+	{
+		.opt_short	= 's',
+		.opt_long	= "stats",
+		.descr		= "Print statistics of the undo log buffers",
+		.type		= CLO_TYPE_FLAG,
+		.off		= clo_field_offset(struct obj_tx_args,
+								print_stats),
+	},
 	/*
 	 * nclos field in benchmark_info structures is decremented to make this
 	 * options available only for obj_tx_alloc, obj_tx_free and
@@ -327,6 +339,7 @@ enum op_mode {
 	OP_MODE_ONE_OBJ_NESTED,
 	OP_MODE_ONE_OBJ_RANGE,
 	OP_MODE_ONE_OBJ_NESTED_RANGE,
+	OP_MODE_ONE_OBJ_OVERLAP_RANGE,
 	OP_MODE_ALL_OBJ,
 	OP_MODE_ALL_OBJ_NESTED,
 	OP_MODE_UNKNOWN
@@ -671,6 +684,8 @@ parse_op_mode_add_range(const char *arg)
 		return OP_MODE_ONE_OBJ_RANGE;
 	else if (strcmp(arg, "range-nested") == 0)
 		return OP_MODE_ONE_OBJ_NESTED_RANGE;
+	else if (strcmp(arg, "overlap") == 0)
+		return OP_MODE_ONE_OBJ_OVERLAP_RANGE;
 	else if (strcmp(arg, "all-obj") == 0)
 		return OP_MODE_ALL_OBJ;
 	else if (strcmp(arg, "all-obj-nested") == 0)
@@ -786,6 +801,20 @@ off_range(struct obj_tx_bench *obj_bench, unsigned idx)
 	return offset;
 }
 
+/*
+ * off_overlap -- returns offset for range in object which overlaps with
+ * the ranges of the neighbouring operations.
+ */
+static struct offset
+off_overlap(struct obj_tx_bench *obj_bench, unsigned idx)
+{
+	struct offset offset;
+	size_t step = obj_bench->sizes[0] / (obj_bench->obj_args->n_ops + 1);
+	offset.off = step * idx;
+	offset.size = 2 * step;
+	return offset;
+}
+
 /*
  * rand_values -- allocates array and if range mode calculates random
  * values as allocation sizes for each object otherwise populates whole array
@@ -955,7 +984,15 @@ obj_tx_add_range_init(struct benchmark *bench, struct benchmark_args *args)
 
 		obj_bench->sizes[0] = args->dsize;
 	}
+	if (obj_bench->op_mode == OP_MODE_ONE_OBJ_OVERLAP_RANGE) {
+		obj_bench->fn_off = off_overlap;
+		if (args->n_ops_per_thread + 1 > args->dsize)
+			args->dsize = args->n_ops_per_thread + 1;
+
+		obj_bench->sizes[0] = args->dsize;
+	}
 	obj_bench->lib_op = (obj_bench->op_mode == OP_MODE_ONE_OBJ ||
+			obj_bench->op_mode == OP_MODE_ONE_OBJ_OVERLAP_RANGE ||
 				obj_bench->op_mode == OP_MODE_ALL_OBJ) ?
 				ADD_RANGE_MODE_ONE_TX :
 				ADD_RANGE_MODE_NESTED_TX;
@@ -1141,6 +1178,23 @@ free_random_types:
 	return -1;
 }
 
+/*
+ * print_undo_stats -- prints statistics of the undo log buffers
+ */
+static void
+print_undo_stats(struct obj_tx_bench *obj_bench)
+{
+	struct tx_undo_stats s;
+	tx_get_undo_stats(obj_bench->pop, &s);
+
+	uint64_t nbufs = s.reused + s.allocated;
+	double reuse_rate = nbufs ? (double)s.reused * 100.0 / nbufs : 0.0;
+
+	printf("undo buffers reused: %lu allocated: %lu reuse-rate[%%]: %.2f "
+		"grows: %lu shrinks: %lu\n", s.reused, s.allocated,
+		reuse_rate, s.grows, s.shrinks);
+}
+
 /*
  * obj_tx_exit -- common part for the exit function of the transactional
  * benchmarks in their exit functions.
@@ -1149,8 +1203,12 @@ int
 obj_tx_exit(struct benchmark *bench, struct benchmark_args *args)
 {
 	struct obj_tx_bench *obj_bench = pmembench_get_priv(bench);
-	if (obj_bench->lib_mode != LIB_MODE_DRAM)
+	if (obj_bench->lib_mode != LIB_MODE_DRAM) {
+		if (obj_bench->obj_args->print_stats)
+			print_undo_stats(obj_bench);
+
 		pmemobj_close(obj_bench->pop);
+	}
 
 	free(obj_bench->sizes);
 	if (obj_bench->type_mode == NUM_MODE_RAND)
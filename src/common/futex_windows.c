@@ -0,0 +1,67 @@
+/*
+ * Copyright 2016, Intel Corporation
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in
+ *       the documentation and/or other materials provided with the
+ *       distribution.
+ *
+ *     * Neither the name of the copyright holder nor the names of its
+ *       contributors may be used to endorse or promote products derived
+ *       from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+/*
+ * futex_windows.c -- waiting on a memory word implemented with WaitOnAddress
+ */
+
+#include <limits.h>
+
+#include "futex.h"
+#include "out.h"
+
+/*
+ * util_futex_wait -- sleeps until woken up if the word at addr still equals
+ *	val, spurious wakeups are possible
+ */
+void
+util_futex_wait(uint32_t *addr, uint32_t val)
+{
+	if (!WaitOnAddress(addr, &val, sizeof(val), INFINITE))
+		FATAL("WaitOnAddress");
+}
+
+/*
+ * util_futex_wake -- wakes up to nwaiters threads waiting on the word at addr
+ */
+void
+util_futex_wake(uint32_t *addr, int nwaiters)
+{
+	if (nwaiters == INT_MAX) {
+		WakeByAddressAll(addr);
+		return;
+	}
+
+	while (nwaiters-- > 0)
+		WakeByAddressSingle(addr);
+}
@@ -0,0 +1,66 @@
+/*
+ * Copyright 2016, Intel Corporation
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in
+ *       the documentation and/or other materials provided with the
+ *       distribution.
+ *
+ *     * Neither the name of the copyright holder nor the names of its
+ *       contributors may be used to endorse or promote products derived
+ *       from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+/*
+ * numa.h -- internal definitions for the NUMA topology module
+ */
+
+#ifndef NVML_NUMA_H
+#define NVML_NUMA_H 1
+
+/*
+ * Limits of the tracked topology, processors and nodes beyond them are
+ * treated as if they belonged to the first node.
+ */
+#define NUMA_MAX_NODES 64
+#define NUMA_MAX_CPUS 4096
+
+void util_numa_init(void);
+unsigned util_numa_nnodes(void);
+unsigned util_numa_ncpus(unsigned node);
+unsigned util_numa_node(void);
+
+/*
+ * util_numa_ncpus_total -- returns the number of processors of all the nodes
+ */
+static inline unsigned
+util_numa_ncpus_total(void)
+{
+	unsigned ncpus = 0;
+	for (unsigned n = 0; n < util_numa_nnodes(); ++n)
+		ncpus += util_numa_ncpus(n);
+
+	return ncpus;
+}
+
+#endif
@@ -0,0 +1,220 @@
+/*
+ * Copyright 2016, Intel Corporation
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in
+ *       the documentation and/or other materials provided with the
+ *       distribution.
+ *
+ *     * Neither the name of the copyright holder nor the names of its
+ *       contributors may be used to endorse or promote products derived
+ *       from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+/*
+ * numa_linux.c -- NUMA topology of the machine read from sysfs
+ *
+ * Nodes are numbered densely from 0 in the order of their system ids, so
+ * that gaps in the system numbering don't waste any per-node resources.
+ */
+
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+
+#include <limits.h>
+#include <sched.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "numa.h"
+#include "out.h"
+#include "util.h"
+
+#define NUMA_SYSFS_DIR "/sys/devices/system/node"
+
+static unsigned Numa_nnodes = 1;
+static unsigned Numa_ncpus[NUMA_MAX_NODES] = {1};
+static uint8_t Numa_cpu_node[NUMA_MAX_CPUS];
+
+typedef void (*numa_list_cb)(unsigned id, void *arg);
+
+/*
+ * util_numa_parse_list -- (internal) calls cb for every id in the list read
+ *	from the file, the list is in the "0-3,8,10-11" format used by sysfs
+ */
+static int
+util_numa_parse_list(const char *path, numa_list_cb cb, void *arg)
+{
+	FILE *f = fopen(path, "r");
+	if (f == NULL) {
+		LOG(3, "!%s", path);
+		return -1;
+	}
+
+	int ret = 0;
+	unsigned first;
+	unsigned last;
+	while (fscanf(f, "%u", &first) == 1) {
+		last = first;
+
+		int c = fgetc(f);
+		if (c == '-') {
+			if (fscanf(f, "%u", &last) != 1 || last < first) {
+				ret = -1;
+				break;
+			}
+			c = fgetc(f);
+		}
+
+		for (unsigned id = first; id <= last; ++id)
+			cb(id, arg);
+
+		if (c != ',')
+			break;
+	}
+
+	fclose(f);
+
+	return ret;
+}
+
+struct numa_sysnodes {
+	unsigned nnodes;
+	unsigned ids[NUMA_MAX_NODES];
+};
+
+/*
+ * util_numa_add_node -- (internal) adds the system node to the list
+ */
+static void
+util_numa_add_node(unsigned id, void *arg)
+{
+	struct numa_sysnodes *sysnodes = arg;
+	if (sysnodes->nnodes == NUMA_MAX_NODES)
+		return;
+
+	sysnodes->ids[sysnodes->nnodes++] = id;
+}
+
+/*
+ * util_numa_add_cpu -- (internal) assigns the processor to the node
+ */
+static void
+util_numa_add_cpu(unsigned id, void *arg)
+{
+	unsigned node = *(unsigned *)arg;
+	if (id >= NUMA_MAX_CPUS)
+		return;
+
+	Numa_cpu_node[id] = (uint8_t)node;
+	Numa_ncpus[node]++;
+}
+
+/*
+ * util_numa_init -- reads the NUMA topology, if it's not available the whole
+ *	machine is treated as a single node
+ */
+void
+util_numa_init(void)
+{
+	LOG(3, NULL);
+
+	COMPILE_ERROR_ON(NUMA_MAX_NODES > UINT8_MAX + 1);
+
+	struct numa_sysnodes sysnodes;
+	sysnodes.nnodes = 0;
+
+	memset(Numa_ncpus, 0, sizeof(Numa_ncpus));
+	memset(Numa_cpu_node, 0, sizeof(Numa_cpu_node));
+
+	if (util_numa_parse_list(NUMA_SYSFS_DIR "/online",
+			util_numa_add_node, &sysnodes) != 0 ||
+			sysnodes.nnodes == 0)
+		goto single_node;
+
+	char path[PATH_MAX];
+	for (unsigned node = 0; node < sysnodes.nnodes; ++node) {
+		snprintf(path, sizeof(path), NUMA_SYSFS_DIR "/node%u/cpulist",
+			sysnodes.ids[node]);
+
+		if (util_numa_parse_list(path, util_numa_add_cpu, &node) != 0)
+			goto single_node;
+	}
+
+	unsigned ncpus = 0;
+	for (unsigned node = 0; node < sysnodes.nnodes; ++node)
+		ncpus += Numa_ncpus[node];
+
+	if (ncpus == 0)
+		goto single_node;
+
+	Numa_nnodes = sysnodes.nnodes;
+
+	LOG(4, "%u NUMA nodes", Numa_nnodes);
+
+	return;
+
+single_node:
+	memset(Numa_cpu_node, 0, sizeof(Numa_cpu_node));
+
+	long nprocs = sysconf(_SC_NPROCESSORS_CONF);
+
+	Numa_nnodes = 1;
+	Numa_ncpus[0] = nprocs > 0 ? (unsigned)nprocs : 1;
+}
+
+/*
+ * util_numa_nnodes -- returns the number of NUMA nodes
+ */
+unsigned
+util_numa_nnodes(void)
+{
+	return Numa_nnodes;
+}
+
+/*
+ * util_numa_ncpus -- returns the number of processors of the node
+ */
+unsigned
+util_numa_ncpus(unsigned node)
+{
+	ASSERT(node < Numa_nnodes);
+
+	return Numa_ncpus[node];
+}
+
+/*
+ * util_numa_node -- returns the node the calling thread currently runs on
+ */
+unsigned
+util_numa_node(void)
+{
+	int cpu = sched_getcpu();
+	if (cpu < 0 || cpu >= NUMA_MAX_CPUS)
+		return 0;
+
+	return Numa_cpu_node[cpu];
+}
@@ -0,0 +1,141 @@
+/*
+ * Copyright 2016, Intel Corporation
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in
+ *       the documentation and/or other materials provided with the
+ *       distribution.
+ *
+ *     * Neither the name of the copyright holder nor the names of its
+ *       contributors may be used to endorse or promote products derived
+ *       from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+/*
+ * numa_windows.c -- NUMA topology of the machine
+ *
+ * Nodes are numbered densely from 0 in the order of their system numbers.
+ */
+
+#include <stdint.h>
+#include <string.h>
+
+#include "numa.h"
+#include "out.h"
+#include "util.h"
+
+static unsigned Numa_nnodes = 1;
+static unsigned Numa_ncpus[NUMA_MAX_NODES] = {1};
+static uint8_t Numa_sysnode_node[NUMA_MAX_NODES];
+
+/*
+ * util_numa_init -- reads the NUMA topology, if it's not available the whole
+ *	machine is treated as a single node
+ */
+void
+util_numa_init(void)
+{
+	LOG(3, NULL);
+
+	COMPILE_ERROR_ON(NUMA_MAX_NODES > UINT8_MAX + 1);
+
+	memset(Numa_ncpus, 0, sizeof(Numa_ncpus));
+	memset(Numa_sysnode_node, 0, sizeof(Numa_sysnode_node));
+
+	ULONG highest;
+	if (!GetNumaHighestNodeNumber(&highest))
+		goto single_node;
+
+	unsigned nnodes = 0;
+	for (USHORT sysnode = 0; sysnode <= highest &&
+			sysnode < NUMA_MAX_NODES; ++sysnode) {
+		GROUP_AFFINITY affinity;
+		if (!GetNumaNodeProcessorMaskEx(sysnode, &affinity))
+			continue;
+
+		Numa_sysnode_node[sysnode] = (uint8_t)nnodes;
+		for (KAFFINITY m = affinity.Mask; m != 0; m &= m - 1)
+			Numa_ncpus[nnodes]++;
+
+		nnodes++;
+	}
+
+	unsigned ncpus = 0;
+	for (unsigned node = 0; node < nnodes; ++node)
+		ncpus += Numa_ncpus[node];
+
+	if (ncpus == 0)
+		goto single_node;
+
+	Numa_nnodes = nnodes;
+
+	LOG(4, "%u NUMA nodes", Numa_nnodes);
+
+	return;
+
+single_node:
+	memset(Numa_sysnode_node, 0, sizeof(Numa_sysnode_node));
+
+	SYSTEM_INFO si;
+	GetSystemInfo(&si);
+
+	Numa_nnodes = 1;
+	Numa_ncpus[0] = si.dwNumberOfProcessors;
+}
+
+/*
+ * util_numa_nnodes -- returns the number of NUMA nodes
+ */
+unsigned
+util_numa_nnodes(void)
+{
+	return Numa_nnodes;
+}
+
+/*
+ * util_numa_ncpus -- returns the number of processors of the node
+ */
+unsigned
+util_numa_ncpus(unsigned node)
+{
+	ASSERT(node < Numa_nnodes);
+
+	return Numa_ncpus[node];
+}
+
+/*
+ * util_numa_node -- returns the node the calling thread currently runs on
+ */
+unsigned
+util_numa_node(void)
+{
+	PROCESSOR_NUMBER pn;
+	USHORT sysnode;
+
+	GetCurrentProcessorNumberEx(&pn);
+	if (!GetNumaProcessorNodeEx(&pn, &sysnode) ||
+			sysnode >= NUMA_MAX_NODES)
+		return 0;
+
+	return Numa_sysnode_node[sysnode];
+}
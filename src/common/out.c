@@ -61,8 +61,6 @@ static int Log_level;
 static FILE *Out_fp;
 static unsigned Log_alignment;
 
-#ifndef NO_LIBPTHREAD
-
 #define MAXPRINT 8192	/* maximum expected log line */
 
 static pthread_once_t Last_errormsg_key_once = PTHREAD_ONCE_INIT;
@@ -113,38 +111,6 @@ Last_errormsg_get()
 	}
 	return errormsg;
 }
-#else
-
-/*
- * We don't want libpmem to depend on libpthread.  Instead of using pthread
- * API to dynamically allocate thread-specific error message buffer, we put
- * it into TLS.  However, keeping a pretty large static buffer (8K) in TLS
- * may lead to some issues, so the maximum message length is reduced.
- * Fortunately, it looks like the longest error message in libpmem should
- * not be longer than about 90 chars (in case of pmem_check_version()).
- */
-
-#define MAXPRINT 256	/* maximum expected log line for libpmem */
-
-static __thread char Last_errormsg[MAXPRINT];
-
-static inline void
-Last_errormsg_key_alloc()
-{
-}
-
-static inline void
-Last_errormsg_fini()
-{
-}
-
-static inline const char *
-Last_errormsg_get()
-{
-	return Last_errormsg;
-}
-
-#endif /* NO_LIBPTHREAD */
 
 #ifdef DEBUG
 /*
@@ -1558,6 +1558,56 @@ util_header_create(struct pool_set *set, unsigned repidx, unsigned partidx,
 	return 0;
 }
 
+/*
+ * util_poolset_incompat_enable -- sets incompat feature bits in the headers
+ *	of all the parts of an open pool set
+ *
+ * The part files are reopened only for the time of the update, because the
+ * descriptors are closed once the pool set is mapped.
+ */
+int
+util_poolset_incompat_enable(struct pool_set *set, uint32_t incompat)
+{
+	LOG(3, "set %p incompat %#x", set, incompat);
+
+	if (set->remote) {
+		ERR("cannot change features of a pool set with remote "
+			"replicas");
+		errno = ENOTSUP;
+		return -1;
+	}
+
+	for (unsigned r = 0; r < set->nreplicas; r++) {
+		struct pool_replica *rep = set->replica[r];
+		for (unsigned p = 0; p < rep->nparts; p++) {
+			struct pool_set_part *part = &rep->part[p];
+
+			/* the pool is still locked through the mapping */
+			part->fd = open(part->path, O_RDWR);
+			if (part->fd < 0) {
+				ERR("!open %s", part->path);
+				return -1;
+			}
+
+			if (util_map_hdr(part, MAP_SHARED, 0) != 0) {
+				util_part_fdclose(part);
+				return -1;
+			}
+
+			struct pool_hdr *hdrp = part->hdr;
+			hdrp->incompat_features = htole32(
+				le32toh(hdrp->incompat_features) | incompat);
+			util_checksum(hdrp, sizeof(*hdrp), &hdrp->checksum, 1);
+			PERSIST_GENERIC_AUTO(hdrp, sizeof(*hdrp));
+
+			util_unmap_hdr(part);
+			util_part_fdclose(part);
+		}
+	}
+
+	return 0;
+}
+
 /*
  * util_header_check -- (internal) validate header of a single pool set file
  */
@@ -154,6 +154,35 @@ __sync_bool_compare_and_swap64(volatile LONG64 *ptr,
 	__sync_bool_compare_and_swap64((LONG64 *)(p), (LONG64)(o), (LONG64)(n))
 #endif
 
+/*
+ * util_load_barrier -- keeps the loads before it from being reordered with
+ * the loads after it, on x86 it only stops the compiler
+ */
+#ifndef _MSC_VER
+#define util_load_barrier() __atomic_thread_fence(__ATOMIC_ACQUIRE)
+#else
+#define util_load_barrier() _ReadBarrier()
+#endif
+
+/*
+ * util_release_barrier -- keeps the loads and stores before it from being
+ * reordered with the stores after it, on x86 it only stops the compiler
+ */
+#ifndef _MSC_VER
+#define util_release_barrier() __atomic_thread_fence(__ATOMIC_RELEASE)
+#else
+#define util_release_barrier() _ReadWriteBarrier()
+#endif
+
+/*
+ * util_cpu_relax -- hints the processor that it's in a spin-wait loop
+ */
+#ifndef _MSC_VER
+#define util_cpu_relax() __builtin_ia32_pause()
+#else
+#define util_cpu_relax() YieldProcessor()
+#endif
+
 /*
  * util_get_printable_ascii -- convert non-printable ascii to dot '.'
  */
@@ -53,6 +53,10 @@ extern "C" {
 
 #include <sys/types.h>
 
+#ifndef _WIN32
+#include <sys/uio.h>
+#endif
+
 /*
  * flags supported by pmem_map_file()
  */
@@ -68,6 +72,8 @@ int pmem_is_pmem(const void *addr, size_t len);
 void pmem_persist(const void *addr, size_t len);
 int pmem_msync(const void *addr, size_t len);
 void pmem_flush(const void *addr, size_t len);
+void pmem_persistv(const struct iovec *iov, int iovcnt);
+void pmem_flushv(const struct iovec *iov, int iovcnt);
 void pmem_drain(void);
 int pmem_has_hw_drain(void);
 void *pmem_memmove_persist(void *pmemdest, const void *src, size_t len);
@@ -77,6 +83,23 @@ void *pmem_memmove_nodrain(void *pmemdest, const void *src, size_t len);
 void *pmem_memcpy_nodrain(void *pmemdest, const void *src, size_t len);
 void *pmem_memset_nodrain(void *pmemdest, int c, size_t len);
 
+/*
+ * opaque type of an asynchronous copy, internal to libpmem
+ */
+typedef struct pmem_async PMEMasync;
+
+/*
+ * flags supported by pmem_memcpy_async()
+ */
+#define PMEM_ASYNC_NOPMEM	(1U << 0)	/* use msync for persistence */
+
+#define PMEM_ASYNC_ALL_FLAGS	PMEM_ASYNC_NOPMEM
+
+PMEMasync *pmem_memcpy_async(void *pmemdest, const void *src, size_t len,
+	unsigned flags);
+int pmem_async_poll(PMEMasync *async);
+int pmem_async_wait(PMEMasync *async);
+
 /*
  * PMEM_MAJOR_VERSION and PMEM_MINOR_VERSION provide the current version of the
  * libpmem API as provided by this header file.  Applications can verify that
@@ -54,11 +54,6 @@ extern "C" {
 
 #ifndef _WIN32
 #include <sys/uio.h>
-#else
-struct iovec {
-	void  *iov_base;
-	size_t iov_len;
-};
 #endif
 
 /*
@@ -47,7 +47,8 @@ extern "C" {
  * Non-transactional atomic allocations
  *
  * Those functions can be used outside transactions. The allocations are always
- * aligned to the cache-line boundary.
+ * aligned to the cache-line boundary, unless they come from a user-defined
+ * allocation class with a different alignment.
  */
 
 /*
@@ -59,6 +60,16 @@ extern "C" {
 int pmemobj_alloc(PMEMobjpool *pop, PMEMoid *oidp, size_t size,
 	uint64_t type_num, pmemobj_constr constructor, void *arg);
 
+/*
+ * Allocates a new object from the pool and calls a constructor function before
+ * returning. 'Flags' is a bitmask of the following values:
+ *  - POBJ_XALLOC_ZERO - zero the allocated object
+ *  - POBJ_CLASS_ID(id) - allocate from the given allocation class
+ */
+int pmemobj_xalloc(PMEMobjpool *pop, PMEMoid *oidp, size_t size,
+	uint64_t type_num, uint64_t flags,
+	pmemobj_constr constructor, void *arg);
+
 /*
  * Allocates a new zeroed object from the pool.
  */
@@ -88,6 +99,68 @@ int pmemobj_strdup(PMEMobjpool *pop, PMEMoid *oidp, const char *s,
  */
 void pmemobj_free(PMEMoid *oidp);
 
+/*
+ * Allocates nobjs new objects, each of the corresponding size from the sizes
+ * array, and stores their handles in the oids array. The allocator is acquired
+ * only once for the whole batch and the metadata modifications of multiple
+ * objects are committed together. 'Flags' are the same as in pmemobj_xalloc.
+ * On failure none of the objects is allocated.
+ * This is EXPERIMENTAL API.
+ */
+int pmemobj_alloc_batch(PMEMobjpool *pop, PMEMoid *oids, const size_t *sizes,
+	size_t nobjs, uint64_t type_num, uint64_t flags,
+	pmemobj_constr constructor, void *arg);
+
+/*
+ * Frees noids existing objects, skipping the null ones.
+ * This is EXPERIMENTAL API.
+ */
+void pmemobj_free_batch(PMEMoid *oids, size_t noids);
+
+/*
+ * Type of the header of objects allocated from an allocation class.
+ */
+enum pobj_header_type {
+	/* 64-byte header with the size and type of each object */
+	POBJ_HEADER_LEGACY,
+
+	/*
+	 * No header at all, all of the objects are exactly one unit and
+	 * have the type number of the class.
+	 */
+	POBJ_HEADER_NONE,
+};
+
+/*
+ * Description of a user-defined allocation class.
+ */
+struct pobj_alloc_class_desc {
+	/* size of a single unit, including the object header if any */
+	size_t unit_size;
+
+	/* alignment of objects, 0 for no requirement */
+	size_t alignment;
+
+	/* size of a run in chunks, 0 for the default */
+	unsigned run_chunks;
+
+	/* type of the object header */
+	enum pobj_header_type header_type;
+
+	/* type number of all objects of a POBJ_HEADER_NONE class */
+	uint64_t type_num;
+
+	/* id of the class, set by pmemobj_alloc_class_new() */
+	unsigned class_id;
+};
+
+/*
+ * Registers a new allocation class in the pool, the class is valid until the
+ * pool is closed.
+ */
+int pmemobj_alloc_class_new(PMEMobjpool *pop,
+	struct pobj_alloc_class_desc *desc);
+
 #ifdef __cplusplus
 }
 #endif
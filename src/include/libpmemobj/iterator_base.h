@@ -61,6 +61,52 @@ PMEMoid pmemobj_first(PMEMobjpool *pop);
  */
 PMEMoid pmemobj_next(PMEMoid oid);
 
+/*
+ * Type number which makes a cursor return the objects of all types.
+ */
+#define POBJ_CURSOR_ANY_TYPE UINT64_MAX
+
+struct pobj_cursor;
+
+/*
+ * Creates a cursor which iterates once through the objects of the specified
+ * type number, found in the part 'part' of the pool split into 'nparts'
+ * disjoint parts. Cursors of all of the parts visit every object exactly once,
+ * so they can be used by separate threads to scan the pool in parallel.
+ *
+ * If successful, returns the cursor. Otherwise, NULL is returned and errno
+ * is set appropriately.
+ *
+ * This is EXPERIMENTAL API.
+ */
+struct pobj_cursor *pmemobj_cursor_new(PMEMobjpool *pop, uint64_t type_num,
+	unsigned part, unsigned nparts);
+
+/*
+ * Returns the next object of the cursor, OID_NULL if there are no more.
+ * This is EXPERIMENTAL API.
+ */
+PMEMoid pmemobj_cursor_next(struct pobj_cursor *cursor);
+
+/*
+ * Deletes the cursor.
+ * This is EXPERIMENTAL API.
+ */
+void pmemobj_cursor_delete(struct pobj_cursor *cursor);
+
+/*
+ * Enables the volatile index of objects by their type numbers, which lets
+ * the cursors of a single type number visit only the objects of that type.
+ * The index is built on the first use and then updated by every allocation
+ * and free until the pool is closed. It must not be enabled concurrently
+ * with allocations or frees.
+ *
+ * If successful, returns zero. Otherwise, -1 is returned and errno is set
+ * appropriately.
+ *
+ * This is EXPERIMENTAL API.
+ */
+int pmemobj_type_index_enable(PMEMobjpool *pop);
 
 #ifdef __cplusplus
 }
@@ -64,6 +64,23 @@ typedef union {
 	char padding[_POBJ_CL_SIZE];
 } PMEMcond;
 
+/*
+ * Mutex which spins for a while before it sleeps. This is EXPERIMENTAL API.
+ */
+typedef union {
+	long long align;
+	char padding[_POBJ_CL_SIZE];
+} PMEMspinmutex;
+
+/*
+ * Reader-biased rwlock, the readers don't modify the lock while there are no
+ * writers. This is EXPERIMENTAL API.
+ */
+typedef union {
+	long long align;
+	char padding[_POBJ_CL_SIZE];
+} PMEMbiasrwlock;
+
 void pmemobj_mutex_zero(PMEMobjpool *pop, PMEMmutex *mutexp);
 int pmemobj_mutex_lock(PMEMobjpool *pop, PMEMmutex *mutexp);
 int pmemobj_mutex_timedlock(PMEMobjpool *pop, PMEMmutex *__restrict mutexp,
@@ -84,6 +101,22 @@ int pmemobj_rwlock_tryrdlock(PMEMobjpool *pop, PMEMrwlock *rwlockp);
 int pmemobj_rwlock_trywrlock(PMEMobjpool *pop, PMEMrwlock *rwlockp);
 int pmemobj_rwlock_unlock(PMEMobjpool *pop, PMEMrwlock *rwlockp);
 
+/*
+ * The adaptive mutex and the reader-biased rwlock.
+ * This is EXPERIMENTAL API.
+ */
+void pmemobj_spinmutex_zero(PMEMobjpool *pop, PMEMspinmutex *mutexp);
+int pmemobj_spinmutex_lock(PMEMobjpool *pop, PMEMspinmutex *mutexp);
+int pmemobj_spinmutex_trylock(PMEMobjpool *pop, PMEMspinmutex *mutexp);
+int pmemobj_spinmutex_unlock(PMEMobjpool *pop, PMEMspinmutex *mutexp);
+
+void pmemobj_biasrwlock_zero(PMEMobjpool *pop, PMEMbiasrwlock *rwlockp);
+int pmemobj_biasrwlock_rdlock(PMEMobjpool *pop, PMEMbiasrwlock *rwlockp);
+int pmemobj_biasrwlock_wrlock(PMEMobjpool *pop, PMEMbiasrwlock *rwlockp);
+int pmemobj_biasrwlock_tryrdlock(PMEMobjpool *pop, PMEMbiasrwlock *rwlockp);
+int pmemobj_biasrwlock_trywrlock(PMEMobjpool *pop, PMEMbiasrwlock *rwlockp);
+int pmemobj_biasrwlock_unlock(PMEMobjpool *pop, PMEMbiasrwlock *rwlockp);
+
 void pmemobj_cond_zero(PMEMobjpool *pop, PMEMcond *condp);
 int pmemobj_cond_broadcast(PMEMobjpool *pop, PMEMcond *condp);
 int pmemobj_cond_signal(PMEMobjpool *pop, PMEMcond *condp);
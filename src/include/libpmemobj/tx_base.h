@@ -108,7 +108,13 @@ typedef void (*pmemobj_tx_callback)(PMEMobjpool *pop, enum pobj_tx_stage stage,
 
 #define POBJ_XALLOC_ZERO	POBJ_FLAG_ZERO
 #define POBJ_XALLOC_NO_FLUSH	POBJ_FLAG_NO_FLUSH
-#define POBJ_XALLOC_VALID_FLAGS	(POBJ_XALLOC_ZERO | POBJ_XALLOC_NO_FLUSH)
+
+/* allocation class id, see pmemobj_alloc_class_new() */
+#define POBJ_CLASS_ID(id)	(((uint64_t)(id)) << 48)
+#define POBJ_XALLOC_CLASS_MASK	((((uint64_t)1 << 16) - 1) << 48)
+
+#define POBJ_XALLOC_VALID_FLAGS	(POBJ_XALLOC_ZERO | POBJ_XALLOC_NO_FLUSH |\
+	POBJ_XALLOC_CLASS_MASK)
 
 #define POBJ_XADD_NO_FLUSH	POBJ_FLAG_NO_FLUSH
 #define POBJ_XADD_VALID_FLAGS	POBJ_XADD_NO_FLUSH
@@ -218,6 +224,51 @@ int pmemobj_tx_xadd_range(PMEMoid oid, uint64_t off, size_t size,
  */
 int pmemobj_tx_xadd_range_direct(const void *ptr, size_t size, uint64_t flags);
 
+/*
+ * Copies 'size' bytes from 'src' into the redo log of the transaction, to be
+ * written at offset 'off' of the object 'oid' when the transaction commits.
+ * Unlike pmemobj_tx_add_range, no snapshot of the old data is made and the
+ * object is not modified until the commit, which makes the write cheaper.
+ * Writes to the same range are applied in order, so the last one wins.
+ *
+ * If successful, returns zero.
+ * Otherwise, state changes to TX_STAGE_ONABORT and an error number is returned.
+ *
+ * This function must be called during TX_STAGE_WORK.
+ * This is EXPERIMENTAL API.
+ */
+int pmemobj_tx_write(PMEMoid oid, uint64_t off, const void *src, size_t size);
+
+/*
+ * Behaves exactly the same as pmemobj_tx_write, but the destination is given
+ * as a pointer to the persistent memory of the pool.
+ * This is EXPERIMENTAL API.
+ */
+int pmemobj_tx_write_direct(void *dest, const void *src, size_t size);
+
+/*
+ * Single 8-byte write of a transaction published with pmemobj_tx_publish.
+ */
+struct pobj_tx_word {
+	uint64_t *ptr;		/* destination in the heap of the pool */
+	uint64_t value;		/* value to be written */
+};
+
+/*
+ * Atomically writes the values of all 'nwords' words, as a transaction of
+ * its own. Transactions published concurrently by different threads are
+ * committed together by one of the publishing threads, with a single redo
+ * log and drain, and each of them succeeds or fails on its own.
+ *
+ * If successful, returns zero. Otherwise, none of the words is written and
+ * an error number is returned.
+ *
+ * This function must be called outside of a transaction.
+ * This is EXPERIMENTAL API.
+ */
+int pmemobj_tx_publish(PMEMobjpool *pop, const struct pobj_tx_word *words,
+	size_t nwords);
+
 /*
  * Transactionally allocates a new object.
  *
@@ -236,6 +287,7 @@ PMEMoid pmemobj_tx_alloc(size_t size, uint64_t type_num);
  * 'Flags' is a bitmask of the following values:
  *  - POBJ_XALLOC_ZERO - zero the allocated object
  *  - POBJ_XALLOC_NO_FLUSH - skip flush on commit
+ *  - POBJ_CLASS_ID(id) - allocate from the given allocation class
  *
  * This function must be called during TX_STAGE_WORK.
  * This is EXPERIMENTAL API.
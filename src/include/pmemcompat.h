@@ -39,6 +39,15 @@
 #include <windows.h>
 
 typedef int mode_t;
+
+/* the same definition as in src/windows/include/sys/uio.h */
+#ifndef SYS_UIO_H
+#define SYS_UIO_H 1
+struct iovec {
+	void  *iov_base;
+	size_t iov_len;
+};
+#endif
 /*
  * XXX: this code will not work on windows if our library is included in
  * an extern block.
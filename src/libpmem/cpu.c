@@ -69,6 +69,20 @@ cpuid(unsigned func, unsigned subfunc, unsigned cpuinfo[4])
 			cpuinfo[ECX_IDX], cpuinfo[EDX_IDX]);
 }
 
+/*
+ * xgetbv -- (internal) read extended control register
+ *
+ * Only valid once OSXSAVE support was confirmed through cpuid.
+ */
+static inline unsigned long long
+xgetbv(unsigned xcr)
+{
+	unsigned eax, edx;
+	__asm__ volatile("xgetbv" : "=a" (eax), "=d" (edx) : "c" (xcr));
+
+	return ((unsigned long long)edx << 32) | eax;
+}
+
 #elif defined(_M_X64) || defined(_M_AMD64)
 
 #include <intrin.h>
@@ -79,11 +93,19 @@ cpuid(unsigned func, unsigned subfunc, unsigned cpuinfo[4])
 	__cpuidex(cpuinfo, func, subfunc);
 }
 
+static inline unsigned long long
+xgetbv(unsigned xcr)
+{
+	return _xgetbv(xcr);
+}
+
 #else /* not x86_64 */
 
 #define cpuid(func, subfunc, cpuinfo)\
 	do { (void)(func); (void)(subfunc); (void)(cpuinfo); } while (0)
 
+#define xgetbv(xcr) ((void)(xcr), 0ULL)
+
 #endif
 
 #ifndef bit_SSE2
@@ -102,6 +124,27 @@ cpuid(unsigned func, unsigned subfunc, unsigned cpuinfo[4])
 #define bit_CLWB	(1 << 24)
 #endif
 
+#ifndef bit_OSXSAVE
+#define bit_OSXSAVE	(1 << 27)
+#endif
+
+#ifndef bit_AVX
+#define bit_AVX		(1 << 28)
+#endif
+
+#ifndef bit_AVX512F
+#define bit_AVX512F	(1 << 16)
+#endif
+
+/* XCR0 state components that must be enabled by the OS */
+#define XSTATE_SSE	(1 << 1)
+#define XSTATE_YMM	(1 << 2)
+#define XSTATE_OPMASK	(1 << 5)
+#define XSTATE_ZMM	(3 << 6)
+
+#define XSTATE_AVX	(XSTATE_SSE | XSTATE_YMM)
+#define XSTATE_AVX512	(XSTATE_AVX | XSTATE_OPMASK | XSTATE_ZMM)
+
 /*
  * is_cpu_feature_present -- (internal) checks if CPU feature is supported
  */
@@ -119,6 +162,19 @@ is_cpu_feature_present(unsigned func, unsigned reg, unsigned bit)
 	return (cpuinfo[reg] & bit) != 0;
 }
 
+/*
+ * is_xstate_enabled -- (internal) check if the OS saves the given state
+ * components on context switch
+ */
+static int
+is_xstate_enabled(unsigned long long mask)
+{
+	if (!is_cpu_feature_present(0x1, ECX_IDX, bit_OSXSAVE))
+		return 0;
+
+	return (xgetbv(0) & mask) == mask;
+}
+
 /*
  * is_cpu_genuine_intel -- checks for genuine Intel CPU
  */
@@ -186,3 +242,23 @@ is_cpu_clwb_present(void)
 
 	return ret;
 }
+
+int
+is_cpu_avx_present(void)
+{
+	int ret = is_cpu_feature_present(0x1, ECX_IDX, bit_AVX) &&
+		is_xstate_enabled(XSTATE_AVX);
+	LOG(4, "AVX %ssupported", ret == 0 ? "not " : "");
+
+	return ret;
+}
+
+int
+is_cpu_avx512f_present(void)
+{
+	int ret = is_cpu_feature_present(0x7, EBX_IDX, bit_AVX512F) &&
+		is_xstate_enabled(XSTATE_AVX512);
+	LOG(4, "AVX512F %ssupported", ret == 0 ? "not " : "");
+
+	return ret;
+}
@@ -41,5 +41,7 @@ int is_cpu_genuine_intel(void);
 int is_cpu_clflush_present(void);
 int is_cpu_clflushopt_present(void);
 int is_cpu_clwb_present(void);
+int is_cpu_avx_present(void);
+int is_cpu_avx512f_present(void);
 
 #endif
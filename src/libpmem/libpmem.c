@@ -55,6 +55,7 @@ libpmem_init(void)
 			PMEM_MAJOR_VERSION, PMEM_MINOR_VERSION);
 	LOG(3, NULL);
 	pmem_init();
+	pmem_async_init();
 }
 
 /*
@@ -68,6 +69,7 @@ libpmem_fini(void)
 {
 	LOG(3, NULL);
 
+	pmem_async_fini();
 	common_fini();
 }
 
@@ -103,6 +103,12 @@
  *
  *	SFENCE unless using CLFLUSH
  *
+ * pmem_flushv(iov, iovcnt) and pmem_persistv(iov, iovcnt)
+ *
+ *	Same as pmem_flush() and pmem_persist(), but for a vector of ranges.
+ *	The ranges are rounded to cache lines, sorted and merged first, so
+ *	every cache line is flushed once and the fence is issued once.
+ *
  *
  * INTERFACES FOR COPYING/SETTING RANGES OF MEMORY
  *
@@ -151,11 +157,21 @@
  *
  *	Func_memmove_nodrain is used by memmove_nodrain() to call one of:
  *		memmove_nodrain_normal()
- *		memmove_nodrain_movnt()
+ *		memmove_nodrain_movnt_sse2()
+ *		memmove_nodrain_movnt_avx()
+ *		memmove_nodrain_movnt_avx512f()
  *
  *	Func_memset_nodrain is used by memset_nodrain() to call one of:
  *		memset_nodrain_normal()
- *		memset_nodrain_movnt()
+ *		memset_nodrain_movnt_sse2()
+ *		memset_nodrain_movnt_avx()
+ *		memset_nodrain_movnt_avx512f()
+ *
+ * The movnt variants differ only in the width of the non-temporal stores
+ * used for the cache line aligned part of the range (16, 32 or 64 bytes).
+ * The AVX and AVX-512 kernels live in separate files, because they have
+ * to be compiled with the matching instruction set enabled, and they are
+ * only used when both the CPU and the OS support the wider registers.
  *
  * DEBUG LOGGING
  *
@@ -171,6 +187,11 @@
 #include <stdint.h>
 #include <string.h>
 #include <emmintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#else
+#include <x86intrin.h>
+#endif
 #include <errno.h>
 #include <fcntl.h>
 #include <unistd.h>
@@ -201,6 +222,9 @@
 
 #define FLUSH_ALIGN ((uintptr_t)64)
 
+/* max number of ranges pmem_flushv() sorts without allocating memory */
+#define FLUSHV_STACK_MAX	64
+
 #define ALIGN_MASK	(FLUSH_ALIGN - 1)
 
 #define CHUNK_SIZE	128 /* 16*8 */
@@ -217,7 +241,14 @@
 
 #define MOVNT_THRESHOLD	256
 
-static size_t Movnt_threshold = MOVNT_THRESHOLD;
+/* range of thresholds considered by the optional calibration */
+#define MOVNT_THRESHOLD_MIN	64
+#define MOVNT_THRESHOLD_MAX	4096
+
+#define CALIBRATE_BUF_SIZE	(128 * 1024)
+#define CALIBRATE_ROUNDS	3
+
+size_t Movnt_threshold = MOVNT_THRESHOLD;
 
 /*
  * pmem_has_hw_drain -- return whether or not HW drain was found
@@ -366,6 +397,130 @@ pmem_flush(const void *addr, size_t len)
 	Func_flush(addr, len);
 }
 
+/*
+ * flush_range -- cache line aligned range, used by pmem_flushv()
+ */
+struct flush_range {
+	uintptr_t start;
+	uintptr_t end;
+};
+
+/*
+ * flush_range_cmp -- (internal) compare two ranges by their beginning
+ */
+static int
+flush_range_cmp(const void *lhs, const void *rhs)
+{
+	const struct flush_range *l = lhs;
+	const struct flush_range *r = rhs;
+
+	if (l->start < r->start)
+		return -1;
+
+	return l->start > r->start;
+}
+
+/*
+ * flush_ranges -- (internal) sort, merge and flush the cache line
+ * aligned ranges of the given vector
+ */
+static void
+flush_ranges(struct flush_range *ranges, const struct iovec *iov, int iovcnt)
+{
+	int n = 0;
+	for (int i = 0; i < iovcnt; i++) {
+		if (iov[i].iov_len == 0)
+			continue;
+
+		VALGRIND_DO_CHECK_MEM_IS_ADDRESSABLE(iov[i].iov_base,
+				iov[i].iov_len);
+
+		uintptr_t start = (uintptr_t)iov[i].iov_base;
+		ranges[n].start = start & ~ALIGN_MASK;
+		ranges[n].end = (start + iov[i].iov_len + ALIGN_MASK) &
+				~ALIGN_MASK;
+		n++;
+	}
+
+	if (n == 0)
+		return;
+
+	/* insertion sort is cheaper than qsort() for short vectors */
+	if (n <= FLUSHV_STACK_MAX) {
+		for (int i = 1; i < n; i++) {
+			struct flush_range r = ranges[i];
+			int j = i;
+			for (; j > 0 && ranges[j - 1].start > r.start; j--)
+				ranges[j] = ranges[j - 1];
+			ranges[j] = r;
+		}
+	} else {
+		qsort(ranges, (size_t)n, sizeof(*ranges), flush_range_cmp);
+	}
+
+	struct flush_range cur = ranges[0];
+	for (int i = 1; i < n; i++) {
+		if (ranges[i].start <= cur.end) {
+			if (ranges[i].end > cur.end)
+				cur.end = ranges[i].end;
+		} else {
+			Func_flush((void *)cur.start, cur.end - cur.start);
+			cur = ranges[i];
+		}
+	}
+	Func_flush((void *)cur.start, cur.end - cur.start);
+}
+
+/*
+ * pmem_flushv -- flush processor cache for the given vector of ranges
+ *
+ * Every cache line covered by the vector is flushed exactly once.
+ */
+void
+pmem_flushv(const struct iovec *iov, int iovcnt)
+{
+	LOG(10, "iov %p iovcnt %d", iov, iovcnt);
+
+	if (iovcnt <= 0)
+		return;
+
+	struct flush_range stack_ranges[FLUSHV_STACK_MAX];
+
+	if (iovcnt <= FLUSHV_STACK_MAX) {
+		flush_ranges(stack_ranges, iov, iovcnt);
+		return;
+	}
+
+	struct flush_range *ranges = Malloc((size_t)iovcnt * sizeof(*ranges));
+	if (ranges != NULL) {
+		flush_ranges(ranges, iov, iovcnt);
+		Free(ranges);
+		return;
+	}
+
+	/* out of memory -- dedup only within each batch of ranges */
+	LOG(4, "!Malloc");
+	for (int i = 0; i < iovcnt; i += FLUSHV_STACK_MAX) {
+		int cnt = iovcnt - i;
+		if (cnt > FLUSHV_STACK_MAX)
+			cnt = FLUSHV_STACK_MAX;
+		flush_ranges(stack_ranges, iov + i, cnt);
+	}
+}
+
+/*
+ * pmem_persistv -- make any cached changes to a vector of pmem ranges
+ * persistent
+ */
+void
+pmem_persistv(const struct iovec *iov, int iovcnt)
+{
+	LOG(15, "iov %p iovcnt %d", iov, iovcnt);
+
+	pmem_flushv(iov, iovcnt);
+	pmem_drain();
+}
+
 /*
  * pmem_persist -- make any cached changes to a range of pmem persistent
  */
@@ -713,18 +868,118 @@ memmove_nodrain_normal(void *pmemdest, const void *src, size_t len)
 	return pmemdest;
 }
 
+/*
+ * memmove_movnt_sse2_fw -- (internal) copy a multiple of 16 bytes in forward
+ * direction, using 16-byte non-temporal stores
+ */
+static void
+memmove_movnt_sse2_fw(char *dest, const char *src, size_t len)
+{
+	__m128i xmm0, xmm1, xmm2, xmm3, xmm4, xmm5, xmm6, xmm7;
+	size_t i;
+	__m128i *d = (__m128i *)dest;
+	__m128i *s = (__m128i *)src;
+	size_t cnt;
+
+	cnt = len >> CHUNK_SHIFT;
+	for (i = 0; i < cnt; i++) {
+		xmm0 = _mm_loadu_si128(s);
+		xmm1 = _mm_loadu_si128(s + 1);
+		xmm2 = _mm_loadu_si128(s + 2);
+		xmm3 = _mm_loadu_si128(s + 3);
+		xmm4 = _mm_loadu_si128(s + 4);
+		xmm5 = _mm_loadu_si128(s + 5);
+		xmm6 = _mm_loadu_si128(s + 6);
+		xmm7 = _mm_loadu_si128(s + 7);
+		s += 8;
+		_mm_stream_si128(d,	xmm0);
+		_mm_stream_si128(d + 1,	xmm1);
+		_mm_stream_si128(d + 2,	xmm2);
+		_mm_stream_si128(d + 3,	xmm3);
+		_mm_stream_si128(d + 4,	xmm4);
+		_mm_stream_si128(d + 5, xmm5);
+		_mm_stream_si128(d + 6,	xmm6);
+		_mm_stream_si128(d + 7,	xmm7);
+		VALGRIND_DO_FLUSH(d, 8 * sizeof(*d));
+		d += 8;
+	}
+
+	/* copy the tail (<128 bytes) in 16 bytes chunks */
+	cnt = (len & CHUNK_MASK) >> MOVNT_SHIFT;
+	for (i = 0; i < cnt; i++) {
+		xmm0 = _mm_loadu_si128(s);
+		_mm_stream_si128(d, xmm0);
+		VALGRIND_DO_FLUSH(d, sizeof(*d));
+		s++;
+		d++;
+	}
+}
+
+/*
+ * memmove_movnt_sse2_bw -- (internal) copy a multiple of 16 bytes in backward
+ * direction, using 16-byte non-temporal stores
+ *
+ * The dest and src arguments point to the end of the ranges.
+ */
+static void
+memmove_movnt_sse2_bw(char *dest, const char *src, size_t len)
+{
+	__m128i xmm0, xmm1, xmm2, xmm3, xmm4, xmm5, xmm6, xmm7;
+	size_t i;
+	__m128i *d = (__m128i *)dest;
+	__m128i *s = (__m128i *)src;
+	size_t cnt;
+
+	cnt = len >> CHUNK_SHIFT;
+	for (i = 0; i < cnt; i++) {
+		xmm0 = _mm_loadu_si128(s - 1);
+		xmm1 = _mm_loadu_si128(s - 2);
+		xmm2 = _mm_loadu_si128(s - 3);
+		xmm3 = _mm_loadu_si128(s - 4);
+		xmm4 = _mm_loadu_si128(s - 5);
+		xmm5 = _mm_loadu_si128(s - 6);
+		xmm6 = _mm_loadu_si128(s - 7);
+		xmm7 = _mm_loadu_si128(s - 8);
+		s -= 8;
+		_mm_stream_si128(d - 1, xmm0);
+		_mm_stream_si128(d - 2, xmm1);
+		_mm_stream_si128(d - 3, xmm2);
+		_mm_stream_si128(d - 4, xmm3);
+		_mm_stream_si128(d - 5, xmm4);
+		_mm_stream_si128(d - 6, xmm5);
+		_mm_stream_si128(d - 7, xmm6);
+		_mm_stream_si128(d - 8, xmm7);
+		d -= 8;
+		VALGRIND_DO_FLUSH(d, 8 * sizeof(*d));
+	}
+
+	/* copy the tail (<128 bytes) in 16 bytes chunks */
+	cnt = (len & CHUNK_MASK) >> MOVNT_SHIFT;
+	for (i = 0; i < cnt; i++) {
+		d--;
+		s--;
+		xmm0 = _mm_loadu_si128(s);
+		_mm_stream_si128(d, xmm0);
+		VALGRIND_DO_FLUSH(d, sizeof(*d));
+	}
+}
+
 /*
  * memmove_nodrain_movnt -- (internal) memmove to pmem without hw drain, movnt
+ *
+ * The cache-line aligned middle part of the range is copied by copy_fw or
+ * copy_bw, depending on the direction, so that the same head and tail
+ * handling is shared by all the non-temporal store variants.
  */
-static void *
-memmove_nodrain_movnt(void *pmemdest, const void *src, size_t len)
+static inline void *
+memmove_nodrain_movnt(void *pmemdest, const void *src, size_t len,
+	movnt_copy_fn copy_fw, movnt_copy_fn copy_bw)
 {
 	LOG(15, "pmemdest %p src %p len %zu", pmemdest, src, len);
 
-	__m128i xmm0, xmm1, xmm2, xmm3, xmm4, xmm5, xmm6, xmm7;
 	size_t i;
-	__m128i *d;
-	__m128i *s;
+	char *d;
+	const char *s;
 	void *dest1 = pmemdest;
 	size_t cnt;
 
@@ -767,44 +1022,14 @@ memmove_nodrain_movnt(void *pmemdest, const void *src, size_t len)
 			len -= cnt;
 		}
 
-		d = (__m128i *)dest1;
-		s = (__m128i *)src;
-
-		cnt = len >> CHUNK_SHIFT;
-		for (i = 0; i < cnt; i++) {
-			xmm0 = _mm_loadu_si128(s);
-			xmm1 = _mm_loadu_si128(s + 1);
-			xmm2 = _mm_loadu_si128(s + 2);
-			xmm3 = _mm_loadu_si128(s + 3);
-			xmm4 = _mm_loadu_si128(s + 4);
-			xmm5 = _mm_loadu_si128(s + 5);
-			xmm6 = _mm_loadu_si128(s + 6);
-			xmm7 = _mm_loadu_si128(s + 7);
-			s += 8;
-			_mm_stream_si128(d,	xmm0);
-			_mm_stream_si128(d + 1,	xmm1);
-			_mm_stream_si128(d + 2,	xmm2);
-			_mm_stream_si128(d + 3,	xmm3);
-			_mm_stream_si128(d + 4,	xmm4);
-			_mm_stream_si128(d + 5, xmm5);
-			_mm_stream_si128(d + 6,	xmm6);
-			_mm_stream_si128(d + 7,	xmm7);
-			VALGRIND_DO_FLUSH(d, 8 * sizeof(*d));
-			d += 8;
-		}
+		d = (char *)dest1;
+		s = (const char *)src;
 
-		/* copy the tail (<128 bytes) in 16 bytes chunks */
-		len &= CHUNK_MASK;
-		if (len != 0) {
-			cnt = len >> MOVNT_SHIFT;
-			for (i = 0; i < cnt; i++) {
-				xmm0 = _mm_loadu_si128(s);
-				_mm_stream_si128(d, xmm0);
-				VALGRIND_DO_FLUSH(d, sizeof(*d));
-				s++;
-				d++;
-			}
-		}
+		/* copy the aligned part in 16 bytes or wider chunks */
+		cnt = len & ~(size_t)MOVNT_MASK;
+		copy_fw(d, s, cnt);
+		d += cnt;
+		s += cnt;
 
 		/* copy the last bytes (<16), first dwords then bytes */
 		len &= MOVNT_MASK;
@@ -859,44 +1084,14 @@ memmove_nodrain_movnt(void *pmemdest, const void *src, size_t len)
 			len -= cnt;
 		}
 
-		d = (__m128i *)dest1;
-		s = (__m128i *)src;
-
-		cnt = len >> CHUNK_SHIFT;
-		for (i = 0; i < cnt; i++) {
-			xmm0 = _mm_loadu_si128(s - 1);
-			xmm1 = _mm_loadu_si128(s - 2);
-			xmm2 = _mm_loadu_si128(s - 3);
-			xmm3 = _mm_loadu_si128(s - 4);
-			xmm4 = _mm_loadu_si128(s - 5);
-			xmm5 = _mm_loadu_si128(s - 6);
-			xmm6 = _mm_loadu_si128(s - 7);
-			xmm7 = _mm_loadu_si128(s - 8);
-			s -= 8;
-			_mm_stream_si128(d - 1, xmm0);
-			_mm_stream_si128(d - 2, xmm1);
-			_mm_stream_si128(d - 3, xmm2);
-			_mm_stream_si128(d - 4, xmm3);
-			_mm_stream_si128(d - 5, xmm4);
-			_mm_stream_si128(d - 6, xmm5);
-			_mm_stream_si128(d - 7, xmm6);
-			_mm_stream_si128(d - 8, xmm7);
-			d -= 8;
-			VALGRIND_DO_FLUSH(d, 8 * sizeof(*d));
-		}
+		d = (char *)dest1;
+		s = (const char *)src;
 
-		/* copy the tail (<128 bytes) in 16 bytes chunks */
-		len &= CHUNK_MASK;
-		if (len != 0) {
-			cnt = len >> MOVNT_SHIFT;
-			for (i = 0; i < cnt; i++) {
-				d--;
-				s--;
-				xmm0 = _mm_loadu_si128(s);
-				_mm_stream_si128(d, xmm0);
-				VALGRIND_DO_FLUSH(d, sizeof(*d));
-			}
-		}
+		/* copy the aligned part in 16 bytes or wider chunks */
+		cnt = len & ~(size_t)MOVNT_MASK;
+		copy_bw(d, s, cnt);
+		d -= cnt;
+		s -= cnt;
 
 		/* copy the last bytes (<16), first dwords then bytes */
 		len &= MOVNT_MASK;
@@ -930,12 +1125,47 @@ memmove_nodrain_movnt(void *pmemdest, const void *src, size_t len)
 	return pmemdest;
 }
 
+/*
+ * memmove_nodrain_movnt_sse2 -- memmove to pmem without hw drain,
+ * 16-byte movnt
+ */
+void *
+memmove_nodrain_movnt_sse2(void *pmemdest, const void *src, size_t len)
+{
+	return memmove_nodrain_movnt(pmemdest, src, len,
+			memmove_movnt_sse2_fw, memmove_movnt_sse2_bw);
+}
+
+/*
+ * memmove_nodrain_movnt_avx -- memmove to pmem without hw drain,
+ * 32-byte movnt
+ */
+void *
+memmove_nodrain_movnt_avx(void *pmemdest, const void *src, size_t len)
+{
+	return memmove_nodrain_movnt(pmemdest, src, len,
+			memmove_movnt_avx_fw, memmove_movnt_avx_bw);
+}
+
+/*
+ * memmove_nodrain_movnt_avx512f -- memmove to pmem without hw drain,
+ * 64-byte movnt
+ */
+void *
+memmove_nodrain_movnt_avx512f(void *pmemdest, const void *src, size_t len)
+{
+	return memmove_nodrain_movnt(pmemdest, src, len,
+			memmove_movnt_avx512f_fw, memmove_movnt_avx512f_bw);
+}
+
 /*
  * pmem_memmove_nodrain() calls through Func_memmove_nodrain to do the work.
  * Although initialized to memmove_nodrain_normal(), once the existence of the
  * sse2 feature is confirmed by pmem_init() at library initialization time,
- * Func_memmove_nodrain is set to memmove_nodrain_movnt().  That's the most
- * common case on modern hardware that supports persistent memory.
+ * Func_memmove_nodrain is set to memmove_nodrain_movnt_sse2(), or to one of
+ * its wider memmove_nodrain_movnt_avx() and memmove_nodrain_movnt_avx512f()
+ * counterparts when the CPU supports them.  That's the most common case on
+ * modern hardware that supports persistent memory.
  */
 static void *(*Func_memmove_nodrain)
 	(void *pmemdest, const void *src, size_t len) = memmove_nodrain_normal;
@@ -999,19 +1229,55 @@ memset_nodrain_normal(void *pmemdest, int c, size_t len)
 	return pmemdest;
 }
 
+/*
+ * memset_movnt_sse2 -- (internal) memset a multiple of 16 bytes,
+ * using 16-byte non-temporal stores
+ */
+static void
+memset_movnt_sse2(char *dest, int c, size_t len)
+{
+	size_t i;
+	__m128i xmm0 = _mm_set1_epi8((char)c);
+	__m128i *d = (__m128i *)dest;
+	size_t cnt;
+
+	cnt = len >> CHUNK_SHIFT;
+	for (i = 0; i < cnt; i++) {
+		_mm_stream_si128(d, xmm0);
+		_mm_stream_si128(d + 1, xmm0);
+		_mm_stream_si128(d + 2, xmm0);
+		_mm_stream_si128(d + 3, xmm0);
+		_mm_stream_si128(d + 4, xmm0);
+		_mm_stream_si128(d + 5, xmm0);
+		_mm_stream_si128(d + 6, xmm0);
+		_mm_stream_si128(d + 7, xmm0);
+		VALGRIND_DO_FLUSH(d, 8 * sizeof(*d));
+		d += 8;
+	}
+
+	/* memset the tail (<128 bytes) in 16 bytes chunks */
+	cnt = (len & CHUNK_MASK) >> MOVNT_SHIFT;
+	for (i = 0; i < cnt; i++) {
+		_mm_stream_si128(d, xmm0);
+		VALGRIND_DO_FLUSH(d, sizeof(*d));
+		d++;
+	}
+}
+
 /*
  * memset_nodrain_movnt -- (internal) memset to pmem without hw drain, movnt
+ *
+ * The cache-line aligned middle part of the range is filled by set_fn.
  */
-static void *
-memset_nodrain_movnt(void *pmemdest, int c, size_t len)
+static inline void *
+memset_nodrain_movnt(void *pmemdest, int c, size_t len, movnt_set_fn set_fn)
 {
 	LOG(15, "pmemdest %p c 0x%x len %zu", pmemdest, c, len);
 
 	size_t i;
+	char *d;
 	void *dest1 = pmemdest;
 	size_t cnt;
-	__m128i xmm0;
-	__m128i *d;
 
 	if (len < Movnt_threshold) {
 		memset(pmemdest, c, len);
@@ -1033,34 +1299,11 @@ memset_nodrain_movnt(void *pmemdest, int c, size_t len)
 		dest1 = (char *)dest1 + cnt;
 	}
 
-	xmm0 = _mm_set1_epi8((char)c);
-
-	d = (__m128i *)dest1;
-	cnt = len / CHUNK_SIZE;
-	if (cnt != 0) {
-		for (i = 0; i < cnt; i++) {
-			_mm_stream_si128(d, xmm0);
-			_mm_stream_si128(d + 1, xmm0);
-			_mm_stream_si128(d + 2, xmm0);
-			_mm_stream_si128(d + 3, xmm0);
-			_mm_stream_si128(d + 4, xmm0);
-			_mm_stream_si128(d + 5, xmm0);
-			_mm_stream_si128(d + 6, xmm0);
-			_mm_stream_si128(d + 7, xmm0);
-			VALGRIND_DO_FLUSH(d, 8 * sizeof(*d));
-			d += 8;
-		}
-	}
-	/* memset the tail (<128 bytes) in 16 bytes chunks */
-	len &= CHUNK_MASK;
-	if (len != 0) {
-		cnt = len >> MOVNT_SHIFT;
-		for (i = 0; i < cnt; i++) {
-			_mm_stream_si128(d, xmm0);
-			VALGRIND_DO_FLUSH(d, sizeof(*d));
-			d++;
-		}
-	}
+	/* memset the aligned part in 16 bytes or wider chunks */
+	d = (char *)dest1;
+	cnt = len & ~(size_t)MOVNT_MASK;
+	set_fn(d, c, cnt);
+	d += cnt;
 
 	/* memset the last bytes (<16), first dwords then bytes */
 	len &= MOVNT_MASK;
@@ -1068,6 +1311,7 @@ memset_nodrain_movnt(void *pmemdest, int c, size_t len)
 		int32_t *d32 = (int32_t *)d;
 		cnt = len >> DWORD_SHIFT;
 		if (cnt != 0) {
+			__m128i xmm0 = _mm_set1_epi8((char)c);
 			for (i = 0; i < cnt; i++) {
 				_mm_stream_si32(d32,
 					_mm_cvtsi128_si32(xmm0));
@@ -1090,12 +1334,42 @@ memset_nodrain_movnt(void *pmemdest, int c, size_t len)
 	return pmemdest;
 }
 
+/*
+ * memset_nodrain_movnt_sse2 -- memset to pmem without hw drain, 16-byte movnt
+ */
+void *
+memset_nodrain_movnt_sse2(void *pmemdest, int c, size_t len)
+{
+	return memset_nodrain_movnt(pmemdest, c, len, memset_movnt_sse2);
+}
+
+/*
+ * memset_nodrain_movnt_avx -- memset to pmem without hw drain, 32-byte movnt
+ */
+void *
+memset_nodrain_movnt_avx(void *pmemdest, int c, size_t len)
+{
+	return memset_nodrain_movnt(pmemdest, c, len, memset_movnt_avx);
+}
+
+/*
+ * memset_nodrain_movnt_avx512f -- memset to pmem without hw drain,
+ * 64-byte movnt
+ */
+void *
+memset_nodrain_movnt_avx512f(void *pmemdest, int c, size_t len)
+{
+	return memset_nodrain_movnt(pmemdest, c, len, memset_movnt_avx512f);
+}
+
 /*
  * pmem_memset_nodrain() calls through Func_memset_nodrain to do the work.
  * Although initialized to memset_nodrain_normal(), once the existence of the
  * sse2 feature is confirmed by pmem_init() at library initialization time,
- * Func_memset_nodrain is set to memset_nodrain_movnt().  That's the most
- * common case on modern hardware that supports persistent memory.
+ * Func_memset_nodrain is set to memset_nodrain_movnt_sse2(), or to one of
+ * its wider memset_nodrain_movnt_avx() and memset_nodrain_movnt_avx512f()
+ * counterparts when the CPU supports them.  That's the most common case on
+ * modern hardware that supports persistent memory.
  */
 static void *(*Func_memset_nodrain)
 	(void *pmemdest, int c, size_t len) = memset_nodrain_normal;
@@ -1140,12 +1414,19 @@ pmem_log_cpuinfo(void)
 	else
 		FATAL("invalid flush function address");
 
-	if (Func_memmove_nodrain == memmove_nodrain_movnt)
-		LOG(3, "using movnt");
+	if (Func_memmove_nodrain == memmove_nodrain_movnt_sse2)
+		LOG(3, "using movnt SSE2");
+	else if (Func_memmove_nodrain == memmove_nodrain_movnt_avx)
+		LOG(3, "using movnt AVX");
+	else if (Func_memmove_nodrain == memmove_nodrain_movnt_avx512f)
+		LOG(3, "using movnt AVX512F");
 	else if (Func_memmove_nodrain == memmove_nodrain_normal)
 		LOG(3, "not using movnt");
 	else
 		FATAL("invalid memove_nodrain function address");
+
+	if (Func_memmove_nodrain != memmove_nodrain_normal)
+		LOG(3, "movnt threshold %zu", Movnt_threshold);
 }
 
 /*
@@ -1184,6 +1465,115 @@ pmem_get_cpuinfo(void)
 	}
 }
 
+/*
+ * pmem_get_movnt_variant -- (internal) pick the widest non-temporal store
+ * variant supported by the CPU
+ */
+static void
+pmem_get_movnt_variant(void)
+{
+	if (is_cpu_avx_present()) {
+		LOG(3, "avx supported");
+
+		char *e = getenv("PMEM_NO_AVX");
+		if (e && strcmp(e, "1") == 0)
+			LOG(3, "PMEM_NO_AVX forced no avx");
+		else {
+			Func_memmove_nodrain = memmove_nodrain_movnt_avx;
+			Func_memset_nodrain = memset_nodrain_movnt_avx;
+		}
+	}
+
+	if (is_cpu_avx512f_present()) {
+		LOG(3, "avx512f supported");
+
+		char *e = getenv("PMEM_NO_AVX512F");
+		if (e && strcmp(e, "1") == 0)
+			LOG(3, "PMEM_NO_AVX512F forced no avx512f");
+		else {
+			Func_memmove_nodrain = memmove_nodrain_movnt_avx512f;
+			Func_memset_nodrain = memset_nodrain_movnt_avx512f;
+		}
+	}
+}
+
+/*
+ * calibrate_time -- (internal) measure the best time of copying the whole
+ * calibration buffer in len-sized pieces
+ */
+static uint64_t
+calibrate_time(char *dest, const char *src, size_t len,
+	void *(*memmove_nodrain)(void *, const void *, size_t))
+{
+	uint64_t best = UINT64_MAX;
+
+	for (int r = 0; r < CALIBRATE_ROUNDS; r++) {
+		uint64_t start = __rdtsc();
+
+		for (size_t off = 0; off + len <= CALIBRATE_BUF_SIZE;
+				off += len)
+			memmove_nodrain(dest + off, src + off, len);
+		Func_predrain_fence();
+
+		uint64_t t = __rdtsc() - start;
+		if (t < best)
+			best = t;
+	}
+
+	return best;
+}
+
+/*
+ * pmem_calibrate_movnt_threshold -- (internal) find the smallest length for
+ * which non-temporal stores beat regular stores followed by a flush
+ *
+ * Both paths are timed on a volatile buffer, for the power of two lengths
+ * from MOVNT_THRESHOLD_MAX down to MOVNT_THRESHOLD_MIN.  The threshold is
+ * the last length for which non-temporal stores were still not slower.
+ */
+static size_t
+pmem_calibrate_movnt_threshold(void)
+{
+	LOG(3, NULL);
+
+	char *buf = Malloc(2 * CALIBRATE_BUF_SIZE + FLUSH_ALIGN);
+	if (buf == NULL) {
+		LOG(3, "!Malloc");
+		return MOVNT_THRESHOLD;
+	}
+
+	char *src = (char *)(((uintptr_t)buf + ALIGN_MASK) & ~ALIGN_MASK);
+	char *dest = src + CALIBRATE_BUF_SIZE;
+	memset(src, 0xc5, CALIBRATE_BUF_SIZE);
+	memset(dest, 0, CALIBRATE_BUF_SIZE);
+
+	/* the movnt variants have to be timed without the threshold check */
+	Movnt_threshold = 0;
+
+	size_t threshold = MOVNT_THRESHOLD_MAX;
+	for (size_t len = MOVNT_THRESHOLD_MAX; len >= MOVNT_THRESHOLD_MIN;
+			len /= 2) {
+		uint64_t t_normal = calibrate_time(dest, src, len,
+				memmove_nodrain_normal);
+		uint64_t t_movnt = calibrate_time(dest, src, len,
+				Func_memmove_nodrain);
+
+		LOG(4, "len %zu normal %ju movnt %ju", len,
+				(uintmax_t)t_normal, (uintmax_t)t_movnt);
+
+		if (t_movnt > t_normal)
+			break;
+
+		threshold = len;
+	}
+
+	Free(buf);
+
+	LOG(3, "movnt threshold calibrated to %zu", threshold);
+
+	return threshold;
+}
+
 /*
  * pmem_init -- load-time initialization for pmem.c
  */
@@ -1201,13 +1591,32 @@ pmem_init(void)
 		Func_predrain_fence = predrain_fence_sfence;
 	}
 
+	char *ptr = getenv("PMEM_NO_MOVNT");
+	if (ptr && strcmp(ptr, "1") == 0)
+		LOG(3, "PMEM_NO_MOVNT forced no movnt");
+	else {
+		Func_memmove_nodrain = memmove_nodrain_movnt_sse2;
+		Func_memset_nodrain = memset_nodrain_movnt_sse2;
+
+		pmem_get_movnt_variant();
+	}
+
 	/*
-	 * For testing, allow overriding the default threshold
-	 * for using non-temporal stores in pmem_memcpy_*(), pmem_memmove_*()
-	 * and pmem_memset_*().
+	 * Allow overriding the threshold for using non-temporal stores
+	 * in pmem_memcpy_*(), pmem_memmove_*() and pmem_memset_*(), or
+	 * calibrating it at startup, except under Valgrind, where timing
+	 * makes no sense.  The default is kept otherwise, so that it doesn't
+	 * vary from run to run.
 	 * It has no effect if movnt is not supported or disabled.
 	 */
-	char *ptr = getenv("PMEM_MOVNT_THRESHOLD");
+	int calibrate = 0;
+	ptr = getenv("PMEM_MOVNT_CALIBRATION");
+	if (ptr && strcmp(ptr, "1") == 0) {
+		LOG(3, "PMEM_MOVNT_CALIBRATION forced calibration");
+		calibrate = 1;
+	}
+
+	ptr = getenv("PMEM_MOVNT_THRESHOLD");
 	if (ptr) {
 		long long val = atoll(ptr);
 
@@ -1216,16 +1625,13 @@ pmem_init(void)
 		else {
 			LOG(3, "PMEM_MOVNT_THRESHOLD set to %zu", (size_t)val);
 			Movnt_threshold = (size_t)val;
+			calibrate = 0;
 		}
 	}
 
-	ptr = getenv("PMEM_NO_MOVNT");
-	if (ptr && strcmp(ptr, "1") == 0)
-		LOG(3, "PMEM_NO_MOVNT forced no movnt");
-	else {
-		Func_memmove_nodrain = memmove_nodrain_movnt;
-		Func_memset_nodrain = memset_nodrain_movnt;
-	}
+	if (calibrate && !On_valgrind &&
+			Func_memmove_nodrain != memmove_nodrain_normal)
+		Movnt_threshold = pmem_calibrate_movnt_threshold();
 
 	pmem_log_cpuinfo();
 }
@@ -39,7 +39,40 @@
 #define PMEM_LOG_FILE_VAR "PMEM_LOG_FILE"
 
 extern unsigned long long Pagesize;
+extern size_t Movnt_threshold;
 
 void pmem_init(void);
+void pmem_async_init(void);
+void pmem_async_fini(void);
 
 int is_pmem_proc(const void *addr, size_t len);
+
+/*
+ * movnt_copy_fn -- copies a multiple of 16 bytes using non-temporal stores
+ *
+ * The destination is expected to be cache line aligned.  For the backward
+ * direction dest and src point to the end of the ranges.
+ */
+typedef void (*movnt_copy_fn)(char *dest, const char *src, size_t len);
+
+/*
+ * movnt_set_fn -- fills a multiple of 16 bytes using non-temporal stores
+ */
+typedef void (*movnt_set_fn)(char *dest, int c, size_t len);
+
+void memmove_movnt_avx_fw(char *dest, const char *src, size_t len);
+void memmove_movnt_avx_bw(char *dest, const char *src, size_t len);
+void memset_movnt_avx(char *dest, int c, size_t len);
+
+void memmove_movnt_avx512f_fw(char *dest, const char *src, size_t len);
+void memmove_movnt_avx512f_bw(char *dest, const char *src, size_t len);
+void memset_movnt_avx512f(char *dest, int c, size_t len);
+
+void *memmove_nodrain_movnt_sse2(void *pmemdest, const void *src, size_t len);
+void *memmove_nodrain_movnt_avx(void *pmemdest, const void *src, size_t len);
+void *memmove_nodrain_movnt_avx512f(void *pmemdest, const void *src,
+	size_t len);
+
+void *memset_nodrain_movnt_sse2(void *pmemdest, int c, size_t len);
+void *memset_nodrain_movnt_avx(void *pmemdest, int c, size_t len);
+void *memset_nodrain_movnt_avx512f(void *pmemdest, int c, size_t len);
@@ -0,0 +1,476 @@
+/*
+ * Copyright 2016, Intel Corporation
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in
+ *       the documentation and/or other materials provided with the
+ *       distribution.
+ *
+ *     * Neither the name of the copyright holder nor the names of its
+ *       contributors may be used to endorse or promote products derived
+ *       from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * pmem_async.c -- asynchronous bulk copy engine for libpmem
+ *
+ * A copy started with pmem_memcpy_async() is split into chunks of
+ * ASYNC_CHUNK_SIZE bytes, which are copied to pmem by a small pool of
+ * worker threads.  Each worker drains its own stores before reporting
+ * a chunk as done, because a fence orders only the stores issued by the
+ * thread executing it.  Threads waiting for a copy in pmem_async_wait()
+ * copy the remaining chunks themselves, so a copy always completes, even
+ * if no worker could be started.
+ *
+ * All the state is protected by a single mutex -- chunks are large enough
+ * to make the cost of taking it negligible.
+ *
+ * The workers don't survive fork(), so the child process starts its own
+ * ones on its first copy.  Chunks the parent's workers were copying at the
+ * time of fork() are never completed in the child.
+ */
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/queue.h>
+
+#include "libpmem.h"
+
+#include "pmem.h"
+#include "out.h"
+#include "util.h"
+#include "sys_util.h"
+
+/* size of a unit of work */
+#define ASYNC_CHUNK_SIZE	((size_t)1 << 20)
+
+/* default (and max) number of worker threads */
+#define ASYNC_THREADS_DEFAULT	4
+#define ASYNC_THREADS_MAX	64
+
+struct pmem_async {
+	char *dest;
+	const char *src;
+	size_t len;
+	unsigned flags;
+
+	size_t nchunks;
+	size_t next_chunk;	/* first chunk not taken by any thread */
+	size_t chunks_done;
+	int error;		/* errno of the first failed chunk */
+	const char *error_op;	/* the operation which failed */
+
+	STAILQ_ENTRY(pmem_async) next;	/* valid while in Async_queue */
+};
+
+static STAILQ_HEAD(async_queue, pmem_async) Async_queue =
+	STAILQ_HEAD_INITIALIZER(Async_queue);
+
+static pthread_mutex_t Async_lock;
+static pthread_cond_t Async_work_cond;	/* new chunks in the queue */
+static pthread_cond_t Async_done_cond;	/* chunks completed */
+
+static unsigned Async_nthreads = ASYNC_THREADS_DEFAULT;
+static unsigned Async_nstarted;		/* number of running workers */
+static int Async_started;		/* workers already spawned */
+static int Async_shutdown;
+static pthread_t Async_threads[ASYNC_THREADS_MAX];
+
+/*
+ * async_take_chunk -- (internal) take the next chunk of the copy
+ *
+ * Must be called with Async_lock held.
+ */
+static size_t
+async_take_chunk(PMEMasync *async)
+{
+	ASSERT(async->next_chunk < async->nchunks);
+
+	size_t chunk = async->next_chunk++;
+	if (async->next_chunk == async->nchunks)
+		STAILQ_REMOVE(&Async_queue, async, pmem_async, next);
+
+	return chunk;
+}
+
+/*
+ * async_copy_chunk -- (internal) copy one chunk and make it persistent
+ *
+ * Returns 0 on success, errno value otherwise, in which case the name of the
+ * failed operation is stored in *op.
+ */
+static int
+async_copy_chunk(PMEMasync *async, size_t chunk, const char **op)
+{
+	size_t off = chunk * ASYNC_CHUNK_SIZE;
+	size_t len = async->len - off;
+	if (len > ASYNC_CHUNK_SIZE)
+		len = ASYNC_CHUNK_SIZE;
+
+	char *dest = async->dest + off;
+	const char *src = async->src + off;
+
+	LOG(15, "async %p chunk %zu dest %p len %zu", async, chunk, dest, len);
+
+	if (async->flags & PMEM_ASYNC_NOPMEM) {
+		memcpy(dest, src, len);
+		if (pmem_msync(dest, len)) {
+			*op = "pmem_msync";
+			return errno;
+		}
+	} else {
+		pmem_memcpy_nodrain(dest, src, len);
+		pmem_drain();
+	}
+
+	return 0;
+}
+
+/*
+ * async_chunk_done -- (internal) account a completed chunk
+ *
+ * Must be called with Async_lock held.
+ */
+static void
+async_chunk_done(PMEMasync *async, int error, const char *op)
+{
+	if (error && async->error == 0) {
+		async->error = error;
+		async->error_op = op;
+	}
+
+	if (++async->chunks_done == async->nchunks) {
+		int ret = pthread_cond_broadcast(&Async_done_cond);
+		if (ret) {
+			errno = ret;
+			FATAL("!pthread_cond_broadcast");
+		}
+	}
+}
+
+/*
+ * async_worker -- (internal) worker thread routine
+ */
+static void *
+async_worker(void *arg)
+{
+	util_mutex_lock(&Async_lock);
+
+	while (!Async_shutdown) {
+		PMEMasync *async = STAILQ_FIRST(&Async_queue);
+		if (async == NULL) {
+			int ret = pthread_cond_wait(&Async_work_cond,
+					&Async_lock);
+			if (ret) {
+				errno = ret;
+				FATAL("!pthread_cond_wait");
+			}
+			continue;
+		}
+
+		size_t chunk = async_take_chunk(async);
+		util_mutex_unlock(&Async_lock);
+
+		const char *op = NULL;
+		int error = async_copy_chunk(async, chunk, &op);
+
+		util_mutex_lock(&Async_lock);
+		async_chunk_done(async, error, op);
+	}
+
+	util_mutex_unlock(&Async_lock);
+
+	return NULL;
+}
+
+/*
+ * async_start_workers -- (internal) spawn the worker threads
+ *
+ * Must be called with Async_lock held.  Failing to start a thread is not
+ * an error, the remaining work is done by pmem_async_wait().
+ */
+static void
+async_start_workers(void)
+{
+	Async_started = 1;
+
+	for (unsigned i = 0; i < Async_nthreads; i++) {
+		int ret = pthread_create(&Async_threads[i], NULL,
+				async_worker, NULL);
+		if (ret) {
+			errno = ret;
+			LOG(2, "!pthread_create");
+			break;
+		}
+		Async_nstarted++;
+	}
+
+	LOG(3, "started %u async copy workers", Async_nstarted);
+}
+
+/*
+ * pmem_memcpy_async -- start copying a range of memory to pmem
+ *
+ * The copy is persistent once pmem_async_wait() returns, or once
+ * pmem_async_poll() reports the copy as completed.
+ */
+PMEMasync *
+pmem_memcpy_async(void *pmemdest, const void *src, size_t len,
+	unsigned flags)
+{
+	LOG(3, "pmemdest %p src %p len %zu flags 0x%x", pmemdest, src, len,
+			flags);
+
+	if (flags & ~PMEM_ASYNC_ALL_FLAGS) {
+		ERR("invalid flags 0x%x", flags);
+		errno = EINVAL;
+		return NULL;
+	}
+
+	PMEMasync *async = Malloc(sizeof(*async));
+	if (async == NULL) {
+		ERR("!Malloc");
+		return NULL;
+	}
+
+	async->dest = pmemdest;
+	async->src = src;
+	async->len = len;
+	async->flags = flags;
+	async->nchunks = (len + ASYNC_CHUNK_SIZE - 1) / ASYNC_CHUNK_SIZE;
+	async->next_chunk = 0;
+	async->chunks_done = 0;
+	async->error = 0;
+	async->error_op = NULL;
+
+	/* a single chunk is not worth handing over to another thread */
+	if (async->nchunks <= 1) {
+		if (async->nchunks == 1) {
+			async->error = async_copy_chunk(async, 0,
+					&async->error_op);
+			async->next_chunk = async->chunks_done = 1;
+		}
+		return async;
+	}
+
+	util_mutex_lock(&Async_lock);
+
+	if (!Async_started && Async_nthreads > 0)
+		async_start_workers();
+
+	STAILQ_INSERT_TAIL(&Async_queue, async, next);
+
+	int ret = pthread_cond_broadcast(&Async_work_cond);
+	if (ret) {
+		errno = ret;
+		FATAL("!pthread_cond_broadcast");
+	}
+
+	util_mutex_unlock(&Async_lock);
+
+	return async;
+}
+
+/*
+ * pmem_async_poll -- check whether an asynchronous copy has completed
+ */
+int
+pmem_async_poll(PMEMasync *async)
+{
+	LOG(15, "async %p", async);
+
+	util_mutex_lock(&Async_lock);
+	int done = async->chunks_done == async->nchunks;
+	util_mutex_unlock(&Async_lock);
+
+	return done;
+}
+
+/*
+ * pmem_async_wait -- wait for an asynchronous copy to complete and release
+ * its handle
+ *
+ * The calling thread copies the chunks not taken by the workers yet.
+ */
+int
+pmem_async_wait(PMEMasync *async)
+{
+	LOG(3, "async %p", async);
+
+	util_mutex_lock(&Async_lock);
+
+	while (async->chunks_done < async->nchunks) {
+		if (async->next_chunk < async->nchunks) {
+			size_t chunk = async_take_chunk(async);
+			util_mutex_unlock(&Async_lock);
+
+			const char *op = NULL;
+			int error = async_copy_chunk(async, chunk, &op);
+
+			util_mutex_lock(&Async_lock);
+			async_chunk_done(async, error, op);
+			continue;
+		}
+
+		int ret = pthread_cond_wait(&Async_done_cond, &Async_lock);
+		if (ret) {
+			errno = ret;
+			FATAL("!pthread_cond_wait");
+		}
+	}
+
+	util_mutex_unlock(&Async_lock);
+
+	int error = async->error;
+	const char *op = async->error_op;
+	Free(async);
+
+	if (error) {
+		errno = error;
+		ERR("!%s", op);
+		return -1;
+	}
+
+	return 0;
+}
+
+/*
+ * async_init_sync -- (internal) initialize the lock and the condition
+ *	variables of the engine
+ */
+static void
+async_init_sync(void)
+{
+	util_mutex_init(&Async_lock, NULL);
+
+	int ret;
+	if ((ret = pthread_cond_init(&Async_work_cond, NULL)) ||
+	    (ret = pthread_cond_init(&Async_done_cond, NULL))) {
+		errno = ret;
+		FATAL("!pthread_cond_init");
+	}
+}
+
+#ifndef _WIN32
+/*
+ * async_prefork -- (internal) keep the state consistent across fork()
+ */
+static void
+async_prefork(void)
+{
+	util_mutex_lock(&Async_lock);
+}
+
+/*
+ * async_postfork_parent -- (internal) release the state after fork()
+ */
+static void
+async_postfork_parent(void)
+{
+	util_mutex_unlock(&Async_lock);
+}
+
+/*
+ * async_postfork_child -- (internal) forget the workers of the parent
+ *
+ * The child has none of the worker threads, so it must neither wait for
+ * them in the condition variables nor join them at exit.
+ */
+static void
+async_postfork_child(void)
+{
+	Async_started = 0;
+	Async_nstarted = 0;
+
+	async_init_sync();
+}
+#endif
+
+/*
+ * pmem_async_init -- initialize the asynchronous copy engine
+ *
+ * The worker threads are spawned on the first copy which needs them.
+ */
+void
+pmem_async_init(void)
+{
+	LOG(3, NULL);
+
+	async_init_sync();
+
+#ifndef _WIN32
+	int ret = pthread_atfork(async_prefork, async_postfork_parent,
+			async_postfork_child);
+	if (ret) {
+		errno = ret;
+		FATAL("!pthread_atfork");
+	}
+#endif
+
+	long ncpus = sysconf(_SC_NPROCESSORS_ONLN);
+	if (ncpus > 0 && ncpus < ASYNC_THREADS_DEFAULT)
+		Async_nthreads = (unsigned)ncpus;
+
+	char *e = getenv("PMEM_ASYNC_THREADS");
+	if (e) {
+		long long val = atoll(e);
+		if (val < 0 || val > ASYNC_THREADS_MAX)
+			LOG(3, "Invalid PMEM_ASYNC_THREADS");
+		else {
+			LOG(3, "PMEM_ASYNC_THREADS set to %lld", val);
+			Async_nthreads = (unsigned)val;
+		}
+	}
+}
+
+/*
+ * pmem_async_fini -- stop the worker threads
+ */
+void
+pmem_async_fini(void)
+{
+	LOG(3, NULL);
+
+	util_mutex_lock(&Async_lock);
+	Async_shutdown = 1;
+	int ret = pthread_cond_broadcast(&Async_work_cond);
+	if (ret) {
+		errno = ret;
+		FATAL("!pthread_cond_broadcast");
+	}
+	util_mutex_unlock(&Async_lock);
+
+	for (unsigned i = 0; i < Async_nstarted; i++) {
+		ret = pthread_join(Async_threads[i], NULL);
+		if (ret) {
+			errno = ret;
+			FATAL("!pthread_join");
+		}
+	}
+
+	pthread_cond_destroy(&Async_done_cond);
+	pthread_cond_destroy(&Async_work_cond);
+	util_mutex_destroy(&Async_lock);
+}
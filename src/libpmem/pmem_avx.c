@@ -0,0 +1,208 @@
+/*
+ * Copyright 2016, Intel Corporation
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in
+ *       the documentation and/or other materials provided with the
+ *       distribution.
+ *
+ *     * Neither the name of the copyright holder nor the names of its
+ *       contributors may be used to endorse or promote products derived
+ *       from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * pmem_avx.c -- 32-byte non-temporal store kernels for libpmem
+ *
+ * This file has to be compiled with AVX enabled, and the functions defined
+ * here can be called only after pmem_init() confirmed the CPU and the OS
+ * support it.
+ */
+
+#include <immintrin.h>
+#include <stddef.h>
+
+#include "pmem.h"
+#include "valgrind_internal.h"
+
+#define AVX_SIZE	32
+#define AVX_MASK	(AVX_SIZE - 1)
+#define AVX_SHIFT	5
+
+#define AVX_CHUNK_SIZE	256 /* 32*8 */
+#define AVX_CHUNK_MASK	(AVX_CHUNK_SIZE - 1)
+#define AVX_CHUNK_SHIFT	8
+
+/*
+ * memmove_movnt_avx_fw -- copy a multiple of 16 bytes in forward direction,
+ * using 32-byte non-temporal stores
+ */
+void
+memmove_movnt_avx_fw(char *dest, const char *src, size_t len)
+{
+	__m256i ymm0, ymm1, ymm2, ymm3, ymm4, ymm5, ymm6, ymm7;
+	size_t i;
+	__m256i *d = (__m256i *)dest;
+	__m256i *s = (__m256i *)src;
+	size_t cnt;
+
+	cnt = len >> AVX_CHUNK_SHIFT;
+	for (i = 0; i < cnt; i++) {
+		ymm0 = _mm256_loadu_si256(s);
+		ymm1 = _mm256_loadu_si256(s + 1);
+		ymm2 = _mm256_loadu_si256(s + 2);
+		ymm3 = _mm256_loadu_si256(s + 3);
+		ymm4 = _mm256_loadu_si256(s + 4);
+		ymm5 = _mm256_loadu_si256(s + 5);
+		ymm6 = _mm256_loadu_si256(s + 6);
+		ymm7 = _mm256_loadu_si256(s + 7);
+		s += 8;
+		_mm256_stream_si256(d, ymm0);
+		_mm256_stream_si256(d + 1, ymm1);
+		_mm256_stream_si256(d + 2, ymm2);
+		_mm256_stream_si256(d + 3, ymm3);
+		_mm256_stream_si256(d + 4, ymm4);
+		_mm256_stream_si256(d + 5, ymm5);
+		_mm256_stream_si256(d + 6, ymm6);
+		_mm256_stream_si256(d + 7, ymm7);
+		VALGRIND_DO_FLUSH(d, 8 * sizeof(*d));
+		d += 8;
+	}
+
+	/* copy the tail (<256 bytes) in 32 bytes chunks */
+	len &= AVX_CHUNK_MASK;
+	cnt = len >> AVX_SHIFT;
+	for (i = 0; i < cnt; i++) {
+		ymm0 = _mm256_loadu_si256(s);
+		_mm256_stream_si256(d, ymm0);
+		VALGRIND_DO_FLUSH(d, sizeof(*d));
+		s++;
+		d++;
+	}
+
+	/* copy the last 16 bytes, if any */
+	if (len & AVX_MASK) {
+		__m128i xmm0 = _mm_loadu_si128((__m128i *)s);
+		_mm_stream_si128((__m128i *)d, xmm0);
+		VALGRIND_DO_FLUSH(d, sizeof(xmm0));
+	}
+}
+
+/*
+ * memmove_movnt_avx_bw -- copy a multiple of 16 bytes in backward direction,
+ * using 32-byte non-temporal stores
+ *
+ * The dest and src arguments point to the end of the ranges.
+ */
+void
+memmove_movnt_avx_bw(char *dest, const char *src, size_t len)
+{
+	__m256i ymm0, ymm1, ymm2, ymm3, ymm4, ymm5, ymm6, ymm7;
+	size_t i;
+	__m256i *d = (__m256i *)dest;
+	__m256i *s = (__m256i *)src;
+	size_t cnt;
+
+	cnt = len >> AVX_CHUNK_SHIFT;
+	for (i = 0; i < cnt; i++) {
+		ymm0 = _mm256_loadu_si256(s - 1);
+		ymm1 = _mm256_loadu_si256(s - 2);
+		ymm2 = _mm256_loadu_si256(s - 3);
+		ymm3 = _mm256_loadu_si256(s - 4);
+		ymm4 = _mm256_loadu_si256(s - 5);
+		ymm5 = _mm256_loadu_si256(s - 6);
+		ymm6 = _mm256_loadu_si256(s - 7);
+		ymm7 = _mm256_loadu_si256(s - 8);
+		s -= 8;
+		_mm256_stream_si256(d - 1, ymm0);
+		_mm256_stream_si256(d - 2, ymm1);
+		_mm256_stream_si256(d - 3, ymm2);
+		_mm256_stream_si256(d - 4, ymm3);
+		_mm256_stream_si256(d - 5, ymm4);
+		_mm256_stream_si256(d - 6, ymm5);
+		_mm256_stream_si256(d - 7, ymm6);
+		_mm256_stream_si256(d - 8, ymm7);
+		d -= 8;
+		VALGRIND_DO_FLUSH(d, 8 * sizeof(*d));
+	}
+
+	/* copy the tail (<256 bytes) in 32 bytes chunks */
+	len &= AVX_CHUNK_MASK;
+	cnt = len >> AVX_SHIFT;
+	for (i = 0; i < cnt; i++) {
+		d--;
+		s--;
+		ymm0 = _mm256_loadu_si256(s);
+		_mm256_stream_si256(d, ymm0);
+		VALGRIND_DO_FLUSH(d, sizeof(*d));
+	}
+
+	/* copy the last 16 bytes, if any */
+	if (len & AVX_MASK) {
+		__m128i *d16 = (__m128i *)d - 1;
+		__m128i xmm0 = _mm_loadu_si128((__m128i *)s - 1);
+		_mm_stream_si128(d16, xmm0);
+		VALGRIND_DO_FLUSH(d16, sizeof(*d16));
+	}
+}
+
+/*
+ * memset_movnt_avx -- memset a multiple of 16 bytes, using 32-byte
+ * non-temporal stores
+ */
+void
+memset_movnt_avx(char *dest, int c, size_t len)
+{
+	size_t i;
+	__m256i ymm0 = _mm256_set1_epi8((char)c);
+	__m256i *d = (__m256i *)dest;
+	size_t cnt;
+
+	cnt = len >> AVX_CHUNK_SHIFT;
+	for (i = 0; i < cnt; i++) {
+		_mm256_stream_si256(d, ymm0);
+		_mm256_stream_si256(d + 1, ymm0);
+		_mm256_stream_si256(d + 2, ymm0);
+		_mm256_stream_si256(d + 3, ymm0);
+		_mm256_stream_si256(d + 4, ymm0);
+		_mm256_stream_si256(d + 5, ymm0);
+		_mm256_stream_si256(d + 6, ymm0);
+		_mm256_stream_si256(d + 7, ymm0);
+		VALGRIND_DO_FLUSH(d, 8 * sizeof(*d));
+		d += 8;
+	}
+
+	/* memset the tail (<256 bytes) in 32 bytes chunks */
+	len &= AVX_CHUNK_MASK;
+	cnt = len >> AVX_SHIFT;
+	for (i = 0; i < cnt; i++) {
+		_mm256_stream_si256(d, ymm0);
+		VALGRIND_DO_FLUSH(d, sizeof(*d));
+		d++;
+	}
+
+	/* memset the last 16 bytes, if any */
+	if (len & AVX_MASK) {
+		_mm_stream_si128((__m128i *)d, _mm256_castsi256_si128(ymm0));
+		VALGRIND_DO_FLUSH(d, sizeof(__m128i));
+	}
+}
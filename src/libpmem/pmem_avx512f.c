@@ -0,0 +1,244 @@
+/*
+ * Copyright 2016, Intel Corporation
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in
+ *       the documentation and/or other materials provided with the
+ *       distribution.
+ *
+ *     * Neither the name of the copyright holder nor the names of its
+ *       contributors may be used to endorse or promote products derived
+ *       from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * pmem_avx512f.c -- 64-byte non-temporal store kernels for libpmem
+ *
+ * This file has to be compiled with AVX-512F enabled, and the functions
+ * defined here can be called only after pmem_init() confirmed the CPU and
+ * the OS support it.
+ */
+
+#include <immintrin.h>
+#include <stddef.h>
+
+#include "pmem.h"
+#include "valgrind_internal.h"
+
+#define AVX512_SIZE		64
+#define AVX512_MASK		(AVX512_SIZE - 1)
+#define AVX512_SHIFT		6
+
+#define AVX512_CHUNK_SIZE	512 /* 64*8 */
+#define AVX512_CHUNK_MASK	(AVX512_CHUNK_SIZE - 1)
+#define AVX512_CHUNK_SHIFT	9
+
+#define AVX_SIZE		32
+
+#define SSE_SIZE		16
+
+/*
+ * memmove_movnt_avx512f_fw -- copy a multiple of 16 bytes in forward
+ * direction, using 64-byte non-temporal stores
+ */
+void
+memmove_movnt_avx512f_fw(char *dest, const char *src, size_t len)
+{
+	__m512i zmm0, zmm1, zmm2, zmm3, zmm4, zmm5, zmm6, zmm7;
+	size_t i;
+	__m512i *d = (__m512i *)dest;
+	__m512i *s = (__m512i *)src;
+	size_t cnt;
+
+	cnt = len >> AVX512_CHUNK_SHIFT;
+	for (i = 0; i < cnt; i++) {
+		zmm0 = _mm512_loadu_si512(s);
+		zmm1 = _mm512_loadu_si512(s + 1);
+		zmm2 = _mm512_loadu_si512(s + 2);
+		zmm3 = _mm512_loadu_si512(s + 3);
+		zmm4 = _mm512_loadu_si512(s + 4);
+		zmm5 = _mm512_loadu_si512(s + 5);
+		zmm6 = _mm512_loadu_si512(s + 6);
+		zmm7 = _mm512_loadu_si512(s + 7);
+		s += 8;
+		_mm512_stream_si512(d, zmm0);
+		_mm512_stream_si512(d + 1, zmm1);
+		_mm512_stream_si512(d + 2, zmm2);
+		_mm512_stream_si512(d + 3, zmm3);
+		_mm512_stream_si512(d + 4, zmm4);
+		_mm512_stream_si512(d + 5, zmm5);
+		_mm512_stream_si512(d + 6, zmm6);
+		_mm512_stream_si512(d + 7, zmm7);
+		VALGRIND_DO_FLUSH(d, 8 * sizeof(*d));
+		d += 8;
+	}
+
+	/* copy the tail (<512 bytes) in 64 bytes chunks */
+	len &= AVX512_CHUNK_MASK;
+	cnt = len >> AVX512_SHIFT;
+	for (i = 0; i < cnt; i++) {
+		zmm0 = _mm512_loadu_si512(s);
+		_mm512_stream_si512(d, zmm0);
+		VALGRIND_DO_FLUSH(d, sizeof(*d));
+		s++;
+		d++;
+	}
+
+	/* copy the last (<64) bytes in 32 and 16 bytes chunks */
+	len &= AVX512_MASK;
+	char *d8 = (char *)d;
+	const char *s8 = (const char *)s;
+	if (len & AVX_SIZE) {
+		__m256i ymm0 = _mm256_loadu_si256((__m256i *)s8);
+		_mm256_stream_si256((__m256i *)d8, ymm0);
+		VALGRIND_DO_FLUSH(d8, AVX_SIZE);
+		d8 += AVX_SIZE;
+		s8 += AVX_SIZE;
+	}
+
+	if (len & SSE_SIZE) {
+		__m128i xmm0 = _mm_loadu_si128((__m128i *)s8);
+		_mm_stream_si128((__m128i *)d8, xmm0);
+		VALGRIND_DO_FLUSH(d8, SSE_SIZE);
+	}
+}
+
+/*
+ * memmove_movnt_avx512f_bw -- copy a multiple of 16 bytes in backward
+ * direction, using 64-byte non-temporal stores
+ *
+ * The dest and src arguments point to the end of the ranges.
+ */
+void
+memmove_movnt_avx512f_bw(char *dest, const char *src, size_t len)
+{
+	__m512i zmm0, zmm1, zmm2, zmm3, zmm4, zmm5, zmm6, zmm7;
+	size_t i;
+	__m512i *d = (__m512i *)dest;
+	__m512i *s = (__m512i *)src;
+	size_t cnt;
+
+	cnt = len >> AVX512_CHUNK_SHIFT;
+	for (i = 0; i < cnt; i++) {
+		zmm0 = _mm512_loadu_si512(s - 1);
+		zmm1 = _mm512_loadu_si512(s - 2);
+		zmm2 = _mm512_loadu_si512(s - 3);
+		zmm3 = _mm512_loadu_si512(s - 4);
+		zmm4 = _mm512_loadu_si512(s - 5);
+		zmm5 = _mm512_loadu_si512(s - 6);
+		zmm6 = _mm512_loadu_si512(s - 7);
+		zmm7 = _mm512_loadu_si512(s - 8);
+		s -= 8;
+		_mm512_stream_si512(d - 1, zmm0);
+		_mm512_stream_si512(d - 2, zmm1);
+		_mm512_stream_si512(d - 3, zmm2);
+		_mm512_stream_si512(d - 4, zmm3);
+		_mm512_stream_si512(d - 5, zmm4);
+		_mm512_stream_si512(d - 6, zmm5);
+		_mm512_stream_si512(d - 7, zmm6);
+		_mm512_stream_si512(d - 8, zmm7);
+		d -= 8;
+		VALGRIND_DO_FLUSH(d, 8 * sizeof(*d));
+	}
+
+	/* copy the tail (<512 bytes) in 64 bytes chunks */
+	len &= AVX512_CHUNK_MASK;
+	cnt = len >> AVX512_SHIFT;
+	for (i = 0; i < cnt; i++) {
+		d--;
+		s--;
+		zmm0 = _mm512_loadu_si512(s);
+		_mm512_stream_si512(d, zmm0);
+		VALGRIND_DO_FLUSH(d, sizeof(*d));
+	}
+
+	/* copy the last (<64) bytes in 32 and 16 bytes chunks */
+	len &= AVX512_MASK;
+	char *d8 = (char *)d;
+	const char *s8 = (const char *)s;
+	if (len & AVX_SIZE) {
+		d8 -= AVX_SIZE;
+		s8 -= AVX_SIZE;
+		__m256i ymm0 = _mm256_loadu_si256((__m256i *)s8);
+		_mm256_stream_si256((__m256i *)d8, ymm0);
+		VALGRIND_DO_FLUSH(d8, AVX_SIZE);
+	}
+
+	if (len & SSE_SIZE) {
+		d8 -= SSE_SIZE;
+		s8 -= SSE_SIZE;
+		__m128i xmm0 = _mm_loadu_si128((__m128i *)s8);
+		_mm_stream_si128((__m128i *)d8, xmm0);
+		VALGRIND_DO_FLUSH(d8, SSE_SIZE);
+	}
+}
+
+/*
+ * memset_movnt_avx512f -- memset a multiple of 16 bytes, using 64-byte
+ * non-temporal stores
+ */
+void
+memset_movnt_avx512f(char *dest, int c, size_t len)
+{
+	size_t i;
+	__m512i zmm0 = _mm512_set1_epi8((char)c);
+	__m512i *d = (__m512i *)dest;
+	size_t cnt;
+
+	cnt = len >> AVX512_CHUNK_SHIFT;
+	for (i = 0; i < cnt; i++) {
+		_mm512_stream_si512(d, zmm0);
+		_mm512_stream_si512(d + 1, zmm0);
+		_mm512_stream_si512(d + 2, zmm0);
+		_mm512_stream_si512(d + 3, zmm0);
+		_mm512_stream_si512(d + 4, zmm0);
+		_mm512_stream_si512(d + 5, zmm0);
+		_mm512_stream_si512(d + 6, zmm0);
+		_mm512_stream_si512(d + 7, zmm0);
+		VALGRIND_DO_FLUSH(d, 8 * sizeof(*d));
+		d += 8;
+	}
+
+	/* memset the tail (<512 bytes) in 64 bytes chunks */
+	len &= AVX512_CHUNK_MASK;
+	cnt = len >> AVX512_SHIFT;
+	for (i = 0; i < cnt; i++) {
+		_mm512_stream_si512(d, zmm0);
+		VALGRIND_DO_FLUSH(d, sizeof(*d));
+		d++;
+	}
+
+	/* memset the last (<64) bytes in 32 and 16 bytes chunks */
+	len &= AVX512_MASK;
+	char *d8 = (char *)d;
+	if (len & AVX_SIZE) {
+		_mm256_stream_si256((__m256i *)d8,
+			_mm512_castsi512_si256(zmm0));
+		VALGRIND_DO_FLUSH(d8, AVX_SIZE);
+		d8 += AVX_SIZE;
+	}
+
+	if (len & SSE_SIZE) {
+		_mm_stream_si128((__m128i *)d8, _mm512_castsi512_si128(zmm0));
+		VALGRIND_DO_FLUSH(d8, SSE_SIZE);
+	}
+}
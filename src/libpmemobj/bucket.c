@@ -42,6 +42,8 @@
  * creation.
  */
 
+#include <string.h>
+
 #include "bucket.h"
 #include "ctree.h"
 #include "heap.h"
@@ -73,6 +75,54 @@ struct block_container_ctree {
 	struct ctree *tree;
 };
 
+/*
+ * Each power of two of the block sizes is divided into this many size classes
+ * of the segregated lists container.
+ */
+#define SEG_SL_BITS 3
+#define SEG_SL_COUNT (1U << SEG_SL_BITS)
+
+/*
+ * The number of size classes, enough to cover sizes up to 2^17 chunks, which
+ * is more than the size of a zone.
+ */
+#define SEG_NCLASSES 128
+#define SEG_CLASS_WORDS (SEG_NCLASSES / 64)
+
+/*
+ * The nodes of the segregated lists are stored in per-zone arrays, which are
+ * found through a two-level directory indexed by the zone id.
+ */
+#define SEG_DIR_ZONES 256
+#define SEG_NDIRS ((UINT16_MAX + 1) / SEG_DIR_ZONES)
+
+#define SEG_NODE_NONE UINT32_MAX
+#define SEG_NODE_ID(_z, _c) ((uint32_t)(_z) << 16 | (uint32_t)(_c))
+#define SEG_NODE_ID_ZONE(_id) ((_id) >> 16)
+#define SEG_NODE_ID_CHUNK(_id) ((_id) & UINT16_MAX)
+
+struct seg_node {
+	uint32_t size_idx; /* 0 if the chunk isn't in the container */
+	uint32_t prev;
+	uint32_t next;
+};
+
+struct seg_class {
+	pthread_mutex_t lock;
+	uint32_t head;
+};
+
+struct block_container_seglists {
+	struct block_container super;
+
+	/* bitmap of the size classes with non-empty lists */
+	uint64_t nonempty[SEG_CLASS_WORDS];
+
+	struct seg_class classes[SEG_NCLASSES];
+
+	struct seg_node **dirs[SEG_NDIRS];
+};
+
 #ifdef USE_VG_MEMCHECK
 /*
  * bucket_vg_mark_noaccess -- (internal) marks memory block as no access for vg
@@ -244,6 +294,399 @@ bucket_tree_delete(struct block_container *bc)
 	Free(bc);
 }
 
+/*
+ * seg_class_of -- (internal) returns the size class of the given block size
+ */
+static unsigned
+seg_class_of(uint32_t size_idx)
+{
+	if (size_idx < SEG_SL_COUNT)
+		return size_idx;
+
+	unsigned fl = 63 - (unsigned)__builtin_clzll(size_idx);
+	unsigned sl = (size_idx >> (fl - SEG_SL_BITS)) & (SEG_SL_COUNT - 1);
+
+	return (fl - SEG_SL_BITS + 1) * SEG_SL_COUNT + sl;
+}
+
+/*
+ * seg_search_class -- (internal) returns the lowest size class in which all
+ *	of the blocks are at least as large as the given size
+ */
+static unsigned
+seg_search_class(uint32_t size_idx)
+{
+	if (size_idx >= SEG_SL_COUNT) {
+		unsigned fl = 63 - (unsigned)__builtin_clzll(size_idx);
+		size_idx += (1U << (fl - SEG_SL_BITS)) - 1;
+	}
+
+	return seg_class_of(size_idx);
+}
+
+/*
+ * seg_class_mark -- (internal) sets or clears the non-empty bit of a class
+ */
+static void
+seg_class_mark(struct block_container_seglists *c, unsigned cls, int nonempty)
+{
+	uint64_t *w = &c->nonempty[cls / 64];
+	uint64_t bit = 1ULL << (cls % 64);
+	uint64_t v;
+	uint64_t nv;
+
+	do {
+		v = *w;
+		nv = nonempty ? (v | bit) : (v & ~bit);
+	} while (!util_bool_compare_and_swap64(w, v, nv));
+}
+
+/*
+ * seg_find_class -- (internal) returns the first size class, starting from
+ *	the given one, which has free blocks or SEG_NCLASSES if there's none
+ *
+ * The bitmap is read without any locks, so the result is only a hint that has
+ * to be verified under the class lock.
+ */
+static unsigned
+seg_find_class(struct block_container_seglists *c, unsigned cls)
+{
+	for (unsigned i = cls / 64; i < SEG_CLASS_WORDS; ++i) {
+		uint64_t v = c->nonempty[i];
+		if (i == cls / 64)
+			v &= UINT64_MAX << (cls % 64);
+
+		if (v != 0)
+			return i * 64 + (unsigned)__builtin_ctzll(v);
+	}
+
+	return SEG_NCLASSES;
+}
+
+/*
+ * seg_get_node -- (internal) returns the node of the chunk, allocates the
+ *	zone's array of nodes if requested
+ */
+static struct seg_node *
+seg_get_node(struct block_container_seglists *c, uint32_t zone_id,
+	uint32_t chunk_id, int create)
+{
+	ASSERT(zone_id <= UINT16_MAX);
+	ASSERT(chunk_id < MAX_CHUNK);
+
+	struct seg_node ***dirp = &c->dirs[zone_id / SEG_DIR_ZONES];
+	if (*dirp == NULL) {
+		if (!create)
+			return NULL;
+
+		struct seg_node **dir =
+			Zalloc(sizeof(struct seg_node *) * SEG_DIR_ZONES);
+		if (dir == NULL)
+			return NULL;
+
+		if (!util_bool_compare_and_swap64(dirp, NULL, dir))
+			Free(dir);
+	}
+
+	struct seg_node **nodesp = &(*dirp)[zone_id % SEG_DIR_ZONES];
+	if (*nodesp == NULL) {
+		if (!create)
+			return NULL;
+
+		/* the zeroed pages of large allocations are mapped lazily */
+		struct seg_node *nodes =
+			Zalloc(sizeof(struct seg_node) * MAX_CHUNK);
+		if (nodes == NULL)
+			return NULL;
+
+		if (!util_bool_compare_and_swap64(nodesp, NULL, nodes))
+			Free(nodes);
+	}
+
+	return &(*nodesp)[chunk_id];
+}
+
+/*
+ * seg_node_by_id -- (internal) returns the node of a chunk in the container
+ */
+static struct seg_node *
+seg_node_by_id(struct block_container_seglists *c, uint32_t id)
+{
+	struct seg_node *n = seg_get_node(c, SEG_NODE_ID_ZONE(id),
+		SEG_NODE_ID_CHUNK(id), 0);
+	ASSERTne(n, NULL);
+
+	return n;
+}
+
+/*
+ * seg_unlink -- (internal) removes the node from the list of its size class,
+ *	must be called with the class lock held
+ */
+static void
+seg_unlink(struct block_container_seglists *c, unsigned cls,
+	struct seg_node *n)
+{
+	struct seg_class *sc = &c->classes[cls];
+
+	if (n->prev != SEG_NODE_NONE)
+		seg_node_by_id(c, n->prev)->next = n->next;
+	else
+		sc->head = n->next;
+
+	if (n->next != SEG_NODE_NONE)
+		seg_node_by_id(c, n->next)->prev = n->prev;
+
+	n->size_idx = 0;
+
+	if (sc->head == SEG_NODE_NONE)
+		seg_class_mark(c, cls, 0);
+}
+
+/*
+ * bucket_seglists_insert_block -- (internal) inserts a new memory block
+ *	into the container
+ */
+static int
+bucket_seglists_insert_block(struct block_container *bc,
+	struct palloc_heap *heap, struct memory_block m)
+{
+	ASSERT(m.chunk_id < MAX_CHUNK);
+	ASSERT(m.zone_id < UINT16_MAX);
+	ASSERTeq(m.block_off, 0);
+	ASSERTne(m.size_idx, 0);
+
+	struct block_container_seglists *c =
+		(struct block_container_seglists *)bc;
+
+#ifdef USE_VG_MEMCHECK
+	bucket_vg_mark_noaccess(heap, bc, m);
+#endif
+
+	struct seg_node *n = seg_get_node(c, m.zone_id, m.chunk_id, 1);
+	if (n == NULL)
+		return ENOMEM;
+
+	unsigned cls = seg_class_of(m.size_idx);
+	struct seg_class *sc = &c->classes[cls];
+	uint32_t id = SEG_NODE_ID(m.zone_id, m.chunk_id);
+
+	util_mutex_lock(&sc->lock);
+	ASSERTeq(n->size_idx, 0);
+
+	n->size_idx = m.size_idx;
+	n->prev = SEG_NODE_NONE;
+	n->next = sc->head;
+	if (sc->head != SEG_NODE_NONE)
+		seg_node_by_id(c, sc->head)->prev = id;
+	else
+		seg_class_mark(c, cls, 1);
+	sc->head = id;
+
+	util_mutex_unlock(&sc->lock);
+
+	return 0;
+}
+
+/*
+ * bucket_seglists_get_rm_block_bestfit -- (internal) removes and returns
+ *	a memory block which is at least as large as the requested size
+ *
+ * The first block from the lowest non-empty size class that only holds large
+ * enough blocks is taken. Only if there's none, the size class of the
+ * requested size is searched for a fitting block.
+ */
+static int
+bucket_seglists_get_rm_block_bestfit(struct block_container *bc,
+	struct memory_block *m)
+{
+	struct block_container_seglists *c =
+		(struct block_container_seglists *)bc;
+
+	for (unsigned cls = seg_find_class(c, seg_search_class(m->size_idx));
+		cls < SEG_NCLASSES; cls = seg_find_class(c, cls + 1)) {
+		struct seg_class *sc = &c->classes[cls];
+
+		util_mutex_lock(&sc->lock);
+		uint32_t id = sc->head;
+		if (id == SEG_NODE_NONE) {
+			/* the list was emptied since the bitmap was read */
+			util_mutex_unlock(&sc->lock);
+			continue;
+		}
+
+		struct seg_node *n = seg_node_by_id(c, id);
+		ASSERT(n->size_idx >= m->size_idx);
+		m->size_idx = n->size_idx;
+		seg_unlink(c, cls, n);
+		util_mutex_unlock(&sc->lock);
+
+		m->zone_id = SEG_NODE_ID_ZONE(id);
+		m->chunk_id = SEG_NODE_ID_CHUNK(id);
+		m->block_off = 0;
+
+		return 0;
+	}
+
+	unsigned cls = seg_class_of(m->size_idx);
+	struct seg_class *sc = &c->classes[cls];
+	int ret = ENOMEM;
+
+	util_mutex_lock(&sc->lock);
+	for (uint32_t id = sc->head; id != SEG_NODE_NONE; ) {
+		struct seg_node *n = seg_node_by_id(c, id);
+		if (n->size_idx >= m->size_idx) {
+			m->size_idx = n->size_idx;
+			m->zone_id = SEG_NODE_ID_ZONE(id);
+			m->chunk_id = SEG_NODE_ID_CHUNK(id);
+			m->block_off = 0;
+			seg_unlink(c, cls, n);
+			ret = 0;
+			break;
+		}
+		id = n->next;
+	}
+	util_mutex_unlock(&sc->lock);
+
+	return ret;
+}
+
+/*
+ * bucket_seglists_find_exact -- (internal) finds exact match memory block,
+ *	removes it from the container if requested
+ *
+ * Only the lock of the size class of the block is taken. A concurrent insert
+ * of the same chunk with a different size can't satisfy the size check.
+ */
+static int
+bucket_seglists_find_exact(struct block_container_seglists *c,
+	struct memory_block m, int remove)
+{
+	/* the block might have been read from a concurrently modified header */
+	if (m.block_off != 0 || m.chunk_id >= MAX_CHUNK ||
+		m.zone_id > UINT16_MAX)
+		return ENOMEM;
+
+	struct seg_node *n = seg_get_node(c, m.zone_id, m.chunk_id, 0);
+	if (n == NULL)
+		return ENOMEM;
+
+	unsigned cls = seg_class_of(m.size_idx);
+	struct seg_class *sc = &c->classes[cls];
+	int ret = ENOMEM;
+
+	util_mutex_lock(&sc->lock);
+	if (n->size_idx == m.size_idx) {
+		if (remove)
+			seg_unlink(c, cls, n);
+		ret = 0;
+	}
+	util_mutex_unlock(&sc->lock);
+
+	return ret;
+}
+
+/*
+ * bucket_seglists_get_rm_block_exact -- (internal) removes exact match memory
+ *	block
+ */
+static int
+bucket_seglists_get_rm_block_exact(struct block_container *bc,
+	struct memory_block m)
+{
+	return bucket_seglists_find_exact(
+		(struct block_container_seglists *)bc, m, 1);
+}
+
+/*
+ * bucket_seglists_get_block_exact -- (internal) finds exact match memory block
+ */
+static int
+bucket_seglists_get_block_exact(struct block_container *bc,
+	struct memory_block m)
+{
+	return bucket_seglists_find_exact(
+		(struct block_container_seglists *)bc, m, 0);
+}
+
+/*
+ * bucket_seglists_is_empty -- (internal) checks whether the bucket is empty
+ */
+static int
+bucket_seglists_is_empty(struct block_container *bc)
+{
+	struct block_container_seglists *c =
+		(struct block_container_seglists *)bc;
+
+	return seg_find_class(c, 0) == SEG_NCLASSES;
+}
+
+/*
+ * Segregated lists container used to provide good-fit functionality to the
+ * huge bucket. The blocks are kept in per size class lists, each protected by
+ * its own lock, and the lowest non-empty class is found with a bitmap scan, so
+ * all of the operations are O(1) apart from the fallback search of the
+ * requested size's own class.
+ *
+ * Unlike the tree container, the blocks aren't returned in address order and
+ * only blocks with zero block offset are supported.
+ */
+static struct block_container_ops container_seglists_ops = {
+	.insert = bucket_seglists_insert_block,
+	.get_rm_exact = bucket_seglists_get_rm_block_exact,
+	.get_rm_bestfit = bucket_seglists_get_rm_block_bestfit,
+	.get_exact = bucket_seglists_get_block_exact,
+	.is_empty = bucket_seglists_is_empty
+};
+
+/*
+ * bucket_seglists_create -- (internal) creates a new segregated lists
+ *	container
+ */
+static struct block_container *
+bucket_seglists_create(size_t unit_size)
+{
+	struct block_container_seglists *bc = Malloc(sizeof(*bc));
+	if (bc == NULL)
+		return NULL;
+
+	memset(bc, 0, sizeof(*bc));
+	bc->super.type = CONTAINER_SEGLISTS;
+	bc->super.unit_size = unit_size;
+
+	for (unsigned i = 0; i < SEG_NCLASSES; ++i) {
+		util_mutex_init(&bc->classes[i].lock, NULL);
+		bc->classes[i].head = SEG_NODE_NONE;
+	}
+
+	return &bc->super;
+}
+
+/*
+ * bucket_seglists_delete -- (internal) deletes a segregated lists container
+ */
+static void
+bucket_seglists_delete(struct block_container *bc)
+{
+	struct block_container_seglists *c =
+		(struct block_container_seglists *)bc;
+
+	for (unsigned i = 0; i < SEG_NCLASSES; ++i)
+		util_mutex_destroy(&c->classes[i].lock);
+
+	for (unsigned i = 0; i < SEG_NDIRS; ++i) {
+		if (c->dirs[i] == NULL)
+			continue;
+
+		for (unsigned j = 0; j < SEG_DIR_ZONES; ++j)
+			Free(c->dirs[i][j]);
+
+		Free(c->dirs[i]);
+	}
+
+	Free(bc);
+}
+
 static struct {
 	struct block_container_ops *ops;
 	struct block_container *(*create)(size_t unit_size);
@@ -251,6 +694,8 @@ static struct {
 } block_containers[MAX_CONTAINER_TYPE] = {
 	{NULL, NULL, NULL},
 	{&container_ctree_ops, bucket_tree_create, bucket_tree_delete},
+	{&container_seglists_ops, bucket_seglists_create,
+		bucket_seglists_delete},
 };
 
 /*
@@ -315,20 +760,43 @@ bucket_huge_new(uint8_t id, enum block_container_type ctype,
 }
 
 /*
- * bucket_run_new -- creates a run bucket
- *
- * This type of bucket is responsible for holding memory blocks from runs, which
- * means that each object it contains has a representation in a bitmap.
- *
- * The run buckets also contain the detailed information about the bitmap
- * all of the memory blocks contained within this container must be
- * represented by. This is not to say that a single bucket contains objects
- * only from a single chunk/bitmap - a bucket contains objects from a single
- * TYPE of bitmap run.
+ * bucket_run_calc_bitmap -- (internal) calculates the bitmap definition of runs
+ *	with the given number of blocks
  */
-struct bucket_run *
-bucket_run_new(uint8_t id, enum block_container_type ctype,
-	size_t unit_size, unsigned unit_max, unsigned unit_max_alloc)
+static void
+bucket_run_calc_bitmap(struct bucket_run *b, size_t nallocs)
+{
+	ASSERT(nallocs <= UINT32_MAX);
+	b->bitmap_nallocs = (unsigned)nallocs;
+
+	/*
+	 * The two other numbers that define our bitmap is the size of the
+	 * array that represents the bitmap and the last value of that array
+	 * with the bits that exceed number of blocks marked as set (1).
+	 */
+	ASSERT(b->bitmap_nallocs <= RUN_BITMAP_SIZE);
+	unsigned unused_bits = RUN_BITMAP_SIZE - b->bitmap_nallocs;
+
+	unsigned unused_values = unused_bits / BITS_PER_VALUE;
+
+	ASSERT(MAX_BITMAP_VALUES >= unused_values);
+	b->bitmap_nval = MAX_BITMAP_VALUES - unused_values;
+
+	ASSERT(unused_bits >= unused_values * BITS_PER_VALUE);
+	unused_bits -= unused_values * BITS_PER_VALUE;
+
+	b->bitmap_lastval = unused_bits ?
+		(((1ULL << unused_bits) - 1ULL) <<
+			(BITS_PER_VALUE - unused_bits)) : 0;
+}
+
+/*
+ * bucket_run_create -- (internal) allocates and initializes a run bucket
+ */
+static struct bucket_run *
+bucket_run_create(uint8_t id, enum block_container_type ctype,
+	size_t unit_size, unsigned unit_max, unsigned unit_max_alloc,
+	size_t nallocs)
 {
 	struct bucket_run *b = Malloc(sizeof(*b));
 	if (b == NULL)
@@ -342,35 +810,57 @@ bucket_run_new(uint8_t id, enum block_container_type ctype,
 	b->super.type = BUCKET_RUN;
 	b->unit_max = unit_max;
 	b->unit_max_alloc = unit_max_alloc;
+	b->headerless = 0;
+	b->type_num = 0;
+
+	bucket_run_calc_bitmap(b, nallocs);
 
+	return b;
+}
+
+/*
+ * bucket_run_new -- creates a run bucket
+ *
+ * This type of bucket is responsible for holding memory blocks from runs, which
+ * means that each object it contains has a representation in a bitmap.
+ *
+ * The run buckets also contain the detailed information about the bitmap
+ * all of the memory blocks contained within this container must be
+ * represented by. This is not to say that a single bucket contains objects
+ * only from a single chunk/bitmap - a bucket contains objects from a single
+ * TYPE of bitmap run.
+ */
+struct bucket_run *
+bucket_run_new(uint8_t id, enum block_container_type ctype,
+	size_t unit_size, unsigned unit_max, unsigned unit_max_alloc)
+{
 	/*
 	 * Here the bitmap definition is calculated based on the size of the
 	 * available memory and the size of a memory block - the result of
 	 * dividing those two numbers is the number of possible allocations from
 	 * that block, and in other words, the amount of bits in the bitmap.
 	 */
-	ASSERT(RUN_NALLOCS(unit_size) <= UINT32_MAX);
-	b->bitmap_nallocs = (unsigned)(RUN_NALLOCS(unit_size));
-
-	/*
-	 * The two other numbers that define our bitmap is the size of the
-	 * array that represents the bitmap and the last value of that array
-	 * with the bits that exceed number of blocks marked as set (1).
-	 */
-	ASSERT(b->bitmap_nallocs <= RUN_BITMAP_SIZE);
-	unsigned unused_bits = RUN_BITMAP_SIZE - b->bitmap_nallocs;
-
-	unsigned unused_values = unused_bits / BITS_PER_VALUE;
-
-	ASSERT(MAX_BITMAP_VALUES >= unused_values);
-	b->bitmap_nval = MAX_BITMAP_VALUES - unused_values;
+	return bucket_run_create(id, ctype, unit_size, unit_max,
+		unit_max_alloc, RUN_NALLOCS(unit_size));
+}
 
-	ASSERT(unused_bits >= unused_values * BITS_PER_VALUE);
-	unused_bits -= unused_values * BITS_PER_VALUE;
+/*
+ * bucket_run_headerless_new -- creates a run bucket for header-less blocks
+ *
+ * Without the allocation header there's no way of telling the size of a memory
+ * block, so all of the blocks are exactly one unit and are never coalesced.
+ */
+struct bucket_run *
+bucket_run_headerless_new(uint8_t id, enum block_container_type ctype,
+	size_t unit_size, uint64_t type_num)
+{
+	struct bucket_run *b = bucket_run_create(id, ctype, unit_size, 1, 1,
+		RUN_HEADERLESS_NALLOCS(unit_size));
+	if (b == NULL)
+		return NULL;
 
-	b->bitmap_lastval = unused_bits ?
-		(((1ULL << unused_bits) - 1ULL) <<
-			(BITS_PER_VALUE - unused_bits)) : 0;
+	b->headerless = 1;
+	b->type_num = type_num;
 
 	return b;
 }
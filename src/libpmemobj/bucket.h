@@ -46,12 +46,22 @@
 #define RUN_NALLOCS(_bs)\
 ((RUNSIZE / ((_bs))))
 
+/*
+ * Runs of header-less blocks keep the type number of their objects in the last
+ * 8 bytes of the data and, because their unit size can be very small, are
+ * also limited by the number of bits in the bitmap.
+ */
+#define RUN_HEADERLESS_NALLOCS(_bs)\
+(((RUNSIZE - RUN_TYPE_NUM_SIZE) / (_bs)) < RUN_BITMAP_SIZE ?\
+((RUNSIZE - RUN_TYPE_NUM_SIZE) / (_bs)) : RUN_BITMAP_SIZE)
+
 #define CALC_SIZE_IDX(_unit_size, _size)\
 ((uint32_t)(((_size - 1) / _unit_size) + 1))
 
 enum block_container_type {
 	CONTAINER_UNKNOWN,
 	CONTAINER_CTREE,
+	CONTAINER_SEGLISTS,
 
 	MAX_CONTAINER_TYPE
 };
@@ -137,6 +147,14 @@ struct bucket_run {
 	 * remainder is returned back to the bucket.
 	 */
 	unsigned unit_max_alloc;
+
+	/*
+	 * Whether the memory blocks of this bucket lack the allocation header,
+	 * such buckets only serve single unit blocks of objects that all have
+	 * the same type number.
+	 */
+	int headerless;
+	uint64_t type_num;
 };
 
 struct bucket_huge *bucket_huge_new(uint8_t id, enum block_container_type ctype,
@@ -145,6 +163,9 @@ struct bucket_huge *bucket_huge_new(uint8_t id, enum block_container_type ctype,
 struct bucket_run *bucket_run_new(uint8_t id, enum block_container_type ctype,
 	size_t unit_size, unsigned unit_max, unsigned unit_max_alloc);
 
+struct bucket_run *bucket_run_headerless_new(uint8_t id,
+	enum block_container_type ctype, size_t unit_size, uint64_t type_num);
+
 void bucket_delete(struct bucket *b);
 
 #endif
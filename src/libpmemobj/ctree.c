@@ -270,6 +270,28 @@ ctree_find(struct ctree *t, uint64_t key)
 	return ret;
 }
 
+/*
+ * ctree_update_unlocked -- changes the value of an existing key in the tree
+ */
+int
+ctree_update_unlocked(struct ctree *t, uint64_t key, uint64_t value)
+{
+	struct node_leaf *dst = t->root;
+	struct node *a = NULL;
+
+	while (NODE_IS_INTERNAL(dst)) {
+		a = NODE_INTERNAL_GET(dst);
+		dst = a->slots[BIT_IS_SET(key, a->diff)];
+	}
+
+	if (dst == NULL || dst->key != key)
+		return ENOENT;
+
+	dst->value = value;
+
+	return 0;
+}
+
 /*
  * ctree_find_le_unlocked -- searches for a (less or equal) key in the tree
  */
@@ -53,6 +53,8 @@ uint64_t ctree_find(struct ctree *t, uint64_t key);
 uint64_t ctree_find_unlocked(struct ctree *t, uint64_t key);
 
 uint64_t ctree_find_le(struct ctree *t, uint64_t *key);
+
+int ctree_update_unlocked(struct ctree *t, uint64_t key, uint64_t value);
 uint64_t ctree_find_le_unlocked(struct ctree *t, uint64_t *key);
 
 uint64_t ctree_remove(struct ctree *t, uint64_t key, int eq);
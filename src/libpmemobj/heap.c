@@ -35,6 +35,7 @@
  */
 
 #include <errno.h>
+#include <stdlib.h>
 #include <sys/queue.h>
 #include <unistd.h>
 #include <pthread.h>
@@ -42,6 +43,7 @@
 #include <float.h>
 
 #include "heap.h"
+#include "futex.h"
 #include "out.h"
 #include "util.h"
 #include "sys_util.h"
@@ -56,6 +58,24 @@
 
 #define NCACHES_PER_CPU	2
 
+/*
+ * Maximum number of memory blocks held by a single thread magazine.
+ */
+#define MAGAZINE_SIZE 32
+
+/*
+ * A magazine is never refilled with more than this fraction of the units of
+ * a single run, so that the blocks held by threads which don't allocate from
+ * the given class anymore don't waste too much of the heap.
+ */
+#define MAGAZINE_RUN_FRACTION 8
+
+/*
+ * Sort key of the memory blocks in a magazine, reflects their address order.
+ */
+#define MAGAZINE_BLOCK_KEY(_m) (((uint64_t)(_m).zone_id << 48) |\
+	((uint64_t)(_m).chunk_id << 16) | (_m).block_off)
+
 /*
  * Percentage of memory block units from a single run that can be migrated
  * from a cache bucket to auxiliary bucket in a single drain call.
@@ -105,6 +125,16 @@
  */
 #define FIRST_GENERATED_CLASS_SIZE 2
 
+/*
+ * States of the zones, each zone is claimed by exactly one thread which then
+ * creates its volatile state without holding the populate lock.
+ */
+enum zone_state {
+	ZONE_UNPOPULATED,
+	ZONE_POPULATING,
+	ZONE_POPULATED,
+};
+
 static struct {
 	size_t size;
 	size_t step;
@@ -127,26 +157,100 @@ struct bucket_cache {
 	struct bucket *buckets[MAX_BUCKETS]; /* no default bucket */
 };
 
+/*
+ * Stack of single unit memory blocks reserved from a bucket, owned by
+ * exactly one thread and therefore accessed without any locks.
+ */
+struct heap_magazine {
+	unsigned nblocks;
+	struct memory_block blocks[MAGAZINE_SIZE];
+};
+
+/*
+ * Cache of a single thread for a single heap. It is owned by the thread, which
+ * flushes it back to the buckets when it exits. The cache of a thread which
+ * outlives the heap is only detached from it by heap_cleanup and freed later
+ * by the owner.
+ */
+struct heap_thread_cache {
+	struct palloc_heap *heap; /* NULL once detached from the heap */
+	uint64_t heap_id;
+	void *owner; /* Thread_caches of the owning thread */
+	struct heap_magazine *magazines[MAX_BUCKETS];
+	struct palloc_cache_stats stats;
+	LIST_ENTRY(heap_thread_cache) heap_entry; /* Thread_caches_lock */
+	SLIST_ENTRY(heap_thread_cache) thread_entry; /* only the owner */
+};
+
+SLIST_HEAD(thread_caches, heap_thread_cache);
+
 struct heap_rt {
 	struct bucket *default_bucket;
 	struct bucket *buckets[MAX_BUCKETS];
 	/* runs are lazy-loaded, removed from this list on-demand */
 	SLIST_HEAD(arun, active_run) active_runs[MAX_BUCKETS];
 	pthread_mutex_t active_run_lock;
+	/* serializes the creation of allocation classes at runtime */
+	pthread_mutex_t class_lock;
 	uint8_t *bucket_map;
 	pthread_mutex_t run_locks[MAX_RUN_LOCKS];
 	unsigned max_zone;
-	unsigned zones_exhausted;
+	unsigned zones_exhausted; /* zones below this one are all claimed */
+	uint8_t *zones_populated; /* enum zone_state */
+	unsigned zones_populating;
+	pthread_mutex_t populate_lock;
+	pthread_cond_t populate_cond; /* signaled when a zone is populated */
+	int populate_stop;
+	unsigned nprefetch;
+	pthread_t *prefetch_threads;
 	size_t last_run_max_size;
 
+	/* huge blocks taken out of the container and not yet split */
+	uint32_t huge_splits;
+	/* advanced every time a split is finished, the futex of the waiters */
+	uint32_t huge_split_seq;
+	/* threads waiting for the splits in progress */
+	uint32_t huge_split_waiters;
+
 	struct bucket_cache *caches;
 	unsigned ncaches;
 	uint32_t last_drained[MAX_BUCKETS];
+
+	/* unique identifier of this heap incarnation */
+	uint64_t id;
+	/* the thread caches, protected by Thread_caches_lock */
+	LIST_HEAD(tcaches, heap_thread_cache) thread_caches;
+	/* number of the thread caches being flushed by exiting threads */
+	uint32_t thread_caches_flushing;
+	/* statistics of the thread caches already flushed */
+	struct palloc_cache_stats flushed_stats;
 };
 
 static __thread unsigned Cache_idx = UINT32_MAX;
 static unsigned Next_cache_idx;
 
+/*
+ * The thread cache of the most recently used heap. Heap identifiers are never
+ * reused, so a stale pointer left by a closed heap is never dereferenced.
+ */
+static __thread uint64_t Thread_cache_heap_id;
+static __thread struct heap_thread_cache *Thread_cache;
+static uint64_t Next_heap_id;
+
+/* all the caches of the calling thread, one per heap */
+static __thread struct thread_caches Thread_caches;
+
+/* the key of Thread_caches, its destructor flushes them */
+static pthread_key_t Thread_caches_key;
+static pthread_once_t Thread_caches_once = PTHREAD_ONCE_INIT;
+
+/*
+ * Protects the lists of thread caches of all heaps. It's never held while
+ * taking a bucket or a run lock, so a thread cache can be created by a thread
+ * which holds one.
+ */
+static pthread_mutex_t Thread_caches_lock;
+
 /*
  * bucket_group_init -- (internal) creates new bucket group instance
  */
@@ -224,7 +328,7 @@ heap_chunk_write_footer(struct chunk_header *hdr, uint32_t size_idx)
 	f.type = CHUNK_TYPE_FOOTER;
 	f.size_idx = size_idx;
 	*(hdr + size_idx - 1) = f;
-	/* no need to persist, footers are recreated in heap_populate_buckets */
+	/* no need to persist, footers are recreated in heap_populate_zone */
 	VALGRIND_SET_CLEAN(hdr + size_idx - 1, sizeof(f));
 }
 
@@ -268,6 +372,16 @@ heap_zone_init(struct palloc_heap *heap, uint32_t zone_id)
 	pmemops_persist(&heap->p_ops, &z->header, sizeof(z->header));
 }
 
+/*
+ * heap_run_type_num_ptr -- (internal) returns the location of the type number
+ *	of a header-less run
+ */
+static uint64_t *
+heap_run_type_num_ptr(struct chunk_run *run)
+{
+	return (uint64_t *)&run->data[RUNSIZE - RUN_TYPE_NUM_SIZE];
+}
+
 /*
  * heap_init_run -- (internal) creates a run based on a chunk
  */
@@ -294,12 +408,23 @@ heap_init_run(struct palloc_heap *heap, struct bucket *b,
 	/* clear only the bits available for allocations from this bucket */
 	memset(run->bitmap, 0, sizeof(uint64_t) * (nval - 1));
 	run->bitmap[nval - 1] = r->bitmap_lastval;
+
+	if (r->headerless) {
+		uint64_t *type_num = heap_run_type_num_ptr(run);
+		*type_num = r->type_num;
+		pmemops_persist(&heap->p_ops, type_num, sizeof(*type_num));
+	}
 	VALGRIND_REMOVE_FROM_TX(run, sizeof(*run));
 
 	pmemops_persist(&heap->p_ops, run->bitmap, sizeof(run->bitmap));
 
+	struct chunk_header nhdr = *hdr;
+	nhdr.type = CHUNK_TYPE_RUN;
+	if (r->headerless)
+		nhdr.flags |= CHUNK_FLAG_HEADERLESS;
+
 	VALGRIND_ADD_TO_TX(hdr, sizeof(*hdr));
-	hdr->type = CHUNK_TYPE_RUN;
+	*hdr = nhdr; /* write the entire header (8 bytes) at once */
 	VALGRIND_REMOVE_FROM_TX(hdr, sizeof(*hdr));
 
 	pmemops_persist(&heap->p_ops, hdr, sizeof(*hdr));
@@ -354,12 +479,14 @@ heap_process_run_metadata(struct palloc_heap *heap, struct bucket *b,
 	ASSERTeq(b->type, BUCKET_RUN);
 	struct bucket_run *r = (struct bucket_run *)b;
 
-	ASSERT(RUN_NALLOCS(run->block_size) <= UINT16_MAX);
+	ASSERT(r->bitmap_nallocs <= UINT16_MAX);
 
-	uint16_t run_bits = (uint16_t)(RUNSIZE / run->block_size);
-	ASSERT(run_bits < (MAX_BITMAP_VALUES * BITS_PER_VALUE));
+	/*
+	 * The bits past the last block of the run are always set in the last
+	 * bitmap value, so there's no need to check the run boundary here.
+	 */
+	ASSERT(r->bitmap_nallocs <= RUN_BITMAP_SIZE);
 	uint16_t block_off = 0;
-	uint16_t block_size_idx = 0;
 
 	for (unsigned i = 0; i < r->bitmap_nval; ++i) {
 		uint64_t v = run->bitmap[i];
@@ -373,31 +500,25 @@ heap_process_run_metadata(struct palloc_heap *heap, struct bucket *b,
 			continue;
 		}
 
-		for (unsigned j = 0; j < BITS_PER_VALUE; ++j) {
-			if (BIT_IS_CLR(v, j)) {
-				block_size_idx++;
-			} else if (block_size_idx != 0) {
-				ASSERT(block_off >= block_size_idx);
+		/*
+		 * Find the spans of free blocks (cleared bits) with bit scans
+		 * instead of testing the bits one by one.
+		 */
+		uint64_t free_bits = ~v;
+		while (free_bits != 0) {
+			unsigned start = (unsigned)__builtin_ctzll(free_bits);
+
+			/* the shifted in zeros terminate a span at the end */
+			unsigned len = (unsigned)
+				__builtin_ctzll(~(free_bits >> start));
 
-				heap_run_insert(heap, b, chunk_id, zone_id,
-					block_size_idx,
-					(uint16_t)(block_off - block_size_idx));
-				block_size_idx = 0;
-			}
+			heap_run_insert(heap, b, chunk_id, zone_id, len,
+				(uint16_t)(block_off + start));
 
-			if ((block_off++) == run_bits) {
-				i = MAX_BITMAP_VALUES;
+			if (start + len == BITS_PER_VALUE)
 				break;
-			}
-		}
-
-		if (block_size_idx != 0) {
-			ASSERT(block_off >= block_size_idx);
 
-			heap_run_insert(heap, b, chunk_id, zone_id,
-					block_size_idx,
-					(uint16_t)(block_off - block_size_idx));
-			block_size_idx = 0;
+			free_bits &= UINT64_MAX << (start + len);
 		}
 	}
 }
@@ -462,6 +583,8 @@ heap_reuse_run(struct palloc_heap *heap, struct bucket *b,
 	heap_set_run_bucket(run, b);
 	ASSERTeq(hdr->size_idx, 1);
 	ASSERTeq(b->unit_size, run->block_size);
+	ASSERTeq(((struct bucket_run *)b)->headerless,
+		(hdr->flags & CHUNK_FLAG_HEADERLESS) != 0);
 
 	heap_process_run_metadata(heap, b, run, chunk_id, zone_id);
 }
@@ -472,11 +595,12 @@ heap_reuse_run(struct palloc_heap *heap, struct bucket *b,
 static int
 heap_run_is_empty(struct chunk_run *run)
 {
+	/* no early exit, so that the compiler can vectorize the loop */
+	uint64_t used = UINT64_MAX;
 	for (int i = 0; i < MAX_BITMAP_VALUES; ++i)
-		if (run->bitmap[i] != UINT64_MAX)
-			return 0;
+		used &= run->bitmap[i];
 
-	return 1;
+	return used == UINT64_MAX;
 }
 
 /*
@@ -497,29 +621,47 @@ heap_find_first_free_bucket_slot(struct heap_rt *h)
 	return MAX_BUCKETS;
 }
 
+/*
+ * heap_run_bucket_new -- (internal) creates either a regular or a header-less
+ *	run bucket
+ */
+static struct bucket *
+heap_run_bucket_new(uint8_t slot, size_t unit_size, unsigned unit_max,
+	unsigned unit_max_alloc, int headerless, uint64_t type_num)
+{
+	struct bucket_run *r = headerless ?
+		bucket_run_headerless_new(slot, CONTAINER_CTREE,
+			unit_size, type_num) :
+		bucket_run_new(slot, CONTAINER_CTREE,
+			unit_size, unit_max, unit_max_alloc);
+
+	return r == NULL ? NULL : &r->super;
+}
+
 /*
  * heap_create_alloc_class_buckets -- (internal) allocates both auxiliary and
  *	cache bucket instances of the specified type
  */
 static uint8_t
 heap_create_alloc_class_buckets(struct heap_rt *h,
-	size_t unit_size, unsigned unit_max, unsigned unit_max_alloc)
+	size_t unit_size, unsigned unit_max, unsigned unit_max_alloc,
+	int headerless, uint64_t type_num)
 {
 	uint8_t slot = heap_find_first_free_bucket_slot(h);
 	if (slot == MAX_BUCKETS)
 		goto out;
 
-	h->buckets[slot] = &(bucket_run_new(slot, CONTAINER_CTREE,
-			unit_size, unit_max, unit_max_alloc)->super);
+	h->buckets[slot] = heap_run_bucket_new(slot, unit_size,
+			unit_max, unit_max_alloc, headerless, type_num);
 
 	if (h->buckets[slot] == NULL)
 		goto error_bucket_new;
 
 	int i;
 	for (i = 0; i < (int)h->ncaches; ++i) {
-		h->caches[i].buckets[slot] =
-			&(bucket_run_new(slot, CONTAINER_CTREE,
-				unit_size, unit_max, unit_max_alloc)->super);
+		h->caches[i].buckets[slot] = heap_run_bucket_new(slot,
+			unit_size, unit_max, unit_max_alloc,
+			headerless, type_num);
 		if (h->caches[i].buckets[slot] == NULL)
 			goto error_cache_bucket_new;
 	}
@@ -558,7 +700,7 @@ heap_get_create_bucket_idx_by_unit_size(struct heap_rt *h, uint64_t unit_size)
 		 * initialization time.
 		 */
 		bucket_idx = heap_create_alloc_class_buckets(h, unit_size,
-			RUN_UNIT_MAX, RUN_UNIT_MAX_ALLOC);
+			RUN_UNIT_MAX, RUN_UNIT_MAX_ALLOC, 0, 0);
 
 		if (bucket_idx == MAX_BUCKETS) {
 			ERR("Failed to allocate new bucket class");
@@ -581,12 +723,74 @@ heap_get_create_bucket_idx_by_unit_size(struct heap_rt *h, uint64_t unit_size)
 	return bucket_idx;
 }
 
+/*
+ * heap_find_alloc_class -- (internal) searches for the buckets of a class with
+ *	the given properties
+ */
+static uint8_t
+heap_find_alloc_class(struct heap_rt *h, uint64_t unit_size,
+	int headerless, uint64_t type_num)
+{
+	for (unsigned i = 0; i < MAX_BUCKETS; ++i) {
+		struct bucket *b = h->buckets[i];
+		if (b == NULL || b == BUCKET_RESERVED ||
+			b->unit_size != unit_size)
+			continue;
+
+		struct bucket_run *r = (struct bucket_run *)b;
+		if (r->headerless == headerless &&
+			(!headerless || r->type_num == type_num))
+			return (uint8_t)i;
+	}
+
+	return MAX_BUCKETS;
+}
+
+/*
+ * heap_get_create_run_bucket_idx -- (internal) retrieves or creates the memory
+ *	bucket index that points to buckets that are responsible for
+ *	allocations from the given run.
+ *
+ * Header-less runs are never described by the bucket map, their buckets are
+ * identified by both the unit size and the type number of the run.
+ */
+static uint8_t
+heap_get_create_run_bucket_idx(struct heap_rt *h, struct chunk_header *hdr,
+	struct chunk_run *run)
+{
+	uint8_t bucket_idx;
+
+	util_mutex_lock(&h->class_lock);
+
+	if (!(hdr->flags & CHUNK_FLAG_HEADERLESS)) {
+		bucket_idx = heap_get_create_bucket_idx_by_unit_size(h,
+			run->block_size);
+		goto out;
+	}
+
+	uint64_t type_num = *heap_run_type_num_ptr(run);
+
+	bucket_idx = heap_find_alloc_class(h, run->block_size, 1, type_num);
+	if (bucket_idx != MAX_BUCKETS)
+		goto out;
+
+	bucket_idx = heap_create_alloc_class_buckets(h, run->block_size,
+		1, 1, 1, type_num);
+	if (bucket_idx == MAX_BUCKETS)
+		ERR("Failed to allocate new bucket class");
+
+out:
+	util_mutex_unlock(&h->class_lock);
+
+	return bucket_idx;
+}
+
 /*
  * heap_register_active_run -- (internal) inserts a run for eventual reuse
  */
 static void
-heap_register_active_run(struct heap_rt *h, struct chunk_run *run,
-	uint32_t chunk_id, uint32_t zone_id)
+heap_register_active_run(struct heap_rt *h, struct chunk_header *hdr,
+	struct chunk_run *run, uint32_t chunk_id, uint32_t zone_id)
 {
 	/* reset the volatile state of the run */
 	run->bucket_vptr = 0;
@@ -604,29 +808,40 @@ heap_register_active_run(struct heap_rt *h, struct chunk_run *run,
 	arun->chunk_id = chunk_id;
 	arun->zone_id = zone_id;
 
-	uint8_t bucket_idx = heap_get_create_bucket_idx_by_unit_size(h,
-		run->block_size);
+	uint8_t bucket_idx = heap_get_create_run_bucket_idx(h, hdr, run);
 
 	if (bucket_idx == MAX_BUCKETS) {
 		ASSERT(0);
 		return;
 	}
 
+	/* the zones can be populated concurrently with allocations */
+	util_mutex_lock(&h->active_run_lock);
 	SLIST_INSERT_HEAD(&h->active_runs[bucket_idx], arun, run);
+	util_mutex_unlock(&h->active_run_lock);
 }
 
 /*
- * heap_populate_buckets -- (internal) creates volatile state of memory blocks
+ * heap_claim_zone -- (internal) marks the zone as being populated by the
+ *	calling thread, must be called with the populate lock held
  */
-static int
-heap_populate_buckets(struct palloc_heap *heap)
+static void
+heap_claim_zone(struct heap_rt *h, uint32_t zone_id)
 {
-	struct heap_rt *h = heap->rt;
+	ASSERTeq(h->zones_populated[zone_id], ZONE_UNPOPULATED);
 
-	if (h->zones_exhausted == h->max_zone)
-		return ENOMEM;
+	h->zones_populated[zone_id] = ZONE_POPULATING;
+	h->zones_populating++;
+}
 
-	uint32_t zone_id = h->zones_exhausted++;
+/*
+ * heap_populate_zone -- (internal) creates volatile state of memory blocks
+ *	of the zone claimed by the calling thread
+ */
+static int
+heap_populate_zone(struct palloc_heap *heap, uint32_t zone_id)
+{
+	struct heap_rt *h = heap->rt;
 	struct zone *z = ZID_TO_ZONE(heap->layout, zone_id);
 
 	/* ignore zone and chunk headers */
@@ -645,14 +860,21 @@ heap_populate_buckets(struct palloc_heap *heap)
 		ASSERT(hdr->size_idx != 0);
 		heap_chunk_write_footer(hdr, hdr->size_idx);
 
+		/*
+		 * Once the chunk is published it might be concurrently split
+		 * or reused, so its header can't be read afterwards.
+		 */
+		uint32_t size_idx = hdr->size_idx;
+
 		switch (hdr->type) {
 			case CHUNK_TYPE_RUN:
 				run = (struct chunk_run *)&z->chunks[i];
-				heap_register_active_run(h, run, i, zone_id);
+				heap_register_active_run(h, hdr, run,
+					i, zone_id);
 				break;
 			case CHUNK_TYPE_FREE:
 				m.chunk_id = i;
-				m.size_idx = hdr->size_idx;
+				m.size_idx = size_idx;
 				CNT_OP(def_bucket, insert, heap, m);
 				break;
 			case CHUNK_TYPE_USED:
@@ -661,12 +883,148 @@ heap_populate_buckets(struct palloc_heap *heap)
 				ASSERT(0);
 		}
 
-		i += hdr->size_idx;
+		i += size_idx;
 	}
 
+	util_mutex_lock(&h->populate_lock);
+
+	/* the volatile state must be visible before the flag */
+	__sync_synchronize();
+	h->zones_populated[zone_id] = ZONE_POPULATED;
+	h->zones_populating--;
+
+	pthread_cond_broadcast(&h->populate_cond);
+	util_mutex_unlock(&h->populate_lock);
+
 	return 0;
 }
 
+/*
+ * heap_populate_buckets -- (internal) creates volatile state of memory blocks
+ *	of the next zone that wasn't processed yet
+ */
+static int
+heap_populate_buckets(struct palloc_heap *heap)
+{
+	struct heap_rt *h = heap->rt;
+	int ret = 0;
+
+	util_mutex_lock(&h->populate_lock);
+
+	while (h->zones_exhausted < h->max_zone &&
+		h->zones_populated[h->zones_exhausted] != ZONE_UNPOPULATED)
+		h->zones_exhausted++;
+
+	if (h->populate_stop) {
+		ret = ENOMEM;
+	} else if (h->zones_exhausted < h->max_zone) {
+		uint32_t zone_id = h->zones_exhausted++;
+		heap_claim_zone(h, zone_id);
+		util_mutex_unlock(&h->populate_lock);
+
+		return heap_populate_zone(heap, zone_id);
+	} else if (h->zones_populating != 0) {
+		/* the zones populated by other threads may have free memory */
+		pthread_cond_wait(&h->populate_cond, &h->populate_lock);
+	} else {
+		ret = ENOMEM;
+	}
+
+	util_mutex_unlock(&h->populate_lock);
+
+	return ret;
+}
+
+/*
+ * heap_ensure_zone_populated -- (internal) brings the zone online if it
+ *	wasn't processed yet
+ */
+static void
+heap_ensure_zone_populated(struct palloc_heap *heap, uint32_t zone_id)
+{
+	struct heap_rt *h = heap->rt;
+
+	if (h->zones_populated[zone_id] == ZONE_POPULATED)
+		return;
+
+	util_mutex_lock(&h->populate_lock);
+	while (h->zones_populated[zone_id] == ZONE_POPULATING)
+		pthread_cond_wait(&h->populate_cond, &h->populate_lock);
+
+	if (h->zones_populated[zone_id] == ZONE_UNPOPULATED) {
+		heap_claim_zone(h, zone_id);
+		util_mutex_unlock(&h->populate_lock);
+
+		heap_populate_zone(heap, zone_id);
+		return;
+	}
+	util_mutex_unlock(&h->populate_lock);
+}
+
+/*
+ * heap_prefetch_worker -- (internal) populates the zones in background, until
+ *	all of them are claimed
+ */
+static void *
+heap_prefetch_worker(void *arg)
+{
+	struct palloc_heap *heap = arg;
+
+	while (heap_populate_buckets(heap) == 0)
+		;
+
+	return NULL;
+}
+
+/*
+ * heap_prefetch_nthreads -- (internal) returns the number of background
+ *	threads which bring the zones online, 0 if it's done on demand only
+ */
+static unsigned
+heap_prefetch_nthreads(unsigned max_zone)
+{
+	char *e = getenv("PMEMOBJ_HEAP_PREFETCH");
+	if (e == NULL)
+		return 0;
+
+	int n = atoi(e);
+	if (n <= 0)
+		return 0;
+
+	return (unsigned)n < max_zone ? (unsigned)n : max_zone;
+}
+
+/*
+ * heap_prefetch_start -- (internal) starts the background threads which
+ *	populate the zones, returns the number of the started threads
+ */
+static unsigned
+heap_prefetch_start(struct palloc_heap *heap, unsigned nthreads)
+{
+	struct heap_rt *h = heap->rt;
+
+	if (nthreads == 0)
+		return 0;
+
+	h->prefetch_threads = Malloc(sizeof(pthread_t) * nthreads);
+	if (h->prefetch_threads == NULL)
+		return 0;
+
+	unsigned n;
+	for (n = 0; n < nthreads; ++n) {
+		if (pthread_create(&h->prefetch_threads[n], NULL,
+				heap_prefetch_worker, heap) != 0)
+			break;
+	}
+
+	if (n == 0) {
+		Free(h->prefetch_threads);
+		h->prefetch_threads = NULL;
+	}
+
+	return n;
+}
+
 /*
  * heap_get_active_run -- (internal) searches for an existing, unused, run
  */
@@ -714,12 +1072,8 @@ static int
 heap_ensure_bucket_filled(struct palloc_heap *heap, struct bucket *b)
 {
 	if (b->type == BUCKET_HUGE) {
-		util_mutex_lock(&b->lock);
 		/* not much to do here apart from using the next zone */
-		int ret = heap_populate_buckets(heap);
-		util_mutex_unlock(&b->lock);
-
-		return ret;
+		return heap_populate_buckets(heap);
 	}
 
 	struct heap_rt *h = heap->rt;
@@ -774,28 +1128,526 @@ heap_get_cache_bucket(struct heap_rt *heap, int bucket_id)
 /*
  * heap_get_bucket_by_idx -- (internal) returns bucket with the given index
  */
-static struct bucket *
-heap_get_bucket_by_idx(struct heap_rt *heap, uint8_t idx)
+static struct bucket *
+heap_get_bucket_by_idx(struct heap_rt *heap, uint8_t idx)
+{
+#ifdef USE_PER_THREAD_BUCKETS
+	return heap_get_cache_bucket(heap, idx);
+#else
+	return heap->buckets[idx];
+#endif
+}
+
+/*
+ * heap_get_best_bucket -- returns the bucket that best fits the requested size
+ */
+struct bucket *
+heap_get_best_bucket(struct palloc_heap *heap, size_t size)
+{
+	struct heap_rt *rt = heap->rt;
+	if (size <= rt->last_run_max_size) {
+		return heap_get_bucket_by_idx(rt, SIZE_TO_BID(rt, size));
+	} else {
+		return rt->default_bucket;
+	}
+}
+
+/*
+ * heap_get_class_bucket -- returns the bucket of the allocation class with the
+ *	given id, either the one from the thread's cache or the auxiliary one
+ *
+ * The id of a class is its bucket slot plus one, as 0 means no class.
+ */
+struct bucket *
+heap_get_class_bucket(struct palloc_heap *heap, unsigned class_id,
+	int auxiliary)
+{
+	struct heap_rt *rt = heap->rt;
+
+	if (class_id == 0 || class_id > MAX_BUCKETS)
+		return NULL;
+
+	uint8_t slot = (uint8_t)(class_id - 1);
+	struct bucket *b = rt->buckets[slot];
+	if (b == NULL || b == BUCKET_RESERVED)
+		return NULL;
+
+	return auxiliary ? b : heap_get_bucket_by_idx(rt, slot);
+}
+
+/*
+ * heap_create_alloc_class -- registers an allocation class with the given unit
+ *	size, an existing class is reused if it has the same properties
+ *
+ * The blocks of a header-less class are all one unit and belong to objects of
+ * the given type number.
+ */
+int
+heap_create_alloc_class(struct palloc_heap *heap, size_t unit_size,
+	int headerless, uint64_t type_num, unsigned *class_id)
+{
+	struct heap_rt *h = heap->rt;
+
+	/*
+	 * The block size of runs from the previous incarnation of the heap is
+	 * looked up in the bucket map, so it can't be larger than the largest
+	 * generated class. The smallest unit size is limited by the number of
+	 * bits in the run bitmap, unless the runs are header-less.
+	 */
+	if (unit_size == 0 || unit_size % sizeof(uint64_t) != 0 ||
+		unit_size > MAX_RUN_SIZE ||
+		(!headerless && RUN_NALLOCS(unit_size) >= RUN_BITMAP_SIZE))
+		return EINVAL;
+
+	int ret = 0;
+
+	util_mutex_lock(&h->class_lock);
+
+	uint8_t slot = heap_find_alloc_class(h, unit_size,
+		headerless, type_num);
+	if (slot == MAX_BUCKETS)
+		slot = heap_create_alloc_class_buckets(h, unit_size,
+			RUN_UNIT_MAX, RUN_UNIT_MAX_ALLOC, headerless, type_num);
+
+	if (slot == MAX_BUCKETS)
+		ret = ENOMEM;
+	else
+		*class_id = (unsigned)slot + 1;
+
+	util_mutex_unlock(&h->class_lock);
+
+	return ret;
+}
+
+/*
+ * heap_find_thread_cache -- (internal) returns the calling thread's cache of
+ *	the heap, or NULL if there's none
+ *
+ * The caches of a thread are only modified by the thread itself, so no lock
+ * is needed to look them up.
+ */
+static struct heap_thread_cache *
+heap_find_thread_cache(struct heap_rt *h)
+{
+	if (likely(Thread_cache_heap_id == h->id))
+		return Thread_cache;
+
+	struct heap_thread_cache *tc;
+	SLIST_FOREACH(tc, &Thread_caches, thread_entry) {
+		if (tc->heap_id == h->id) {
+			Thread_cache_heap_id = h->id;
+			Thread_cache = tc;
+			break;
+		}
+	}
+
+	return tc;
+}
+
+/*
+ * heap_prune_thread_caches -- (internal) frees the caches of the calling
+ *	thread that were detached from their closed heaps
+ *
+ * Must be called with Thread_caches_lock held.
+ */
+static void
+heap_prune_thread_caches(void)
+{
+	struct thread_caches live;
+	SLIST_INIT(&live);
+
+	struct heap_thread_cache *tc;
+	while ((tc = SLIST_FIRST(&Thread_caches)) != NULL) {
+		SLIST_REMOVE_HEAD(&Thread_caches, thread_entry);
+		if (tc->heap == NULL)
+			Free(tc);
+		else
+			SLIST_INSERT_HEAD(&live, tc, thread_entry);
+	}
+
+	Thread_caches = live;
+}
+
+/*
+ * heap_get_thread_cache -- (internal) returns the calling thread's cache of
+ *	the heap, creates one if necessary
+ */
+static struct heap_thread_cache *
+heap_get_thread_cache(struct palloc_heap *heap)
+{
+	struct heap_rt *h = heap->rt;
+	struct heap_thread_cache *tc = heap_find_thread_cache(h);
+	if (likely(tc != NULL))
+		return tc;
+
+	tc = Malloc(sizeof(*tc));
+	if (tc == NULL)
+		return NULL;
+
+	memset(tc, 0, sizeof(*tc));
+	tc->heap = heap;
+	tc->heap_id = h->id;
+	tc->owner = &Thread_caches;
+
+	util_mutex_lock(&Thread_caches_lock);
+	heap_prune_thread_caches();
+	LIST_INSERT_HEAD(&h->thread_caches, tc, heap_entry);
+	util_mutex_unlock(&Thread_caches_lock);
+
+	SLIST_INSERT_HEAD(&Thread_caches, tc, thread_entry);
+	int ret = pthread_setspecific(Thread_caches_key,
+			SLIST_FIRST(&Thread_caches));
+	if (ret != 0) {
+		errno = ret;
+		FATAL("!pthread_setspecific");
+	}
+
+	Thread_cache_heap_id = h->id;
+	Thread_cache = tc;
+
+	return tc;
+}
+
+/*
+ * heap_flush_thread_cache -- (internal) returns the memory blocks held in the
+ *	magazines of a thread cache back to their buckets
+ */
+static void
+heap_flush_thread_cache(struct palloc_heap *heap,
+	struct heap_thread_cache *tc)
+{
+	for (int i = 0; i < MAX_BUCKETS; ++i) {
+		struct heap_magazine *mag = tc->magazines[i];
+		if (mag == NULL)
+			continue;
+
+		while (mag->nblocks != 0) {
+			struct memory_block m = mag->blocks[--mag->nblocks];
+
+			/* the same as a free, see palloc_operation */
+			pthread_mutex_t *lock =
+				heap_get_run_lock(heap, m.chunk_id);
+			util_mutex_lock(lock);
+
+			struct bucket *b = heap_get_chunk_bucket(heap,
+				m.chunk_id, m.zone_id);
+			if (b != NULL) {
+				/* coalescing without persistent changes */
+				m = heap_free_block(heap, b, m, NULL);
+				CNT_OP(b, insert, heap, m);
+				heap_degrade_run_if_empty(heap, b, m);
+			}
+
+			util_mutex_unlock(lock);
+		}
+
+		Free(mag);
+		tc->magazines[i] = NULL;
+	}
+}
+
+/*
+ * heap_release_thread_caches -- (internal) flushes the caches of an exiting
+ *	thread and frees them
+ *
+ * The caches are first taken out of their heaps, which then can't be cleaned
+ * up until the flush is finished.
+ */
+static void
+heap_release_thread_caches(void *arg)
+{
+	struct heap_thread_cache *first = arg;
+	struct heap_thread_cache *tc;
+
+	/* the thread might still allocate in the destructors of other keys */
+	SLIST_INIT(&Thread_caches);
+	Thread_cache_heap_id = 0;
+	Thread_cache = NULL;
+
+	util_mutex_lock(&Thread_caches_lock);
+	for (tc = first; tc != NULL; tc = SLIST_NEXT(tc, thread_entry)) {
+		if (tc->heap == NULL)
+			continue;
+
+		LIST_REMOVE(tc, heap_entry);
+		tc->heap->rt->thread_caches_flushing++;
+	}
+	util_mutex_unlock(&Thread_caches_lock);
+
+	for (tc = first; tc != NULL; tc = SLIST_NEXT(tc, thread_entry)) {
+		if (tc->heap != NULL)
+			heap_flush_thread_cache(tc->heap, tc);
+	}
+
+	util_mutex_lock(&Thread_caches_lock);
+	while ((tc = first) != NULL) {
+		first = SLIST_NEXT(tc, thread_entry);
+
+		if (tc->heap != NULL) {
+			struct heap_rt *h = tc->heap->rt;
+			h->flushed_stats.hits += tc->stats.hits;
+			h->flushed_stats.misses += tc->stats.misses;
+			h->flushed_stats.refills += tc->stats.refills;
+			h->flushed_stats.refilled_blocks +=
+				tc->stats.refilled_blocks;
+
+			if (--h->thread_caches_flushing == 0)
+				util_futex_wake(&h->thread_caches_flushing,
+					INT32_MAX);
+		}
+
+		Free(tc);
+	}
+	util_mutex_unlock(&Thread_caches_lock);
+}
+
+/*
+ * heap_thread_caches_init -- (internal) creates the key of the thread caches
+ */
+static void
+heap_thread_caches_init(void)
+{
+	util_mutex_init(&Thread_caches_lock, NULL);
+
+	int ret = pthread_key_create(&Thread_caches_key,
+			heap_release_thread_caches);
+	if (ret != 0) {
+		errno = ret;
+		FATAL("!pthread_key_create");
+	}
+}
+
+/*
+ * heap_detach_thread_caches -- (internal) detaches all thread caches from the
+ *	heap which is being closed
+ *
+ * The caches of the calling thread are freed right away, the other ones are
+ * freed by their owners. The blocks in the magazines are free in the
+ * persistent heap, so there's nothing else to do with them.
+ */
+static void
+heap_detach_thread_caches(struct palloc_heap *heap)
+{
+	struct heap_rt *h = heap->rt;
+	struct heap_thread_cache *tc;
+
+	util_mutex_lock(&Thread_caches_lock);
+	while ((tc = LIST_FIRST(&h->thread_caches)) != NULL) {
+		LIST_REMOVE(tc, heap_entry);
+
+		for (int i = 0; i < MAX_BUCKETS; ++i) {
+			Free(tc->magazines[i]);
+			tc->magazines[i] = NULL;
+		}
+
+		if (tc->owner == &Thread_caches) {
+			SLIST_REMOVE(&Thread_caches, tc, heap_thread_cache,
+				thread_entry);
+			Free(tc);
+		} else {
+			tc->heap = NULL;
+		}
+	}
+
+	/* wait for the exiting threads which flush their caches */
+	uint32_t flushing;
+	while ((flushing = h->thread_caches_flushing) != 0) {
+		util_mutex_unlock(&Thread_caches_lock);
+		util_futex_wait(&h->thread_caches_flushing, flushing);
+		util_mutex_lock(&Thread_caches_lock);
+	}
+	util_mutex_unlock(&Thread_caches_lock);
+
+	int ret = pthread_setspecific(Thread_caches_key,
+			SLIST_FIRST(&Thread_caches));
+	if (ret != 0) {
+		errno = ret;
+		FATAL("!pthread_setspecific");
+	}
+}
+
+/*
+ * heap_magazine_push -- (internal) inserts a memory block into the magazine
+ *
+ * The blocks are kept sorted so that the lowest address is popped first, which
+ * keeps consecutive allocations close to each other.
+ */
+static void
+heap_magazine_push(struct heap_magazine *mag, struct memory_block m)
+{
+	ASSERT(mag->nblocks < MAGAZINE_SIZE);
+
+	unsigned i = mag->nblocks++;
+	while (i > 0 && MAGAZINE_BLOCK_KEY(mag->blocks[i - 1]) <
+			MAGAZINE_BLOCK_KEY(m)) {
+		mag->blocks[i] = mag->blocks[i - 1];
+		i--;
+	}
+
+	mag->blocks[i] = m;
+}
+
+/*
+ * heap_magazine_refill -- (internal) reserves a batch of single unit memory
+ *	blocks from the bucket
+ */
+static int
+heap_magazine_refill(struct palloc_heap *heap, struct bucket *b,
+	struct heap_magazine *mag)
+{
+	ASSERTeq(b->type, BUCKET_RUN);
+	ASSERTeq(mag->nblocks, 0);
+	struct bucket_run *r = (struct bucket_run *)b;
+
+	unsigned nblocks = r->bitmap_nallocs / MAGAZINE_RUN_FRACTION;
+	if (nblocks == 0)
+		nblocks = 1;
+	else if (nblocks > MAGAZINE_SIZE)
+		nblocks = MAGAZINE_SIZE;
+
+	struct memory_block m = EMPTY_MEMORY_BLOCK;
+	int ret = 0;
+
+	util_mutex_lock(&b->lock);
+
+	while (mag->nblocks < nblocks) {
+		m.size_idx = 1;
+		if (CNT_OP(b, get_rm_bestfit, &m) != 0) {
+			if (mag->nblocks != 0)
+				break;
+
+			util_mutex_unlock(&b->lock);
+			if ((ret = heap_ensure_bucket_filled(heap, b)) != 0)
+				return ret;
+			util_mutex_lock(&b->lock);
+			continue;
+		}
+
+		uint32_t units = nblocks - mag->nblocks;
+		if (units > m.size_idx)
+			units = m.size_idx;
+
+		/* pushing the highest offset first avoids shifting */
+		for (uint32_t i = units; i > 0; --i) {
+			struct memory_block u = {m.chunk_id, m.zone_id, 1,
+				(uint16_t)(m.block_off + i - 1)};
+			heap_magazine_push(mag, u);
+		}
+
+		if (units != m.size_idx) {
+			ASSERT(m.block_off + units <= UINT16_MAX);
+			m.block_off = (uint16_t)(m.block_off + units);
+			m.size_idx -= units;
+			CNT_OP(b, insert, heap, m);
+		}
+	}
+
+	util_mutex_unlock(&b->lock);
+
+	return 0;
+}
+
+/*
+ * heap_get_magazine_block -- extracts a single unit memory block from the
+ *	calling thread's magazine, refilling it from the bucket if needed
+ *
+ * Only the refill takes the bucket lock, all other calls are served without
+ * any synchronization. Requests that don't fit the magazines fall back to
+ * heap_get_bestfit_block.
+ */
+int
+heap_get_magazine_block(struct palloc_heap *heap, struct bucket *b,
+	struct memory_block *m)
+{
+	if (b->type != BUCKET_RUN || m->size_idx != 1)
+		return heap_get_bestfit_block(heap, b, m);
+
+	struct heap_thread_cache *tc = heap_get_thread_cache(heap);
+	if (unlikely(tc == NULL))
+		return heap_get_bestfit_block(heap, b, m);
+
+	struct heap_magazine *mag = tc->magazines[b->id];
+	if (unlikely(mag == NULL)) {
+		mag = Malloc(sizeof(*mag));
+		if (mag == NULL)
+			return heap_get_bestfit_block(heap, b, m);
+
+		mag->nblocks = 0;
+		tc->magazines[b->id] = mag;
+	}
+
+	if (mag->nblocks == 0) {
+		tc->stats.misses++;
+
+		int ret = heap_magazine_refill(heap, b, mag);
+		if (ret != 0)
+			return ret;
+
+		tc->stats.refills++;
+		tc->stats.refilled_blocks += mag->nblocks;
+	} else {
+		tc->stats.hits++;
+	}
+
+	*m = mag->blocks[--mag->nblocks];
+
+	return 0;
+}
+
+/*
+ * heap_put_magazine_block -- returns a freed single unit memory block to the
+ *	calling thread's magazine
+ *
+ * This is only possible if the magazine isn't full and is refilled from the
+ * bucket that owns the block. Returns 0 if the block was taken, otherwise the
+ * caller has to insert it back into the bucket.
+ */
+int
+heap_put_magazine_block(struct palloc_heap *heap, struct bucket *b,
+	struct memory_block m)
 {
-#ifdef USE_PER_THREAD_BUCKETS
-	return heap_get_cache_bucket(heap, idx);
-#else
-	return heap->buckets[idx];
-#endif
+	if (b->type != BUCKET_RUN || m.size_idx != 1)
+		return -1;
+
+	struct heap_rt *h = heap->rt;
+	if (heap_get_bucket_by_idx(h, b->id) != b)
+		return -1;
+
+	/* a thread without a cache has no magazine to put the block into */
+	struct heap_thread_cache *tc = heap_find_thread_cache(h);
+	if (tc == NULL)
+		return -1;
+
+	struct heap_magazine *mag = tc->magazines[b->id];
+	if (mag == NULL || mag->nblocks == MAGAZINE_SIZE)
+		return -1;
+
+	heap_magazine_push(mag, m);
+
+	return 0;
 }
 
 /*
- * heap_get_best_bucket -- returns the bucket that best fits the requested size
+ * heap_get_cache_stats -- sums up the magazine statistics of all threads
+ *
+ * The counters are updated without synchronization by the owning threads, so
+ * the result is only approximate if the heap is being concurrently used.
  */
-struct bucket *
-heap_get_best_bucket(struct palloc_heap *heap, size_t size)
+void
+heap_get_cache_stats(struct palloc_heap *heap, struct palloc_cache_stats *s)
 {
-	struct heap_rt *rt = heap->rt;
-	if (size <= rt->last_run_max_size) {
-		return heap_get_bucket_by_idx(rt, SIZE_TO_BID(rt, size));
-	} else {
-		return rt->default_bucket;
+	struct heap_rt *h = heap->rt;
+	struct heap_thread_cache *tc;
+
+	util_mutex_lock(&Thread_caches_lock);
+	*s = h->flushed_stats;
+	LIST_FOREACH(tc, &h->thread_caches, heap_entry) {
+		s->hits += tc->stats.hits;
+		s->misses += tc->stats.misses;
+		s->refills += tc->stats.refills;
+		s->refilled_blocks += tc->stats.refilled_blocks;
 	}
+	util_mutex_unlock(&Thread_caches_lock);
 }
 
 /*
@@ -817,11 +1669,10 @@ heap_get_run_bucket(struct chunk_run *run)
  * heap_assign_run_bucket -- (internal) finds and sets bucket for a run
  */
 static struct bucket *
-heap_assign_run_bucket(struct palloc_heap *heap, struct chunk_run *run,
-	uint32_t chunk_id, uint32_t zone_id)
+heap_assign_run_bucket(struct palloc_heap *heap, struct chunk_header *hdr,
+	struct chunk_run *run, uint32_t chunk_id, uint32_t zone_id)
 {
-	uint8_t bucket_idx = heap_get_create_bucket_idx_by_unit_size(heap->rt,
-		run->block_size);
+	uint8_t bucket_idx = heap_get_create_run_bucket_idx(heap->rt, hdr, run);
 
 	/*
 	 * Due to lack of resources the volatile heap state can't be tracked
@@ -851,9 +1702,11 @@ heap_get_chunk_bucket(struct palloc_heap *heap, uint32_t chunk_id,
 
 	ASSERT(zone_id < rt->max_zone);
 
-	/* This zone wasn't processed yet, so no associated bucket */
-	if (zone_id >= rt->zones_exhausted)
-		return NULL;
+	/*
+	 * The free must not race with the zone being processed for the first
+	 * time, otherwise the block could be inserted into a bucket twice.
+	 */
+	heap_ensure_zone_populated(heap, zone_id);
 
 	struct zone *z = ZID_TO_ZONE(heap->layout, zone_id);
 
@@ -867,7 +1720,7 @@ heap_get_chunk_bucket(struct palloc_heap *heap, uint32_t chunk_id,
 		if (run->bucket_vptr != 0)
 			return heap_get_run_bucket(run);
 		else
-			return heap_assign_run_bucket(heap, run,
+			return heap_assign_run_bucket(heap, hdr, run,
 				chunk_id, zone_id);
 	} else {
 		return rt->default_bucket;
@@ -1005,7 +1858,7 @@ heap_find_or_create_alloc_class(struct palloc_heap *heap, size_t n)
 	}
 
 	return heap_create_alloc_class_buckets(h, n,
-		RUN_UNIT_MAX, RUN_UNIT_MAX_ALLOC);
+		RUN_UNIT_MAX, RUN_UNIT_MAX_ALLOC, 0, 0);
 }
 
 /*
@@ -1065,7 +1918,7 @@ heap_buckets_init(struct palloc_heap *heap)
 		goto error_bucket_map_malloc;
 
 	h->default_bucket = &(bucket_huge_new(MAX_BUCKETS,
-		CONTAINER_CTREE, CHUNKSIZE)->super);
+		CONTAINER_SEGLISTS, CHUNKSIZE)->super);
 	if (h->default_bucket == NULL)
 		goto error_default_bucket_new;
 
@@ -1078,7 +1931,7 @@ heap_buckets_init(struct palloc_heap *heap)
 	 */
 	size_t size = 0;
 	uint8_t slot = heap_create_alloc_class_buckets(h,
-		MIN_RUN_SIZE, RUN_UNIT_MAX, RUN_UNIT_MAX_ALLOC);
+		MIN_RUN_SIZE, RUN_UNIT_MAX, RUN_UNIT_MAX_ALLOC, 0, 0);
 	if (slot == MAX_BUCKETS)
 		goto error_bucket_create;
 
@@ -1154,7 +2007,13 @@ heap_buckets_init(struct palloc_heap *heap)
 	}
 #endif
 
-	heap_populate_buckets(heap);
+	/*
+	 * In the lazy mode, no zone is walked here - the background threads and
+	 * the allocations that run out of memory bring zones online as needed.
+	 */
+	h->nprefetch = heap_prefetch_start(heap, h->nprefetch);
+	if (h->nprefetch == 0)
+		heap_populate_buckets(heap);
 
 	return 0;
 
@@ -1213,25 +2072,116 @@ heap_recycle_block(struct palloc_heap *heap, struct bucket *b,
 	m->size_idx = units;
 }
 
+/*
+ * heap_huge_split_done -- (internal) marks the end of an attempt to take a
+ *	block out of the huge bucket, successful or not
+ */
+static void
+heap_huge_split_done(struct heap_rt *h)
+{
+	__sync_fetch_and_sub(&h->huge_splits, 1);
+	__sync_fetch_and_add(&h->huge_split_seq, 1);
+
+	if (__sync_fetch_and_add(&h->huge_split_waiters, 0) != 0)
+		util_futex_wake(&h->huge_split_seq, INT32_MAX);
+}
+
+/*
+ * heap_get_huge_block_locked -- (internal) extracts a huge memory block once
+ *	the splits in progress are finished
+ *
+ * Must be called with the huge bucket lock held, which also keeps the runs
+ * that are being degraded from coalescing with the free chunks. Every finished
+ * split, including the failed attempts, advances the sequence number on which
+ * the thread sleeps, so the counter of the splits is rechecked each time.
+ * A block that is found is counted as being split.
+ */
+static int
+heap_get_huge_block_locked(struct heap_rt *h, struct bucket *b,
+	struct memory_block *m)
+{
+	uint32_t units = m->size_idx;
+	int ret = ENOMEM;
+
+	__sync_fetch_and_add(&h->huge_split_waiters, 1);
+
+	for (;;) {
+		uint32_t seq = __sync_fetch_and_add(&h->huge_split_seq, 0);
+
+		__sync_fetch_and_add(&h->huge_splits, 1);
+
+		m->size_idx = units;
+		if (CNT_OP(b, get_rm_bestfit, m) == 0) {
+			ret = 0;
+			break;
+		}
+
+		if (__sync_sub_and_fetch(&h->huge_splits, 1) == 0)
+			break;
+
+		util_futex_wait(&h->huge_split_seq, seq);
+	}
+
+	__sync_fetch_and_sub(&h->huge_split_waiters, 1);
+
+	return ret;
+}
+
 /*
  * heap_get_bestfit_block --
  *	extracts a memory block of equal size index
+ *
+ * The container of the huge bucket synchronizes itself and the chunk it
+ * returns is exclusively owned by the caller, so, just like on the free path,
+ * the bucket lock isn't needed to split it. This lets huge allocations of
+ * different sizes proceed in parallel.
+ *
+ * While a huge block is being split, its remainder is missing from the
+ * container. A thread that finds no block large enough takes the bucket lock
+ * and sleeps until the splits in progress are finished, instead of reporting
+ * out of memory.
  */
 int
 heap_get_bestfit_block(struct palloc_heap *heap, struct bucket *b,
 	struct memory_block *m)
 {
-	util_mutex_lock(&b->lock);
+	struct heap_rt *h = heap->rt;
+	int huge = b->type == BUCKET_HUGE;
+	pthread_mutex_t *lock = huge ? NULL : &b->lock;
+	if (lock != NULL)
+		util_mutex_lock(lock);
 
 	uint32_t units = m->size_idx;
 	int ret = 0;
 
-	while (CNT_OP(b, get_rm_bestfit, m) != 0) {
-		util_mutex_unlock(&b->lock);
+	for (;;) {
+		if (huge)
+			__sync_fetch_and_add(&h->huge_splits, 1);
+
+		if (CNT_OP(b, get_rm_bestfit, m) == 0)
+			break;
+
+		if (huge) {
+			heap_huge_split_done(h);
+
+			util_mutex_lock(&b->lock);
+			m->size_idx = units;
+			ret = heap_get_huge_block_locked(h, b, m);
+			util_mutex_unlock(&b->lock);
+
+			if (ret == 0)
+				break;
+		}
+
+		if (lock != NULL)
+			util_mutex_unlock(lock);
 		if ((ret = heap_ensure_bucket_filled(heap, b)) != 0) {
 			return ret;
 		}
-		util_mutex_lock(&b->lock);
+		if (lock != NULL)
+			util_mutex_lock(lock);
+
+		m->size_idx = units;
 	}
 
 	ASSERT(m->size_idx >= units);
@@ -1239,7 +2189,10 @@ heap_get_bestfit_block(struct palloc_heap *heap, struct bucket *b,
 	if (units != m->size_idx)
 		heap_recycle_block(heap, b, m, units);
 
-	util_mutex_unlock(&b->lock);
+	if (lock != NULL)
+		util_mutex_unlock(lock);
+	else
+		heap_huge_split_done(h);
 
 	return 0;
 }
@@ -1287,6 +2240,59 @@ heap_get_block_data(struct palloc_heap *heap, struct memory_block m)
 	return (char *)&run->data + (run->block_size * m.block_off);
 }
 
+/*
+ * heap_get_headerless_block -- checks whether the data at the given offset
+ *	belongs to a header-less memory block and if so, returns that block
+ *
+ * The data of a block with an allocation header always starts in the first
+ * chunk of the block, whose header is valid, so looking at the chunk in which
+ * the offset lies is enough to tell the two kinds of blocks apart.
+ */
+int
+heap_get_headerless_block(struct palloc_heap *heap, uint64_t off,
+	struct memory_block *m)
+{
+	uintptr_t addr = (uintptr_t)heap->base + off;
+	uintptr_t zone0 = (uintptr_t)ZID_TO_ZONE(heap->layout, 0);
+	ASSERT(addr >= zone0);
+
+	uint32_t zone_id = (uint32_t)((addr - zone0) / ZONE_MAX_SIZE);
+	struct zone *z = ZID_TO_ZONE(heap->layout, zone_id);
+
+	ASSERT(addr >= (uintptr_t)&z->chunks[0]);
+	uint32_t chunk_id = (uint32_t)
+		((addr - (uintptr_t)&z->chunks[0]) / CHUNKSIZE);
+
+	struct chunk_header *hdr = &z->chunk_headers[chunk_id];
+	if (hdr->type != CHUNK_TYPE_RUN ||
+		!(hdr->flags & CHUNK_FLAG_HEADERLESS))
+		return 0;
+
+	struct chunk_run *run = (struct chunk_run *)&z->chunks[chunk_id];
+	uintptr_t diff = addr - (uintptr_t)&run->data;
+	ASSERT(diff % run->block_size == 0);
+
+	m->chunk_id = chunk_id;
+	m->zone_id = zone_id;
+	m->size_idx = 1;
+	m->block_off = (uint16_t)(diff / run->block_size);
+
+	return 1;
+}
+
+/*
+ * heap_get_headerless_type_num -- returns the type number of a header-less
+ *	memory block
+ */
+uint64_t
+heap_get_headerless_type_num(struct palloc_heap *heap, struct memory_block m)
+{
+	struct zone *z = ZID_TO_ZONE(heap->layout, m.zone_id);
+	struct chunk_run *run = (struct chunk_run *)&z->chunks[m.chunk_id];
+
+	return *heap_run_type_num_ptr(run);
+}
+
 /*
  * heap_run_get_block -- (internal) returns next/prev memory block from run
  */
@@ -1301,26 +2307,33 @@ heap_run_get_block(struct bucket *rb, struct chunk_run *r,
 	ASSERTeq(rb->type, BUCKET_RUN);
 	struct bucket_run *run = (struct bucket_run *)rb;
 
+	/*
+	 * The free blocks adjacent to the given one are counted with bit scans,
+	 * up to the closest unit_max boundary.
+	 */
 	if (prev) {
-		unsigned i;
-		for (i = b;
-			i % run->unit_max && BIT_IS_CLR(r->bitmap[v], i - 1);
-			--i)
-			;
-
-		mblock->block_off = (uint16_t)(v * BITS_PER_VALUE + i);
-		ASSERT(block_off >= mblock->block_off);
-		mblock->size_idx = (uint16_t)(block_off - mblock->block_off);
+		unsigned n = b % run->unit_max;
+		if (n != 0) {
+			uint64_t used = r->bitmap[v] << (BITS_PER_VALUE - b);
+			if (used != 0 && (unsigned)__builtin_clzll(used) < n)
+				n = (unsigned)__builtin_clzll(used);
+		}
+
+		mblock->block_off = (uint16_t)(block_off - n);
+		mblock->size_idx = n;
 	} else { /* next */
-		unsigned i;
-		for (i = b + size_idx;
-			i % run->unit_max && BIT_IS_CLR(r->bitmap[v], i);
-			++i)
-			;
+		unsigned i = b + size_idx;
+		unsigned n = (run->unit_max - i % run->unit_max) %
+			run->unit_max;
+		if (n != 0) {
+			uint64_t used = r->bitmap[v] >> i;
+			if (used != 0 && (unsigned)__builtin_ctzll(used) < n)
+				n = (unsigned)__builtin_ctzll(used);
+		}
 
 		ASSERT((uint64_t)block_off + size_idx <= UINT16_MAX);
 		mblock->block_off = (uint16_t)(block_off + size_idx);
-		mblock->size_idx = i - (b + size_idx);
+		mblock->size_idx = n;
 	}
 
 	if (mblock->size_idx == 0)
@@ -1420,6 +2433,40 @@ heap_coalesce(struct palloc_heap *heap,
 	return ret;
 }
 
+/*
+ * heap_get_rm_adjacent_block -- (internal) removes the free memory block that
+ *	directly touches the given one from the bucket
+ *
+ * The free units adjacent to the block in the run bitmap might not all be in
+ * the bucket, some of them can be held by the thread cache magazines. In that
+ * case only the part that directly touches the freed block is taken out, so
+ * that the bucket never keeps two adjacent blocks of the same run.
+ */
+static int
+heap_get_rm_adjacent_block(struct bucket *b, struct memory_block *m,
+	int prev)
+{
+	if (CNT_OP(b, get_rm_exact, *m) == 0)
+		return 0;
+
+	if (b->type != BUCKET_RUN)
+		return ENOENT;
+
+	struct memory_block f = *m;
+	for (f.size_idx = m->size_idx - 1; f.size_idx > 0; --f.size_idx) {
+		if (prev)
+			f.block_off = (uint16_t)(m->block_off +
+				m->size_idx - f.size_idx);
+
+		if (CNT_OP(b, get_rm_exact, f) == 0) {
+			*m = f;
+			return 0;
+		}
+	}
+
+	return ENOENT;
+}
+
 /*
  * heap_free_block -- creates free persistent state of a memory block
  */
@@ -1431,13 +2478,13 @@ heap_free_block(struct palloc_heap *heap, struct bucket *b,
 
 	struct memory_block prev = {0, 0, 0, 0};
 	if (heap_get_adjacent_free_block(heap, b, &prev, m, 1) == 0 &&
-		CNT_OP(b, get_rm_exact, prev) == 0) {
+		heap_get_rm_adjacent_block(b, &prev, 1) == 0) {
 		blocks[0] = &prev;
 	}
 
 	struct memory_block next = {0, 0, 0, 0};
 	if (heap_get_adjacent_free_block(heap, b, &next, m, 0) == 0 &&
-		CNT_OP(b, get_rm_exact, next) == 0) {
+		heap_get_rm_adjacent_block(b, &next, 0) == 0) {
 		blocks[2] = &next;
 	}
 
@@ -1506,11 +2553,14 @@ heap_degrade_run_if_empty(struct palloc_heap *heap,
 
 	unsigned i;
 	unsigned nval = r->bitmap_nval;
-	for (i = 0; nval > 0 && i < nval - 1; ++i)
-		if (run->bitmap[i] != 0)
-			goto out;
+	ASSERT(nval > 0);
+
+	/* no early exit, so that the compiler can vectorize the loop */
+	uint64_t used = 0;
+	for (i = 0; i < nval - 1; ++i)
+		used |= run->bitmap[i];
 
-	if (run->bitmap[i] != r->bitmap_lastval)
+	if (used != 0 || run->bitmap[i] != r->bitmap_lastval)
 		goto out;
 
 	if (traverse_bucket_run(b, m, b->c_ops->get_exact) != 0) {
@@ -1604,14 +2654,38 @@ heap_boot(struct palloc_heap *heap, void *heap_start, uint64_t heap_size,
 
 	h->max_zone = heap_max_zone(heap_size);
 	h->zones_exhausted = 0;
+	h->zones_populated = Zalloc(h->max_zone);
+	if (h->zones_populated == NULL) {
+		err = ENOMEM;
+		goto error_zones_populated_malloc;
+	}
+
+	h->zones_populating = 0;
+	util_mutex_init(&h->populate_lock, NULL);
+	if ((errno = pthread_cond_init(&h->populate_cond, NULL)) != 0)
+		FATAL("!pthread_cond_init");
+	h->populate_stop = 0;
+	h->nprefetch = heap_prefetch_nthreads(h->max_zone);
+	h->prefetch_threads = NULL;
 
 	util_mutex_init(&h->active_run_lock, NULL);
+	util_mutex_init(&h->class_lock, NULL);
 
 	for (int i = 0; i < MAX_RUN_LOCKS; ++i)
 		util_mutex_init(&h->run_locks[i], NULL);
 
 	memset(h->last_drained, 0, sizeof(h->last_drained));
 
+	h->huge_splits = 0;
+	h->huge_split_seq = 0;
+	h->huge_split_waiters = 0;
+
+	pthread_once(&Thread_caches_once, heap_thread_caches_init);
+	h->id = __sync_add_and_fetch(&Next_heap_id, 1);
+	LIST_INIT(&h->thread_caches);
+	h->thread_caches_flushing = 0;
+	memset(&h->flushed_stats, 0, sizeof(h->flushed_stats));
+
 	heap->p_ops = *p_ops;
 	heap->layout = heap_start;
 	heap->rt = h;
@@ -1626,6 +2700,8 @@ heap_boot(struct palloc_heap *heap, void *heap_start, uint64_t heap_size,
 
 	return 0;
 
+error_zones_populated_malloc:
+	Free(h->caches);
 error_heap_cache_malloc:
 	Free(h);
 	heap->rt = NULL;
@@ -1697,6 +2773,22 @@ heap_cleanup(struct palloc_heap *heap)
 {
 	struct heap_rt *rt = heap->rt;
 
+	if (rt->nprefetch != 0) {
+		util_mutex_lock(&rt->populate_lock);
+		rt->populate_stop = 1;
+		util_mutex_unlock(&rt->populate_lock);
+
+		for (unsigned i = 0; i < rt->nprefetch; ++i)
+			pthread_join(rt->prefetch_threads[i], NULL);
+		Free(rt->prefetch_threads);
+	}
+
+	heap_detach_thread_caches(heap);
+
+	util_mutex_destroy(&rt->populate_lock);
+	pthread_cond_destroy(&rt->populate_cond);
+	Free(rt->zones_populated);
+
 	bucket_delete(rt->default_bucket);
 
 	bucket_group_destroy(rt->buckets);
@@ -1712,6 +2804,7 @@ heap_cleanup(struct palloc_heap *heap)
 	Free(rt->caches);
 
 	util_mutex_destroy(&rt->active_run_lock);
+	util_mutex_destroy(&rt->class_lock);
 
 	struct active_run *r;
 	for (int i = 0; i < MAX_BUCKETS; ++i) {
@@ -1783,6 +2876,12 @@ heap_verify_chunk_header(struct chunk_header *hdr)
 		return -1;
 	}
 
+	if ((hdr->flags & CHUNK_FLAG_HEADERLESS) &&
+		hdr->type != CHUNK_TYPE_RUN) {
+		ERR("heap: invalid chunk flags");
+		return -1;
+	}
+
 	return 0;
 }
 
@@ -1899,17 +2998,170 @@ heap_check_remote(void *heap_start, uint64_t heap_size, struct remote_ops *ops)
 	return 0;
 }
 
+/*
+ * heap_cursor_run_next -- (internal) finds the next object of a run, starting
+ *	from the current block of the cursor
+ */
+static int
+heap_cursor_run_next(struct palloc_heap *heap, struct palloc_cursor *cur,
+	struct chunk_header *hdr, struct chunk_run *run,
+	struct palloc_object *obj)
+{
+	uint64_t bs = run->block_size;
+
+	int headerless = (hdr->flags & CHUNK_FLAG_HEADERLESS) != 0;
+	uint64_t nallocs = headerless ?
+		RUN_HEADERLESS_NALLOCS(bs) : RUN_NALLOCS(bs);
+
+	uint64_t b = cur->block;
+	while (b < nallocs) {
+		uint64_t used = run->bitmap[b / BITS_PER_VALUE] >>
+			(b % BITS_PER_VALUE);
+		if (used == 0) {
+			/* skip the rest of the free blocks of this value */
+			b = (b / BITS_PER_VALUE + 1) * BITS_PER_VALUE;
+			continue;
+		}
+
+		b += (uint64_t)__builtin_ctzll(used);
+		if (b >= nallocs)
+			break;
+
+		void *block = run->data + b * bs;
+		obj->off = PMALLOC_PTR_TO_OFF(heap, block);
+		obj->headerless = headerless;
+
+		if (headerless) {
+			obj->type_num = *heap_run_type_num_ptr(run);
+			/* header-less blocks are always one unit */
+			b += 1;
+		} else {
+			b += ((struct allocation_header *)block)->size / bs;
+		}
+
+		cur->block = (uint32_t)b;
+		return 1;
+	}
+
+	return 0;
+}
+
+/*
+ * heap_cursor_init -- positions the cursor at the beginning of one of
+ *	'nparts' disjoint ranges of chunks of a similar length
+ */
+void
+heap_cursor_init(struct palloc_heap *heap, struct palloc_cursor *cur,
+	unsigned part, unsigned nparts)
+{
+	ASSERT(part < nparts);
+
+	unsigned max_zone = heap_max_zone(heap->size);
+	uint64_t nchunks = max_zone == 0 ? 0 :
+		(uint64_t)(max_zone - 1) * MAX_CHUNK +
+		get_zone_size_idx(max_zone - 1, max_zone, heap->size);
+
+	uint64_t begin = nchunks * part / nparts;
+	cur->end = nchunks * (part + 1) / nparts;
+	cur->block = 0;
+	cur->chunk = begin;
+
+	if (begin >= cur->end)
+		return;
+
+	/*
+	 * The range begins at the first memory block that starts in it,
+	 * the previous one belongs to the preceding range.
+	 */
+	uint32_t zone_id = (uint32_t)(begin / MAX_CHUNK);
+	uint32_t chunk_id = (uint32_t)(begin % MAX_CHUNK);
+	struct zone *z = ZID_TO_ZONE(heap->layout, zone_id);
+	if (z->header.magic == 0)
+		return;
+
+	uint32_t i = 0;
+	while (i < chunk_id && i < z->header.size_idx)
+		i += z->chunk_headers[i].size_idx;
+
+	cur->chunk = (uint64_t)zone_id * MAX_CHUNK + i;
+}
+
+/*
+ * heap_cursor_seek -- positions the cursor right after the given memory block
+ */
+void
+heap_cursor_seek(struct palloc_heap *heap, struct palloc_cursor *cur,
+	struct memory_block m)
+{
+	heap_cursor_init(heap, cur, 0, 1);
+
+	struct zone *z = ZID_TO_ZONE(heap->layout, m.zone_id);
+	struct chunk_header *hdr = &z->chunk_headers[m.chunk_id];
+
+	cur->chunk = (uint64_t)m.zone_id * MAX_CHUNK + m.chunk_id;
+	cur->block = hdr->type == CHUNK_TYPE_RUN ?
+		m.block_off + m.size_idx : 1;
+}
+
+/*
+ * heap_cursor_next -- returns the next object of the cursor's range, the
+ *	offset is the one of the memory block
+ */
+int
+heap_cursor_next(struct palloc_heap *heap, struct palloc_cursor *cur,
+	struct palloc_object *obj)
+{
+	struct heap_layout *layout = heap->layout;
+
+	while (cur->chunk < cur->end) {
+		uint32_t zone_id = (uint32_t)(cur->chunk / MAX_CHUNK);
+		uint32_t chunk_id = (uint32_t)(cur->chunk % MAX_CHUNK);
+		struct zone *z = ZID_TO_ZONE(layout, zone_id);
+
+		if (z->header.magic == 0 || chunk_id >= z->header.size_idx) {
+			/* the rest of the zone holds no objects */
+			cur->chunk = (uint64_t)(zone_id + 1) * MAX_CHUNK;
+			cur->block = 0;
+			continue;
+		}
+
+		struct chunk_header *hdr = &z->chunk_headers[chunk_id];
+		struct chunk *chunk = &z->chunks[chunk_id];
+
+		if (hdr->type == CHUNK_TYPE_USED && cur->block == 0) {
+			cur->block = 1;
+			obj->off = PMALLOC_PTR_TO_OFF(heap, chunk);
+			obj->headerless = 0;
+			return 1;
+		}
+
+		if (hdr->type == CHUNK_TYPE_RUN &&
+			heap_cursor_run_next(heap, cur, hdr,
+				(struct chunk_run *)chunk, obj))
+			return 1;
+
+		cur->chunk += hdr->size_idx;
+		cur->block = 0;
+	}
+
+	return 0;
+}
+
+#ifdef USE_VG_MEMCHECK
+
 /*
  * heap_run_foreach_object -- (internal) iterates through objects in a run
  */
 static int
 heap_run_foreach_object(struct palloc_heap *heap, object_callback cb,
-		void *arg, struct chunk_run *run)
+		void *arg, struct chunk_header *hdr, struct chunk_run *run)
 {
 	uint64_t bs = run->block_size;
 	uint64_t block_off;
 
-	uint64_t bitmap_nallocs = RUN_NALLOCS(bs);
+	int headerless = (hdr->flags & CHUNK_FLAG_HEADERLESS) != 0;
+	uint64_t bitmap_nallocs = headerless ?
+		RUN_HEADERLESS_NALLOCS(bs) : RUN_NALLOCS(bs);
 	uint64_t unused_bits = RUN_BITMAP_SIZE - bitmap_nallocs;
 	uint64_t unused_values = unused_bits / BITS_PER_VALUE;
 	uint64_t bitmap_nval = MAX_BITMAP_VALUES - unused_values;
@@ -1934,9 +3186,13 @@ heap_run_foreach_object(struct palloc_heap *heap, object_callback cb,
 				if (cb(PMALLOC_PTR_TO_OFF(heap, alloc), arg)
 						!= 0)
 					return 1;
-				j += (alloc->size / bs);
+				/* header-less blocks are always one unit */
+				j += headerless ? 1 : (alloc->size / bs);
 			} else {
-				++j;
+				/* skip the entire span of free blocks */
+				uint64_t used = v >> j;
+				j = used == 0 ? BITS_PER_VALUE :
+					j + (uint64_t)__builtin_ctzll(used);
 			}
 		}
 		block_start = 0;
@@ -1945,68 +3201,6 @@ heap_run_foreach_object(struct palloc_heap *heap, object_callback cb,
 	return 0;
 }
 
-/*
- * heap_chunk_foreach_object -- (internal) iterates through objects in a chunk
- */
-static int
-heap_chunk_foreach_object(struct palloc_heap *heap, object_callback cb,
-	void *arg, struct chunk_header *hdr, struct chunk *chunk)
-{
-	switch (hdr->type) {
-		case CHUNK_TYPE_FREE:
-			return 0;
-		case CHUNK_TYPE_USED:
-			return cb(PMALLOC_PTR_TO_OFF(heap, chunk), arg);
-		case CHUNK_TYPE_RUN:
-			return heap_run_foreach_object(heap, cb, arg,
-				(struct chunk_run *)chunk);
-		default:
-			ASSERT(0);
-	}
-
-	return 0;
-}
-
-/*
- * heap_zone_foreach_object -- (internal) iterates through objects in a zone
- */
-static int
-heap_zone_foreach_object(struct palloc_heap *heap, object_callback cb,
-	void *arg, struct zone *zone, struct memory_block start)
-{
-	if (zone->header.magic == 0)
-		return 0;
-
-	uint32_t i;
-	for (i = start.chunk_id; i < zone->header.size_idx; ) {
-		if (heap_chunk_foreach_object(heap, cb, arg,
-			&zone->chunk_headers[i], &zone->chunks[i]) != 0)
-			return 1;
-
-		i += zone->chunk_headers[i].size_idx;
-	}
-
-	return 0;
-}
-
-/*
- * heap_foreach_object -- (internal) iterates through objects in the heap
- */
-void
-heap_foreach_object(struct palloc_heap *heap, object_callback cb, void *arg,
-	struct memory_block start)
-{
-	struct heap_layout *layout = heap->layout;
-
-	for (unsigned i = start.zone_id;
-		i < heap_max_zone(layout->header.size); ++i)
-		if (heap_zone_foreach_object(heap, cb, arg,
-				ZID_TO_ZONE(layout, i), start) != 0)
-			break;
-}
-
-#ifdef USE_VG_MEMCHECK
-
 /*
  * heap_vg_open_chunk -- (internal) notifies Valgrind about chunk layout
  */
@@ -2021,9 +3215,13 @@ heap_vg_open_chunk(struct palloc_heap *heap,
 		VALGRIND_DO_MAKE_MEM_NOACCESS(run, sizeof(*run));
 		VALGRIND_DO_MAKE_MEM_DEFINED(run,
 			sizeof(*run) - sizeof(run->data));
+		if (hdr->flags & CHUNK_FLAG_HEADERLESS)
+			VALGRIND_DO_MAKE_MEM_DEFINED(heap_run_type_num_ptr(run),
+				RUN_TYPE_NUM_SIZE);
 
 		if (objects) {
-			int ret = heap_run_foreach_object(heap, cb, arg, run);
+			int ret = heap_run_foreach_object(heap, cb, arg,
+				hdr, run);
 			ASSERTeq(ret, 0);
 		}
 	} else {
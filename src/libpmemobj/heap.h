@@ -78,9 +78,17 @@ struct bucket *heap_get_chunk_bucket(struct palloc_heap *heap,
 		uint32_t chunk_id, uint32_t zone_id);
 struct bucket *heap_get_auxiliary_bucket(struct palloc_heap *heap,
 		size_t size);
+struct bucket *heap_get_class_bucket(struct palloc_heap *heap,
+		unsigned class_id, int auxiliary);
+int heap_create_alloc_class(struct palloc_heap *heap, size_t unit_size,
+		int headerless, uint64_t type_num, unsigned *class_id);
 void heap_drain_to_auxiliary(struct palloc_heap *heap, struct bucket *auxb,
 	uint32_t size_idx);
 void *heap_get_block_data(struct palloc_heap *heap, struct memory_block m);
+int heap_get_headerless_block(struct palloc_heap *heap, uint64_t off,
+	struct memory_block *m);
+uint64_t heap_get_headerless_type_num(struct palloc_heap *heap,
+	struct memory_block m);
 
 int heap_get_adjacent_free_block(struct palloc_heap *heap, struct bucket *b,
 	struct memory_block *m, struct memory_block cnt, int prev);
@@ -88,6 +96,12 @@ void heap_chunk_write_footer(struct chunk_header *hdr, uint32_t size_idx);
 
 int heap_get_bestfit_block(struct palloc_heap *heap, struct bucket *b,
 	struct memory_block *m);
+int heap_get_magazine_block(struct palloc_heap *heap, struct bucket *b,
+	struct memory_block *m);
+int heap_put_magazine_block(struct palloc_heap *heap, struct bucket *b,
+	struct memory_block m);
+void heap_get_cache_stats(struct palloc_heap *heap,
+	struct palloc_cache_stats *stats);
 int heap_get_exact_block(struct palloc_heap *heap, struct bucket *b,
 	struct memory_block *m, uint32_t new_size_idx);
 void heap_degrade_run_if_empty(struct palloc_heap *heap, struct bucket *b,
@@ -99,8 +113,12 @@ pthread_mutex_t *heap_get_run_lock(struct palloc_heap *heap,
 struct memory_block heap_free_block(struct palloc_heap *heap, struct bucket *b,
 	struct memory_block m, struct operation_context *ctx);
 
-void heap_foreach_object(struct palloc_heap *heap, object_callback cb,
-	void *arg, struct memory_block start);
+void heap_cursor_init(struct palloc_heap *heap, struct palloc_cursor *cur,
+	unsigned part, unsigned nparts);
+void heap_cursor_seek(struct palloc_heap *heap, struct palloc_cursor *cur,
+	struct memory_block m);
+int heap_cursor_next(struct palloc_heap *heap, struct palloc_cursor *cur,
+	struct palloc_object *obj);
 
 void *heap_end(struct palloc_heap *heap);
 
@@ -60,6 +60,7 @@
 #define RUN_BITMAP_SIZE (BITS_PER_VALUE * MAX_BITMAP_VALUES)
 #define RUNSIZE (CHUNKSIZE - RUN_METASIZE)
 #define MIN_RUN_SIZE 128
+#define RUN_TYPE_NUM_SIZE 8 /* type number of header-less runs */
 
 #define ZID_TO_ZONE(layoutp, zone_id)\
 	((struct zone *)((uintptr_t)&(((struct heap_layout *)(layoutp))->zone0)\
@@ -67,7 +68,8 @@
 
 enum chunk_flags {
 	CHUNK_FLAG_ZEROED	=	0x0001,
-	CHUNK_RUN_ACTIVE	=	0x0002
+	CHUNK_RUN_ACTIVE	=	0x0002,
+	CHUNK_FLAG_HEADERLESS	=	0x0004
 };
 
 enum chunk_type {
@@ -84,6 +86,11 @@ struct chunk {
 	uint8_t data[CHUNKSIZE];
 };
 
+/*
+ * The runs of chunks with CHUNK_FLAG_HEADERLESS set contain blocks without
+ * the allocation header and store the type number of those blocks in the last
+ * RUN_TYPE_NUM_SIZE bytes of the data.
+ */
 struct chunk_run {
 	uint64_t block_size;
 	uint64_t bucket_vptr; /* runtime information */
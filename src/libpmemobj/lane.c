@@ -41,15 +41,43 @@
 #include <errno.h>
 #include <limits.h>
 #include <pthread.h>
+#include <stdlib.h>
 
 #include "libpmemobj.h"
 #include "cuckoo.h"
+#include "futex.h"
 #include "lane.h"
+#include "numa.h"
 #include "out.h"
 #include "util.h"
 #include "obj.h"
 #include "valgrind_internal.h"
 
+/*
+ * Number of rounds of looking for a free lane before the thread goes to sleep
+ * until one of the lanes is released.
+ */
+#define LANE_SPIN_ROUNDS 8
+
+/*
+ * Lanes are recovered by multiple threads only when each of them gets at
+ * least this many lanes, there's nothing to gain on clean pools with few lanes.
+ */
+#define LANE_RECOVERY_MIN_LANES 128
+
+/* number of consecutive lanes claimed at once by a recovery thread */
+#define LANE_RECOVERY_BATCH 16
+
+/*
+ * lane_recovery -- state shared by the threads recovering a lane section
+ */
+struct lane_recovery {
+	PMEMobjpool *pop;
+	int section;
+	uint64_t next_lane; /* first lane of the next batch to be claimed */
+	int err;
+};
+
 static pthread_key_t Lane_info_key;
 
 static __thread struct cuckoo *Lane_info_ht;
@@ -206,6 +234,40 @@ lane_destroy(PMEMobjpool *pop, struct lane *lane)
 		Section_ops[i]->destroy_rt(pop, lane->sections[i].runtime);
 }
 
+/*
+ * lane_nodes_init -- (internal) splits the lanes available at runtime between
+ *	the NUMA nodes, proportionally to the number of processors of each node
+ */
+static int
+lane_nodes_init(struct lane_descriptor *desc)
+{
+	unsigned nnodes = util_numa_nnodes();
+
+	desc->nodes = Malloc(sizeof(struct lane_node) * nnodes);
+	if (desc->nodes == NULL)
+		return -1;
+
+	desc->nnodes = nnodes;
+
+	uint64_t ncpus = util_numa_ncpus_total();
+	uint64_t nlanes = desc->runtime_nlanes;
+	uint64_t cpus_before = 0;
+	for (unsigned n = 0; n < nnodes; ++n) {
+		struct lane_node *node = &desc->nodes[n];
+
+		node->first = (unsigned)(nlanes * cpus_before / ncpus);
+		cpus_before += util_numa_ncpus(n);
+		node->nlanes = (unsigned)(nlanes * cpus_before / ncpus) -
+			node->first;
+		node->next_lane_idx = 0;
+
+		LOG(4, "node %u lanes %u-%u", n, node->first,
+			node->first + node->nlanes);
+	}
+
+	return 0;
+}
+
 /*
  * lane_boot -- initializes all lanes
  */
@@ -214,22 +276,35 @@ lane_boot(PMEMobjpool *pop)
 {
 	int err = 0;
 
-	pop->lanes_desc.lane = Malloc(sizeof(struct lane) * pop->nlanes);
+	pop->lanes_desc.lane = Zalloc(sizeof(struct lane) * pop->nlanes);
 	if (pop->lanes_desc.lane == NULL) {
 		err = ENOMEM;
 		ERR("!Malloc of volatile lanes");
 		goto error_lanes_malloc;
 	}
 
-	pop->lanes_desc.next_lane_idx = 0;
+	if (lane_nodes_init(&pop->lanes_desc) != 0) {
+		err = ENOMEM;
+		ERR("!Malloc of lane nodes");
+		goto error_nodes_malloc;
+	}
 
 	pop->lanes_desc.lane_locks =
 		Zalloc(sizeof(*pop->lanes_desc.lane_locks) * pop->nlanes);
 	if (pop->lanes_desc.lane_locks == NULL) {
+		err = ENOMEM;
 		ERR("!Malloc for lane locks");
 		goto error_locks_malloc;
 	}
 
+	pop->lanes_desc.stats =
+		Zalloc(sizeof(*pop->lanes_desc.stats) * pop->nlanes);
+	if (pop->lanes_desc.stats == NULL) {
+		err = ENOMEM;
+		ERR("!Malloc for lane stats");
+		goto error_stats_malloc;
+	}
+
 	/* add lanes to pmemcheck ignored list */
 	VALGRIND_ADD_TO_GLOBAL_TX_IGNORE((char *)pop + pop->lanes_offset,
 		(sizeof(struct lane_layout) * pop->nlanes));
@@ -249,9 +324,15 @@ lane_boot(PMEMobjpool *pop)
 error_lane_init:
 	for (; i >= 1; --i)
 		lane_destroy(pop, &pop->lanes_desc.lane[i - 1]);
+	Free(pop->lanes_desc.stats);
+	pop->lanes_desc.stats = NULL;
+error_stats_malloc:
 	Free(pop->lanes_desc.lane_locks);
 	pop->lanes_desc.lane_locks = NULL;
 error_locks_malloc:
+	Free(pop->lanes_desc.nodes);
+	pop->lanes_desc.nodes = NULL;
+error_nodes_malloc:
 	Free(pop->lanes_desc.lane);
 	pop->lanes_desc.lane = NULL;
 error_lanes_malloc:
@@ -271,33 +352,165 @@ lane_cleanup(PMEMobjpool *pop)
 	pop->lanes_desc.lane = NULL;
 	Free(pop->lanes_desc.lane_locks);
 	pop->lanes_desc.lane_locks = NULL;
+	Free(pop->lanes_desc.stats);
+	pop->lanes_desc.stats = NULL;
+	Free(pop->lanes_desc.nodes);
+	pop->lanes_desc.nodes = NULL;
 
 	lane_info_cleanup(pop);
 }
 
 /*
- * lane_recover_and_boot -- performs initialization and recovery of all lanes
+ * lane_recovery_nthreads -- (internal) returns the number of threads which
+ *	recover the lanes of the pool
+ *
+ * The number can be set using PMEMOBJ_RECOVERY_THREADS environment variable,
+ * by default there's one thread per CPU as long as there are enough lanes.
  */
-int
-lane_recover_and_section_boot(PMEMobjpool *pop)
+static unsigned
+lane_recovery_nthreads(PMEMobjpool *pop)
 {
-	int err = 0;
-	int i; /* section index */
-	uint64_t j; /* lane index */
-	struct lane_layout *layout;
+	uint64_t nthreads;
+
+	char *e = getenv("PMEMOBJ_RECOVERY_THREADS");
+	if (e != NULL) {
+		int n = atoi(e);
+		nthreads = n > 0 ? (uint64_t)n : 1;
+	} else {
+		nthreads = util_numa_ncpus_total();
+		if (nthreads > pop->nlanes / LANE_RECOVERY_MIN_LANES)
+			nthreads = pop->nlanes / LANE_RECOVERY_MIN_LANES;
+	}
 
-	for (i = 0; i < MAX_LANE_SECTION; ++i) {
-		for (j = 0; j < pop->nlanes; ++j) {
-			layout = lane_get_layout(pop, j);
-			err = Section_ops[i]->recover(pop, &layout->sections[i],
+	/* every thread has to get at least one batch */
+	uint64_t nbatches = (pop->nlanes + LANE_RECOVERY_BATCH - 1) /
+		LANE_RECOVERY_BATCH;
+	if (nthreads > nbatches)
+		nthreads = nbatches;
+
+	return nthreads == 0 ? 1 : (unsigned)nthreads;
+}
+
+/*
+ * lane_recover_worker -- (internal) recovers the section of the lanes claimed
+ *	in batches until all lanes of the pool are claimed
+ */
+static void *
+lane_recover_worker(void *arg)
+{
+	struct lane_recovery *rec = arg;
+	PMEMobjpool *pop = rec->pop;
+	int i = rec->section;
+
+	uint64_t first;
+	while ((first = __sync_fetch_and_add(&rec->next_lane,
+			LANE_RECOVERY_BATCH)) < pop->nlanes) {
+		uint64_t end = first + LANE_RECOVERY_BATCH;
+		if (end > pop->nlanes)
+			end = pop->nlanes;
+
+		for (uint64_t j = first; j < end; ++j) {
+			/* give up on the rest if one of the lanes failed */
+			if (rec->err != 0)
+				return NULL;
+
+			struct lane_layout *layout = lane_get_layout(pop, j);
+			int err = Section_ops[i]->recover(pop,
+				&layout->sections[i],
 				sizeof(layout->sections[i]));
 
 			if (err != 0) {
 				LOG(2, "section_ops->recover %d %ju %d",
 					i, j, err);
-				return err;
+				__sync_bool_compare_and_swap(&rec->err, 0, err);
+				return NULL;
 			}
 		}
+	}
+
+	return NULL;
+}
+
+/*
+ * lane_need_recovery -- (internal) checks if the section of any lane has to be
+ *	recovered
+ */
+static int
+lane_need_recovery(PMEMobjpool *pop, int section)
+{
+	if (Section_ops[section]->need_recovery == NULL)
+		return 1;
+
+	for (uint64_t j = 0; j < pop->nlanes; ++j) {
+		struct lane_layout *layout = lane_get_layout(pop, j);
+		if (Section_ops[section]->need_recovery(pop,
+				&layout->sections[section],
+				sizeof(layout->sections[section]))) {
+			LOG(4, "section %d of lane %ju needs recovery",
+				section, j);
+			return 1;
+		}
+	}
+
+	return 0;
+}
+
+/*
+ * lane_recover_section -- (internal) recovers the section of all lanes
+ *
+ * The lanes are independent of each other - the operations which could leave
+ * overlapping modifications in different lanes are serialized by the locks
+ * they hold until their logs are cleared. They can be thus recovered
+ * concurrently, with the calling thread being one of the recovery threads.
+ * The threads are started only if any of the lanes was left in the middle of
+ * an operation, the recovery of clean lanes is cheap.
+ */
+static int
+lane_recover_section(PMEMobjpool *pop, int section, unsigned nthreads)
+{
+	struct lane_recovery rec = {pop, section, 0, 0};
+
+	pthread_t *threads = NULL;
+	unsigned nstarted = 0;
+
+	if (nthreads > 1 && lane_need_recovery(pop, section) &&
+	    (threads = Malloc(sizeof(*threads) * (nthreads - 1))) != NULL) {
+		/* the calling thread does the work of any missing thread */
+		while (nstarted < nthreads - 1 &&
+		    pthread_create(&threads[nstarted], NULL,
+				lane_recover_worker, &rec) == 0)
+			nstarted++;
+	}
+
+	lane_recover_worker(&rec);
+
+	for (unsigned t = 0; t < nstarted; ++t)
+		pthread_join(threads[t], NULL);
+
+	Free(threads);
+
+	return rec.err;
+}
+
+/*
+ * lane_recover_and_boot -- performs initialization and recovery of all lanes
+ *
+ * Each section has to be recovered in all lanes before it's booted, because
+ * the recovery of the allocator section repairs the heap metadata used by
+ * the allocator, which is in turn used by the recovery of the other sections.
+ */
+int
+lane_recover_and_section_boot(PMEMobjpool *pop)
+{
+	int err = 0;
+	int i; /* section index */
+	unsigned nthreads = lane_recovery_nthreads(pop);
+
+	LOG(4, "recovery threads %u", nthreads);
+
+	for (i = 0; i < MAX_LANE_SECTION; ++i) {
+		if ((err = lane_recover_section(pop, i, nthreads)) != 0)
+			return err;
 
 		if ((err = Section_ops[i]->boot(pop)) != 0) {
 			LOG(2, "section_ops->init %d %d", i, err);
@@ -338,22 +551,119 @@ lane_check(PMEMobjpool *pop)
 }
 
 /*
- * get_lane -- (internal) get free lane index
+ * get_lane_in_range -- (internal) tries to lock one of n lanes starting from
+ *	the index, wrapping around from the end to the first lane of the range
+ */
+static inline int
+get_lane_in_range(uint64_t *locks, uint64_t *index, uint64_t first,
+	uint64_t end, uint64_t n)
+{
+	for (uint64_t i = 0; i < n; ++i) {
+		/* don't steal the cache lines of the held locks */
+		if (likely(locks[*index] == 0 &&
+				util_bool_compare_and_swap64(
+				&locks[*index], 0, 1)))
+			return 1;
+
+		if (++(*index) == end)
+			*index = first;
+	}
+
+	return 0;
+}
+
+/*
+ * lane_assign -- (internal) returns the lane from which the thread starts
+ *	looking for a free lane of the node
+ */
+static inline uint64_t
+lane_assign(struct lane_node *node)
+{
+	if (node->nlanes == 0)
+		return node->first;
+
+	/* initial wrap to next CL */
+	unsigned idx = __sync_fetch_and_add(&node->next_lane_idx, LANE_JUMP);
+
+	return node->first + idx % node->nlanes;
+}
+
+/*
+ * get_lane_once -- (internal) makes a single pass over the lanes of the node
+ *	and then over the lanes of the other nodes looking for a free lane
+ */
+static inline int
+get_lane_once(struct lane_descriptor *desc, struct lane_info *info,
+	struct lane_node *node)
+{
+	uint64_t *locks = desc->lane_locks;
+	uint64_t nlanes = desc->runtime_nlanes;
+	uint64_t end = node->first + node->nlanes;
+
+	if (likely(get_lane_in_range(locks, &info->lane_idx,
+			node->first, end, node->nlanes))) {
+		desc->stats[info->lane_idx].stats.local_hits++;
+		return 1;
+	}
+
+	/* steal a lane of the other nodes */
+	uint64_t idx = end % nlanes;
+	if (get_lane_in_range(locks, &idx, 0, nlanes,
+			nlanes - node->nlanes)) {
+		info->lane_idx = idx;
+		desc->stats[idx].stats.remote_hits++;
+		return 1;
+	}
+
+	return 0;
+}
+
+/*
+ * get_lane -- (internal) get free lane index, preferably from the lanes of
+ *	the NUMA node the thread runs on
+ *
+ * If all lanes stay held for a few rounds, the thread sleeps on the lanes
+ * eventcount: it announces itself as a waiter, reads the epoch and looks for
+ * a free lane once more before going to sleep. A lane released after that
+ * last look bumps the epoch, so the sleep either doesn't start or is
+ * interrupted, and no wakeup can be lost.
  */
 static inline void
-get_lane(uint64_t *locks, uint64_t *index, uint64_t nlocks)
+get_lane(struct lane_descriptor *desc, struct lane_info *info)
 {
-	while (1) {
-		do {
-			*index %= nlocks;
-			if (likely(util_bool_compare_and_swap64(
-					&locks[*index], 0, 1)))
-				return;
+	unsigned n = util_numa_node();
+	if (unlikely(n >= desc->nnodes))
+		n = 0;
+
+	struct lane_node *node = &desc->nodes[n];
 
-			++(*index);
-		} while (*index < nlocks);
+	/* also true for threads that moved to another node */
+	if (unlikely(info->lane_idx - node->first >= node->nlanes))
+		info->lane_idx = lane_assign(node);
 
+	if (likely(get_lane_once(desc, info, node)))
+		return;
+
+	for (unsigned round = 1; round < LANE_SPIN_ROUNDS; ++round) {
 		sched_yield();
+
+		if (get_lane_once(desc, info, node))
+			return;
+	}
+
+	while (1) {
+		__sync_fetch_and_add(&desc->lane_waiters, 1);
+		uint32_t epoch = desc->lane_epoch;
+		__sync_synchronize();
+
+		int found = get_lane_once(desc, info, node);
+		if (!found)
+			util_futex_wait(&desc->lane_epoch, epoch);
+
+		__sync_fetch_and_sub(&desc->lane_waiters, 1);
+
+		if (found || get_lane_once(desc, info, node))
+			return;
 	}
 }
 
@@ -401,7 +711,8 @@ get_lane_info_record(PMEMobjpool *pop)
 }
 
 /*
- * lane_hold -- grabs a per-thread lane in a round-robin fashion
+ * lane_hold -- grabs a per-thread lane in a round-robin fashion from the lanes
+ *	of the thread's NUMA node
  */
 unsigned
 lane_hold(PMEMobjpool *pop, struct lane_section **section,
@@ -422,17 +733,10 @@ lane_hold(PMEMobjpool *pop, struct lane_section **section,
 	}
 
 	struct lane_info *lane = get_lane_info_record(pop);
-	while (unlikely(lane->lane_idx == UINT64_MAX)) {
-		/* initial wrap to next CL */
-		lane->lane_idx = __sync_fetch_and_add(
-			&pop->lanes_desc.next_lane_idx, LANE_JUMP);
-	} /* handles wraparound */
 
-	uint64_t *llocks = pop->lanes_desc.lane_locks;
 	/* grab next free lane from lanes available at runtime */
 	if (!lane->nest_count++)
-		get_lane(llocks, &lane->lane_idx,
-			pop->lanes_desc.runtime_nlanes);
+		get_lane(&pop->lanes_desc, lane);
 
 	if (section) {
 		ASSERT(type < MAX_LANE_SECTION);
@@ -461,10 +765,37 @@ lane_release(PMEMobjpool *pop)
 	if (unlikely(lane->nest_count == 0)) {
 		FATAL("lane_release");
 	} else if (--(lane->nest_count) == 0) {
+		struct lane_descriptor *desc = &pop->lanes_desc;
+
 		if (unlikely(!util_bool_compare_and_swap64(
-				&pop->lanes_desc.lane_locks[lane->lane_idx],
+				&desc->lane_locks[lane->lane_idx],
 				1, 0))) {
 			FATAL("util_bool_compare_and_swap64");
 		}
+
+		/* the CAS orders the unlock before reading the waiters */
+		if (unlikely(desc->lane_waiters != 0)) {
+			__sync_fetch_and_add(&desc->lane_epoch, 1);
+			util_futex_wake(&desc->lane_epoch, 1);
+		}
+	}
+}
+
+/*
+ * lane_get_stats -- sums up the statistics of all lanes
+ *
+ * The counters are updated without synchronization by the lane holders, so
+ * the result is only approximate if the lanes are being concurrently used.
+ */
+void
+lane_get_stats(PMEMobjpool *pop, struct lane_stats *stats)
+{
+	stats->local_hits = 0;
+	stats->remote_hits = 0;
+
+	for (unsigned i = 0; i < pop->lanes_desc.runtime_nlanes; ++i) {
+		struct lane_stats *s = &pop->lanes_desc.stats[i].stats;
+		stats->local_hits += s->local_hits;
+		stats->remote_hits += s->remote_hits;
 	}
 }
@@ -81,11 +81,41 @@ struct lane_layout {
 	struct lane_section_layout sections[MAX_LANE_SECTION];
 };
 
+/*
+ * Number of times a lane was taken by threads running on the NUMA node the
+ * lane belongs to and by threads from the other nodes.
+ */
+struct lane_stats {
+	uint64_t local_hits;
+	uint64_t remote_hits;
+};
+
+/*
+ * Statistics of a lane, updated only by the thread holding the lane. They are
+ * padded to a cache line, so that the threads holding adjacent lanes don't
+ * share it.
+ */
+struct lane_stats_line {
+	struct lane_stats stats;
+	char padding[_POBJ_CL_SIZE - sizeof(struct lane_stats)];
+};
+
 struct lane {
 	/* volatile state */
 	struct lane_section sections[MAX_LANE_SECTION];
 };
 
+/*
+ * Contiguous range of lanes assigned to a NUMA node. Threads prefer the lanes
+ * of the node they run on and only take the lanes of other nodes if all of
+ * these are held.
+ */
+struct lane_node {
+	unsigned first;
+	unsigned nlanes;
+	unsigned next_lane_idx;
+};
+
 struct lane_descriptor {
 	/*
 	 * Number of lanes available at runtime must be <= total number of lanes
@@ -93,9 +123,19 @@ struct lane_descriptor {
 	 * other resources e.g. available RNIC's submission queue sizes.
 	 */
 	unsigned runtime_nlanes;
-	unsigned next_lane_idx;
+	unsigned nnodes;
+	struct lane_node *nodes;
 	uint64_t *lane_locks;
 	struct lane *lane;
+	struct lane_stats_line *stats;
+
+	/*
+	 * Eventcount of the lane locks, threads that can't find a free lane
+	 * sleep on the epoch, which is bumped by lane releases if there are
+	 * any waiters.
+	 */
+	uint32_t lane_epoch;
+	uint32_t lane_waiters;
 };
 
 typedef int (*section_layout_op)(PMEMobjpool *pop, void *data, unsigned length);
@@ -108,6 +148,7 @@ struct section_operations {
 	section_destr destroy_rt;
 	section_layout_op check;
 	section_layout_op recover;
+	section_layout_op need_recovery; /* optional, cheaper than recover */
 	section_global_op boot;
 };
 
@@ -132,6 +173,8 @@ unsigned lane_hold(PMEMobjpool *pop, struct lane_section **section,
 	enum lane_section_type type);
 void lane_release(PMEMobjpool *pop);
 
+void lane_get_stats(PMEMobjpool *pop, struct lane_stats *stats);
+
 #ifndef _MSC_VER
 
 #define SECTION_PARM(n, ops)\
@@ -516,7 +516,7 @@ list_insert_new(PMEMobjpool *pop,
 	if (constructor) {
 		if ((ret = pmalloc_construct(pop,
 				&section->obj_offset, size,
-				constructor, arg))) {
+				constructor, arg, 0))) {
 			ERR("!pmalloc_construct");
 			goto err_pmalloc;
 		}
@@ -1053,6 +1053,21 @@ lane_list_recovery(PMEMobjpool *pop, void *data, unsigned length)
 	return 0;
 }
 
+/*
+ * lane_list_need_recovery -- (internal) checks if the list section of the lane
+ *	has to be recovered
+ */
+static int
+lane_list_need_recovery(PMEMobjpool *pop, void *data, unsigned length)
+{
+	struct lane_list_layout *section = data;
+	ASSERT(sizeof(*section) <= length);
+
+	return section->obj_offset != 0 ||
+		redo_log_need_recovery(pop->redo, section->redo,
+			REDO_NUM_ENTRIES);
+}
+
 /*
  * lane_list_check -- (internal) check consistency of lane
  */
@@ -1114,6 +1129,7 @@ static struct section_operations list_ops = {
 	.construct_rt = lane_list_construct_rt,
 	.destroy_rt = lane_list_destroy_rt,
 	.recover = lane_list_recovery,
+	.need_recovery = lane_list_need_recovery,
 	.check = lane_list_check,
 	.boot = lane_list_boot
 };
@@ -63,8 +63,65 @@ operation_init(struct operation_context *ctx, const void *base,
 	else
 		ctx->p_ops = NULL;
 
-	ctx->nentries[ENTRY_PERSISTENT] = 0;
-	ctx->nentries[ENTRY_TRANSIENT] = 0;
+	ctx->redo_nentries = MAX_PERSITENT_ENTRIES;
+	ctx->redo_ext = NULL;
+
+	for (int t = 0; t < MAX_OPERATION_ENTRY_TYPE; ++t) {
+		ctx->nentries[t] = 0;
+		ctx->max_entries[t] = t == ENTRY_PERSISTENT ?
+			MAX_PERSITENT_ENTRIES : MAX_TRANSIENT_ENTRIES;
+		ctx->entries[t] = ctx->local_entries[t];
+	}
+}
+
+/*
+ * operation_reserve -- extends the capacity of the operation to nentries of
+ *	each type
+ *
+ * The persistent entries that don't fit into the fixed-size redo log are
+ * stored in the extension whose offset is pointed to by redo_ext, and it's up
+ * to the caller to make sure that the extension is large enough.
+ * A context with reserved capacity has to be finalized with operation_fini.
+ */
+int
+operation_reserve(struct operation_context *ctx, size_t nentries,
+	const uint64_t *redo_ext)
+{
+	ASSERTeq(ctx->nentries[ENTRY_PERSISTENT], 0);
+	ASSERTeq(ctx->nentries[ENTRY_TRANSIENT], 0);
+
+	for (int t = 0; t < MAX_OPERATION_ENTRY_TYPE; ++t) {
+		if (nentries <= ctx->max_entries[t])
+			continue;
+
+		struct operation_entry *entries =
+			ctx->entries[t] == ctx->local_entries[t] ?
+			Malloc(nentries * sizeof(*entries)) :
+			Realloc(ctx->entries[t], nentries * sizeof(*entries));
+		if (entries == NULL) {
+			ERR("!Malloc");
+			return -1;
+		}
+
+		ctx->entries[t] = entries;
+		ctx->max_entries[t] = nentries;
+	}
+
+	ctx->redo_ext = redo_ext;
+
+	return 0;
+}
+
+/*
+ * operation_fini -- releases the entries of an operation with reserved capacity
+ */
+void
+operation_fini(struct operation_context *ctx)
+{
+	for (int t = 0; t < MAX_OPERATION_ENTRY_TYPE; ++t) {
+		if (ctx->entries[t] != ctx->local_entries[t])
+			Free(ctx->entries[t]);
+	}
 }
 
 /*
@@ -98,8 +155,10 @@ operation_add_typed_entry(struct operation_context *ctx,
 	void *ptr, uint64_t value,
 	enum operation_type type, enum operation_entry_type en_type)
 {
-	ASSERT(ctx->nentries[ENTRY_PERSISTENT] <= MAX_PERSITENT_ENTRIES);
-	ASSERT(ctx->nentries[ENTRY_TRANSIENT] <= MAX_TRANSIENT_ENTRIES);
+	ASSERT(ctx->nentries[ENTRY_PERSISTENT] <=
+		ctx->max_entries[ENTRY_PERSISTENT]);
+	ASSERT(ctx->nentries[ENTRY_TRANSIENT] <=
+		ctx->max_entries[ENTRY_TRANSIENT]);
 
 	/*
 	 * New entry to be added to the operations, all operations eventually
@@ -130,12 +189,11 @@ operation_add_typed_entry(struct operation_context *ctx,
 }
 
 /*
- * operation_add_entry -- adds new entry to the current operation with
- *	entry type autodetected based on the memory location
+ * operation_get_entry_type -- returns the type of entry that a modification
+ *	of the given memory location would be added as
  */
-void
-operation_add_entry(struct operation_context *ctx, void *ptr, uint64_t value,
-	enum operation_type type)
+enum operation_entry_type
+operation_get_entry_type(struct operation_context *ctx, const void *ptr)
 {
 	const struct pmem_ops *p_ops = ctx->p_ops;
 
@@ -146,8 +204,30 @@ operation_add_entry(struct operation_context *ctx, void *ptr, uint64_t value,
 	ASSERTeq(from_pool, OBJ_OFF_IS_VALID((struct pmemobjpool *)p_ops->base,
 		(uintptr_t)ptr - (uintptr_t)p_ops->base));
 
+	return from_pool ? ENTRY_PERSISTENT : ENTRY_TRANSIENT;
+}
+
+/*
+ * operation_get_space -- returns the number of entries of the given type that
+ *	can still be added to the operation
+ */
+size_t
+operation_get_space(struct operation_context *ctx,
+	enum operation_entry_type en_type)
+{
+	return ctx->max_entries[en_type] - ctx->nentries[en_type];
+}
+
+/*
+ * operation_add_entry -- adds new entry to the current operation with
+ *	entry type autodetected based on the memory location
+ */
+void
+operation_add_entry(struct operation_context *ctx, void *ptr, uint64_t value,
+	enum operation_type type)
+{
 	operation_add_typed_entry(ctx, ptr, value, type,
-		from_pool ? ENTRY_PERSISTENT : ENTRY_TRANSIENT);
+		operation_get_entry_type(ctx, ptr));
 }
 
 /*
@@ -172,17 +252,20 @@ operation_process_persistent_redo(struct operation_context *ctx)
 	struct operation_entry *e;
 	const struct redo_ctx *redo = ctx->redo_ctx;
 
-	size_t i;
-	for (i = 0; i < ctx->nentries[ENTRY_PERSISTENT]; ++i) {
+	struct redo_log_cursor cur;
+	redo_log_cursor_init(&cur, ctx->redo, ctx->redo_nentries,
+		ctx->redo_ext != NULL ? *ctx->redo_ext : 0);
+
+	for (size_t i = 0; i < ctx->nentries[ENTRY_PERSISTENT]; ++i) {
 		e = &ctx->entries[ENTRY_PERSISTENT][i];
 
-		redo_log_store(redo, ctx->redo, i,
+		redo_log_cursor_store(redo, &cur,
 				(uintptr_t)e->ptr - (uintptr_t)ctx->base,
 				e->value);
 	}
 
-	redo_log_set_last(redo, ctx->redo, i - 1);
-	redo_log_process(redo, ctx->redo, i);
+	redo_log_cursor_set_last(redo, &cur);
+	redo_log_process(redo, ctx->redo, ctx->redo_nentries);
 }
 
 /*
@@ -228,3 +311,14 @@ operation_process(struct operation_context *ctx)
 		VALGRIND_SET_CLEAN(e->ptr, sizeof(e->value));
 	}
 }
+
+/*
+ * operation_reset -- discards all of the processed entries, which allows the
+ *	context to be reused for another operation on the same redo log
+ */
+void
+operation_reset(struct operation_context *ctx)
+{
+	ctx->nentries[ENTRY_PERSISTENT] = 0;
+	ctx->nentries[ENTRY_TRANSIENT] = 0;
+}
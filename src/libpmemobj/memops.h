@@ -69,21 +69,32 @@ enum operation_entry_type {
 
 /*
  * operation_context -- context of an ongoing palloc operation
+ *
+ * By default the entries are kept in the context itself and the redo log is
+ * expected to hold MAX_PERSITENT_ENTRIES of them. Larger operations have to
+ * reserve the capacity upfront, which requires an extension of the redo log.
  */
 struct operation_context {
 	const void *base;
 
 	const struct redo_ctx *redo_ctx;
 	struct redo_log *redo;
+	size_t redo_nentries; /* size of the fixed-size redo log */
+	const uint64_t *redo_ext; /* offset of the redo log extension */
 	const struct pmem_ops *p_ops;
 
 	size_t nentries[MAX_OPERATION_ENTRY_TYPE];
+	size_t max_entries[MAX_OPERATION_ENTRY_TYPE];
+	struct operation_entry *entries[MAX_OPERATION_ENTRY_TYPE];
 	struct operation_entry
-		entries[MAX_OPERATION_ENTRY_TYPE][MAX_PERSITENT_ENTRIES];
+		local_entries[MAX_OPERATION_ENTRY_TYPE][MAX_PERSITENT_ENTRIES];
 };
 
 void operation_init(struct operation_context *ctx, const void *base,
 	const struct redo_ctx *redo_ctx, struct redo_log *redo);
+int operation_reserve(struct operation_context *ctx, size_t nentries,
+	const uint64_t *redo_ext);
+void operation_fini(struct operation_context *ctx);
 void operation_add_entry(struct operation_context *ctx,
 	void *ptr, uint64_t value, enum operation_type type);
 void operation_add_typed_entry(struct operation_context *ctx,
@@ -91,6 +102,11 @@ void operation_add_typed_entry(struct operation_context *ctx,
 	enum operation_type type, enum operation_entry_type en_type);
 void operation_add_entries(struct operation_context *ctx,
 	struct operation_entry *entries, size_t nentries);
+enum operation_entry_type operation_get_entry_type(
+	struct operation_context *ctx, const void *ptr);
+size_t operation_get_space(struct operation_context *ctx,
+	enum operation_entry_type en_type);
 void operation_process(struct operation_context *ctx);
+void operation_reset(struct operation_context *ctx);
 
 #endif
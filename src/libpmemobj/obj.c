@@ -34,6 +34,7 @@
  * obj.c -- transactional object store implementation
  */
 #include <limits.h>
+#include <endian.h>
 
 #include "valgrind_internal.h"
 #include "libpmem.h"
@@ -41,15 +42,44 @@
 #include "cuckoo.h"
 #include "list.h"
 #include "mmap.h"
+#include "numa.h"
 #include "obj.h"
 
 #include "pmemops.h"
 #include "set.h"
 #include "sync.h"
+#include "sys_util.h"
 #include "tx.h"
+#include "type_index.h"
 
 static struct cuckoo *pools_ht; /* hash table used for searching by UUID */
-static struct ctree *pools_tree; /* tree used for searching by address */
+
+/* initial number of the pools for which there's room in the pool ranges */
+#define POOL_RANGES_INIT_CAPACITY 16
+
+/*
+ * pool_ranges -- address ranges of the open pools, sorted by the address
+ */
+struct pool_ranges {
+	size_t capacity;
+	size_t count;
+	struct pool_ranges *retired; /* the previous, smaller array */
+	struct {
+		uintptr_t addr;
+		size_t size;
+	} ranges[];
+};
+
+/*
+ * The pools are searched by address with a seqlock, so that the readers never
+ * write to shared memory and don't block each other. Only opening and closing
+ * of a pool modifies the ranges. The array is replaced only when it's full
+ * and the replaced ones are freed in the library destructor, since some
+ * readers might still be searching them.
+ */
+static struct pool_ranges *pools_ranges;
+static unsigned pools_ranges_seq; /* odd while the ranges are modified */
+static pthread_mutex_t pools_ranges_lock; /* serializes the modifications */
 
 int _pobj_cache_invalidate;
 
@@ -60,12 +90,9 @@ __thread struct _pobj_pcache _pobj_cached_pool;
 #else /* _WIN32 */
 
 /*
- * XXX - this is a temporary implementation
- *
- * Seems like we could still use TLS and simply substitute "__thread" with
- * "__declspec(thread)", however it's not clear if it would work correctly
- * with Windows DLL's.
- * Need to verify that once we have the multi-threaded tests ported.
+ * The cache can't be exported from the DLL and used by the inline
+ * pmemobj_direct, like on the other platforms, but a static TLS variable
+ * is still much cheaper than a TLS key.
  */
 
 struct _pobj_pcache {
@@ -74,19 +101,7 @@ struct _pobj_pcache {
 	int invalidate;
 };
 
-static pthread_once_t Cached_pool_key_once = PTHREAD_ONCE_INIT;
-static pthread_key_t Cached_pool_key;
-
-/*
- * _Cached_pool_key_alloc -- (internal) allocate pool cache pthread key
- */
-static void
-_Cached_pool_key_alloc(void)
-{
-	int pth_ret = pthread_key_create(&Cached_pool_key, free);
-	if (pth_ret)
-		FATAL("!pthread_key_create");
-}
+static __thread struct _pobj_pcache _pobj_cached_pool;
 
 /*
  * pmemobj_direct -- returns the direct pointer of an object
@@ -97,13 +112,7 @@ pmemobj_direct(PMEMoid oid)
 	if (oid.off == 0 || oid.pool_uuid_lo == 0)
 		return NULL;
 
-	struct _pobj_pcache *pcache = pthread_getspecific(Cached_pool_key);
-	if (pcache == NULL) {
-		pcache = malloc(sizeof(struct _pobj_pcache));
-		int ret = pthread_setspecific(Cached_pool_key, pcache);
-		if (ret)
-			FATAL("!pthread_setspecific");
-	}
+	struct _pobj_pcache *pcache = &_pobj_cached_pool;
 
 	if (_pobj_cache_invalidate != pcache->invalidate ||
 	    pcache->uuid_lo != oid.pool_uuid_lo) {
@@ -122,6 +131,24 @@ pmemobj_direct(PMEMoid oid)
 
 #endif /* _WIN32 */
 
+/* number of the recently used pools remembered by each thread */
+#define POOL_CACHE_SIZE 4
+
+/*
+ * Pool_cache -- the pools recently found by pmemobj_pool_by_oid, which is
+ * called by pmemobj_direct whenever the oid is from another pool than the
+ * previous one, so that the threads which alternate between a few pools
+ * don't have to look them up in the hash table on every such switch
+ */
+static __thread struct {
+	int invalidate;
+	unsigned victim; /* the entry to be replaced on the next miss */
+	struct {
+		uint64_t uuid_lo;
+		PMEMobjpool *pop;
+	} entries[POOL_CACHE_SIZE];
+} Pool_cache;
+
 /*
  * obj_pool_init -- (internal) allocate global structs holding all opened pools
  *
@@ -140,9 +167,136 @@ obj_pool_init(void)
 	if (pools_ht == NULL)
 		FATAL("!cuckoo_new");
 
-	pools_tree = ctree_new();
-	if (pools_tree == NULL)
-		FATAL("!ctree_new");
+	pools_ranges = Zalloc(sizeof(*pools_ranges) +
+		POOL_RANGES_INIT_CAPACITY * sizeof(pools_ranges->ranges[0]));
+	if (pools_ranges == NULL)
+		FATAL("!Zalloc");
+	pools_ranges->capacity = POOL_RANGES_INIT_CAPACITY;
+}
+
+/*
+ * pool_ranges_insert -- (internal) inserts the address range of the pool
+ */
+static int
+pool_ranges_insert(PMEMobjpool *pop)
+{
+	util_mutex_lock(&pools_ranges_lock);
+
+	struct pool_ranges *r = pools_ranges;
+	if (r->count == r->capacity) {
+		size_t capacity = r->capacity * 2;
+		struct pool_ranges *n = Malloc(sizeof(*n) +
+			capacity * sizeof(n->ranges[0]));
+		if (n == NULL) {
+			util_mutex_unlock(&pools_ranges_lock);
+			return ENOMEM;
+		}
+
+		n->capacity = capacity;
+		n->count = r->count;
+		n->retired = r;
+		memcpy(n->ranges, r->ranges, r->count * sizeof(r->ranges[0]));
+
+		/* the copy has the same contents, the readers may use either */
+		__sync_synchronize();
+		pools_ranges = n;
+		r = n;
+	}
+
+	size_t i = 0;
+	while (i < r->count && r->ranges[i].addr < (uintptr_t)pop)
+		++i;
+
+	__sync_fetch_and_add(&pools_ranges_seq, 1);
+
+	memmove(&r->ranges[i + 1], &r->ranges[i],
+		(r->count - i) * sizeof(r->ranges[0]));
+	r->ranges[i].addr = (uintptr_t)pop;
+	r->ranges[i].size = pop->size;
+	r->count++;
+
+	__sync_fetch_and_add(&pools_ranges_seq, 1);
+
+	util_mutex_unlock(&pools_ranges_lock);
+
+	return 0;
+}
+
+/*
+ * pool_ranges_remove -- (internal) removes the address range of the pool
+ */
+static int
+pool_ranges_remove(PMEMobjpool *pop)
+{
+	util_mutex_lock(&pools_ranges_lock);
+
+	struct pool_ranges *r = pools_ranges;
+	size_t i = 0;
+	while (i < r->count && r->ranges[i].addr != (uintptr_t)pop)
+		++i;
+
+	if (i == r->count) {
+		util_mutex_unlock(&pools_ranges_lock);
+		return -1;
+	}
+
+	__sync_fetch_and_add(&pools_ranges_seq, 1);
+
+	r->count--;
+	memmove(&r->ranges[i], &r->ranges[i + 1],
+		(r->count - i) * sizeof(r->ranges[0]));
+
+	__sync_fetch_and_add(&pools_ranges_seq, 1);
+
+	util_mutex_unlock(&pools_ranges_lock);
+
+	return 0;
+}
+
+/*
+ * pool_ranges_find -- (internal) returns the pool whose address range
+ *	contains the address
+ */
+static PMEMobjpool *
+pool_ranges_find(uintptr_t addr)
+{
+	volatile unsigned *seqp = &pools_ranges_seq;
+	uintptr_t found;
+	unsigned seq;
+
+	do {
+		while ((seq = *seqp) & 1)
+			util_cpu_relax();
+		util_load_barrier();
+
+		struct pool_ranges *r =
+			*(struct pool_ranges *volatile *)&pools_ranges;
+
+		/* the count might be torn by a concurrent modification */
+		size_t count = r->count;
+		if (count > r->capacity)
+			count = r->capacity;
+
+		/* the last range which starts at or before the address */
+		size_t lo = 0;
+		size_t hi = count;
+		while (lo < hi) {
+			size_t mid = lo + (hi - lo) / 2;
+			if (r->ranges[mid].addr <= addr)
+				lo = mid + 1;
+			else
+				hi = mid;
+		}
+
+		found = 0;
+		if (lo != 0 && addr - r->ranges[lo - 1].addr <
+				r->ranges[lo - 1].size)
+			found = r->ranges[lo - 1].addr;
+
+		util_load_barrier();
+	} while (*seqp != seq);
+
+	return (PMEMobjpool *)found;
 }
 
 /*
@@ -167,6 +321,40 @@ pmemobj_oid(const void *addr)
  */
 static int Open_cow;
 
+static pthread_mutex_t features_lock; /* serializes the header updates */
+
+/*
+ * obj_incompat_enable -- marks the pool as using the given incompat features
+ *
+ * Must be called before the first change of the pool which is not readable
+ * by the versions of the library unaware of the features.
+ */
+int
+obj_incompat_enable(PMEMobjpool *pop, uint32_t incompat)
+{
+	LOG(3, "pop %p incompat %#x", pop, incompat);
+
+	ASSERTeq(incompat & ~(uint32_t)OBJ_FORMAT_INCOMPAT_SUPPORTED, 0);
+
+	/* nothing mapped privately is ever written back to the pool */
+	if (Open_cow)
+		return 0;
+
+	int ret = 0;
+
+	util_mutex_lock(&features_lock);
+
+	if ((pop->incompat_features & incompat) != incompat) {
+		ret = util_poolset_incompat_enable(pop->set, incompat);
+		if (ret == 0)
+			pop->incompat_features |= incompat;
+	}
+
+	util_mutex_unlock(&features_lock);
+
+	return ret;
+}
+
 #ifdef USE_VG_MEMCHECK
 /*
  * obj_vg_register -- register object in valgrind
@@ -175,16 +363,17 @@ int
 obj_vg_register(uint64_t off, void *arg)
 {
 	PMEMobjpool *pop = arg;
-	struct oob_header *oobh = OBJ_OFF_TO_PTR(pop, off);
+	void *obj_ptr = OBJ_OFF_TO_PTR(pop, off);
+	size_t obj_size = palloc_usable_size(&pop->heap, off) - OBJ_OOB_SIZE;
 
-	VALGRIND_DO_MAKE_MEM_DEFINED(oobh, sizeof(*oobh));
+	if (!palloc_is_headerless(&pop->heap, off)) {
+		struct oob_header *oobh = OOB_HEADER_FROM_OFF(pop, off);
 
-	uint64_t obj_off = off + OBJ_OOB_SIZE;
-	void *obj_ptr = OBJ_OFF_TO_PTR(pop, obj_off);
+		VALGRIND_DO_MAKE_MEM_DEFINED(oobh, sizeof(*oobh));
 
-	size_t obj_size = OBJ_IS_ROOT(oobh) ?
-		OBJ_ROOT_SIZE(oobh) :
-		palloc_usable_size(&pop->heap, obj_off) - OBJ_OOB_SIZE;
+		if (OBJ_IS_ROOT(oobh))
+			obj_size = OBJ_ROOT_SIZE(oobh);
+	}
 
 	VALGRIND_DO_MEMPOOL_ALLOC(pop->heap.layout, obj_ptr, obj_size);
 	VALGRIND_DO_MAKE_MEM_DEFINED(obj_ptr, obj_size);
@@ -212,11 +401,9 @@ obj_init(void)
 		Open_cow = atoi(env);
 #endif
 
-#ifdef _WIN32
-	/* XXX - temporary implementation (see above) */
-	pthread_once(&Cached_pool_key_once, _Cached_pool_key_alloc);
-#endif
-
+	util_mutex_init(&pools_ranges_lock, NULL);
+	util_mutex_init(&features_lock, NULL);
+	util_numa_init();
 	lane_info_boot();
 
 	util_remote_init();
@@ -234,8 +421,13 @@ obj_fini(void)
 
 	if (pools_ht)
 		cuckoo_delete(pools_ht);
-	if (pools_tree)
-		ctree_delete(pools_tree);
+	while (pools_ranges != NULL) {
+		struct pool_ranges *r = pools_ranges;
+		pools_ranges = r->retired;
+		Free(r);
+	}
+	util_mutex_destroy(&pools_ranges_lock);
+	util_mutex_destroy(&features_lock);
 	lane_info_destroy();
 	util_remote_fini();
 }
@@ -249,6 +441,18 @@ drain_empty(void)
 	/* do nothing */
 }
 
+/*
+ * nopmem_flushv -- (internal) msync every range of the vector
+ */
+static void
+nopmem_flushv(const struct iovec *iov, int iovcnt)
+{
+	LOG(15, "iov %p iovcnt %d", iov, iovcnt);
+
+	for (int i = 0; i < iovcnt; i++)
+		pmem_msync(iov[i].iov_base, iov[i].iov_len);
+}
+
 /*
  * nopmem_memcpy_persist -- (internal) memcpy followed by an msync
  */
@@ -359,6 +563,18 @@ obj_norep_flush(void *ctx, const void *addr, size_t len)
 	pop->flush_local(addr, len);
 }
 
+/*
+ * obj_norep_flushv -- (internal) vector flush w/o replication
+ */
+static void
+obj_norep_flushv(void *ctx, const struct iovec *iov, int iovcnt)
+{
+	PMEMobjpool *pop = ctx;
+	LOG(15, "pop %p iov %p iovcnt %d", pop, iov, iovcnt);
+
+	pop->flushv_local(iov, iovcnt);
+}
+
 /*
  * obj_norep_drain -- (internal) drain w/o replication
  */
@@ -522,6 +738,45 @@ obj_rep_flush(void *ctx, const void *addr, size_t len)
 		lane_release(pop);
 }
 
+/*
+ * obj_rep_flushv -- (internal) vector flush with replication
+ */
+static void
+obj_rep_flushv(void *ctx, const struct iovec *iov, int iovcnt)
+{
+	PMEMobjpool *pop = ctx;
+	LOG(15, "pop %p iov %p iovcnt %d", pop, iov, iovcnt);
+
+	unsigned lane = UINT_MAX;
+
+	if (pop->has_remote_replicas)
+		lane = lane_hold(pop, NULL, LANE_ID);
+
+	pop->flushv_local(iov, iovcnt);
+
+	PMEMobjpool *rep = pop->replica;
+	while (rep) {
+		for (int i = 0; i < iovcnt; i++) {
+			const void *addr = iov[i].iov_base;
+			size_t len = iov[i].iov_len;
+			void *raddr = (char *)rep + (uintptr_t)addr -
+					(uintptr_t)pop;
+			if (rep->rpp == NULL) {
+				memcpy(raddr, addr, len);
+				rep->flush_local(raddr, len);
+			} else {
+				if (rep->persist_remote(rep, raddr, len,
+						lane) == NULL)
+					obj_handle_remote_persist_error(pop);
+			}
+		}
+		rep = rep->replica;
+	}
+
+	if (pop->has_remote_replicas)
+		lane_release(pop);
+}
+
 /*
  * obj_rep_drain -- (internal) drain with replication
  */
@@ -818,12 +1073,14 @@ pmemobj_replica_init_local(PMEMobjpool *rep, int is_pmem)
 	if (rep->is_pmem) {
 		rep->persist_local = pmem_persist;
 		rep->flush_local = pmem_flush;
+		rep->flushv_local = pmem_flushv;
 		rep->drain_local = pmem_drain;
 		rep->memcpy_persist_local = pmem_memcpy_persist;
 		rep->memset_persist_local = pmem_memset_persist;
 	} else {
 		rep->persist_local = (persist_local_fn)pmem_msync;
 		rep->flush_local = (flush_local_fn)pmem_msync;
+		rep->flushv_local = nopmem_flushv;
 		rep->drain_local = drain_empty;
 		rep->memcpy_persist_local = nopmem_memcpy_persist;
 		rep->memset_persist_local = nopmem_memset_persist;
@@ -866,6 +1123,7 @@ pmemobj_replica_init_remote(PMEMobjpool *rep, struct pool_set *set,
 	rep->persist_remote = obj_remote_persist;
 	rep->persist_local = NULL;
 	rep->flush_local = NULL;
+	rep->flushv_local = NULL;
 	rep->drain_local = NULL;
 	rep->memcpy_persist_local = NULL;
 	rep->memset_persist_local = NULL;
@@ -904,12 +1162,14 @@ pmemobj_replica_init(PMEMobjpool *rep, struct pool_set *set, unsigned repidx,
 		if (set->nreplicas > 1) {
 			rep->p_ops.persist = obj_rep_persist;
 			rep->p_ops.flush = obj_rep_flush;
+			rep->p_ops.flushv = obj_rep_flushv;
 			rep->p_ops.drain = obj_rep_drain;
 			rep->p_ops.memcpy_persist = obj_rep_memcpy_persist;
 			rep->p_ops.memset_persist = obj_rep_memset_persist;
 		} else {
 			rep->p_ops.persist = obj_norep_persist;
 			rep->p_ops.flush = obj_norep_flush;
+			rep->p_ops.flushv = obj_norep_flushv;
 			rep->p_ops.drain = obj_norep_drain;
 			rep->p_ops.memcpy_persist = obj_norep_memcpy_persist;
 			rep->p_ops.memset_persist = obj_norep_memset_persist;
@@ -923,6 +1183,7 @@ pmemobj_replica_init(PMEMobjpool *rep, struct pool_set *set, unsigned repidx,
 
 		rep->p_ops.persist = NULL;
 		rep->p_ops.flush = NULL;
+		rep->p_ops.flushv = NULL;
 		rep->p_ops.drain = NULL;
 		rep->p_ops.memcpy_persist = NULL;
 		rep->p_ops.memset_persist = NULL;
@@ -971,10 +1232,16 @@ pmemobj_runtime_init(PMEMobjpool *pop, int rdonly, int boot, unsigned nlanes)
 	 */
 	pop->rdonly = rdonly;
 
+	/* the header won't be accessible after the initialization */
+	pop->incompat_features = le32toh(pop->hdr.incompat_features);
+
 	pop->uuid_lo = pmemobj_get_uuid_lo(pop);
 
 	pop->lanes_desc.runtime_nlanes = nlanes;
 
+	pop->tx_combiner = NULL;
+	pop->type_index = NULL;
+
 	if (boot) {
 		if ((errno = pmemobj_boot(pop)) != 0)
 			return -1;
@@ -995,9 +1262,8 @@ pmemobj_runtime_init(PMEMobjpool *pop, int rdonly, int boot, unsigned nlanes)
 			return -1;
 		}
 
-		if ((errno = ctree_insert(pools_tree, (uint64_t)pop, pop->size))
-				!= 0) {
-			ERR("!ctree_insert");
+		if ((errno = pool_ranges_insert(pop)) != 0) {
+			ERR("!pool_ranges_insert");
 			return -1;
 		}
 	}
@@ -1266,7 +1532,7 @@ pmemobj_open_common(const char *path, const char *layout, int cow, int boot)
 
 	if (util_pool_open(&set, path, cow, PMEMOBJ_MIN_POOL,
 			OBJ_HDR_SIG, OBJ_FORMAT_MAJOR,
-			OBJ_FORMAT_COMPAT, OBJ_FORMAT_INCOMPAT,
+			OBJ_FORMAT_COMPAT, OBJ_FORMAT_INCOMPAT_SUPPORTED,
 			OBJ_FORMAT_RO_COMPAT, &runtime_nlanes) != 0) {
 		LOG(2, "cannot open pool or pool set");
 		return NULL;
@@ -1443,6 +1709,13 @@ obj_pool_cleanup(PMEMobjpool *pop)
 
 	palloc_heap_cleanup(&pop->heap);
 
+	tx_combiner_cleanup(pop);
+
+	if (pop->type_index != NULL) {
+		type_index_delete(pop->type_index);
+		pop->type_index = NULL;
+	}
+
 	lane_cleanup(pop);
 
 	/* unmap all the replicas */
@@ -1464,29 +1737,15 @@ pmemobj_close(PMEMobjpool *pop)
 		ERR("cuckoo_remove");
 	}
 
-	if (ctree_remove(pools_tree, (uint64_t)pop, 1) != (uint64_t)pop) {
-		ERR("ctree_remove");
+	if (pool_ranges_remove(pop) != 0) {
+		ERR("pool_ranges_remove");
 	}
 
-#ifndef _WIN32
-
 	if (_pobj_cached_pool.pop == pop) {
 		_pobj_cached_pool.pop = NULL;
 		_pobj_cached_pool.uuid_lo = 0;
 	}
 
-#else /* _WIN32 */
-
-	struct _pobj_pcache *pcache = pthread_getspecific(Cached_pool_key);
-	if (pcache != NULL) {
-		if (pcache->pop == pop) {
-			pcache->pop = NULL;
-			pcache->uuid_lo = 0;
-		}
-	}
-
-#endif /* _WIN32 */
-
 	obj_pool_cleanup(pop);
 }
 
@@ -1542,7 +1801,27 @@ pmemobj_pool_by_oid(PMEMoid oid)
 	if (pools_ht == NULL)
 		return NULL;
 
-	return cuckoo_get(pools_ht, oid.pool_uuid_lo);
+	if (Pool_cache.invalidate != _pobj_cache_invalidate) {
+		/* some pool was closed, it might be one of the cached ones */
+		memset(Pool_cache.entries, 0, sizeof(Pool_cache.entries));
+		Pool_cache.invalidate = _pobj_cache_invalidate;
+	}
+
+	for (unsigned i = 0; i < POOL_CACHE_SIZE; ++i) {
+		if (Pool_cache.entries[i].uuid_lo == oid.pool_uuid_lo &&
+		    Pool_cache.entries[i].pop != NULL)
+			return Pool_cache.entries[i].pop;
+	}
+
+	PMEMobjpool *pop = cuckoo_get(pools_ht, oid.pool_uuid_lo);
+	if (pop != NULL) {
+		unsigned victim = Pool_cache.victim;
+		Pool_cache.entries[victim].uuid_lo = oid.pool_uuid_lo;
+		Pool_cache.entries[victim].pop = pop;
+		Pool_cache.victim = (victim + 1) % POOL_CACHE_SIZE;
+	}
+
+	return pop;
 }
 
 /*
@@ -1560,28 +1839,17 @@ pmemobj_pool_by_ptr(const void *addr)
 		return pop;
 
 	/* XXX this is a temporary fix, to be fixed properly later */
-	if (pools_tree == NULL)
-		return NULL;
-
-	uint64_t key = (uint64_t)addr;
-	size_t pool_size = ctree_find_le(pools_tree, &key);
-
-	if (pool_size == 0)
-		return NULL;
-
-	ASSERT((uint64_t)addr >= key);
-	uint64_t addr_off = (uint64_t)addr - key;
-
-	if (pool_size <= addr_off)
+	if (pools_ranges == NULL)
 		return NULL;
 
-	return (PMEMobjpool *)key;
+	return pool_ranges_find((uintptr_t)addr);
 }
 
 /* arguments for constructor_alloc_bytype */
 struct carg_bytype {
 	type_num_t user_type;
 	int zero_init;
+	int headerless;
 	pmemobj_constr constructor;
 	void *arg;
 };
@@ -1599,13 +1867,17 @@ constructor_alloc_bytype(void *ctx, void *ptr, size_t usable_size, void *arg)
 	ASSERTne(ptr, NULL);
 	ASSERTne(arg, NULL);
 
-	struct oob_header *pobj = OOB_HEADER_FROM_PTR(ptr);
 	struct carg_bytype *carg = arg;
 
-	pobj->undo_entry_offset = 0;
-	pobj->type_num = carg->user_type;
-	pobj->size = 0;
-	memset(pobj->unused, 0, sizeof(pobj->unused));
+	/* the type of header-less objects is kept by their run */
+	if (!carg->headerless) {
+		struct oob_header *pobj = OOB_HEADER_FROM_PTR(ptr);
+
+		pobj->undo_entry_offset = 0;
+		pobj->type_num = carg->user_type;
+		pobj->size = 0;
+		memset(pobj->unused, 0, sizeof(pobj->unused));
+	}
 
 	if (carg->zero_init)
 		pmemops_memset_persist(p_ops, ptr, 0, usable_size);
@@ -1622,7 +1894,7 @@ constructor_alloc_bytype(void *ctx, void *ptr, size_t usable_size, void *arg)
  */
 static int
 obj_alloc_construct(PMEMobjpool *pop, PMEMoid *oidp, size_t size,
-	type_num_t type_num, int zero_init,
+	type_num_t type_num, int zero_init, uint16_t class_id,
 	pmemobj_constr constructor,
 	void *arg)
 {
@@ -1636,9 +1908,22 @@ obj_alloc_construct(PMEMobjpool *pop, PMEMoid *oidp, size_t size,
 
 	carg.user_type = type_num;
 	carg.zero_init = zero_init;
+	carg.headerless = 0;
 	carg.constructor = constructor;
 	carg.arg = arg;
 
+	uint64_t class_type_num;
+	if (palloc_class_is_headerless(&pop->heap, class_id,
+			&class_type_num)) {
+		if (class_type_num != type_num) {
+			ERR("type number doesn't match the allocation class");
+			errno = EINVAL;
+			return -1;
+		}
+
+		carg.headerless = 1;
+	}
+
 	struct redo_log *redo = pmalloc_redo_hold(pop);
 
 	struct operation_context ctx;
@@ -1650,7 +1935,7 @@ obj_alloc_construct(PMEMobjpool *pop, PMEMoid *oidp, size_t size,
 
 	int ret = pmalloc_operation(&pop->heap, 0,
 			oidp != NULL ? &oidp->off : NULL, size + OBJ_OOB_SIZE,
-			constructor_alloc_bytype, &carg, &ctx);
+			constructor_alloc_bytype, &carg, class_id, &ctx);
 
 	pmalloc_redo_release(pop);
 
@@ -1678,7 +1963,80 @@ pmemobj_alloc(PMEMobjpool *pop, PMEMoid *oidp, size_t size,
 	}
 
 	return obj_alloc_construct(pop, oidp, size, type_num,
-			0, constructor, arg);
+			0, 0, constructor, arg);
+}
+
+/*
+ * pmemobj_xalloc -- allocates a new object with the given flags
+ */
+int
+pmemobj_xalloc(PMEMobjpool *pop, PMEMoid *oidp, size_t size,
+	uint64_t type_num, uint64_t flags,
+	pmemobj_constr constructor, void *arg)
+{
+	LOG(3, "pop %p oidp %p size %zu type_num %llx flags %llx "
+		"constructor %p arg %p",
+		pop, oidp, size, (unsigned long long)type_num,
+		(unsigned long long)flags,
+		constructor, arg);
+
+	/* log notice message if used inside a transaction */
+	_POBJ_DEBUG_NOTICE_IN_TX();
+
+	if (size == 0) {
+		ERR("allocation with size 0");
+		errno = EINVAL;
+		return -1;
+	}
+
+	if (flags & ~(POBJ_XALLOC_ZERO | POBJ_XALLOC_CLASS_MASK)) {
+		ERR("unknown flags 0x%llx", (unsigned long long)(flags &
+			~(POBJ_XALLOC_ZERO | POBJ_XALLOC_CLASS_MASK)));
+		errno = EINVAL;
+		return -1;
+	}
+
+	return obj_alloc_construct(pop, oidp, size, type_num,
+			(flags & POBJ_XALLOC_ZERO) != 0,
+			CLASS_ID_FROM_FLAG(flags), constructor, arg);
+}
+
+/*
+ * pmemobj_alloc_class_new -- registers a user-defined allocation class
+ */
+int
+pmemobj_alloc_class_new(PMEMobjpool *pop, struct pobj_alloc_class_desc *desc)
+{
+	LOG(3, "pop %p desc %p", pop, desc);
+
+	if (desc->header_type != POBJ_HEADER_LEGACY &&
+		desc->header_type != POBJ_HEADER_NONE) {
+		ERR("invalid header type");
+		errno = EINVAL;
+		return -1;
+	}
+
+	/* runs of header-less blocks can't be read by older versions */
+	if (desc->header_type == POBJ_HEADER_NONE &&
+		obj_incompat_enable(pop, OBJ_INCOMPAT_HEADERLESS) != 0) {
+		ERR("cannot enable header-less runs in the pool");
+		return -1;
+	}
+
+	unsigned class_id;
+	int ret = palloc_alloc_class_new(&pop->heap, desc->unit_size,
+		desc->alignment, desc->run_chunks,
+		desc->header_type == POBJ_HEADER_NONE, desc->type_num,
+		&class_id);
+	if (ret != 0) {
+		ERR("cannot create allocation class");
+		errno = ret;
+		return -1;
+	}
+
+	desc->class_id = class_id;
+
+	return 0;
 }
 
 /* arguments for constructor_realloc and constructor_zrealloc */
@@ -1712,7 +2070,7 @@ pmemobj_zalloc(PMEMobjpool *pop, PMEMoid *oidp, size_t size,
 	}
 
 	return obj_alloc_construct(pop, oidp, size, type_num,
-					1, NULL, NULL);
+					1, 0, NULL, NULL);
 }
 
 /*
@@ -1731,7 +2089,7 @@ obj_free(PMEMobjpool *pop, PMEMoid *oidp)
 	operation_add_entry(&ctx, &oidp->pool_uuid_lo, 0, OPERATION_SET);
 
 	pmalloc_operation(&pop->heap, oidp->off, &oidp->off, 0, NULL, NULL,
-			&ctx);
+			0, &ctx);
 
 	pmalloc_redo_release(pop);
 }
@@ -1786,7 +2144,7 @@ obj_realloc_common(PMEMobjpool *pop,
 			return 0;
 
 		return obj_alloc_construct(pop, oidp, size, type_num,
-				zero_init, NULL, NULL);
+				zero_init, 0, NULL, NULL);
 	}
 
 	if (size > PMEMOBJ_MAX_ALLOC_SIZE) {
@@ -1801,6 +2159,12 @@ obj_realloc_common(PMEMobjpool *pop,
 		return 0;
 	}
 
+	if (palloc_is_headerless(&pop->heap, oidp->off)) {
+		ERR("cannot reallocate a header-less object");
+		errno = ENOTSUP;
+		return -1;
+	}
+
 	struct oob_header *pobj = OOB_HEADER_FROM_OID(pop, *oidp);
 	type_num_t user_type_old = pobj->type_num;
 
@@ -1822,13 +2186,14 @@ obj_realloc_common(PMEMobjpool *pop,
 	if (type_num == user_type_old) {
 		ret = pmalloc_operation(&pop->heap, oidp->off, &oidp->off,
 			size + OBJ_OOB_SIZE,
-			constructor_realloc, &carg, &ctx);
+			constructor_realloc, &carg, 0, &ctx);
 	} else {
 		operation_add_entry(&ctx, &pobj->type_num, type_num,
 				OPERATION_SET);
 
 		ret = pmalloc_operation(&pop->heap, oidp->off, &oidp->off,
-			size + OBJ_OOB_SIZE, constructor_realloc, &carg, &ctx);
+			size + OBJ_OOB_SIZE, constructor_realloc, &carg, 0,
+			&ctx);
 	}
 	pmalloc_redo_release(pop);
 
@@ -1954,7 +2319,7 @@ pmemobj_strdup(PMEMobjpool *pop, PMEMoid *oidp, const char *s,
 	carg.s = s;
 
 	return obj_alloc_construct(pop, oidp, carg.size,
-		(type_num_t)type_num, 0, constructor_strdup, &carg);
+		(type_num_t)type_num, 0, 0, constructor_strdup, &carg);
 }
 
 /*
@@ -1981,6 +2346,213 @@ pmemobj_free(PMEMoid *oidp)
 	obj_free(pop, oidp);
 }
 
+/*
+ * Number of objects for which the allocator operations are prepared at once
+ * by the batched allocation and free functions.
+ */
+#define OBJ_BATCH_CHUNK PALLOC_BATCH_PASS_MAX
+
+/*
+ * obj_batch_reserve -- (internal) extends the allocator redo log so that
+ *	a whole chunk of objects can be committed at once
+ *
+ * Without the extension the batch still works, just in smaller passes.
+ */
+static void
+obj_batch_reserve(PMEMobjpool *pop, struct operation_context *ctx)
+{
+	if (pmalloc_redo_reserve(pop, ctx,
+			OBJ_BATCH_CHUNK * PALLOC_BATCH_OP_ENTRIES) != 0)
+		LOG(2, "unable to extend the allocator redo log");
+}
+
+/*
+ * obj_free_batch -- (internal) frees objects of a single pool using an already
+ *	initialized operation context
+ */
+static void
+obj_free_batch(PMEMobjpool *pop, PMEMoid *oids, size_t noids,
+	struct operation_context *ctx)
+{
+	struct palloc_batch_op ops[OBJ_BATCH_CHUNK];
+
+	size_t i = 0;
+	while (i < noids) {
+		size_t nops = 0;
+		for (; i < noids && nops < OBJ_BATCH_CHUNK; ++i) {
+			if (oids[i].off == 0)
+				continue;
+
+			ASSERT(OBJ_OID_IS_VALID(pop, oids[i]));
+
+			struct palloc_batch_op *op = &ops[nops++];
+			op->off = oids[i].off;
+			op->size = 0;
+			op->dest_off = &oids[i].off;
+			op->extra_ptr = &oids[i].pool_uuid_lo;
+			op->extra_value = 0;
+		}
+
+		size_t ndone;
+		int ret = pmalloc_operation_batch(&pop->heap, ops, nops,
+			NULL, NULL, 0, ctx, &ndone);
+		ASSERTeq(ret, 0);
+	}
+}
+
+/*
+ * pmemobj_alloc_batch -- allocates a number of new objects under a single
+ *	acquisition of the allocator
+ */
+int
+pmemobj_alloc_batch(PMEMobjpool *pop, PMEMoid *oids, const size_t *sizes,
+	size_t nobjs, uint64_t type_num, uint64_t flags,
+	pmemobj_constr constructor, void *arg)
+{
+	LOG(3, "pop %p oids %p sizes %p nobjs %zu type_num %llx flags %llx "
+		"constructor %p arg %p",
+		pop, oids, sizes, nobjs, (unsigned long long)type_num,
+		(unsigned long long)flags, constructor, arg);
+
+	/* log notice message if used inside a transaction */
+	_POBJ_DEBUG_NOTICE_IN_TX();
+
+	if (flags & ~(POBJ_XALLOC_ZERO | POBJ_XALLOC_CLASS_MASK)) {
+		ERR("unknown flags 0x%llx", (unsigned long long)(flags &
+			~(POBJ_XALLOC_ZERO | POBJ_XALLOC_CLASS_MASK)));
+		errno = EINVAL;
+		return -1;
+	}
+
+	for (size_t i = 0; i < nobjs; ++i) {
+		if (sizes[i] == 0) {
+			ERR("allocation with size 0");
+			errno = EINVAL;
+			return -1;
+		}
+
+		if (sizes[i] > PMEMOBJ_MAX_ALLOC_SIZE) {
+			ERR("requested size too large");
+			errno = ENOMEM;
+			return -1;
+		}
+	}
+
+	uint16_t class_id = CLASS_ID_FROM_FLAG(flags);
+
+	struct carg_bytype carg;
+
+	carg.user_type = (type_num_t)type_num;
+	carg.zero_init = (flags & POBJ_XALLOC_ZERO) != 0;
+	carg.headerless = 0;
+	carg.constructor = constructor;
+	carg.arg = arg;
+
+	uint64_t class_type_num;
+	if (palloc_class_is_headerless(&pop->heap, class_id,
+			&class_type_num)) {
+		if (class_type_num != type_num) {
+			ERR("type number doesn't match the allocation class");
+			errno = EINVAL;
+			return -1;
+		}
+
+		carg.headerless = 1;
+	}
+
+	struct palloc_batch_op ops[OBJ_BATCH_CHUNK];
+
+	struct redo_log *redo = pmalloc_redo_hold(pop);
+
+	struct operation_context ctx;
+	operation_init(&ctx, pop, pop->redo, redo);
+	obj_batch_reserve(pop, &ctx);
+
+	int ret = 0;
+	size_t nallocated = 0;
+	while (nallocated < nobjs) {
+		size_t nops = nobjs - nallocated;
+		if (nops > OBJ_BATCH_CHUNK)
+			nops = OBJ_BATCH_CHUNK;
+
+		for (size_t i = 0; i < nops; ++i) {
+			PMEMoid *oidp = &oids[nallocated + i];
+			struct palloc_batch_op *op = &ops[i];
+
+			op->off = 0;
+			op->size = sizes[nallocated + i] + OBJ_OOB_SIZE;
+			op->dest_off = &oidp->off;
+			op->extra_ptr = &oidp->pool_uuid_lo;
+			op->extra_value = pop->uuid_lo;
+		}
+
+		size_t ndone;
+		ret = pmalloc_operation_batch(&pop->heap, ops, nops,
+			constructor_alloc_bytype, &carg, class_id, &ctx,
+			&ndone);
+
+		nallocated += ndone;
+
+		if (ret != 0)
+			break;
+	}
+
+	if (ret != 0) {
+		/* none of the objects are allocated when the batch fails */
+		int oerrno = errno;
+		obj_free_batch(pop, oids, nallocated, &ctx);
+		errno = oerrno;
+	}
+
+	operation_fini(&ctx);
+	pmalloc_redo_release(pop);
+
+	return ret;
+}
+
+/*
+ * pmemobj_free_batch -- frees a number of objects under a single acquisition
+ *	of the allocator
+ */
+void
+pmemobj_free_batch(PMEMoid *oids, size_t noids)
+{
+	LOG(3, "oids %p noids %zu", oids, noids);
+
+	/* log notice message if used inside a transaction */
+	_POBJ_DEBUG_NOTICE_IN_TX();
+
+	size_t i = 0;
+	while (i < noids) {
+		if (oids[i].off == 0) {
+			i++;
+			continue;
+		}
+
+		PMEMobjpool *pop = pmemobj_pool_by_oid(oids[i]);
+		ASSERTne(pop, NULL);
+
+		/* objects are freed in runs of the ones from the same pool */
+		size_t n = 1;
+		while (i + n < noids && (oids[i + n].off == 0 ||
+			oids[i + n].pool_uuid_lo == oids[i].pool_uuid_lo))
+			n++;
+
+		struct redo_log *redo = pmalloc_redo_hold(pop);
+
+		struct operation_context ctx;
+		operation_init(&ctx, pop, pop->redo, redo);
+		obj_batch_reserve(pop, &ctx);
+
+		obj_free_batch(pop, oids + i, n, &ctx);
+
+		operation_fini(&ctx);
+		pmalloc_redo_release(pop);
+
+		i += n;
+	}
+}
+
 /*
  * pmemobj_alloc_usable_size -- returns usable size of object
  */
@@ -2066,9 +2638,15 @@ pmemobj_type_num(PMEMoid oid)
 
 	ASSERT(!OID_IS_NULL(oid));
 
-	void *ptr = pmemobj_direct(oid);
+	PMEMobjpool *pop = pmemobj_pool_by_oid(oid);
+
+	ASSERTne(pop, NULL);
+	ASSERT(OBJ_OID_IS_VALID(pop, oid));
+
+	if (palloc_is_headerless(&pop->heap, oid.off))
+		return palloc_headerless_type_num(&pop->heap, oid.off);
 
-	struct oob_header *oobh = OOB_HEADER_FROM_PTR(ptr);
+	struct oob_header *oobh = OOB_HEADER_FROM_OID(pop, oid);
 	return oobh->type_num;
 }
 
@@ -2134,7 +2712,7 @@ obj_alloc_root(PMEMobjpool *pop, size_t size,
 	carg.arg = arg;
 
 	return pmalloc_construct(pop, &pop->root_offset,
-		size + OBJ_OOB_SIZE, constructor_alloc_root, &carg);
+		size + OBJ_OOB_SIZE, constructor_alloc_root, &carg, 0);
 }
 
 /*
@@ -2164,7 +2742,7 @@ obj_realloc_root(PMEMobjpool *pop, size_t size,
 
 	int ret = pmalloc_operation(&pop->heap, pop->root_offset,
 			&pop->root_offset, size + OBJ_OOB_SIZE,
-			constructor_zrealloc_root, &carg, &ctx);
+			constructor_zrealloc_root, &carg, 0, &ctx);
 
 	pmalloc_redo_release(pop);
 
@@ -2236,6 +2814,52 @@ pmemobj_root(PMEMobjpool *pop, size_t size)
 	return pmemobj_root_construct(pop, size, NULL, NULL);
 }
 
+/*
+ * pobj_cursor -- iteration through the objects of a part of the pool
+ */
+struct pobj_cursor {
+	PMEMobjpool *pop;
+	uint64_t type_num; /* POBJ_CURSOR_ANY_TYPE matches all objects */
+	struct palloc_cursor cur;
+
+	/* iteration through the type index, in the descending order */
+	int indexed;
+	struct ctree *objects; /* objects of the type, NULL if none are left */
+	uint64_t next; /* largest offset not visited yet */
+	uint64_t begin; /* smallest offset of the cursor's part of the pool */
+};
+
+/*
+ * obj_cursor_next -- (internal) returns the next user object of the given
+ *	type found by the cursor
+ */
+static PMEMoid
+obj_cursor_next(PMEMobjpool *pop, struct palloc_cursor *cur, uint64_t type_num)
+{
+	struct palloc_object obj;
+
+	while (palloc_cursor_next(&pop->heap, cur, &obj)) {
+		/* header-less objects are always user objects */
+		if (!obj.headerless) {
+			struct oob_header *oobh =
+				OOB_HEADER_FROM_OFF(pop, obj.off);
+			if (OBJ_IS_INTERNAL(oobh))
+				continue;
+
+			obj.type_num = oobh->type_num;
+		}
+
+		if (type_num != POBJ_CURSOR_ANY_TYPE &&
+			obj.type_num != type_num)
+			continue;
+
+		PMEMoid ret = {pop->uuid_lo, obj.off};
+		return ret;
+	}
+
+	return OID_NULL;
+}
+
 /*
  * pmemobj_first - returns first object of specified type
  */
@@ -2244,20 +2868,10 @@ pmemobj_first(PMEMobjpool *pop)
 {
 	LOG(3, "pop %p", pop);
 
-	PMEMoid ret = {0, 0};
-
-	uint64_t off = palloc_first(&pop->heap);
-	if (off != 0) {
-		ret.off = off + OBJ_OOB_SIZE;
-		ret.pool_uuid_lo = pop->uuid_lo;
-
-		struct oob_header *oobh = OOB_HEADER_FROM_OFF(pop, ret.off);
-		if (oobh->size & OBJ_INTERNAL_OBJECT_MASK) {
-			return pmemobj_next(ret);
-		}
-	}
+	struct palloc_cursor cur;
+	palloc_cursor_init(&pop->heap, &cur, 0, 1);
 
-	return ret;
+	return obj_cursor_next(pop, &cur, POBJ_CURSOR_ANY_TYPE);
 }
 
 /*
@@ -2276,21 +2890,113 @@ pmemobj_next(PMEMoid oid)
 	ASSERTne(pop, NULL);
 	ASSERT(OBJ_OID_IS_VALID(pop, oid));
 
-	PMEMoid ret = {0, 0};
-	uint64_t off = palloc_next(&pop->heap, oid.off);
-	if (off != 0) {
-		ret.off = off + OBJ_OOB_SIZE;
-		ret.pool_uuid_lo = pop->uuid_lo;
+	struct palloc_cursor cur;
+	palloc_cursor_seek(&pop->heap, &cur, oid.off);
 
-		struct oob_header *oobh = OOB_HEADER_FROM_OFF(pop, ret.off);
-		if (oobh->size & OBJ_INTERNAL_OBJECT_MASK) {
-			return pmemobj_next(ret);
-		}
+	return obj_cursor_next(pop, &cur, POBJ_CURSOR_ANY_TYPE);
+}
+
+/*
+ * pmemobj_cursor_new -- creates a cursor iterating through one of 'nparts'
+ *	disjoint parts of the pool
+ */
+struct pobj_cursor *
+pmemobj_cursor_new(PMEMobjpool *pop, uint64_t type_num, unsigned part,
+	unsigned nparts)
+{
+	LOG(3, "pop %p type_num %llx part %u nparts %u", pop,
+		(unsigned long long)type_num, part, nparts);
+
+	if (part >= nparts) {
+		ERR("invalid part %u of %u", part, nparts);
+		errno = EINVAL;
+		return NULL;
+	}
+
+	struct pobj_cursor *c = Malloc(sizeof(*c));
+	if (c == NULL) {
+		ERR("!Malloc");
+		return NULL;
+	}
+
+	c->pop = pop;
+	c->type_num = type_num;
+	c->indexed = 0;
+
+	struct type_index *ti = pop->type_index;
+	if (ti != NULL && type_num != POBJ_CURSOR_ANY_TYPE &&
+		type_index_get(pop, ti, type_num, &c->objects) == 0) {
+		/* the parts are equal ranges of offsets of the heap */
+		c->indexed = 1;
+		c->begin = pop->heap_offset + pop->heap_size * part / nparts;
+		c->next = pop->heap_offset +
+			pop->heap_size * (part + 1) / nparts - 1;
+	} else {
+		palloc_cursor_init(&pop->heap, &c->cur, part, nparts);
+	}
+
+	return c;
+}
+
+/*
+ * pmemobj_cursor_next -- returns the next object of the cursor
+ */
+PMEMoid
+pmemobj_cursor_next(struct pobj_cursor *c)
+{
+	LOG(3, "cursor %p", c);
+
+	if (!c->indexed)
+		return obj_cursor_next(c->pop, &c->cur, c->type_num);
+
+	if (c->objects == NULL)
+		return OID_NULL;
+
+	uint64_t off = c->next;
+	if (ctree_find_le(c->objects, &off) == 0 || off < c->begin) {
+		c->objects = NULL;
+		return OID_NULL;
 	}
 
+	c->next = off - 1;
+
+	PMEMoid ret = {c->pop->uuid_lo, off};
 	return ret;
 }
 
+/*
+ * pmemobj_type_index_enable -- enables the index of objects by their type
+ *	numbers, it's built on the first use by a cursor of a single type
+ */
+int
+pmemobj_type_index_enable(PMEMobjpool *pop)
+{
+	LOG(3, "pop %p", pop);
+
+	if (pop->type_index != NULL)
+		return 0;
+
+	struct type_index *ti = type_index_new();
+	if (ti == NULL)
+		return -1;
+
+	if (!__sync_bool_compare_and_swap(&pop->type_index, NULL, ti))
+		type_index_delete(ti);
+
+	return 0;
+}
+
+/*
+ * pmemobj_cursor_delete -- deletes the cursor
+ */
+void
+pmemobj_cursor_delete(struct pobj_cursor *c)
+{
+	LOG(3, "cursor %p", c);
+
+	Free(c);
+}
+
 /*
  * pmemobj_list_insert -- adds object to a list
  */
@@ -56,6 +56,17 @@
 #define OBJ_FORMAT_INCOMPAT 0x0000
 #define OBJ_FORMAT_RO_COMPAT 0x0000
 
+/* incompat features which are enabled once the pool starts using them */
+#define OBJ_INCOMPAT_HEADERLESS 0x0001	/* runs of header-less blocks */
+#define OBJ_INCOMPAT_TX_REDO_LOG 0x0002	/* redo logs of transactions */
+#define OBJ_INCOMPAT_TX_UNDO_BUFFER 0x0004 /* large snapshots buffers */
+#define OBJ_INCOMPAT_REDO_LOG_EXT 0x0008 /* extensions of allocator logs */
+
+/* all the incompat features this version of the library can handle */
+#define OBJ_FORMAT_INCOMPAT_SUPPORTED\
+	(OBJ_INCOMPAT_HEADERLESS | OBJ_INCOMPAT_TX_REDO_LOG |\
+	OBJ_INCOMPAT_TX_UNDO_BUFFER | OBJ_INCOMPAT_REDO_LOG_EXT)
+
 /* size of the persistent part of PMEMOBJ pool descriptor (2kB) */
 #define OBJ_DSC_P_SIZE		2048
 /* size of unused part of the persistent part of PMEMOBJ pool descriptor */
@@ -65,6 +76,7 @@
 #define OBJ_NLANES		1024	/* number of lanes */
 
 #define OBJ_OOB_SIZE		(sizeof(struct oob_header))
+#define CLASS_ID_FROM_FLAG(flag)	((uint16_t)((flag) >> 48))
 #define OBJ_OFF_TO_PTR(pop, off) ((void *)((uintptr_t)(pop) + (off)))
 #define OBJ_PTR_TO_OFF(pop, ptr) ((uintptr_t)(ptr) - (uintptr_t)(pop))
 #define OBJ_OID_IS_NULL(oid)	((oid).off == 0)
@@ -95,8 +107,10 @@
 #define OOB_HEADER_FROM_OID(pop, oid)\
 	((struct oob_header *)((uintptr_t)(pop) + (oid).off - OBJ_OOB_SIZE))
 
+/* header-less objects can't be allocated in a transaction */
 #define OBJ_OID_IS_IN_UNDO_LOG(pop, oid)\
-	(OOB_HEADER_FROM_OID(pop, oid)->undo_entry_offset != 0)
+	(!palloc_is_headerless(&(pop)->heap, (oid).off) &&\
+	OOB_HEADER_FROM_OID(pop, oid)->undo_entry_offset != 0)
 
 #define OOB_HEADER_FROM_PTR(ptr)\
 	((struct oob_header *)((uintptr_t)(ptr) - OBJ_OOB_SIZE))
@@ -106,6 +120,7 @@
 
 typedef void (*persist_local_fn)(const void *, size_t);
 typedef void (*flush_local_fn)(const void *, size_t);
+typedef void (*flushv_local_fn)(const struct iovec *, int);
 typedef void (*drain_local_fn)(void);
 typedef void *(*memcpy_local_fn)(void *dest, const void *src, size_t len);
 typedef void *(*memset_local_fn)(void *dest, int c, size_t len);
@@ -151,6 +166,7 @@ struct pmemobjpool {
 	/* per-replica functions: pmem or non-pmem */
 	persist_local_fn persist_local;	/* persist function */
 	flush_local_fn flush_local;	/* flush function */
+	flushv_local_fn flushv_local;	/* vector flush function */
 	drain_local_fn drain_local;	/* drain function */
 	memcpy_local_fn memcpy_persist_local; /* persistent memcpy function */
 	memset_local_fn memset_persist_local; /* persistent memset function */
@@ -170,11 +186,15 @@ struct pmemobjpool {
 
 	persist_remote_fn persist_remote; /* remote persist function */
 
+	struct tx_combiner *tx_combiner; /* publication list of tx words */
+	struct type_index *type_index;	/* index of objects by type number */
+
 	int vg_boot;
+	uint32_t incompat_features; /* incompat features of the pool header */
 
 	/* padding to align size of this structure to page boundary */
 	/* sizeof(unused2) == 8192 - offsetof(struct pmemobjpool, unused2) */
-	char unused2[1590];
+	char unused2[1528];
 };
 
 /*
@@ -242,6 +262,7 @@ OBJ_OID_IS_VALID(PMEMobjpool *pop, PMEMoid oid)
 
 void obj_init(void);
 void obj_fini(void);
+int obj_incompat_enable(PMEMobjpool *pop, uint32_t incompat);
 int obj_read_remote(void *ctx, uintptr_t base, void *dest, void *addr,
 		size_t length);
 
@@ -38,11 +38,14 @@
  * in a reasonable time and with an acceptable common-case fragmentation.
  */
 
+#include <string.h>
+
 #include "valgrind_internal.h"
 #include "heap_layout.h"
 #include "heap.h"
 #include "out.h"
 #include "sys_util.h"
+#include "util.h"
 #include "palloc.h"
 
 /*
@@ -99,6 +102,22 @@ get_mblock_from_alloc(struct palloc_heap *heap,
 	return m;
 }
 
+/*
+ * alloc_get_mblock -- (internal) returns the memory block of the object with
+ *	the given offset and whether the block is header-less
+ */
+static struct memory_block
+alloc_get_mblock(struct palloc_heap *heap, uint64_t off, int *headerless)
+{
+	struct memory_block m;
+
+	*headerless = heap_get_headerless_block(heap, off, &m);
+	if (*headerless == 0)
+		m = get_mblock_from_alloc(heap, ALLOC_GET_HEADER(heap, off));
+
+	return m;
+}
+
 /*
  * alloc_reserve_block -- (internal) reserves a memory block in volatile state
  *
@@ -109,9 +128,16 @@ get_mblock_from_alloc(struct palloc_heap *heap,
  * fragmentation the appropriate bucket is chosen depending on the current
  * thread context and to which allocation class the requested size falls into.
  *
+ * If the caller asked for a specific allocation class, its buckets are used
+ * instead and the requested size has to fit in the class. The blocks of
+ * header-less classes have neither the allocation header nor the space for
+ * the caller's header, so the size is reduced by both.
+ *
  * Once the bucket is selected, just enough memory is reserved for the requested
  * size. The underlying block allocation algorithm (best-fit, next-fit, ...)
- * varies depending on the bucket container.
+ * varies depending on the bucket container. Single unit blocks are taken from
+ * a per-thread magazine which is refilled from the bucket in batches, so the
+ * common case of small allocations doesn't take any locks.
  *
  * Because the heap in general tries to avoid lock-contention on buckets,
  * the threads might, in near OOM cases, be unable to allocate requested memory
@@ -125,9 +151,31 @@ get_mblock_from_alloc(struct palloc_heap *heap,
  */
 static int
 alloc_reserve_block(struct palloc_heap *heap, struct memory_block *m,
-		size_t sizeh)
+		size_t size, uint16_t class_id, int *headerless)
 {
-	struct bucket *b = heap_get_best_bucket(heap, sizeh);
+	size_t sizeh = size + sizeof(struct allocation_header);
+
+	struct bucket *b;
+	*headerless = 0;
+	if (class_id != 0) {
+		b = heap_get_class_bucket(heap, class_id, 0);
+		if (b == NULL)
+			return EINVAL;
+
+		struct bucket_run *r = (struct bucket_run *)b;
+		if (r->headerless) {
+			if (size <= PALLOC_DATA_OFF)
+				return EINVAL;
+
+			sizeh = size - PALLOC_DATA_OFF;
+			*headerless = 1;
+		}
+
+		if (b->calc_units(b, sizeh) > r->unit_max_alloc)
+			return EINVAL;
+	} else {
+		b = heap_get_best_bucket(heap, sizeh);
+	}
 
 	/*
 	 * The caller provided size in bytes, but buckets operate in
@@ -138,7 +186,7 @@ alloc_reserve_block(struct palloc_heap *heap, struct memory_block *m,
 	 */
 	m->size_idx = b->calc_units(b, sizeh);
 
-	int err = heap_get_bestfit_block(heap, b, m);
+	int err = heap_get_magazine_block(heap, b, m);
 
 	if (err == ENOMEM && b->type == BUCKET_HUGE)
 		return ENOMEM; /* there's only one huge bucket */
@@ -148,7 +196,8 @@ alloc_reserve_block(struct palloc_heap *heap, struct memory_block *m,
 		 * There's no more available memory in the common heap and in
 		 * this lane cache, fallback to the auxiliary (shared) bucket.
 		 */
-		b = heap_get_auxiliary_bucket(heap, sizeh);
+		b = class_id != 0 ? heap_get_class_bucket(heap, class_id, 1) :
+			heap_get_auxiliary_bucket(heap, sizeh);
 		err = heap_get_bestfit_block(heap, b, m);
 	}
 
@@ -179,34 +228,40 @@ alloc_reserve_block(struct palloc_heap *heap, struct memory_block *m,
  * Because the memory block at this stage is only reserved in transient state
  * there's no need to worry about fail-safety of this method because in case
  * of a crash the memory will be back in the free blocks collection.
+ *
+ * The data of header-less blocks starts at the very beginning of the block.
  */
 static int
 alloc_prep_block(struct palloc_heap *heap, struct memory_block m,
-	palloc_constr constructor, void *arg, uint64_t *offset_value)
+	int headerless, palloc_constr constructor, void *arg,
+	uint64_t *offset_value)
 {
 	void *block_data = heap_get_block_data(heap, m);
-	void *userdatap = (char *)block_data + ALLOC_OFF;
+	size_t data_off = headerless ? 0 : ALLOC_OFF;
+	void *userdatap = (char *)block_data + data_off;
 
 	uint64_t unit_size = MEMBLOCK_OPS(AUTO, &m)->
 			block_size(&m, heap->layout);
 
 	uint64_t real_size = unit_size * m.size_idx;
 
-	ASSERT((uint64_t)block_data % ALLOC_BLOCK_SIZE == 0);
-	ASSERT((uint64_t)userdatap % ALLOC_BLOCK_SIZE == 0);
+	/* the unit size of user-defined classes is only a multiple of 8 */
+	ASSERT((uint64_t)block_data % sizeof(uint64_t) == 0);
+	ASSERT((uint64_t)userdatap % sizeof(uint64_t) == 0);
 
 	/* mark everything (including headers) as accessible */
 	VALGRIND_DO_MAKE_MEM_UNDEFINED(block_data, real_size);
 	/* mark space as allocated */
 	VALGRIND_DO_MEMPOOL_ALLOC(heap->layout, userdatap,
-			real_size - ALLOC_OFF);
+			real_size - data_off);
 
-	alloc_write_header(heap, block_data, m, real_size);
+	if (!headerless)
+		alloc_write_header(heap, block_data, m, real_size);
 
 	int ret;
 	if (constructor != NULL &&
 		(ret = constructor(heap->base, userdatap,
-			real_size - ALLOC_OFF, arg)) != 0) {
+			real_size - data_off, arg)) != 0) {
 
 		/*
 		 * If canceled, revert the block back to the free state in vg
@@ -215,20 +270,21 @@ alloc_prep_block(struct palloc_heap *heap, struct memory_block m,
 		 * in a separate call.
 		 */
 		VALGRIND_DO_MEMPOOL_FREE(heap->layout, userdatap);
-		VALGRIND_DO_MAKE_MEM_NOACCESS(block_data, ALLOC_OFF);
+		VALGRIND_DO_MAKE_MEM_NOACCESS(block_data, data_off);
 
 		/*
 		 * During this method there are several stores to pmem that are
 		 * not immediately flushed and in case of a cancellation those
 		 * stores are no longer relevant anyway.
 		 */
-		VALGRIND_SET_CLEAN(block_data, ALLOC_OFF);
+		VALGRIND_SET_CLEAN(block_data, data_off);
 
 		return ret;
 	}
 
 	/* flushes both the alloc and oob headers */
-	pmemops_persist(&heap->p_ops, block_data, ALLOC_OFF);
+	if (!headerless)
+		pmemops_persist(&heap->p_ops, block_data, ALLOC_OFF);
 
 	/*
 	 * To avoid determining the user data pointer twice this method is also
@@ -272,11 +328,15 @@ alloc_prep_block(struct palloc_heap *heap, struct memory_block m,
  *
  * Reallocation is a combination of the above, which one additional step
  * of copying the old content in the meantime.
+ *
+ * The new memory block is reserved in the allocation class with the given id,
+ * or in the best fitting one if the id is 0. Header-less blocks can't take part
+ * in a reallocation.
  */
 int
 palloc_operation(struct palloc_heap *heap,
 	uint64_t off, uint64_t *dest_off, size_t size,
-	palloc_constr constructor, void *arg,
+	palloc_constr constructor, void *arg, uint16_t class_id,
 	struct operation_context *ctx)
 {
 	struct bucket *b = NULL;
@@ -284,6 +344,8 @@ palloc_operation(struct palloc_heap *heap,
 	struct memory_block existing_block = {0, 0, 0, 0};
 	struct memory_block new_block = {0, 0, 0, 0};
 	struct memory_block reclaimed_block = {0, 0, 0, 0};
+	int existing_headerless = 0;
+	int new_headerless = 0;
 
 	int ret = 0;
 
@@ -304,8 +366,10 @@ palloc_operation(struct palloc_heap *heap,
 	 * methods operate in.
 	 */
 	if (off != 0) {
-		alloc = ALLOC_GET_HEADER(heap, off);
-		existing_block = get_mblock_from_alloc(heap, alloc);
+		existing_block = alloc_get_mblock(heap, off,
+			&existing_headerless);
+		if (!existing_headerless)
+			alloc = ALLOC_GET_HEADER(heap, off);
 		/*
 		 * This lock must be held until the operation is processed
 		 * successfully, because other threads might operate on the
@@ -337,17 +401,25 @@ palloc_operation(struct palloc_heap *heap,
 		 * necessary volatile heap modifications won't be performed for
 		 * this memory block.
 		 */
-		b = heap_get_chunk_bucket(heap, alloc->chunk_id,
-				alloc->zone_id);
+		b = heap_get_chunk_bucket(heap, existing_block.chunk_id,
+				existing_block.zone_id);
 	}
 
 	/* if allocation or reallocation, reserve new memory */
 	if (size != 0) {
+		if (off != 0 && (existing_headerless ||
+			palloc_class_is_headerless(heap, class_id, NULL))) {
+			errno = ENOTSUP;
+			ret = -1;
+			goto out;
+		}
+
 		/* reallocation to exactly the same size, which is a no-op */
 		if (alloc != NULL && alloc->size == sizeh)
 			goto out;
 
-		errno = alloc_reserve_block(heap, &new_block, sizeh);
+		errno = alloc_reserve_block(heap, &new_block, size, class_id,
+			&new_headerless);
 		if (errno != 0) {
 			ret = -1;
 			goto out;
@@ -380,8 +452,8 @@ palloc_operation(struct palloc_heap *heap,
 	}
 
 	if (!MEMORY_BLOCK_IS_EMPTY(new_block)) {
-		if (alloc_prep_block(heap, new_block, constructor,
-				arg, &offset_value) != 0) {
+		if (alloc_prep_block(heap, new_block, new_headerless,
+				constructor, arg, &offset_value) != 0) {
 			/*
 			 * Constructor returned non-zero value which means
 			 * the memory block reservation has to be rolled back.
@@ -477,8 +549,7 @@ palloc_operation(struct palloc_heap *heap,
 	 */
 	if (!MEMORY_BLOCK_IS_EMPTY(existing_block)) {
 		VALGRIND_DO_MEMPOOL_FREE(heap->layout,
-			(char *)heap_get_block_data(heap, existing_block)
-			+ ALLOC_OFF);
+			PMALLOC_OFF_TO_PTR(heap, off));
 
 		/* we might have been operating on inactive run */
 		if (b != NULL) {
@@ -489,7 +560,14 @@ palloc_operation(struct palloc_heap *heap,
 			 * and reflects the current persistent heap state,
 			 * whereas the existing block reflects the state from
 			 * before this operation started.
+			 *
+			 * A block that went back into the thread's magazine
+			 * keeps its run in use, so there's nothing to degrade.
 			 */
+			if (heap_put_magazine_block(heap, b,
+					reclaimed_block) == 0)
+				goto out;
+
 			CNT_OP(b, insert, heap, reclaimed_block);
 
 			/*
@@ -518,73 +596,359 @@ out:
 }
 
 /*
- * palloc_usable_size -- returns the number of bytes in the memory block
+ * Transient state of a single operation of a batch pass.
  */
-size_t
-palloc_usable_size(struct palloc_heap *heap, uint64_t off)
+struct palloc_batch_block {
+	struct memory_block m; /* the allocated or freed block */
+	struct memory_block reclaimed; /* the coalesced block of a free */
+	struct bucket *b; /* the bucket a freed block returns to */
+	uint64_t offset_value; /* value written to the destination */
+	int headerless;
+};
+
+/*
+ * palloc_batch_pass_len -- (internal) returns the number of operations that
+ *	are guaranteed to fit into a single redo log pass
+ *
+ * The heap metadata modification of every operation is at most one persistent
+ * (bitmap value or chunk header) and one transient (chunk footer) entry.
+ * Entries that hit the same 8-byte value are merged by the operation context,
+ * but that can't be known upfront and the estimate assumes the worst case.
+ */
+static size_t
+palloc_batch_pass_len(struct operation_context *ctx,
+	const struct palloc_batch_op *ops, size_t nops)
 {
-	return USABLE_SIZE(ALLOC_GET_HEADER(heap, off));
+	size_t space[MAX_OPERATION_ENTRY_TYPE];
+	space[ENTRY_PERSISTENT] = operation_get_space(ctx, ENTRY_PERSISTENT);
+	space[ENTRY_TRANSIENT] = operation_get_space(ctx, ENTRY_TRANSIENT);
+
+	size_t n;
+	for (n = 0; n < nops && n < PALLOC_BATCH_PASS_MAX; ++n) {
+		size_t needed[MAX_OPERATION_ENTRY_TYPE] = {1, 1};
+
+		if (ops[n].dest_off != NULL)
+			needed[operation_get_entry_type(ctx,
+				ops[n].dest_off)]++;
+		if (ops[n].extra_ptr != NULL)
+			needed[operation_get_entry_type(ctx,
+				ops[n].extra_ptr)]++;
+
+		if (needed[ENTRY_PERSISTENT] > space[ENTRY_PERSISTENT] ||
+			needed[ENTRY_TRANSIENT] > space[ENTRY_TRANSIENT])
+			break;
+
+		space[ENTRY_PERSISTENT] -= needed[ENTRY_PERSISTENT];
+		space[ENTRY_TRANSIENT] -= needed[ENTRY_TRANSIENT];
+	}
+
+	/* every operation must fit into an empty context on its own */
+	ASSERTne(n, 0);
+
+	return n;
 }
 
 /*
- * pmalloc_search_cb -- (internal) foreach callback. If the argument is equal
- *	to the current object offset then sets the argument to UINT64_MAX.
- *	If the argument is UINT64_MAX it breaks the iteration and sets the
- *	argument to the current object offset.
+ * palloc_batch_reserve -- (internal) reserves and constructs the new blocks of
+ *	the allocations in a batch pass
+ *
+ * This happens before any of the block locks is taken, just like in the case
+ * of a single allocation, so that the constructors are free to use the
+ * allocator. If a reservation fails, the number of operations in the pass is
+ * reduced to the ones that succeeded and the error is returned.
  */
 static int
-pmalloc_search_cb(uint64_t off, void *arg)
+palloc_batch_reserve(struct palloc_heap *heap,
+	const struct palloc_batch_op *ops, struct palloc_batch_block *blocks,
+	size_t *n, palloc_constr constructor, void *arg, uint16_t class_id)
 {
-	uint64_t *prev = arg;
+	for (size_t i = 0; i < *n; ++i) {
+		struct palloc_batch_block *bb = &blocks[i];
+		memset(bb, 0, sizeof(*bb));
+
+		if (ops[i].off != 0)
+			continue;
 
-	if (*prev == UINT64_MAX) {
-		*prev = off;
+		ASSERTne(ops[i].size, 0);
 
-		return 1;
+		int err = alloc_reserve_block(heap, &bb->m, ops[i].size,
+			class_id, &bb->headerless);
+		if (err != 0) {
+			*n = i;
+			return err;
+		}
+
+		if (alloc_prep_block(heap, bb->m, bb->headerless,
+				constructor, arg, &bb->offset_value) != 0) {
+			struct bucket *new_bucket = heap_get_chunk_bucket(heap,
+				bb->m.chunk_id, bb->m.zone_id);
+			ASSERTne(new_bucket, NULL);
+
+			bb->m = heap_free_block(heap, new_bucket, bb->m, NULL);
+			CNT_OP(new_bucket, insert, heap, bb->m);
+
+			if (new_bucket->type == BUCKET_RUN)
+				heap_degrade_run_if_empty(heap,
+					new_bucket, bb->m);
+
+			*n = i;
+			return ECANCELED;
+		}
 	}
 
-	if (off == *prev)
-		*prev = UINT64_MAX;
+	return 0;
+}
+
+/*
+ * palloc_batch_lock -- (internal) acquires the locks of all the blocks in
+ *	a batch pass
+ *
+ * Several blocks of a pass often share a single lock, and a lock can only be
+ * taken once. The distinct locks are acquired in the order of their addresses
+ * so that two concurrent batches can't deadlock each other.
+ */
+static size_t
+palloc_batch_lock(struct palloc_heap *heap, struct palloc_batch_block *blocks,
+	size_t n, pthread_mutex_t **locks)
+{
+	size_t nlocks = 0;
+	for (size_t i = 0; i < n; ++i) {
+		pthread_mutex_t *lock = MEMBLOCK_OPS(AUTO, &blocks[i].m)->
+			get_lock(&blocks[i].m, heap);
+		if (lock == NULL)
+			continue;
+
+		/* insertion into the sorted set of locks */
+		size_t pos = nlocks;
+		while (pos > 0 && (uintptr_t)locks[pos - 1] > (uintptr_t)lock)
+			pos--;
+
+		if (pos > 0 && locks[pos - 1] == lock)
+			continue;
+
+		memmove(&locks[pos + 1], &locks[pos],
+			(nlocks - pos) * sizeof(*locks));
+		locks[pos] = lock;
+		nlocks++;
+	}
+
+	for (size_t i = 0; i < nlocks; ++i)
+		util_mutex_lock(locks[i]);
+
+	return nlocks;
+}
+
+/*
+ * palloc_batch_process -- (internal) creates the metadata modifications of
+ *	all the operations in a batch pass, processes them in a single redo log
+ *	and brings the transient heap state in-sync afterwards
+ */
+static void
+palloc_batch_process(struct palloc_heap *heap,
+	const struct palloc_batch_op *ops, struct palloc_batch_block *blocks,
+	size_t n, struct operation_context *ctx)
+{
+	pthread_mutex_t *locks[PALLOC_BATCH_PASS_MAX];
+
+	for (size_t i = 0; i < n; ++i) {
+		if (ops[i].off != 0)
+			blocks[i].m = alloc_get_mblock(heap, ops[i].off,
+				&blocks[i].headerless);
+	}
+
+	size_t nlocks = palloc_batch_lock(heap, blocks, n, locks);
+
+	for (size_t i = 0; i < n; ++i) {
+		struct palloc_batch_block *bb = &blocks[i];
+		int is_free = ops[i].off != 0;
+
+#ifdef DEBUG
+		enum memblock_state state = is_free ?
+			MEMBLOCK_ALLOCATED : MEMBLOCK_FREE;
+		if (MEMBLOCK_OPS(AUTO, &bb->m)->get_state(&bb->m, heap) !=
+				state) {
+			ERR("Double free or heap corruption");
+			ASSERT(0);
+		}
+#endif /* DEBUG */
+
+		if (is_free) {
+			bb->b = heap_get_chunk_bucket(heap, bb->m.chunk_id,
+				bb->m.zone_id);
+			bb->reclaimed = heap_free_block(heap, bb->b, bb->m,
+				ctx);
+		} else {
+			MEMBLOCK_OPS(AUTO, &bb->m)->prep_hdr(&bb->m,
+				heap, MEMBLOCK_ALLOCATED, ctx);
+		}
+
+		if (ops[i].dest_off != NULL)
+			operation_add_entry(ctx, ops[i].dest_off,
+				bb->offset_value, OPERATION_SET);
+		if (ops[i].extra_ptr != NULL)
+			operation_add_entry(ctx, ops[i].extra_ptr,
+				ops[i].extra_value, OPERATION_SET);
+	}
+
+	operation_process(ctx);
+	operation_reset(ctx);
+
+	for (size_t i = 0; i < n; ++i) {
+		struct palloc_batch_block *bb = &blocks[i];
+		if (ops[i].off == 0)
+			continue;
+
+		VALGRIND_DO_MEMPOOL_FREE(heap->layout,
+			PMALLOC_OFF_TO_PTR(heap, ops[i].off));
+
+		/* see palloc_operation */
+		if (bb->b == NULL ||
+			heap_put_magazine_block(heap, bb->b,
+				bb->reclaimed) == 0)
+			continue;
+
+		CNT_OP(bb->b, insert, heap, bb->reclaimed);
+
+		if (bb->b->type == BUCKET_RUN)
+			heap_degrade_run_if_empty(heap, bb->b, bb->reclaimed);
+	}
+
+	for (size_t i = nlocks; i > 0; --i)
+		util_mutex_unlock(locks[i - 1]);
+}
+
+/*
+ * palloc_operation_batch -- performs a batch of allocations or deallocations
+ *	of blocks under a single operation context
+ *
+ * All of the allocations share the constructor and the allocation class, and
+ * every operation might be either an allocation or a free, but not both.
+ *
+ * The operations are split into passes, each of which performs as many of
+ * them as can be fit into the redo log and commits all of them at once.
+ * The capacity of the context can be extended with operation_reserve, up to
+ * PALLOC_BATCH_OP_ENTRIES entries for each of the operations of a pass.
+ * The batch as a whole is not fail-safe atomic, but every single operation
+ * is. If an allocation fails, the preceding operations remain performed and
+ * their number is returned in ndone alongside the error.
+ */
+int
+palloc_operation_batch(struct palloc_heap *heap,
+	const struct palloc_batch_op *ops, size_t nops,
+	palloc_constr constructor, void *arg, uint16_t class_id,
+	struct operation_context *ctx, size_t *ndone)
+{
+	struct palloc_batch_block blocks[PALLOC_BATCH_PASS_MAX];
+
+	ASSERTeq(ctx->nentries[ENTRY_PERSISTENT], 0);
+	ASSERTeq(ctx->nentries[ENTRY_TRANSIENT], 0);
+
+	*ndone = 0;
+	while (*ndone != nops) {
+		const struct palloc_batch_op *pass = ops + *ndone;
+		size_t n = palloc_batch_pass_len(ctx, pass, nops - *ndone);
+		ASSERT(n <= PALLOC_BATCH_PASS_MAX);
+
+		int err = palloc_batch_reserve(heap, pass, blocks, &n,
+			constructor, arg, class_id);
+
+		if (n != 0)
+			palloc_batch_process(heap, pass, blocks, n, ctx);
+
+		*ndone += n;
+
+		if (err != 0) {
+			errno = err;
+			return -1;
+		}
+	}
 
 	return 0;
 }
 
 /*
- * palloc_first -- returns the first object from the heap.
+ * palloc_usable_size -- returns the number of bytes in the memory block
+ *
+ * The size of a header-less block includes the space for the caller's header,
+ * even though it doesn't exist, so that the callers can treat all of the
+ * blocks alike.
  */
-uint64_t
-palloc_first(struct palloc_heap *heap)
+size_t
+palloc_usable_size(struct palloc_heap *heap, uint64_t off)
 {
-	uint64_t off_search = UINT64_MAX;
-	struct memory_block m = {0, 0, 0, 0};
+	struct memory_block m;
+	if (heap_get_headerless_block(heap, off, &m))
+		return MEMBLOCK_OPS(RUN, &m)->block_size(&m, heap->layout) +
+			PALLOC_DATA_OFF;
 
-	heap_foreach_object(heap, pmalloc_search_cb, &off_search, m);
+	return USABLE_SIZE(ALLOC_GET_HEADER(heap, off));
+}
 
-	if (off_search == UINT64_MAX)
-		return 0;
+/*
+ * palloc_is_headerless -- checks whether the memory block has no header
+ */
+int
+palloc_is_headerless(struct palloc_heap *heap, uint64_t off)
+{
+	struct memory_block m;
 
-	return off_search + sizeof(struct allocation_header);
+	return heap_get_headerless_block(heap, off, &m);
 }
 
 /*
- * palloc_next -- returns the next object relative to 'off'.
+ * palloc_headerless_type_num -- returns the type number of a header-less
+ *	memory block
  */
 uint64_t
-palloc_next(struct palloc_heap *heap, uint64_t off)
+palloc_headerless_type_num(struct palloc_heap *heap, uint64_t off)
 {
-	struct allocation_header *alloc = ALLOC_GET_HEADER(heap, off);
-	struct memory_block m = get_mblock_from_alloc(heap, alloc);
+	struct memory_block m;
+	int headerless = heap_get_headerless_block(heap, off, &m);
+	ASSERT(headerless);
 
-	uint64_t off_search = off - ALLOC_OFF;
+	return heap_get_headerless_type_num(heap, m);
+}
 
-	heap_foreach_object(heap, pmalloc_search_cb, &off_search, m);
+/*
+ * palloc_cursor_init -- positions the cursor at the beginning of one of
+ *	'nparts' disjoint parts of the heap
+ */
+void
+palloc_cursor_init(struct palloc_heap *heap, struct palloc_cursor *cur,
+	unsigned part, unsigned nparts)
+{
+	heap_cursor_init(heap, cur, part, nparts);
+}
 
-	if (off_search == (off - ALLOC_OFF) ||
-		off_search == 0 ||
-		off_search == UINT64_MAX)
+/*
+ * palloc_cursor_next -- finds the next object of the cursor's part of
+ *	the heap, returns 0 if there are no more objects
+ */
+int
+palloc_cursor_next(struct palloc_heap *heap, struct palloc_cursor *cur,
+	struct palloc_object *obj)
+{
+	if (!heap_cursor_next(heap, cur, obj))
 		return 0;
 
-	return off_search + sizeof(struct allocation_header);
+	if (!obj->headerless)
+		obj->off += ALLOC_OFF;
+
+	return 1;
+}
+
+/*
+ * palloc_cursor_seek -- positions the cursor right after the object at
+ *	the given data offset
+ */
+void
+palloc_cursor_seek(struct palloc_heap *heap, struct palloc_cursor *cur,
+	uint64_t off)
+{
+	int headerless;
+	struct memory_block m = alloc_get_mblock(heap, off, &headerless);
+
+	heap_cursor_seek(heap, cur, m);
 }
 
 /*
@@ -615,6 +979,76 @@ palloc_init(void *heap_start, uint64_t heap_size, struct pmem_ops *p_ops)
 	return heap_init(heap_start, heap_size, p_ops);
 }
 
+/*
+ * palloc_alloc_class_new -- registers a user-defined allocation class
+ *
+ * All of the blocks of a class have the same offset from the beginning of the
+ * pool modulo the unit size, so an alignment which is a divisor of the unit
+ * size is either satisfied by every object in the class or by none.
+ *
+ * The blocks of a header-less class contain only the data of objects of the
+ * given type number.
+ */
+int
+palloc_alloc_class_new(struct palloc_heap *heap, size_t unit_size,
+	size_t alignment, unsigned run_chunks, int headerless,
+	uint64_t type_num, unsigned *class_id)
+{
+	/* runs span exactly one chunk in this version of the heap layout */
+	if (run_chunks > 1)
+		return ENOTSUP;
+
+	if (alignment != 0) {
+		if ((alignment & (alignment - 1)) != 0 ||
+			alignment > Pagesize ||
+			unit_size % alignment != 0)
+			return EINVAL;
+
+		struct chunk_run *run = (struct chunk_run *)
+			&ZID_TO_ZONE(heap->layout, 0)->chunks[0];
+		uintptr_t data_off = (uintptr_t)&run->data +
+			(headerless ? 0 : ALLOC_OFF) - (uintptr_t)heap->base;
+
+		if (data_off % alignment != 0)
+			return EINVAL;
+	}
+
+	return heap_create_alloc_class(heap, unit_size, headerless, type_num,
+		class_id);
+}
+
+/*
+ * palloc_class_is_headerless -- checks whether the allocation class with the
+ *	given id serves header-less blocks, and if so, returns their type number
+ */
+int
+palloc_class_is_headerless(struct palloc_heap *heap, uint16_t class_id,
+	uint64_t *type_num)
+{
+	if (class_id == 0)
+		return 0;
+
+	struct bucket_run *r = (struct bucket_run *)
+		heap_get_class_bucket(heap, class_id, 1);
+	if (r == NULL || !r->headerless)
+		return 0;
+
+	if (type_num != NULL)
+		*type_num = r->type_num;
+
+	return 1;
+}
+
+/*
+ * palloc_get_cache_stats -- returns statistics of the allocation magazines
+ */
+void
+palloc_get_cache_stats(struct palloc_heap *heap,
+	struct palloc_cache_stats *stats)
+{
+	heap_get_cache_stats(heap, stats);
+}
+
 /*
  * palloc_heap_end -- returns first address after heap
  */
@@ -668,12 +1102,17 @@ static int
 palloc_vg_register_alloc(uint64_t off, void *arg)
 {
 	struct palloc_vg_args *args = arg;
+	struct memory_block m;
+
+	if (heap_get_headerless_block(args->heap, off, &m))
+		return args->cb(off, args->arg);
+
 	struct allocation_header *alloc =
 		(void *)((uintptr_t)args->heap->base + off);
 
 	VALGRIND_DO_MAKE_MEM_DEFINED(alloc, sizeof(*alloc));
 
-	return args->cb(off + sizeof(*alloc), args->arg);
+	return args->cb(off + ALLOC_OFF, args->arg);
 }
 
 /*
@@ -60,14 +60,71 @@ struct palloc_heap {
 typedef int (*palloc_constr)(void *base, void *ptr,
 		size_t usable_size, void *arg);
 
+/*
+ * Statistics of the per-thread allocation magazines.
+ */
+struct palloc_cache_stats {
+	uint64_t hits; /* allocations served directly from a magazine */
+	uint64_t misses; /* allocations that found the magazine empty */
+	uint64_t refills; /* successful magazine refills */
+	uint64_t refilled_blocks; /* blocks moved to magazines by refills */
+};
+
+/*
+ * Maximum number of operations of a batch committed together, and the number
+ * of entries of each type a single one of them might add in the worst case.
+ */
+#define PALLOC_BATCH_PASS_MAX 64
+#define PALLOC_BATCH_OP_ENTRIES 3
+
+/*
+ * A single allocation or deallocation performed as a part of a batch.
+ */
+struct palloc_batch_op {
+	uint64_t off; /* offset of the block to free, 0 for an allocation */
+	size_t size; /* size of the block to allocate, 0 for a free */
+	uint64_t *dest_off; /* destination of the resulting offset, or NULL */
+	uint64_t *extra_ptr; /* value set alongside the offset, or NULL */
+	uint64_t extra_value;
+};
+
 int palloc_operation(struct palloc_heap *heap, uint64_t off, uint64_t *dest_off,
-	size_t size, palloc_constr constructor, void *arg,
+	size_t size, palloc_constr constructor, void *arg, uint16_t class_id,
 	struct operation_context *ctx);
+int palloc_operation_batch(struct palloc_heap *heap,
+	const struct palloc_batch_op *ops, size_t nops,
+	palloc_constr constructor, void *arg, uint16_t class_id,
+	struct operation_context *ctx, size_t *ndone);
+
+/*
+ * Position of an iteration through the objects of a range of the heap. The
+ * chunks are numbered across all zones as if each of them was of maximal size.
+ */
+struct palloc_cursor {
+	uint64_t chunk; /* index of the current chunk */
+	uint64_t end; /* index of the first chunk past the range */
+	uint32_t block; /* next unit of the current chunk to be visited */
+};
+
+/*
+ * Object found by a cursor.
+ */
+struct palloc_object {
+	uint64_t off; /* offset of the data */
+	int headerless;
+	uint64_t type_num; /* type number, valid for header-less objects only */
+};
 
-uint64_t palloc_first(struct palloc_heap *heap);
-uint64_t palloc_next(struct palloc_heap *heap, uint64_t off);
+void palloc_cursor_init(struct palloc_heap *heap, struct palloc_cursor *cur,
+	unsigned part, unsigned nparts);
+void palloc_cursor_seek(struct palloc_heap *heap, struct palloc_cursor *cur,
+	uint64_t off);
+int palloc_cursor_next(struct palloc_heap *heap, struct palloc_cursor *cur,
+	struct palloc_object *obj);
 
 size_t palloc_usable_size(struct palloc_heap *heap, uint64_t off);
+int palloc_is_headerless(struct palloc_heap *heap, uint64_t off);
+uint64_t palloc_headerless_type_num(struct palloc_heap *heap, uint64_t off);
 
 int palloc_boot(struct palloc_heap *heap, void *heap_start,
 		uint64_t heap_size, void *base, struct pmem_ops *p_ops);
@@ -79,6 +136,13 @@ int palloc_heap_check(void *heap_start, uint64_t heap_size);
 int palloc_heap_check_remote(void *heap_start, uint64_t heap_size,
 		struct remote_ops *ops);
 void palloc_heap_cleanup(struct palloc_heap *heap);
+int palloc_alloc_class_new(struct palloc_heap *heap, size_t unit_size,
+	size_t alignment, unsigned run_chunks, int headerless,
+	uint64_t type_num, unsigned *class_id);
+int palloc_class_is_headerless(struct palloc_heap *heap, uint16_t class_id,
+	uint64_t *type_num);
+void palloc_get_cache_stats(struct palloc_heap *heap,
+		struct palloc_cache_stats *stats);
 
 /* foreach callback, terminates iteration if return value is non-zero */
 typedef int (*object_callback)(uint64_t off, void *arg);
@@ -46,6 +46,7 @@
 #include "out.h"
 #include "palloc.h"
 #include "pmalloc.h"
+#include "type_index.h"
 
 /*
  * pmalloc_redo_hold -- acquires allocator lane section and returns a pointer to
@@ -70,6 +71,80 @@ pmalloc_redo_release(PMEMobjpool *pop)
 	lane_release(pop);
 }
 
+/*
+ * constructor_redo_ext -- (internal) constructor of the redo log extension
+ */
+static int
+constructor_redo_ext(void *ctx, void *ptr, size_t usable_size, void *arg)
+{
+	PMEMobjpool *pop = ctx;
+	const struct pmem_ops *p_ops = &pop->p_ops;
+	size_t nentries = *(size_t *)arg;
+
+	struct oob_header *oobh = OOB_HEADER_FROM_PTR(ptr);
+	VALGRIND_ADD_TO_TX(oobh, OBJ_OOB_SIZE);
+	oobh->size = OBJ_INTERNAL_OBJECT_MASK;
+	pmemops_flush(p_ops, &oobh->size, sizeof(oobh->size));
+	VALGRIND_REMOVE_FROM_TX(oobh, OBJ_OOB_SIZE);
+
+	/* stale finish flags can't ever be found in the extension */
+	struct redo_log_ext *ext = ptr;
+	ext->nentries = nentries;
+	ext->unused = 0;
+	pmemops_memset_persist(p_ops, ext->redo, 0,
+		nentries * sizeof(struct redo_log));
+	pmemops_persist(p_ops, ext, sizeof(*ext));
+
+	return 0;
+}
+
+/*
+ * pmalloc_redo_reserve -- extends the capacity of the operation on the redo
+ *	log of the held allocator lane section to nentries of each type
+ *
+ * If the existing redo log extension of the lane is too small, it's replaced
+ * by a large enough one. Must be called before any entries are added.
+ */
+int
+pmalloc_redo_reserve(PMEMobjpool *pop, struct operation_context *ctx,
+	size_t nentries)
+{
+	struct lane_section *lane;
+	lane_hold(pop, &lane, LANE_SECTION_ALLOCATOR);
+
+	struct lane_alloc_layout *sec = (void *)lane->layout;
+	ASSERTeq(ctx->redo, sec->redo);
+
+	int ret = 0;
+	if (redo_log_capacity(pop->redo, ALLOC_REDO_LOG_SIZE,
+			sec->redo_ext) < nentries) {
+		size_t ext_nentries = nentries - (ALLOC_REDO_LOG_SIZE - 1);
+
+		if (sec->redo_ext != 0) {
+			redo_log_ext_detach(pop->redo, sec->redo,
+				ALLOC_REDO_LOG_SIZE);
+			pfree(pop, &sec->redo_ext);
+		} else {
+			/* older versions wouldn't follow the link */
+			ret = obj_incompat_enable(pop,
+				OBJ_INCOMPAT_REDO_LOG_EXT);
+		}
+
+		if (ret == 0)
+			ret = pmalloc_construct(pop, &sec->redo_ext,
+				REDO_LOG_EXT_SIZE(ext_nentries) +
+				OBJ_OOB_SIZE,
+				constructor_redo_ext, &ext_nentries, 0);
+	}
+
+	if (ret == 0)
+		ret = operation_reserve(ctx, nentries, &sec->redo_ext);
+
+	lane_release(pop);
+
+	return ret;
+}
+
 /*
  * pmalloc_operation -- higher level wrapper for basic allocator API
  *
@@ -77,7 +152,7 @@ pmalloc_redo_release(PMEMobjpool *pop)
  */
 int
 pmalloc_operation(struct palloc_heap *heap, uint64_t off, uint64_t *dest_off,
-	size_t size, palloc_constr constructor, void *arg,
+	size_t size, palloc_constr constructor, void *arg, uint16_t class_id,
 	struct operation_context *ctx)
 {
 #ifdef USE_VG_MEMCHECK
@@ -86,13 +161,41 @@ pmalloc_operation(struct palloc_heap *heap, uint64_t off, uint64_t *dest_off,
 		dest_off = &tmp;
 #endif
 
+	struct type_index *ti = ((PMEMobjpool *)heap->base)->type_index;
+	uint64_t new_off;
+	if (ti != NULL) {
+		type_index_hold(ti);
+
+		if (size && dest_off == NULL)
+			dest_off = &new_off;
+
+		/*
+		 * The freed block might be reused by another thread as soon
+		 * as the operation is processed, so the object has to be
+		 * removed from the index before that.
+		 */
+		if (off != 0)
+			type_index_remove(heap->base, ti, off);
+	}
+
 	int ret = palloc_operation(heap, off, dest_off, size, constructor, arg,
-			ctx);
+			class_id, ctx);
+
+	if (ti != NULL) {
+		if (ret == 0 && size != 0)
+			type_index_insert(heap->base, ti, *dest_off);
+		else if (ret != 0 && off != 0)
+			type_index_insert(heap->base, ti, off);
+
+		type_index_release(ti);
+	}
+
 	if (ret)
 		return ret;
 
 #ifdef USE_VG_MEMCHECK
-	if (size && On_valgrind) {
+	if (size && On_valgrind &&
+		!palloc_is_headerless(heap, *dest_off)) {
 		struct oob_header *pobj =
 			OOB_HEADER_FROM_PTR((char *)heap->base + *dest_off);
 
@@ -109,6 +212,105 @@ pmalloc_operation(struct palloc_heap *heap, uint64_t off, uint64_t *dest_off,
 	return 0;
 }
 
+/*
+ * pmalloc_operation_batch_part -- (internal) performs up to
+ *	PALLOC_BATCH_PASS_MAX operations of the batch
+ */
+static int
+pmalloc_operation_batch_part(struct palloc_heap *heap,
+	const struct palloc_batch_op *ops, size_t nops,
+	palloc_constr constructor, void *arg, uint16_t class_id,
+	struct operation_context *ctx, size_t *ndone)
+{
+	ASSERT(nops <= PALLOC_BATCH_PASS_MAX);
+
+	/*
+	 * The offsets of the new blocks are needed even if the caller didn't
+	 * ask for them, see pmalloc_operation.
+	 */
+	struct palloc_batch_op part[PALLOC_BATCH_PASS_MAX];
+	uint64_t new_off[PALLOC_BATCH_PASS_MAX];
+	for (size_t i = 0; i < nops; ++i) {
+		part[i] = ops[i];
+		if (part[i].size != 0 && part[i].dest_off == NULL)
+			part[i].dest_off = &new_off[i];
+	}
+
+	struct type_index *ti = ((PMEMobjpool *)heap->base)->type_index;
+	if (ti != NULL) {
+		type_index_hold(ti);
+
+		/* see pmalloc_operation */
+		for (size_t i = 0; i < nops; ++i) {
+			if (part[i].off != 0)
+				type_index_remove(heap->base, ti, part[i].off);
+		}
+	}
+
+	int ret = palloc_operation_batch(heap, part, nops, constructor, arg,
+			class_id, ctx, ndone);
+
+	if (ti != NULL) {
+		for (size_t i = 0; i < nops; ++i) {
+			if (i < *ndone && part[i].size != 0)
+				type_index_insert(heap->base, ti,
+					*part[i].dest_off);
+			else if (i >= *ndone && part[i].off != 0)
+				type_index_insert(heap->base, ti, part[i].off);
+		}
+
+		type_index_release(ti);
+	}
+
+#ifdef USE_VG_MEMCHECK
+	for (size_t i = 0; On_valgrind && i < *ndone; ++i) {
+		if (part[i].size == 0 ||
+			palloc_is_headerless(heap, *part[i].dest_off))
+			continue;
+
+		struct oob_header *pobj = OOB_HEADER_FROM_PTR(
+			(char *)heap->base + *part[i].dest_off);
+
+		/* see pmalloc_operation */
+		VALGRIND_DO_MAKE_MEM_NOACCESS(pobj->unused,
+				sizeof(pobj->unused));
+	}
+#endif
+
+	return ret;
+}
+
+/*
+ * pmalloc_operation_batch -- higher level wrapper for batched allocator API
+ *
+ * If successful function returns zero. Otherwise an error number is returned
+ * and ndone is set to the number of operations that have been performed.
+ */
+int
+pmalloc_operation_batch(struct palloc_heap *heap,
+	const struct palloc_batch_op *ops, size_t nops,
+	palloc_constr constructor, void *arg, uint16_t class_id,
+	struct operation_context *ctx, size_t *ndone)
+{
+	*ndone = 0;
+	while (*ndone != nops) {
+		size_t n = nops - *ndone;
+		if (n > PALLOC_BATCH_PASS_MAX)
+			n = PALLOC_BATCH_PASS_MAX;
+
+		size_t done;
+		int ret = pmalloc_operation_batch_part(heap, ops + *ndone, n,
+			constructor, arg, class_id, ctx, &done);
+
+		*ndone += done;
+
+		if (ret != 0)
+			return ret;
+	}
+
+	return 0;
+}
+
 /*
  * pmalloc -- allocates a new block of memory
  *
@@ -124,7 +326,8 @@ pmalloc(PMEMobjpool *pop, uint64_t *off, size_t size)
 	struct operation_context ctx;
 	operation_init(&ctx, pop, pop->redo, redo);
 
-	int ret = pmalloc_operation(&pop->heap, 0, off, size, NULL, NULL, &ctx);
+	int ret = pmalloc_operation(&pop->heap, 0, off, size, NULL, NULL, 0,
+			&ctx);
 
 	pmalloc_redo_release(pop);
 
@@ -135,13 +338,14 @@ pmalloc(PMEMobjpool *pop, uint64_t *off, size_t size)
  * pmalloc_construct -- allocates a new block of memory with a constructor
  *
  * The block offset is written persistently into the off variable, but only
- * after the constructor function has been called.
+ * after the constructor function has been called. The block is allocated from
+ * the allocation class with the given id, or the best fitting one if it's 0.
  *
  * If successful function returns zero. Otherwise an error number is returned.
  */
 int
 pmalloc_construct(PMEMobjpool *pop, uint64_t *off, size_t size,
-	palloc_constr constructor, void *arg)
+	palloc_constr constructor, void *arg, uint16_t class_id)
 {
 	struct redo_log *redo = pmalloc_redo_hold(pop);
 	struct operation_context ctx;
@@ -149,7 +353,7 @@ pmalloc_construct(PMEMobjpool *pop, uint64_t *off, size_t size,
 	operation_init(&ctx, pop, pop->redo, redo);
 
 	int ret = pmalloc_operation(&pop->heap, 0, off, size, constructor, arg,
-			&ctx);
+			class_id, &ctx);
 
 	pmalloc_redo_release(pop);
 
@@ -171,7 +375,8 @@ prealloc(PMEMobjpool *pop, uint64_t *off, size_t size)
 
 	operation_init(&ctx, pop, pop->redo, redo);
 
-	int ret = pmalloc_operation(&pop->heap, *off, off, size, NULL, 0, &ctx);
+	int ret = pmalloc_operation(&pop->heap, *off, off, size, NULL, 0, 0,
+			&ctx);
 
 	pmalloc_redo_release(pop);
 
@@ -196,7 +401,7 @@ prealloc_construct(PMEMobjpool *pop, uint64_t *off, size_t size,
 	operation_init(&ctx, pop, pop->redo, redo);
 
 	int ret = pmalloc_operation(&pop->heap, *off, off, size, constructor,
-			arg, &ctx);
+			arg, 0, &ctx);
 
 	pmalloc_redo_release(pop);
 
@@ -218,12 +423,22 @@ pfree(PMEMobjpool *pop, uint64_t *off)
 
 	operation_init(&ctx, pop, pop->redo, redo);
 
-	int ret = pmalloc_operation(&pop->heap, *off, off, 0, NULL, NULL, &ctx);
+	int ret = pmalloc_operation(&pop->heap, *off, off, 0, NULL, NULL, 0,
+			&ctx);
 	ASSERTeq(ret, 0);
 
 	pmalloc_redo_release(pop);
 }
 
+/*
+ * pmalloc_get_cache_stats -- returns statistics of the allocation magazines
+ */
+void
+pmalloc_get_cache_stats(PMEMobjpool *pop, struct palloc_cache_stats *stats)
+{
+	palloc_get_cache_stats(&pop->heap, stats);
+}
+
 /*
  * pmalloc_construct_rt -- construct runtime part of allocator section
  */
@@ -256,6 +471,20 @@ pmalloc_recovery(PMEMobjpool *pop, void *data, unsigned length)
 	return 0;
 }
 
+/*
+ * pmalloc_need_recovery -- checks if the allocator lane section has to be
+ *	recovered
+ */
+static int
+pmalloc_need_recovery(PMEMobjpool *pop, void *data, unsigned length)
+{
+	struct lane_alloc_layout *sec = data;
+	ASSERT(sizeof(*sec) <= length);
+
+	return redo_log_need_recovery(pop->redo, sec->redo,
+		ALLOC_REDO_LOG_SIZE);
+}
+
 /*
  * pmalloc_check -- consistency check of allocator lane section
  */
@@ -280,6 +509,7 @@ static int
 pmalloc_boot(PMEMobjpool *pop)
 {
 	COMPILE_ERROR_ON(PALLOC_DATA_OFF != OBJ_OOB_SIZE);
+	COMPILE_ERROR_ON(ALLOC_REDO_LOG_SIZE != MAX_PERSITENT_ENTRIES);
 	COMPILE_ERROR_ON(ALLOC_BLOCK_SIZE != _POBJ_CL_SIZE);
 
 	int ret = palloc_boot(&pop->heap, (char *)pop + pop->heap_offset,
@@ -302,6 +532,7 @@ static struct section_operations allocator_ops = {
 	.construct_rt = pmalloc_construct_rt,
 	.destroy_rt = pmalloc_destroy_rt,
 	.recover = pmalloc_recovery,
+	.need_recovery = pmalloc_need_recovery,
 	.check = pmalloc_check,
 	.boot = pmalloc_boot
 };
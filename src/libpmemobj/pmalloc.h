@@ -48,20 +48,28 @@
  * The maximum number of entries in redo log used by the allocator. The common
  * case is to use two, one for modification of the object destination memory
  * location and the second for applying the chunk metadata modifications.
+ * Larger operations continue in the redo log extension, which is allocated on
+ * demand and kept for the reuse by later operations.
  */
 #define ALLOC_REDO_LOG_SIZE 10
 struct lane_alloc_layout {
 	struct redo_log redo[ALLOC_REDO_LOG_SIZE];
+	uint64_t redo_ext;
 };
 
 int pmalloc_operation(struct palloc_heap *heap,
 	uint64_t off, uint64_t *dest_off, size_t size,
-	palloc_constr constructor, void *arg,
+	palloc_constr constructor, void *arg, uint16_t class_id,
 	struct operation_context *ctx);
 
+int pmalloc_operation_batch(struct palloc_heap *heap,
+	const struct palloc_batch_op *ops, size_t nops,
+	palloc_constr constructor, void *arg, uint16_t class_id,
+	struct operation_context *ctx, size_t *ndone);
+
 int pmalloc(PMEMobjpool *pop, uint64_t *off, size_t size);
 int pmalloc_construct(PMEMobjpool *pop, uint64_t *off, size_t size,
-	palloc_constr constructor, void *arg);
+	palloc_constr constructor, void *arg, uint16_t class_id);
 
 int prealloc(PMEMobjpool *pop, uint64_t *off, size_t size);
 int prealloc_construct(PMEMobjpool *pop, uint64_t *off, size_t size,
@@ -69,7 +77,12 @@ int prealloc_construct(PMEMobjpool *pop, uint64_t *off, size_t size,
 
 void pfree(PMEMobjpool *pop, uint64_t *off);
 
+void pmalloc_get_cache_stats(PMEMobjpool *pop,
+	struct palloc_cache_stats *stats);
+
 struct redo_log *pmalloc_redo_hold(PMEMobjpool *pop);
 void pmalloc_redo_release(PMEMobjpool *pop);
+int pmalloc_redo_reserve(PMEMobjpool *pop, struct operation_context *ctx,
+	size_t nentries);
 
 #endif
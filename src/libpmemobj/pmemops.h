@@ -35,9 +35,11 @@
 
 #include <stddef.h>
 #include <stdint.h>
+#include <sys/uio.h>
 
 typedef void (*persist_fn)(void *base, const void *, size_t);
 typedef void (*flush_fn)(void *base, const void *, size_t);
+typedef void (*flushv_fn)(void *base, const struct iovec *, int);
 typedef void (*drain_fn)(void *base);
 typedef void *(*memcpy_fn)(void *base, void *dest, const void *src, size_t len);
 typedef void *(*memset_fn)(void *base, void *dest, int c, size_t len);
@@ -49,6 +51,7 @@ struct pmem_ops {
 	/* for 'master' replica: with or without data replication */
 	persist_fn persist;	/* persist function */
 	flush_fn flush;		/* flush function */
+	flushv_fn flushv;	/* vector flush function */
 	drain_fn drain;		/* drain function */
 	memcpy_fn memcpy_persist; /* persistent memcpy function */
 	memset_fn memset_persist; /* persistent memset function */
@@ -82,6 +85,21 @@ pmemops_flush(const struct pmem_ops *p_ops, const void *d, size_t s)
 	p_ops->flush(p_ops->base, d, s);
 }
 
+static force_inline void
+pmemops_flushv(const struct pmem_ops *p_ops, const struct iovec *iov,
+		int iovcnt)
+{
+	p_ops->flushv(p_ops->base, iov, iovcnt);
+}
+
+static force_inline void
+pmemops_persistv(const struct pmem_ops *p_ops, const struct iovec *iov,
+		int iovcnt)
+{
+	p_ops->flushv(p_ops->base, iov, iovcnt);
+	p_ops->drain(p_ops->base);
+}
+
 static force_inline void
 pmemops_drain(const struct pmem_ops *p_ops)
 {
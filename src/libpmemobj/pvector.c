@@ -239,7 +239,7 @@ pvector_push_back(struct pvector_context *ctx)
 
 			if (pmalloc_construct(pop,
 				&ctx->vec->arrays[s.idx],
-				arr_size, pvector_array_constr, NULL) != 0)
+				arr_size, pvector_array_constr, NULL, 0) != 0)
 					return NULL;
 		}
 	}
@@ -34,6 +34,9 @@
  * redo.c -- redo log implementation
  */
 
+#include <inttypes.h>
+#include <string.h>
+
 #include "redo.h"
 #include "out.h"
 #include "util.h"
@@ -43,7 +46,12 @@
  * Finish flag at the least significant bit
  */
 #define REDO_FINISH_FLAG	((uint64_t)1<<0)
-#define REDO_FLAG_MASK		(~REDO_FINISH_FLAG)
+
+/*
+ * Link to the extension of the log, only in the last entry of an array
+ */
+#define REDO_NEXT_FLAG		((uint64_t)1<<1)
+#define REDO_FLAG_MASK		(~(REDO_FINISH_FLAG | REDO_NEXT_FLAG))
 
 struct redo_ctx {
 	void *base;
@@ -109,6 +117,37 @@ redo_log_nflags(const struct redo_log *redo, size_t nentries)
 	return ret;
 }
 
+/*
+ * redo_log_ext_get -- (internal) returns the extension the link entry points to
+ */
+static struct redo_log_ext *
+redo_log_ext_get(const struct redo_ctx *ctx, const struct redo_log *link)
+{
+	ASSERTne(link->offset & REDO_NEXT_FLAG, 0);
+
+	return (struct redo_log_ext *)((uintptr_t)ctx->base +
+		(link->offset & REDO_FLAG_MASK));
+}
+
+/*
+ * redo_log_nflags_chain -- (internal) get number of finish flags set in the
+ *	redo log and in its extension
+ */
+static size_t
+redo_log_nflags_chain(const struct redo_ctx *ctx, const struct redo_log *redo,
+		size_t nentries)
+{
+	size_t ret = redo_log_nflags(redo, nentries);
+
+	if (nentries != 0 && redo_log_is_link(&redo[nentries - 1])) {
+		struct redo_log_ext *ext = redo_log_ext_get(ctx,
+			&redo[nentries - 1]);
+		ret += redo_log_nflags(ext->redo, ext->nentries);
+	}
+
+	return ret;
+}
+
 /*
  * redo_log_store -- (internal) store redo log entry at specified index
  */
@@ -187,6 +226,11 @@ redo_log_process(const struct redo_ctx *ctx, struct redo_log *redo,
 
 	uint64_t *val;
 	while ((redo->offset & REDO_FINISH_FLAG) == 0) {
+		if (redo->offset & REDO_NEXT_FLAG) {
+			redo = redo_log_ext_get(ctx, redo)->redo;
+			continue;
+		}
+
 		val = (uint64_t *)((uintptr_t)ctx->base + redo->offset);
 		VALGRIND_ADD_TO_TX(val, sizeof(*val));
 		*val = redo->value;
@@ -222,13 +266,27 @@ redo_log_recover(const struct redo_ctx *ctx, struct redo_log *redo,
 	LOG(15, "redo %p nentries %zu", redo, nentries);
 	ASSERTne(ctx, NULL);
 
-	size_t nflags = redo_log_nflags(redo, nentries);
+	size_t nflags = redo_log_nflags_chain(ctx, redo, nentries);
 	ASSERT(nflags < 2);
 
 	if (nflags == 1)
 		redo_log_process(ctx, redo, nentries);
 }
 
+/*
+ * redo_log_need_recovery -- (internal) returns 1 if the redo log is committed
+ *	and has to be processed by redo_log_recover
+ */
+int
+redo_log_need_recovery(const struct redo_ctx *ctx, const struct redo_log *redo,
+		size_t nentries)
+{
+	LOG(15, "redo %p nentries %zu", redo, nentries);
+	ASSERTne(ctx, NULL);
+
+	return redo_log_nflags_chain(ctx, redo, nentries) != 0;
+}
+
 /*
  * redo_log_check -- (internal) check consistency of redo log entries
  */
@@ -239,7 +297,32 @@ redo_log_check(const struct redo_ctx *ctx, struct redo_log *redo,
 	LOG(15, "redo %p nentries %zu", redo, nentries);
 	ASSERTne(ctx, NULL);
 
-	size_t nflags = redo_log_nflags(redo, nentries);
+	void *cctx = ctx->check_offset_ctx;
+	struct redo_log *link = nentries != 0 &&
+		redo_log_is_link(&redo[nentries - 1]) ?
+		&redo[nentries - 1] : NULL;
+
+	if (link != NULL) {
+		uint64_t ext_off = link->offset & REDO_FLAG_MASK;
+		if (!ctx->check_offset(cctx, ext_off) ||
+			!ctx->check_offset(cctx, ext_off +
+				sizeof(struct redo_log_ext) - 1)) {
+			LOG(15, "redo %p invalid extension %ju",
+					redo, ext_off);
+			return -1;
+		}
+
+		struct redo_log_ext *ext = redo_log_ext_get(ctx, link);
+		uint64_t ext_end = ext_off + REDO_LOG_EXT_SIZE(ext->nentries);
+		if (ext->nentries == 0 ||
+			!ctx->check_offset(cctx, ext_end - 1)) {
+			LOG(15, "redo %p invalid extension size %ju",
+					redo, ext->nentries);
+			return -1;
+		}
+	}
+
+	size_t nflags = redo_log_nflags_chain(ctx, redo, nentries);
 
 	if (nflags > 1) {
 		LOG(15, "redo %p too many finish flags", redo);
@@ -247,9 +330,21 @@ redo_log_check(const struct redo_ctx *ctx, struct redo_log *redo,
 	}
 
 	if (nflags == 1) {
-		void *cctx = ctx->check_offset_ctx;
+		int extended = 0;
 
 		while ((redo->offset & REDO_FINISH_FLAG) == 0) {
+			if (redo->offset & REDO_NEXT_FLAG) {
+				/* there's only one link, at the array end */
+				if (extended || redo != link) {
+					LOG(15, "redo %p misplaced link", redo);
+					return -1;
+				}
+
+				redo = redo_log_ext_get(ctx, redo)->redo;
+				extended = 1;
+				continue;
+			}
+
 			if (!ctx->check_offset(cctx, redo->offset)) {
 				LOG(15, "redo %p invalid offset %ju",
 						redo, redo->offset);
@@ -268,6 +363,239 @@ redo_log_check(const struct redo_ctx *ctx, struct redo_log *redo,
 	return 0;
 }
 
+/*
+ * redo_log_capacity -- returns the number of entries that can be stored in
+ *	the redo log together with its extension
+ */
+size_t
+redo_log_capacity(const struct redo_ctx *ctx, size_t nentries, uint64_t ext)
+{
+	if (ext == 0)
+		return nentries;
+
+	struct redo_log_ext *e = (struct redo_log_ext *)
+		((uintptr_t)ctx->base + ext);
+
+	/* the last entry of the array becomes the link */
+	return nentries - 1 + e->nentries;
+}
+
+/*
+ * redo_log_cursor_init -- prepares the cursor for storing a redo log in the
+ *	array with the given number of entries, which continues in the extension
+ *	at the ext offset if it doesn't fit, or 0 if there's no extension
+ */
+void
+redo_log_cursor_init(struct redo_log_cursor *cur, struct redo_log *redo,
+		size_t nentries, uint64_t ext)
+{
+	ASSERT(nentries > 1 || ext == 0);
+
+	cur->redo = redo;
+	cur->nentries = nentries;
+	cur->index = 0;
+	cur->ext = ext;
+}
+
+/*
+ * redo_log_cursor_store -- stores the redo log entry at the cursor position
+ *
+ * Once the array is full, its last entry is moved to the beginning of the
+ * extension and replaced by the link, so that the link only ever exists when
+ * the log really continues in the extension.
+ */
+void
+redo_log_cursor_store(const struct redo_ctx *ctx, struct redo_log_cursor *cur,
+		uint64_t offset, uint64_t value)
+{
+	LOG(15, "redo %p index %zu offset %ju value %ju",
+			cur->redo, cur->index, offset, value);
+
+	ASSERTeq(offset & ~REDO_FLAG_MASK, 0);
+
+	if (cur->index == cur->nentries) {
+		ASSERTne(cur->ext, 0);
+		const struct pmem_ops *p_ops = &ctx->p_ops;
+
+		struct redo_log *last = &cur->redo[cur->nentries - 1];
+		struct redo_log_ext *ext = (struct redo_log_ext *)
+			((uintptr_t)ctx->base + cur->ext);
+
+		ext->redo[0] = *last;
+		last->offset = cur->ext | REDO_NEXT_FLAG;
+		last->value = 0;
+
+		/* the flushes are drained when the finish flag is set */
+		pmemops_flush(p_ops, cur->redo,
+			cur->nentries * sizeof(struct redo_log));
+
+		cur->redo = ext->redo;
+		cur->nentries = ext->nentries;
+		cur->index = 1;
+		cur->ext = 0;
+	}
+
+	cur->redo[cur->index].offset = offset;
+	cur->redo[cur->index].value = value;
+	cur->index++;
+}
+
+/*
+ * redo_log_cursor_set_last -- persists the stored entries and sets the finish
+ *	flag in the last one
+ */
+void
+redo_log_cursor_set_last(const struct redo_ctx *ctx,
+		struct redo_log_cursor *cur)
+{
+	LOG(15, "redo %p index %zu", cur->redo, cur->index);
+
+	ASSERTne(cur->index, 0);
+	const struct pmem_ops *p_ops = &ctx->p_ops;
+
+	struct redo_log *last = &cur->redo[cur->index - 1];
+
+	/* persist all redo log entries */
+	pmemops_persist(p_ops, cur->redo,
+		cur->index * sizeof(struct redo_log));
+
+	/* set finish flag of last entry and persist */
+	last->offset |= REDO_FINISH_FLAG;
+	pmemops_persist(p_ops, &last->offset, sizeof(last->offset));
+}
+
+/*
+ * redo_log_ext_detach -- removes the link to the extension from the redo log,
+ *	which has to be done before the extension is freed
+ */
+void
+redo_log_ext_detach(const struct redo_ctx *ctx, struct redo_log *redo,
+		size_t nentries)
+{
+	LOG(15, "redo %p nentries %zu", redo, nentries);
+
+	struct redo_log *last = &redo[nentries - 1];
+	if (!redo_log_is_link(last))
+		return;
+
+	last->offset = 0;
+	pmemops_persist(&ctx->p_ops, &last->offset, sizeof(last->offset));
+}
+
+/*
+ * redo_range_log_store -- copies the entries into the range log and flushes
+ *	it, the log becomes valid once the caller drains the flushes
+ */
+void
+redo_range_log_store(const struct redo_ctx *ctx, struct redo_range_log *log,
+		const void *entries, size_t size, uint64_t flags)
+{
+	LOG(15, "log %p size %zu flags 0x%" PRIx64, log, size, flags);
+
+	ASSERTne(size, 0);
+	ASSERTeq(size % sizeof(uint64_t), 0);
+	const struct pmem_ops *p_ops = &ctx->p_ops;
+
+	VALGRIND_ADD_TO_TX(log, sizeof(*log) + size);
+
+	memcpy(log->data, entries, size);
+	log->size = size;
+	log->flags = flags;
+	log->unused = 0;
+	util_checksum(log, sizeof(*log) + size, &log->checksum, 1);
+
+	VALGRIND_REMOVE_FROM_TX(log, sizeof(*log) + size);
+
+	pmemops_flush(p_ops, log, sizeof(*log) + size);
+}
+
+/*
+ * redo_range_log_is_valid -- checks whether the range log was completely
+ *	stored and all of its entries point to valid offsets
+ */
+int
+redo_range_log_is_valid(const struct redo_ctx *ctx,
+		struct redo_range_log *log, size_t capacity)
+{
+	LOG(15, "log %p capacity %zu", log, capacity);
+
+	if (log->size == 0 || log->size > capacity ||
+			log->size % sizeof(uint64_t) != 0)
+		return 0;
+
+	if (!util_checksum(log, sizeof(*log) + log->size, &log->checksum, 0))
+		return 0;
+
+	void *cctx = ctx->check_offset_ctx;
+	size_t pos = 0;
+	while (pos < log->size) {
+		const struct redo_range *r =
+			(const struct redo_range *)&log->data[pos];
+
+		size_t left = log->size - pos;
+		if (left < sizeof(*r) || r->size == 0 ||
+				r->size > left - sizeof(*r) ||
+				REDO_RANGE_SIZE(r->size) > left)
+			return 0;
+
+		if (!ctx->check_offset(cctx, r->offset) ||
+			!ctx->check_offset(cctx, r->offset + r->size - 1)) {
+			LOG(15, "log %p invalid offset %ju", log, r->offset);
+			return 0;
+		}
+
+		pos += REDO_RANGE_SIZE(r->size);
+	}
+
+	return 1;
+}
+
+/*
+ * redo_range_log_apply -- copies all of the ranges to their destination and
+ *	flushes them, the caller has to drain before the log is cleared
+ */
+void
+redo_range_log_apply(const struct redo_ctx *ctx,
+		const struct redo_range_log *log)
+{
+	LOG(15, "log %p size %ju", log, log->size);
+
+	const struct pmem_ops *p_ops = &ctx->p_ops;
+
+	size_t pos = 0;
+	while (pos < log->size) {
+		const struct redo_range *r =
+			(const struct redo_range *)&log->data[pos];
+		void *dest = (char *)ctx->base + r->offset;
+
+		VALGRIND_ADD_TO_TX(dest, r->size);
+		memcpy(dest, r->data, r->size);
+		VALGRIND_REMOVE_FROM_TX(dest, r->size);
+
+		pmemops_flush(p_ops, dest, r->size);
+
+		pos += REDO_RANGE_SIZE(r->size);
+	}
+}
+
+/*
+ * redo_range_log_clear -- invalidates the range log
+ */
+void
+redo_range_log_clear(const struct redo_ctx *ctx, struct redo_range_log *log)
+{
+	LOG(15, "log %p", log);
+
+	const struct pmem_ops *p_ops = &ctx->p_ops;
+
+	VALGRIND_ADD_TO_TX(log, sizeof(*log));
+	log->checksum = 0;
+	log->size = 0;
+	VALGRIND_REMOVE_FROM_TX(log, sizeof(*log));
+
+	pmemops_persist(p_ops, log, sizeof(*log));
+}
+
 /*
  * redo_log_offset -- returns offset
  */
@@ -286,6 +614,15 @@ redo_log_is_last(const struct redo_log *redo)
 	return redo->offset & REDO_FINISH_FLAG;
 }
 
+/*
+ * redo_log_is_link -- returns whether the entry points to an extension
+ */
+int
+redo_log_is_link(const struct redo_log *redo)
+{
+	return (redo->offset & REDO_NEXT_FLAG) != 0;
+}
+
 /*
  * redo_get_pmem_ops -- returns pmem_ops
  */
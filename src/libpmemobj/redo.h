@@ -52,6 +52,56 @@ struct redo_log {
 	uint64_t value;
 };
 
+/*
+ * redo_log_ext -- extension of a redo log allocated from the heap
+ *
+ * When a log doesn't fit into its fixed-size array, the last entry of the
+ * array becomes a link to the extension in which the log continues.
+ * Extensions can't be chained any further.
+ */
+struct redo_log_ext {
+	uint64_t nentries;	/* number of entries in the extension */
+	uint64_t unused;
+	struct redo_log redo[];
+};
+
+#define REDO_LOG_EXT_SIZE(_nentries)\
+	(sizeof(struct redo_log_ext) + (_nentries) * sizeof(struct redo_log))
+
+/*
+ * redo_log_cursor -- position in a redo log that is being stored
+ */
+struct redo_log_cursor {
+	struct redo_log *redo;	/* the fixed-size array or the extension */
+	size_t nentries;	/* capacity of the current array */
+	size_t index;		/* index of the next entry to store */
+	uint64_t ext;		/* offset of the not yet used extension */
+};
+
+/*
+ * redo_range -- redo log entry holding a range of arbitrary size, the data
+ * is padded to 8 bytes
+ */
+struct redo_range {
+	uint64_t offset;
+	uint64_t size;
+	uint8_t data[];
+};
+
+/*
+ * redo_range_log -- redo log of variable-sized ranges
+ */
+struct redo_range_log {
+	uint64_t checksum;	/* checksum of the header and all entries */
+	uint64_t size;		/* size of all entries in bytes */
+	uint64_t flags;		/* user defined flags */
+	uint64_t unused;
+	uint8_t data[];		/* struct redo_range entries */
+};
+
+#define REDO_RANGE_SIZE(_size)\
+	(sizeof(struct redo_range) + (((_size) + 7) & ~7ULL))
+
 typedef int (*redo_check_offset_fn)(void *ctx, uint64_t offset);
 
 struct redo_ctx *redo_log_config_new(void *base,
@@ -72,12 +122,36 @@ void redo_log_process(const struct redo_ctx *ctx, struct redo_log *redo,
 		size_t nentries);
 void redo_log_recover(const struct redo_ctx *ctx, struct redo_log *redo,
 		size_t nentries);
+int redo_log_need_recovery(const struct redo_ctx *ctx,
+		const struct redo_log *redo, size_t nentries);
 int redo_log_check(const struct redo_ctx *ctx, struct redo_log *redo,
 		size_t nentries);
 
+size_t redo_log_capacity(const struct redo_ctx *ctx, size_t nentries,
+		uint64_t ext);
+void redo_log_cursor_init(struct redo_log_cursor *cur, struct redo_log *redo,
+		size_t nentries, uint64_t ext);
+void redo_log_cursor_store(const struct redo_ctx *ctx,
+		struct redo_log_cursor *cur, uint64_t offset, uint64_t value);
+void redo_log_cursor_set_last(const struct redo_ctx *ctx,
+		struct redo_log_cursor *cur);
+void redo_log_ext_detach(const struct redo_ctx *ctx, struct redo_log *redo,
+		size_t nentries);
+
+void redo_range_log_store(const struct redo_ctx *ctx,
+		struct redo_range_log *log, const void *entries, size_t size,
+		uint64_t flags);
+int redo_range_log_is_valid(const struct redo_ctx *ctx,
+		struct redo_range_log *log, size_t capacity);
+void redo_range_log_apply(const struct redo_ctx *ctx,
+		const struct redo_range_log *log);
+void redo_range_log_clear(const struct redo_ctx *ctx,
+		struct redo_range_log *log);
+
 size_t redo_log_nflags(const struct redo_log *redo, size_t nentries);
 uint64_t redo_log_offset(const struct redo_log *redo);
 int redo_log_is_last(const struct redo_log *redo);
+int redo_log_is_link(const struct redo_log *redo);
 
 const struct pmem_ops *redo_get_pmem_ops(const struct redo_ctx *ctx);
 
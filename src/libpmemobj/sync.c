@@ -56,6 +56,20 @@ get_lock((pop)->run_id,\
 	sizeof((rwlockp)->pmemrwlock.rwlock))
 
 
+#define GET_SPINMUTEX(pop, mutexp)\
+get_lock((pop)->run_id,\
+	&(mutexp)->pmemspinmutex.runid,\
+	&(mutexp)->pmemspinmutex.spinmutex,\
+	spinmutex_init,\
+	sizeof((mutexp)->pmemspinmutex.spinmutex))
+
+#define GET_BIASRWLOCK(pop, rwlockp)\
+get_lock((pop)->run_id,\
+	&(rwlockp)->pmembiasrwlock.runid,\
+	&(rwlockp)->pmembiasrwlock.biasrwlock,\
+	biasrwlock_init,\
+	sizeof((rwlockp)->pmembiasrwlock.biasrwlock))
+
 #define GET_COND(pop, condp)\
 get_lock((pop)->run_id,\
 	&(condp)->pmemcond.runid,\
@@ -63,6 +77,110 @@ get_lock((pop)->run_id,\
 	(void *)pthread_cond_init,\
 	sizeof((condp)->pmemcond.cond))
 
+/* spins of a waiting thread before it starts to yield the processor */
+#define SYNC_SPINS 128
+
+/* initial and maximal number of spins of an adaptive mutex */
+#define SPINMUTEX_MIN_SPINS 16
+#define SPINMUTEX_MAX_SPINS 4096
+
+/* maximal number of spins between the attempts to lock an adaptive mutex */
+#define SPINMUTEX_MAX_BACKOFF 64
+
+/* state of a reader-biased rwlock */
+#define BIASRWLOCK_WRITER (1U << 31) /* held by a writer */
+#define BIASRWLOCK_PENDING (1U << 30) /* a writer waits for the readers */
+#define BIASRWLOCK_READERS (BIASRWLOCK_PENDING - 1) /* slow path readers */
+
+/*
+ * After a writer revokes the bias, it stays off for this many times as long
+ * as the revocation took, so that frequent writers don't have to scan the
+ * table of visible readers all the time.
+ */
+#define BIASRWLOCK_INHIBIT_MULT 9
+
+/* the table of visible readers has 2^VISIBLE_READERS_BITS slots */
+#define VISIBLE_READERS_BITS 12
+#define VISIBLE_READERS (1 << VISIBLE_READERS_BITS)
+
+/*
+ * visible_reader -- a slot of a reader which holds a reader-biased rwlock
+ *	taken on the fast path
+ */
+struct visible_reader {
+	volatile uint64_t lock;
+	void *volatile owner;
+};
+
+/*
+ * The readers of the biased rwlocks publish themselves in slots chosen by a
+ * hash of the lock and the thread. A writer which revokes the bias has to
+ * wait until there are no slots of its lock in the whole table.
+ */
+static struct visible_reader Visible_readers[VISIBLE_READERS];
+
+/* the address identifies the thread in the slots of the visible readers */
+static __thread char Reader_id;
+
+/*
+ * sync_wait -- (internal) waits for another thread, first spinning and then
+ *	yielding the processor
+ */
+static void
+sync_wait(unsigned *spins)
+{
+	if (*spins < SYNC_SPINS) {
+		(*spins)++;
+		util_cpu_relax();
+	} else {
+		sched_yield();
+	}
+}
+
+/*
+ * sync_now -- (internal) returns the monotonic time in nanoseconds
+ */
+static uint64_t
+sync_now(void)
+{
+	struct timespec t;
+	clock_gettime(CLOCK_MONOTONIC, &t);
+
+	return (uint64_t)t.tv_sec * 1000000000ULL + (uint64_t)t.tv_nsec;
+}
+
+/*
+ * spinmutex_init -- (internal) initializes an adaptive mutex
+ */
+static int
+spinmutex_init(void *lock, void *arg)
+{
+	COMPILE_ERROR_ON(sizeof(PMEMspinmutex_internal) != _POBJ_CL_SIZE);
+	COMPILE_ERROR_ON(util_alignof(PMEMspinmutex)
+		!= util_alignof(pthread_mutex_t));
+
+	struct spinmutex *m = lock;
+	m->spins = SPINMUTEX_MIN_SPINS;
+
+	return pthread_mutex_init(&m->mutex, arg);
+}
+
+/*
+ * biasrwlock_init -- (internal) initializes a reader-biased rwlock
+ */
+static int
+biasrwlock_init(void *lock, void *arg)
+{
+	COMPILE_ERROR_ON(sizeof(PMEMbiasrwlock_internal) != _POBJ_CL_SIZE);
+
+	struct biasrwlock *l = lock;
+	l->state = 0;
+	l->rbias = 1;
+	l->inhibit_until = 0;
+
+	return 0;
+}
+
 /*
  * _get_lock -- (internal) atomically initialize and return a lock
  */
@@ -420,6 +538,408 @@ pmemobj_rwlock_unlock(PMEMobjpool *pop, PMEMrwlock *rwlockp)
 	return pthread_rwlock_unlock(rwlock);
 }
 
+/*
+ * pmemobj_spinmutex_zero -- zero-initialize a pmem resident adaptive mutex
+ *
+ * This function is not MT safe.
+ */
+void
+pmemobj_spinmutex_zero(PMEMobjpool *pop, PMEMspinmutex *mutexp)
+{
+	LOG(3, "pop %p mutex %p", pop, mutexp);
+
+	PMEMspinmutex_internal *mutexip = (PMEMspinmutex_internal *)mutexp;
+	mutexip->pmemspinmutex.runid = 0;
+	pmemops_persist(&pop->p_ops, &mutexip->pmemspinmutex.runid,
+				sizeof(mutexip->pmemspinmutex.runid));
+}
+
+/*
+ * pmemobj_spinmutex_lock -- lock a pmem resident adaptive mutex
+ *
+ * Before the thread goes to sleep, it tries to get the mutex for about twice
+ * as many spins as it usually takes. If the mutex is held for too long to get
+ * it by spinning, the number of spins decreases.
+ */
+int
+pmemobj_spinmutex_lock(PMEMobjpool *pop, PMEMspinmutex *mutexp)
+{
+	LOG(3, "pop %p mutex %p", pop, mutexp);
+
+	PMEMspinmutex_internal *mutexip = (PMEMspinmutex_internal *)mutexp;
+	struct spinmutex *m = GET_SPINMUTEX(pop, mutexip);
+	if (m == NULL)
+		return EINVAL;
+
+	ASSERTeq((uintptr_t)&m->mutex % util_alignof(pthread_mutex_t), 0);
+
+	if (pthread_mutex_trylock(&m->mutex) == 0)
+		return 0;
+
+	uint32_t avg = m->spins;
+	uint32_t max = avg * 2 < SPINMUTEX_MAX_SPINS ?
+		avg * 2 : SPINMUTEX_MAX_SPINS;
+	uint32_t spins = 0;
+	uint32_t backoff = 1;
+	int ret;
+
+	while (spins < max) {
+		for (uint32_t i = 0; i < backoff; ++i)
+			util_cpu_relax();
+		spins += backoff;
+
+		if ((ret = pthread_mutex_trylock(&m->mutex)) != EBUSY)
+			goto out;
+
+		if (backoff < SPINMUTEX_MAX_BACKOFF)
+			backoff *= 2;
+	}
+
+	/* spinning didn't pay off this time */
+	spins = avg / 2;
+
+	if ((ret = pthread_mutex_lock(&m->mutex)) != 0)
+		return ret;
+
+out:
+	if (ret == 0) {
+		/* the mutex is held, so it's the only writer of the average */
+		avg = (uint32_t)((int32_t)avg +
+			((int32_t)spins - (int32_t)avg) / 8);
+		m->spins = avg > SPINMUTEX_MIN_SPINS ?
+			avg : SPINMUTEX_MIN_SPINS;
+	}
+
+	return ret;
+}
+
+/*
+ * pmemobj_spinmutex_trylock -- trylock a pmem resident adaptive mutex
+ */
+int
+pmemobj_spinmutex_trylock(PMEMobjpool *pop, PMEMspinmutex *mutexp)
+{
+	LOG(3, "pop %p mutex %p", pop, mutexp);
+
+	PMEMspinmutex_internal *mutexip = (PMEMspinmutex_internal *)mutexp;
+	struct spinmutex *m = GET_SPINMUTEX(pop, mutexip);
+	if (m == NULL)
+		return EINVAL;
+
+	ASSERTeq((uintptr_t)&m->mutex % util_alignof(pthread_mutex_t), 0);
+
+	return pthread_mutex_trylock(&m->mutex);
+}
+
+/*
+ * pmemobj_spinmutex_unlock -- unlock a pmem resident adaptive mutex
+ */
+int
+pmemobj_spinmutex_unlock(PMEMobjpool *pop, PMEMspinmutex *mutexp)
+{
+	LOG(3, "pop %p mutex %p", pop, mutexp);
+
+	PMEMspinmutex_internal *mutexip = (PMEMspinmutex_internal *)mutexp;
+	struct spinmutex *m = GET_SPINMUTEX(pop, mutexip);
+	if (m == NULL)
+		return EINVAL;
+
+	ASSERTeq((uintptr_t)&m->mutex % util_alignof(pthread_mutex_t), 0);
+
+	return pthread_mutex_unlock(&m->mutex);
+}
+
+/*
+ * visible_reader_slot -- (internal) returns the slot of the calling thread
+ *	for the reader-biased rwlock
+ */
+static inline struct visible_reader *
+visible_reader_slot(struct biasrwlock *l)
+{
+	uint64_t h = ((uint64_t)(uintptr_t)&Reader_id >> 4) ^
+		(uint64_t)(uintptr_t)l;
+	h *= 0x9E3779B97F4A7C15ULL;
+
+	return &Visible_readers[h >> (64 - VISIBLE_READERS_BITS)];
+}
+
+/*
+ * biasrwlock_rdlock_fast -- (internal) takes the reader-biased rwlock by
+ *	publishing the reader in its slot, returns 0 if the bias is off or the
+ *	slot is taken by another reader
+ */
+static int
+biasrwlock_rdlock_fast(struct biasrwlock *l)
+{
+	volatile uint32_t *rbiasp = &l->rbias;
+	if (*rbiasp == 0)
+		return 0;
+
+	struct visible_reader *r = visible_reader_slot(l);
+	if (r->lock != 0 || !util_bool_compare_and_swap64(&r->lock, 0,
+			(uint64_t)(uintptr_t)l))
+		return 0;
+
+	r->owner = &Reader_id;
+
+	/*
+	 * The compare and swap is a full barrier, so either the writer which
+	 * revokes the bias sees the slot or the reader sees the revocation.
+	 */
+	if (*rbiasp != 0)
+		return 1;
+
+	r->owner = NULL;
+	util_release_barrier();
+	r->lock = 0;
+
+	return 0;
+}
+
+/*
+ * biasrwlock_rdlock_slow -- (internal) takes the reader-biased rwlock by
+ *	incrementing the number of readers in its state
+ */
+static int
+biasrwlock_rdlock_slow(struct biasrwlock *l, int try)
+{
+	volatile uint32_t *statep = &l->state;
+	unsigned spins = 0;
+
+	for (;;) {
+		uint32_t state = *statep;
+		if (state & (BIASRWLOCK_WRITER | BIASRWLOCK_PENDING)) {
+			if (try)
+				return EBUSY;
+
+			sync_wait(&spins);
+			continue;
+		}
+
+		if ((state & BIASRWLOCK_READERS) == BIASRWLOCK_READERS)
+			return EAGAIN;
+
+		if (util_bool_compare_and_swap32(statep, state, state + 1))
+			break;
+	}
+
+	/*
+	 * No writer can revoke the bias while the lock is held by a reader,
+	 * so it's safe to turn it on again once the inhibition has expired.
+	 */
+	if (!l->rbias && sync_now() >= l->inhibit_until)
+		l->rbias = 1;
+
+	return 0;
+}
+
+/*
+ * biasrwlock_revoke -- (internal) turns off the bias of the rwlock held by
+ *	a writer and waits for the readers which took it on the fast path,
+ *	returns the number of such readers if it shouldn't wait
+ */
+static unsigned
+biasrwlock_revoke(struct biasrwlock *l, int try)
+{
+	if (!l->rbias)
+		return 0;
+
+	l->rbias = 0;
+	__sync_synchronize();
+
+	uint64_t start = sync_now();
+	unsigned nreaders = 0;
+
+	for (unsigned i = 0; i < VISIBLE_READERS; ++i) {
+		unsigned spins = 0;
+		while (Visible_readers[i].lock == (uint64_t)(uintptr_t)l) {
+			if (try) {
+				nreaders++;
+				break;
+			}
+
+			sync_wait(&spins);
+		}
+	}
+
+	if (nreaders != 0) {
+		/* the readers are still there, so the bias stays on */
+		l->rbias = 1;
+		return nreaders;
+	}
+
+	uint64_t now = sync_now();
+	l->inhibit_until = now + (now - start) * BIASRWLOCK_INHIBIT_MULT;
+
+	return 0;
+}
+
+/*
+ * biasrwlock_unlock_writer -- (internal) releases the rwlock held by a writer
+ */
+static void
+biasrwlock_unlock_writer(struct biasrwlock *l)
+{
+	util_release_barrier();
+	*(volatile uint32_t *)&l->state = 0;
+}
+
+/*
+ * pmemobj_biasrwlock_zero -- zero-initialize a pmem resident reader-biased
+ *	rwlock
+ *
+ * This function is not MT safe.
+ */
+void
+pmemobj_biasrwlock_zero(PMEMobjpool *pop, PMEMbiasrwlock *rwlockp)
+{
+	LOG(3, "pop %p rwlock %p", pop, rwlockp);
+
+	PMEMbiasrwlock_internal *rwlockip = (PMEMbiasrwlock_internal *)rwlockp;
+	rwlockip->pmembiasrwlock.runid = 0;
+	pmemops_persist(&pop->p_ops, &rwlockip->pmembiasrwlock.runid,
+				sizeof(rwlockip->pmembiasrwlock.runid));
+}
+
+/*
+ * pmemobj_biasrwlock_rdlock -- rdlock a pmem resident reader-biased rwlock
+ *
+ * While the bias is on, the readers don't modify the lock, they only publish
+ * themselves in the table of visible readers.
+ */
+int
+pmemobj_biasrwlock_rdlock(PMEMobjpool *pop, PMEMbiasrwlock *rwlockp)
+{
+	LOG(3, "pop %p rwlock %p", pop, rwlockp);
+
+	PMEMbiasrwlock_internal *rwlockip = (PMEMbiasrwlock_internal *)rwlockp;
+	struct biasrwlock *l = GET_BIASRWLOCK(pop, rwlockip);
+	if (l == NULL)
+		return EINVAL;
+
+	if (biasrwlock_rdlock_fast(l))
+		return 0;
+
+	return biasrwlock_rdlock_slow(l, 0);
+}
+
+/*
+ * pmemobj_biasrwlock_tryrdlock -- tryrdlock a pmem resident reader-biased
+ *	rwlock
+ */
+int
+pmemobj_biasrwlock_tryrdlock(PMEMobjpool *pop, PMEMbiasrwlock *rwlockp)
+{
+	LOG(3, "pop %p rwlock %p", pop, rwlockp);
+
+	PMEMbiasrwlock_internal *rwlockip = (PMEMbiasrwlock_internal *)rwlockp;
+	struct biasrwlock *l = GET_BIASRWLOCK(pop, rwlockip);
+	if (l == NULL)
+		return EINVAL;
+
+	if (biasrwlock_rdlock_fast(l))
+		return 0;
+
+	return biasrwlock_rdlock_slow(l, 1);
+}
+
+/*
+ * pmemobj_biasrwlock_wrlock -- wrlock a pmem resident reader-biased rwlock
+ *
+ * A waiting writer stops the new readers from taking the lock on the slow
+ * path. Once it gets the lock, it revokes the bias and waits for the readers
+ * which took the lock on the fast path.
+ */
+int
+pmemobj_biasrwlock_wrlock(PMEMobjpool *pop, PMEMbiasrwlock *rwlockp)
+{
+	LOG(3, "pop %p rwlock %p", pop, rwlockp);
+
+	PMEMbiasrwlock_internal *rwlockip = (PMEMbiasrwlock_internal *)rwlockp;
+	struct biasrwlock *l = GET_BIASRWLOCK(pop, rwlockip);
+	if (l == NULL)
+		return EINVAL;
+
+	volatile uint32_t *statep = &l->state;
+	unsigned spins = 0;
+
+	for (;;) {
+		uint32_t state = *statep;
+		if (!(state & (BIASRWLOCK_WRITER | BIASRWLOCK_PENDING)) &&
+			util_bool_compare_and_swap32(statep, state,
+				state | BIASRWLOCK_PENDING))
+			break;
+
+		sync_wait(&spins);
+	}
+
+	while (!util_bool_compare_and_swap32(statep, BIASRWLOCK_PENDING,
+			BIASRWLOCK_WRITER))
+		sync_wait(&spins);
+
+	biasrwlock_revoke(l, 0);
+
+	return 0;
+}
+
+/*
+ * pmemobj_biasrwlock_trywrlock -- trywrlock a pmem resident reader-biased
+ *	rwlock
+ */
+int
+pmemobj_biasrwlock_trywrlock(PMEMobjpool *pop, PMEMbiasrwlock *rwlockp)
+{
+	LOG(3, "pop %p rwlock %p", pop, rwlockp);
+
+	PMEMbiasrwlock_internal *rwlockip = (PMEMbiasrwlock_internal *)rwlockp;
+	struct biasrwlock *l = GET_BIASRWLOCK(pop, rwlockip);
+	if (l == NULL)
+		return EINVAL;
+
+	if (!util_bool_compare_and_swap32(&l->state, 0, BIASRWLOCK_WRITER))
+		return EBUSY;
+
+	if (biasrwlock_revoke(l, 1) != 0) {
+		biasrwlock_unlock_writer(l);
+		return EBUSY;
+	}
+
+	return 0;
+}
+
+/*
+ * pmemobj_biasrwlock_unlock -- unlock a pmem resident reader-biased rwlock
+ */
+int
+pmemobj_biasrwlock_unlock(PMEMobjpool *pop, PMEMbiasrwlock *rwlockp)
+{
+	LOG(3, "pop %p rwlock %p", pop, rwlockp);
+
+	PMEMbiasrwlock_internal *rwlockip = (PMEMbiasrwlock_internal *)rwlockp;
+	struct biasrwlock *l = GET_BIASRWLOCK(pop, rwlockip);
+	if (l == NULL)
+		return EINVAL;
+
+	struct visible_reader *r = visible_reader_slot(l);
+	if (r->lock == (uint64_t)(uintptr_t)l && r->owner == &Reader_id) {
+		r->owner = NULL;
+		util_release_barrier();
+		r->lock = 0;
+		return 0;
+	}
+
+	uint32_t state = *(volatile uint32_t *)&l->state;
+	if (state == BIASRWLOCK_WRITER) {
+		biasrwlock_unlock_writer(l);
+		return 0;
+	}
+
+	ASSERTne(state & BIASRWLOCK_READERS, 0);
+	__sync_fetch_and_sub(&l->state, 1);
+
+	return 0;
+}
+
 /*
  * pmemobj_cond_zero -- zero-initialize a pmem resident condition variable
  *
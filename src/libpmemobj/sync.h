@@ -71,6 +71,41 @@ typedef union padded_pmemcond {
 	} pmemcond;
 } PMEMcond_internal;
 
+/*
+ * spinmutex -- mutex which spins for a while before it sleeps, the number of
+ *	spins is adapted to how long the lock is usually held
+ */
+struct spinmutex {
+	pthread_mutex_t mutex;
+	uint32_t spins; /* average number of spins needed to get the lock */
+};
+
+typedef union padded_pmemspinmutex {
+	char padding[_POBJ_CL_SIZE];
+	struct {
+		uint64_t runid;
+		struct spinmutex spinmutex;
+	} pmemspinmutex;
+} PMEMspinmutex_internal;
+
+/*
+ * biasrwlock -- reader-biased rwlock, while the bias is on the readers only
+ *	publish themselves in a global table instead of modifying the lock
+ */
+struct biasrwlock {
+	uint32_t state; /* number of readers, pending and active writer bits */
+	uint32_t rbias; /* readers may take the fast path */
+	uint64_t inhibit_until; /* no bias until this time after a revocation */
+};
+
+typedef union padded_pmembiasrwlock {
+	char padding[_POBJ_CL_SIZE];
+	struct {
+		uint64_t runid;
+		struct biasrwlock biasrwlock;
+	} pmembiasrwlock;
+} PMEMbiasrwlock_internal;
+
 /*
  * pmemobj_mutex_lock_nofail -- pmemobj_mutex_lock variant that never
  * fails from caller perspective. If pmemobj_mutex_lock failed, this function
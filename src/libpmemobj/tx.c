@@ -35,6 +35,8 @@
  */
 
 #include <inttypes.h>
+#include <limits.h>
+#include <pthread.h>
 #include <sys/queue.h>
 
 #include "ctree.h"
@@ -72,17 +74,40 @@ static __thread struct {
 	void *stage_callback_arg;
 } tx;
 
+/* number of locks a transaction can hold without any allocations */
+#define TX_LOCKS_INLINE 16
+
 struct tx_lock_data {
 	union {
 		PMEMmutex *mutex;
 		PMEMrwlock *rwlock;
 	} lock;
 	enum pobj_tx_param lock_type;
-	SLIST_ENTRY(tx_lock_data) tx_lock;
+};
+
+/*
+ * tx_lock_set -- locks held by the transaction together with an open
+ * addressing hash set of their addresses, used for finding duplicates
+ *
+ * Both are kept inside the lane runtime as long as the transaction doesn't
+ * take more than TX_LOCKS_INLINE locks.
+ */
+struct tx_lock_set {
+	struct tx_lock_data *locks;
+	void **hash; /* has twice as many slots as the capacity of locks */
+	size_t nlocks;
+	size_t capacity;
+	struct tx_lock_data inline_locks[TX_LOCKS_INLINE];
+	void *inline_hash[2 * TX_LOCKS_INLINE];
 };
 
 struct tx_undo_runtime {
 	struct pvector_context *ctx[MAX_UNDO_TYPES];
+
+	struct tx_undo_buffer *buffer; /* large snapshots buffer, if any */
+	uint64_t buffer_off;
+	size_t buffer_capacity;
+	size_t buffer_used; /* bytes of entries of the current generation */
 };
 
 #define RANGE_FLAGS_MIN_BIT 48
@@ -92,13 +117,79 @@ struct tx_undo_runtime {
 
 #define RANGE_FLAG_NO_FLUSH (0x1ULL << RANGE_FLAGS_MIN_BIT)
 
+/* range of an object allocated in the transaction, it's never merged */
+#define RANGE_FLAG_OBJECT (0x2ULL << RANGE_FLAGS_MIN_BIT)
+
+/* max number of ranges flushed at once during commit */
+#define TX_FLUSH_BATCH_SIZE 64
+
+/* the redo log alone decides whether the transaction has been committed */
+#define TX_REDO_LOG_STANDALONE (1ULL << 0)
+
+/* minimal capacity of the redo log buffers */
+#define TX_REDO_LOG_MIN_SIZE 4096
+
+/* number of slots in the publication list of word transactions */
+#define TX_PUBLISH_SLOTS 64
+
+/* size of a slot, keeps the slots in separate cache lines */
+#define TX_PUBLISH_SLOT_SIZE 64
+
+/* number of checks of a posted transaction between yields of the CPU */
+#define TX_PUBLISH_SPINS 128
+
+enum tx_publish_state {
+	TX_PUBLISH_FREE,
+	TX_PUBLISH_CLAIMED,
+	TX_PUBLISH_POSTED,
+	TX_PUBLISH_DONE,
+};
+
+/* number of recent transactions from which the undo buffers are sized */
+#define TX_UNDO_HISTORY_LEN 8
+
+/* minimal and maximal capacity of the large snapshots buffer */
+#define TX_UNDO_BUFFER_MIN_SIZE 4096
+#define TX_UNDO_BUFFER_MAX_SIZE (1ULL << 20)
+
+/* the buffer shrinks once the demand is this many times below its capacity */
+#define TX_UNDO_BUFFER_SHRINK 4
+
+#define TX_UNDO_ENTRY_SIZE(_size)\
+	(sizeof(struct tx_undo_buffer_entry) + (((_size) + 7) & ~7ULL))
+
+/*
+ * tx_redo_buffer -- volatile buffer of redo log entries, written to the
+ * persistent redo log on commit
+ */
+struct tx_redo_buffer {
+	char *data;
+	size_t size;
+	size_t capacity;
+};
+
+/*
+ * tx_undo_history -- demand of the recent transactions on an undo buffer
+ */
+struct tx_undo_history {
+	uint64_t samples[TX_UNDO_HISTORY_LEN];
+	unsigned next;
+};
+
 struct lane_tx_runtime {
 	PMEMobjpool *pop;
 	struct ctree *ranges;
+	struct tx_range_cache *cache; /* range cache currently filled */
 	unsigned cache_slot;
+	unsigned ncaches; /* number of range caches used by the transaction */
+	uint64_t buffer_demand; /* large snapshots bytes of the transaction */
+	struct tx_undo_history caches_hist;
+	struct tx_undo_history buffer_hist;
+	struct tx_undo_stats stats;
 	struct tx_undo_runtime undo;
+	struct tx_redo_buffer redo;
 	SLIST_HEAD(txd, tx_data) tx_entries;
-	SLIST_HEAD(txl, tx_lock_data) tx_locks;
+	struct tx_lock_set locks;
 };
 
 struct tx_alloc_args {
@@ -122,6 +213,13 @@ struct tx_add_range_args {
 	uint64_t flags;
 };
 
+struct tx_write_args {
+	PMEMobjpool *pop;
+	uint64_t offset;
+	uint64_t size;
+	const void *src;
+};
+
 /*
  * tx_clr_flag -- flags for clearing undo log list
  */
@@ -485,11 +583,9 @@ tx_restore_range(PMEMobjpool *pop, struct tx_range *range)
 	txr->end = (char *)txr->begin + range->size;
 	SLIST_INSERT_HEAD(&tx_ranges, txr, tx_range);
 
-	struct tx_lock_data *txl;
-
 	/* check if there are any locks within given memory range */
-	SLIST_FOREACH(txl, &(runtime->tx_locks), tx_lock) {
-		void *lock_begin = txl->lock.mutex;
+	for (size_t i = 0; i < runtime->locks.nlocks; ++i) {
+		void *lock_begin = runtime->locks.locks[i].lock.mutex;
 		/* all PMEM locks have the same size */
 		void *lock_end = (char *)lock_begin + _POBJ_CL_SIZE;
 
@@ -544,6 +640,127 @@ tx_foreach_set(PMEMobjpool *pop, struct tx_undo_runtime *tx_rt,
 			cb(pop, range);
 		}
 	}
+
+	struct tx_undo_buffer *buffer = tx_rt->buffer;
+	if (buffer == NULL)
+		return;
+
+	struct tx_undo_buffer_entry *entry;
+	for (size_t pos = 0; pos + sizeof(*entry) <= tx_rt->buffer_capacity;
+			pos += TX_UNDO_ENTRY_SIZE(entry->size)) {
+		entry = (struct tx_undo_buffer_entry *)&buffer->data[pos];
+		if (entry->generation != buffer->generation)
+			break;
+
+		/* those structures are binary compatible */
+		cb(pop, (struct tx_range *)&entry->offset);
+	}
+}
+
+/*
+ * tx_undo_buffer_reset -- (internal) invalidates all entries of the large
+ *	snapshots buffer
+ */
+static void
+tx_undo_buffer_reset(PMEMobjpool *pop, struct tx_undo_runtime *tx_rt,
+	int recovery)
+{
+	struct tx_undo_buffer *buffer = tx_rt->buffer;
+
+	/* in recovery the number of valid entries is unknown */
+	if (buffer == NULL || (tx_rt->buffer_used == 0 && !recovery))
+		return;
+
+	VALGRIND_ADD_TO_TX(&buffer->generation, sizeof(buffer->generation));
+	buffer->generation++;
+	pmemops_persist(&pop->p_ops, &buffer->generation,
+		sizeof(buffer->generation));
+	VALGRIND_REMOVE_FROM_TX(&buffer->generation,
+		sizeof(buffer->generation));
+
+	tx_rt->buffer_used = 0;
+}
+
+/*
+ * tx_undo_history_add -- (internal) records the demand of a transaction and
+ *	returns the highest demand among the recent transactions
+ */
+static uint64_t
+tx_undo_history_add(struct tx_undo_history *hist, uint64_t demand)
+{
+	hist->samples[hist->next] = demand;
+	hist->next = (hist->next + 1) % TX_UNDO_HISTORY_LEN;
+
+	uint64_t max = 0;
+	for (int i = 0; i < TX_UNDO_HISTORY_LEN; ++i) {
+		if (hist->samples[i] > max)
+			max = hist->samples[i];
+	}
+
+	return max;
+}
+
+/*
+ * tx_reset_caches -- (internal) clears the range caches and keeps them for the
+ *	next transactions
+ */
+static void
+tx_reset_caches(PMEMobjpool *pop, struct tx_undo_runtime *tx_rt, int recovery)
+{
+	LOG(3, NULL);
+
+	struct pvector_context *cache_undo = tx_rt->ctx[UNDO_SET_CACHE];
+	struct tx_range_cache *cache;
+	uint64_t off;
+
+	if (recovery) {
+		/* the used part of the caches is unknown, keep only one */
+		uint64_t first_cache = pvector_first(cache_undo);
+		while ((off = pvector_last(cache_undo)) != first_cache)
+			pvector_pop_back(cache_undo, tx_free_vec_entry);
+
+		if (first_cache != 0) {
+			cache = OBJ_OFF_TO_PTR(pop, first_cache);
+
+			VALGRIND_ADD_TO_TX(cache, sizeof(*cache));
+			pmemops_memset_persist(&pop->p_ops, cache, 0,
+				sizeof(*cache));
+			VALGRIND_REMOVE_FROM_TX(cache, sizeof(*cache));
+		}
+	} else {
+		/*
+		 * The caches are kept for the next transactions, as many as
+		 * the recent transactions needed.
+		 */
+		struct lane_tx_runtime *r = tx.section->runtime;
+		uint64_t keep = tx_undo_history_add(&r->caches_hist,
+			r->ncaches);
+		if (keep == 0)
+			keep = 1;
+
+		while (pvector_nvalues(cache_undo) > keep)
+			pvector_pop_back(cache_undo, tx_free_vec_entry);
+
+		unsigned i = 0;
+		for (off = pvector_first(cache_undo);
+				off != 0 && i < r->ncaches;
+				off = pvector_next(cache_undo)) {
+			cache = OBJ_OFF_TO_PTR(pop, off);
+
+			/* only the last used cache can be partially filled */
+			size_t sz = ++i == r->ncaches ?
+				sizeof(cache->range[0]) * r->cache_slot :
+				sizeof(*cache);
+
+			VALGRIND_ADD_TO_TX(cache, sz);
+			pmemops_memset_persist(&pop->p_ops, cache, 0, sz);
+			VALGRIND_REMOVE_FROM_TX(cache, sz);
+
+#ifdef DEBUG
+			ASSERTeq(util_is_zeroed(cache, sizeof(*cache)), 1);
+#endif
+		}
+	}
 }
 
 /*
@@ -580,10 +797,10 @@ tx_abort_set(PMEMobjpool *pop, struct tx_undo_runtime *tx_rt, int recovery)
 	else
 		tx_foreach_set(pop, tx_rt, tx_abort_restore_range);
 
-	tx_clear_undo_log(pop, tx_rt->ctx[UNDO_SET_CACHE],
-		TX_CLR_FLAG_FREE | TX_CLR_FLAG_VG_CLEAN);
+	tx_reset_caches(pop, tx_rt, recovery);
 	tx_clear_undo_log(pop, tx_rt->ctx[UNDO_SET],
 		TX_CLR_FLAG_FREE | TX_CLR_FLAG_VG_CLEAN);
+	tx_undo_buffer_reset(pop, tx_rt, recovery);
 }
 
 /*
@@ -666,52 +883,134 @@ tx_post_commit_set(PMEMobjpool *pop, struct tx_undo_runtime *tx_rt,
 		tx_foreach_set(pop, tx_rt, tx_post_commit_range_vg_tx_remove);
 #endif
 
-	struct pvector_context *cache_undo = tx_rt->ctx[UNDO_SET_CACHE];
-	uint64_t first_cache = pvector_first(cache_undo);
-	uint64_t off;
+	tx_reset_caches(pop, tx_rt, recovery);
+	tx_clear_undo_log(pop, tx_rt->ctx[UNDO_SET], TX_CLR_FLAG_FREE);
+	tx_undo_buffer_reset(pop, tx_rt, recovery);
+}
 
-	int zero_all = recovery;
+/*
+ * tx_flush_batch -- ranges collected at commit, flushed with a single
+ * pmemops_flushv() call per batch
+ */
+struct tx_flush_batch {
+	PMEMobjpool *pop;
+	int nranges;
+	struct iovec iov[TX_FLUSH_BATCH_SIZE];
+};
 
-	while ((off = pvector_last(cache_undo)) != first_cache) {
-		pvector_pop_back(cache_undo, tx_free_vec_entry);
-		zero_all = 1;
-	}
+/*
+ * tx_flush_batch_flush -- (internal) flush all ranges collected in batch
+ */
+static void
+tx_flush_batch_flush(struct tx_flush_batch *batch)
+{
+	if (batch->nranges == 0)
+		return;
 
-	if (first_cache != 0) {
-		struct tx_range_cache *cache = OBJ_OFF_TO_PTR(pop, first_cache);
+	pmemops_flushv(&batch->pop->p_ops, batch->iov, batch->nranges);
+	batch->nranges = 0;
+}
 
-		size_t sz;
-		if (zero_all) {
-			sz = sizeof(*cache);
-		} else {
-			struct lane_tx_runtime *r = tx.section->runtime;
-			sz = sizeof(cache->range[0]) * r->cache_slot;
-		}
+/*
+ * tx_flush_range -- (internal) add one range to the flush batch
+ */
+static void
+tx_flush_range(uint64_t offset, uint64_t size_flags, void *ctx)
+{
+	if (size_flags & RANGE_FLAG_NO_FLUSH)
+		return;
+	struct tx_flush_batch *batch = ctx;
+	PMEMobjpool *pop = batch->pop;
 
-		VALGRIND_ADD_TO_TX(cache, sz);
-		pmemops_memset_persist(&pop->p_ops, cache, 0, sz);
-		VALGRIND_REMOVE_FROM_TX(cache, sz);
+	struct iovec *iov = &batch->iov[batch->nranges++];
+	iov->iov_base = OBJ_OFF_TO_PTR(pop, offset);
+	iov->iov_len = RANGE_GET_SIZE(size_flags);
 
-#ifdef DEBUG
-		if (!zero_all) /* for recovery we know we zeroed everything */
-			ASSERTeq(util_is_zeroed(cache, sizeof(*cache)), 1);
-#endif
-	}
+	if (batch->nranges == TX_FLUSH_BATCH_SIZE)
+		tx_flush_batch_flush(batch);
+}
 
-	tx_clear_undo_log(pop, tx_rt->ctx[UNDO_SET], TX_CLR_FLAG_FREE);
+/*
+ * tx_redo_log_capacity -- (internal) returns the number of bytes of entries
+ *	that fit in the persistent redo log
+ */
+static size_t
+tx_redo_log_capacity(PMEMobjpool *pop, uint64_t off)
+{
+	if (off == 0)
+		return 0;
+
+	return palloc_usable_size(&pop->heap, off) - OBJ_OOB_SIZE -
+		sizeof(struct redo_range_log);
+}
+
+/*
+ * tx_redo_log_get -- (internal) returns the persistent redo log of the lane
+ *	if it contains a completely stored log, NULL otherwise
+ */
+static struct redo_range_log *
+tx_redo_log_get(PMEMobjpool *pop, struct lane_tx_layout *layout)
+{
+	if (layout->redo_log == 0)
+		return NULL;
+
+	struct redo_range_log *log = OBJ_OFF_TO_PTR(pop, layout->redo_log);
+	if (!redo_range_log_is_valid(pop->redo, log,
+			tx_redo_log_capacity(pop, layout->redo_log)))
+		return NULL;
+
+	return log;
+}
+
+/*
+ * tx_pre_commit_redo -- (internal) stores the redo log buffered during the
+ *	transaction, the log is valid once the flushes are drained
+ */
+static struct redo_range_log *
+tx_pre_commit_redo(PMEMobjpool *pop, struct lane_tx_runtime *lane,
+	struct lane_tx_layout *layout)
+{
+	LOG(3, NULL);
+
+	if (lane->redo.size == 0)
+		return NULL;
+
+	ASSERT(lane->redo.size <=
+		tx_redo_log_capacity(pop, layout->redo_log));
+
+	/*
+	 * Without any undo log entries the stored redo log is the only
+	 * thing that has to be committed and the transaction state can be
+	 * left alone.
+	 */
+	uint64_t flags = 0;
+	if (ctree_is_empty_unlocked(lane->ranges) &&
+		pvector_nvalues(lane->undo.ctx[UNDO_ALLOC]) == 0 &&
+		pvector_nvalues(lane->undo.ctx[UNDO_FREE]) == 0)
+		flags |= TX_REDO_LOG_STANDALONE;
+
+	struct redo_range_log *log = OBJ_OFF_TO_PTR(pop, layout->redo_log);
+	redo_range_log_store(pop->redo, log, lane->redo.data,
+		lane->redo.size, flags);
+
+	lane->redo.size = 0;
+
+	return log;
 }
 
 /*
- * tx_flush_range -- (internal) flush one range
+ * tx_post_commit_redo -- (internal) applies the committed redo log and
+ *	clears it
  */
 static void
-tx_flush_range(uint64_t offset, uint64_t size_flags, void *ctx)
+tx_post_commit_redo(PMEMobjpool *pop, struct redo_range_log *log)
 {
-	if (size_flags & RANGE_FLAG_NO_FLUSH)
-		return;
-	PMEMobjpool *pop = ctx;
-	pmemops_flush(&pop->p_ops, OBJ_OFF_TO_PTR(pop, offset),
-			RANGE_GET_SIZE(size_flags));
+	LOG(3, NULL);
+
+	redo_range_log_apply(pop->redo, log);
+	pmemops_drain(&pop->p_ops);
+
+	redo_range_log_clear(pop->redo, log);
 }
 
 /*
@@ -727,7 +1026,12 @@ tx_pre_commit(PMEMobjpool *pop, struct lane_tx_runtime *lane)
 	tx_pre_commit_alloc(pop, &lane->undo);
 
 	/* Flush all regions and destroy the whole tree. */
-	ctree_delete_cb(lane->ranges, tx_flush_range, pop);
+	struct tx_flush_batch batch;
+	batch.pop = pop;
+	batch.nranges = 0;
+
+	ctree_delete_cb(lane->ranges, tx_flush_range, &batch);
+	tx_flush_batch_flush(&batch);
 	lane->ranges = NULL;
 }
 
@@ -740,6 +1044,20 @@ tx_rebuild_undo_runtime(PMEMobjpool *pop, struct lane_tx_layout *layout,
 {
 	LOG(3, NULL);
 
+	if (tx_rt->buffer_off != layout->undo_buffer) {
+		tx_rt->buffer_off = layout->undo_buffer;
+		if (layout->undo_buffer != 0) {
+			tx_rt->buffer = OBJ_OFF_TO_PTR(pop,
+				layout->undo_buffer);
+			tx_rt->buffer_capacity = palloc_usable_size(&pop->heap,
+				layout->undo_buffer) - OBJ_OOB_SIZE -
+				sizeof(struct tx_undo_buffer);
+		} else {
+			tx_rt->buffer = NULL;
+			tx_rt->buffer_capacity = 0;
+		}
+	}
+
 	int i;
 	for (i = UNDO_ALLOC; i < MAX_UNDO_TYPES; ++i) {
 		if (tx_rt->ctx[i] == NULL)
@@ -798,6 +1116,98 @@ tx_post_commit(PMEMobjpool *pop, struct lane_tx_layout *layout, int recovery)
 		tx_destroy_undo_runtime(tx_rt);
 }
 
+/*
+ * constructor_tx_undo_buffer -- (internal) large snapshots buffer constructor
+ */
+static int
+constructor_tx_undo_buffer(void *ctx, void *ptr, size_t usable_size,
+	void *arg)
+{
+	LOG(3, NULL);
+	PMEMobjpool *pop = ctx;
+	const struct pmem_ops *p_ops = &pop->p_ops;
+
+	ASSERTne(ptr, NULL);
+
+	struct oob_header *oobh = OOB_HEADER_FROM_PTR(ptr);
+	size_t size = OBJ_OOB_SIZE + sizeof(struct tx_undo_buffer) +
+		sizeof(struct tx_undo_buffer_entry);
+	VALGRIND_ADD_TO_TX(oobh, size);
+
+	oobh->size = OBJ_INTERNAL_OBJECT_MASK;
+	pmemops_flush(p_ops, &oobh->size, sizeof(oobh->size));
+
+	/* the first generation starts with no valid entries */
+	struct tx_undo_buffer *buffer = ptr;
+	struct tx_undo_buffer_entry *entry =
+		(struct tx_undo_buffer_entry *)buffer->data;
+	buffer->generation = 1;
+	buffer->unused = 0;
+	entry->generation = 0;
+	pmemops_persist(p_ops, buffer, sizeof(*buffer) + sizeof(*entry));
+
+	VALGRIND_REMOVE_FROM_TX(oobh, size);
+
+	return 0;
+}
+
+/*
+ * tx_undo_buffer_adapt -- (internal) resizes the large snapshots buffer to
+ *	the demand of the recent transactions
+ *
+ * The buffer grows at once, but shrinks only when the recent transactions
+ * used less than 1/TX_UNDO_BUFFER_SHRINK of it, so that the demand on the
+ * edge of the capacity doesn't reallocate it all the time. The buffer is
+ * freed when none of them used it.
+ *
+ * Must be called outside of the transaction, when the buffer holds no valid
+ * entries.
+ */
+static void
+tx_undo_buffer_adapt(PMEMobjpool *pop, struct lane_tx_runtime *lane,
+	struct lane_tx_layout *layout)
+{
+	struct tx_undo_runtime *tx_rt = &lane->undo;
+
+	ASSERTeq(tx_rt->buffer_used, 0);
+
+	uint64_t demand = tx_undo_history_add(&lane->buffer_hist,
+		lane->buffer_demand);
+	lane->buffer_demand = 0;
+
+	size_t capacity = 0;
+	if (demand != 0) {
+		capacity = TX_UNDO_BUFFER_MIN_SIZE;
+		while (capacity < demand && capacity < TX_UNDO_BUFFER_MAX_SIZE)
+			capacity <<= 1;
+	}
+
+	int grow = capacity > tx_rt->buffer_capacity;
+	if (!grow && (tx_rt->buffer_capacity == 0 ||
+		capacity * TX_UNDO_BUFFER_SHRINK > tx_rt->buffer_capacity))
+		return;
+
+	if (layout->undo_buffer != 0) {
+		pfree(pop, &layout->undo_buffer);
+	} else if (obj_incompat_enable(pop, OBJ_INCOMPAT_TX_UNDO_BUFFER)) {
+		/* older versions wouldn't know about the buffer */
+		LOG(2, "unable to enable the undo buffer");
+		return;
+	}
+
+	if (capacity != 0 && pmalloc_construct(pop, &layout->undo_buffer,
+		capacity + sizeof(struct tx_undo_buffer) + OBJ_OOB_SIZE,
+		constructor_tx_undo_buffer, NULL, 0) != 0)
+		LOG(2, "unable to allocate the undo buffer");
+	else if (grow)
+		lane->stats.grows++;
+	else
+		lane->stats.shrinks++;
+
+	if (tx_rebuild_undo_runtime(pop, layout, tx_rt) != 0)
+		FATAL("!Cannot rebuild runtime undo log state");
+}
+
 #ifdef USE_VG_MEMCHECK
 /*
  * tx_abort_register_valgrind -- tells Valgrind about objects from specified
@@ -863,6 +1273,9 @@ tx_abort(PMEMobjpool *pop, struct lane_tx_runtime *lane,
 		ASSERTne(lane, NULL);
 		ctree_delete(lane->ranges);
 		lane->ranges = NULL;
+
+		/* the buffered writes never reached the persistent log */
+		lane->redo.size = 0;
 	}
 }
 
@@ -883,106 +1296,297 @@ tx_get_pop(void)
 }
 
 /*
- * add_to_tx_and_lock -- (internal) add lock to the transaction and acquire it
+ * tx_lock_set_init -- (internal) prepares an empty set of locks
  */
-static int
-add_to_tx_and_lock(struct lane_tx_runtime *lane, enum pobj_tx_param type,
-	void *lock)
+static void
+tx_lock_set_init(struct tx_lock_set *set)
 {
-	LOG(15, NULL);
-	int retval = 0;
-	struct tx_lock_data *txl;
-	/* check if the lock is already on the list */
-	SLIST_FOREACH(txl, &(lane->tx_locks), tx_lock) {
-		if (memcmp(&txl->lock, &lock, sizeof(lock)) == 0)
-			return 0;
-	}
-
-	txl = Malloc(sizeof(*txl));
-	if (txl == NULL)
-		return ENOMEM;
+	set->locks = set->inline_locks;
+	set->hash = set->inline_hash;
+	set->nlocks = 0;
+	set->capacity = TX_LOCKS_INLINE;
+}
 
-	txl->lock_type = type;
-	switch (txl->lock_type) {
-		case TX_PARAM_MUTEX:
-			txl->lock.mutex = lock;
-			retval = pmemobj_mutex_lock(lane->pop,
-				txl->lock.mutex);
-			if (retval) {
-				errno = retval;
-				ERR("!pmemobj_mutex_lock");
-			}
-			break;
-		case TX_PARAM_RWLOCK:
-			txl->lock.rwlock = lock;
-			retval = pmemobj_rwlock_wrlock(lane->pop,
-				txl->lock.rwlock);
-			if (retval) {
-				errno = retval;
-				ERR("!pmemobj_rwlock_wrlock");
-			}
-			break;
-		default:
-			ERR("Unrecognized lock type");
-			ASSERT(0);
-			break;
-	}
+/*
+ * tx_lock_set_slot -- (internal) returns the hash slot holding the lock or
+ *	the empty slot in which it would be inserted
+ */
+static void **
+tx_lock_set_slot(void **hash, size_t nslots, void *lock)
+{
+	/* the locks are cache line aligned */
+	uint64_t h = ((uint64_t)(uintptr_t)lock >> 6) * 0x9E3779B97F4A7C15ULL;
+	size_t i = (size_t)(h >> 32) & (nslots - 1);
 
-	SLIST_INSERT_HEAD(&lane->tx_locks, txl, tx_lock);
+	while (hash[i] != NULL && hash[i] != lock)
+		i = (i + 1) & (nslots - 1);
 
-	return retval;
+	return &hash[i];
 }
 
 /*
- * release_and_free_tx_locks -- (internal) release and remove all locks from the
- *				transaction
+ * tx_lock_set_rehash -- (internal) inserts all the locks to the empty hash
  */
 static void
-release_and_free_tx_locks(struct lane_tx_runtime *lane)
+tx_lock_set_rehash(struct tx_lock_set *set)
 {
-	LOG(15, NULL);
-
-	while (!SLIST_EMPTY(&lane->tx_locks)) {
-		struct tx_lock_data *tx_lock = SLIST_FIRST(&lane->tx_locks);
-		SLIST_REMOVE_HEAD(&lane->tx_locks, tx_lock);
-		switch (tx_lock->lock_type) {
-			case TX_PARAM_MUTEX:
-				pmemobj_mutex_unlock(lane->pop,
-					tx_lock->lock.mutex);
-				break;
-			case TX_PARAM_RWLOCK:
-				pmemobj_rwlock_unlock(lane->pop,
-					tx_lock->lock.rwlock);
-				break;
-			default:
-				ERR("Unrecognized lock type");
-				ASSERT(0);
-				break;
-		}
-		Free(tx_lock);
-	}
+	for (size_t i = 0; i < set->nlocks; ++i)
+		*tx_lock_set_slot(set->hash, 2 * set->capacity,
+			set->locks[i].lock.mutex) = set->locks[i].lock.mutex;
 }
 
 /*
- * tx_alloc_common -- (internal) common function for alloc and zalloc
+ * tx_lock_set_grow -- (internal) moves the locks to the heap, doubling the
+ *	capacity of the set
  */
-static PMEMoid
-tx_alloc_common(size_t size, type_num_t type_num, palloc_constr constructor,
-		uint64_t flags)
+static int
+tx_lock_set_grow(struct tx_lock_set *set)
 {
-	LOG(3, NULL);
+	size_t capacity = 2 * set->capacity;
 
-	if (size > PMEMOBJ_MAX_ALLOC_SIZE) {
-		ERR("requested size too large");
-		return obj_tx_abort_null(ENOMEM);
+	struct tx_lock_data *locks = Malloc(sizeof(*locks) * capacity);
+	if (locks == NULL)
+		return ENOMEM;
+
+	void **hash = Zalloc(sizeof(*hash) * 2 * capacity);
+	if (hash == NULL) {
+		Free(locks);
+		return ENOMEM;
 	}
 
-	struct lane_tx_runtime *lane =
-		(struct lane_tx_runtime *)tx.section->runtime;
+	memcpy(locks, set->locks, sizeof(*locks) * set->nlocks);
 
-	uint64_t *entry_offset = pvector_push_back(lane->undo.ctx[UNDO_ALLOC]);
-	if (entry_offset == NULL) {
-		ERR("allocation undo log too large");
+	if (set->locks != set->inline_locks) {
+		Free(set->locks);
+		Free(set->hash);
+	}
+
+	set->locks = locks;
+	set->hash = hash;
+	set->capacity = capacity;
+
+	tx_lock_set_rehash(set);
+
+	return 0;
+}
+
+/*
+ * tx_lock_set_add -- (internal) adds the lock to the set unless it's already
+ *	there, sets added to 1 if it has been added
+ */
+static int
+tx_lock_set_add(struct tx_lock_set *set, enum pobj_tx_param type, void *lock,
+	int *added)
+{
+	void **slot = tx_lock_set_slot(set->hash, 2 * set->capacity, lock);
+	if (*slot != NULL) {
+		*added = 0;
+		return 0;
+	}
+
+	if (set->nlocks == set->capacity) {
+		if (tx_lock_set_grow(set) != 0)
+			return ENOMEM;
+
+		slot = tx_lock_set_slot(set->hash, 2 * set->capacity, lock);
+	}
+
+	*slot = lock;
+
+	struct tx_lock_data *txl = &set->locks[set->nlocks++];
+	txl->lock.mutex = lock;
+	txl->lock_type = type;
+
+	*added = 1;
+	return 0;
+}
+
+/*
+ * tx_lock_set_truncate -- (internal) removes the locks from the given index
+ *	to the end of the set
+ */
+static void
+tx_lock_set_truncate(struct tx_lock_set *set, size_t nlocks)
+{
+	set->nlocks = nlocks;
+
+	memset(set->hash, 0, sizeof(*set->hash) * 2 * set->capacity);
+	tx_lock_set_rehash(set);
+}
+
+/*
+ * tx_lock_set_clear -- (internal) empties the set, releasing the memory
+ *	allocated for large sets
+ */
+static void
+tx_lock_set_clear(struct tx_lock_set *set)
+{
+	if (set->locks != set->inline_locks) {
+		Free(set->locks);
+		Free(set->hash);
+	}
+
+	memset(set->inline_hash, 0, sizeof(set->inline_hash));
+	tx_lock_set_init(set);
+}
+
+/*
+ * tx_lock_acquire -- (internal) acquires the lock in the mode expected by the
+ *	transaction
+ */
+static int
+tx_lock_acquire(PMEMobjpool *pop, struct tx_lock_data *txl)
+{
+	int retval = 0;
+
+	switch (txl->lock_type) {
+		case TX_PARAM_MUTEX:
+			retval = pmemobj_mutex_lock(pop, txl->lock.mutex);
+			if (retval) {
+				errno = retval;
+				ERR("!pmemobj_mutex_lock");
+			}
+			break;
+		case TX_PARAM_RWLOCK:
+			retval = pmemobj_rwlock_wrlock(pop, txl->lock.rwlock);
+			if (retval) {
+				errno = retval;
+				ERR("!pmemobj_rwlock_wrlock");
+			}
+			break;
+		default:
+			ERR("Unrecognized lock type");
+			ASSERT(0);
+			break;
+	}
+
+	return retval;
+}
+
+/*
+ * tx_lock_release -- (internal) releases the lock held by the transaction
+ */
+static void
+tx_lock_release(PMEMobjpool *pop, struct tx_lock_data *txl)
+{
+	switch (txl->lock_type) {
+		case TX_PARAM_MUTEX:
+			pmemobj_mutex_unlock(pop, txl->lock.mutex);
+			break;
+		case TX_PARAM_RWLOCK:
+			pmemobj_rwlock_unlock(pop, txl->lock.rwlock);
+			break;
+		default:
+			ERR("Unrecognized lock type");
+			ASSERT(0);
+			break;
+	}
+}
+
+/*
+ * add_to_tx_and_lock -- (internal) add lock to the transaction and acquire it
+ */
+static int
+add_to_tx_and_lock(struct lane_tx_runtime *lane, enum pobj_tx_param type,
+	void *lock)
+{
+	LOG(15, NULL);
+
+	struct tx_lock_set *set = &lane->locks;
+	int added;
+
+	int retval = tx_lock_set_add(set, type, lock, &added);
+	if (retval != 0 || !added)
+		return retval;
+
+	retval = tx_lock_acquire(lane->pop, &set->locks[set->nlocks - 1]);
+	if (retval != 0)
+		tx_lock_set_truncate(set, set->nlocks - 1);
+
+	return retval;
+}
+
+/*
+ * acquire_tx_locks_ordered -- (internal) acquires the locks added to the set
+ *	from the given index on, in the order of their addresses
+ *
+ * Transactions which declare all of their locks up front can't deadlock on
+ * them regardless of the order in which the locks were passed.
+ */
+static int
+acquire_tx_locks_ordered(struct lane_tx_runtime *lane, size_t first)
+{
+	LOG(15, NULL);
+
+	struct tx_lock_data *locks = lane->locks.locks;
+	size_t nlocks = lane->locks.nlocks;
+
+	/* the sets are small, insertion sort is good enough */
+	for (size_t i = first + 1; i < nlocks; ++i) {
+		struct tx_lock_data txl = locks[i];
+		size_t j = i;
+		for (; j > first && (uintptr_t)locks[j - 1].lock.mutex >
+				(uintptr_t)txl.lock.mutex; --j)
+			locks[j] = locks[j - 1];
+
+		locks[j] = txl;
+	}
+
+	for (size_t i = first; i < nlocks; ++i) {
+		int retval = tx_lock_acquire(lane->pop, &locks[i]);
+		if (retval != 0) {
+			tx_lock_set_truncate(&lane->locks, i);
+			return retval;
+		}
+	}
+
+	return 0;
+}
+
+/*
+ * release_and_free_tx_locks -- (internal) release and remove all locks from the
+ *				transaction
+ */
+static void
+release_and_free_tx_locks(struct lane_tx_runtime *lane)
+{
+	LOG(15, NULL);
+
+	struct tx_lock_set *set = &lane->locks;
+
+	/* in the reverse order of acquisition */
+	for (size_t i = set->nlocks; i > 0; --i)
+		tx_lock_release(lane->pop, &set->locks[i - 1]);
+
+	tx_lock_set_clear(set);
+}
+
+/*
+ * tx_alloc_common -- (internal) common function for alloc and zalloc
+ */
+static PMEMoid
+tx_alloc_common(size_t size, type_num_t type_num, palloc_constr constructor,
+		uint64_t flags)
+{
+	LOG(3, NULL);
+
+	if (size > PMEMOBJ_MAX_ALLOC_SIZE) {
+		ERR("requested size too large");
+		return obj_tx_abort_null(ENOMEM);
+	}
+
+	struct lane_tx_runtime *lane =
+		(struct lane_tx_runtime *)tx.section->runtime;
+
+	if (palloc_class_is_headerless(&lane->pop->heap,
+			CLASS_ID_FROM_FLAG(flags), NULL)) {
+		ERR("header-less objects cannot be allocated transactionally");
+		return obj_tx_abort_null(EINVAL);
+	}
+
+	uint64_t *entry_offset = pvector_push_back(lane->undo.ctx[UNDO_ALLOC]);
+	if (entry_offset == NULL) {
+		ERR("allocation undo log too large");
 		return obj_tx_abort_null(ENOMEM);
 	}
 
@@ -996,8 +1600,13 @@ tx_alloc_common(size_t size, type_num_t type_num, palloc_constr constructor,
 	PMEMoid retoid = OID_NULL;
 	PMEMobjpool *pop = lane->pop;
 
-	pmalloc_construct(pop, entry_offset, size + OBJ_OOB_SIZE, constructor,
-			&args);
+	if (pmalloc_construct(pop, entry_offset, size + OBJ_OOB_SIZE,
+			constructor, &args, CLASS_ID_FROM_FLAG(flags)) != 0 &&
+			errno == EINVAL) {
+		pvector_pop_back(lane->undo.ctx[UNDO_ALLOC], NULL);
+		ERR("invalid allocation class");
+		return obj_tx_abort_null(EINVAL);
+	}
 
 	retoid.off = *entry_offset;
 	retoid.pool_uuid_lo = pop->uuid_lo;
@@ -1005,8 +1614,9 @@ tx_alloc_common(size_t size, type_num_t type_num, palloc_constr constructor,
 	if (OBJ_OID_IS_NULL(retoid))
 		goto err_oom;
 
-	uint64_t range_flags = (flags & POBJ_FLAG_NO_FLUSH) ?
-			RANGE_FLAG_NO_FLUSH : 0;
+	uint64_t range_flags = RANGE_FLAG_OBJECT;
+	if (flags & POBJ_FLAG_NO_FLUSH)
+		range_flags |= RANGE_FLAG_NO_FLUSH;
 	size = palloc_usable_size(&pop->heap, retoid.off) - OBJ_OOB_SIZE;
 	ASSERTeq(size & RANGE_FLAGS_MASK, 0);
 
@@ -1061,7 +1671,7 @@ tx_alloc_copy_common(size_t size, type_num_t type_num, const void *ptr,
 	PMEMoid retoid;
 	PMEMobjpool *pop = lane->pop;
 	int ret = pmalloc_construct(pop, entry_offset, size + OBJ_OOB_SIZE,
-			constructor, &args);
+			constructor, &args, 0);
 
 	retoid.off = *entry_offset;
 	retoid.pool_uuid_lo = pop->uuid_lo;
@@ -1070,7 +1680,8 @@ tx_alloc_copy_common(size_t size, type_num_t type_num, const void *ptr,
 		goto err_oom;
 
 	size = palloc_usable_size(&pop->heap, retoid.off) - OBJ_OOB_SIZE;
-	if (ctree_insert_unlocked(lane->ranges, retoid.off, size) != 0)
+	if (ctree_insert_unlocked(lane->ranges, retoid.off,
+			size | RANGE_FLAG_OBJECT) != 0)
 		goto err_oom;
 
 	return retoid;
@@ -1166,9 +1777,12 @@ pmemobj_tx_begin(PMEMobjpool *pop, jmp_buf env, ...)
 
 		lane = tx.section->runtime;
 		SLIST_INIT(&lane->tx_entries);
-		SLIST_INIT(&lane->tx_locks);
+		tx_lock_set_init(&lane->locks);
 		lane->ranges = ctree_new();
+		lane->cache = NULL;
 		lane->cache_slot = 0;
+		lane->ncaches = 0;
+		lane->buffer_demand = 0;
 
 		struct lane_tx_layout *layout =
 			(struct lane_tx_layout *)tx.section->layout;
@@ -1201,7 +1815,10 @@ pmemobj_tx_begin(PMEMobjpool *pop, jmp_buf env, ...)
 
 	tx.stage = TX_STAGE_WORK;
 
-	/* handle locks */
+	/* handle locks, they are acquired once all are known */
+	size_t first_lock = lane->locks.nlocks;
+	int added;
+
 	va_list argp;
 	va_start(argp, env);
 	enum pobj_tx_param param_type;
@@ -1225,9 +1842,10 @@ pmemobj_tx_begin(PMEMobjpool *pop, jmp_buf env, ...)
 			tx.stage_callback = cb;
 			tx.stage_callback_arg = arg;
 		} else {
-			err = add_to_tx_and_lock(lane, param_type,
-					va_arg(argp, void *));
+			err = tx_lock_set_add(&lane->locks, param_type,
+					va_arg(argp, void *), &added);
 			if (err) {
+				tx_lock_set_truncate(&lane->locks, first_lock);
 				va_end(argp);
 				goto err_abort;
 			}
@@ -1235,6 +1853,10 @@ pmemobj_tx_begin(PMEMobjpool *pop, jmp_buf env, ...)
 	}
 	va_end(argp);
 
+	err = acquire_tx_locks_ordered(lane, first_lock);
+	if (err)
+		goto err_abort;
+
 	ASSERT(err == 0);
 	return 0;
 
@@ -1380,18 +2002,28 @@ pmemobj_tx_commit()
 		PMEMobjpool *pop = lane->pop;
 
 		/* pre-commit phase */
+		struct redo_range_log *redo =
+			tx_pre_commit_redo(pop, lane, layout);
 		tx_pre_commit(pop, lane);
 
 		pmemops_drain(&pop->p_ops);
 
-		/* set transaction state as committed */
-		tx_set_state(pop, layout, TX_STATE_COMMITTED);
+		if (redo != NULL && (redo->flags & TX_REDO_LOG_STANDALONE)) {
+			/* the redo log has been the commit point */
+			tx_post_commit_redo(pop, redo);
+		} else {
+			/* set transaction state as committed */
+			tx_set_state(pop, layout, TX_STATE_COMMITTED);
+
+			if (redo != NULL)
+				tx_post_commit_redo(pop, redo);
 
-		/* post commit phase */
-		tx_post_commit(pop, layout, 0 /* not recovery */);
+			/* post commit phase */
+			tx_post_commit(pop, layout, 0 /* not recovery */);
 
-		/* clear transaction state */
-		tx_set_state(pop, layout, TX_STATE_NONE);
+			/* clear transaction state */
+			tx_set_state(pop, layout, TX_STATE_NONE);
+		}
 	}
 
 	tx.stage = TX_STAGE_ONCOMMIT;
@@ -1435,7 +2067,11 @@ pmemobj_tx_end()
 			(struct lane_tx_layout *)tx.section->layout;
 
 		/* cleanup cache */
+		lane->cache = NULL;
 		lane->cache_slot = 0;
+		lane->ncaches = 0;
+
+		tx_undo_buffer_adapt(lane->pop, lane, layout);
 
 		/* the transaction state and undo log should be clear */
 		ASSERTeq(layout->state, TX_STATE_NONE);
@@ -1505,6 +2141,63 @@ pmemobj_tx_process()
 	}
 }
 
+/*
+ * tx_undo_buffer_push -- (internal) stores the snapshot in the large snapshots
+ *	buffer, if there's enough space left
+ */
+static int
+tx_undo_buffer_push(struct tx_undo_runtime *tx_rt,
+	struct tx_add_range_args *args)
+{
+	struct tx_undo_buffer *buffer = tx_rt->buffer;
+	size_t size = TX_UNDO_ENTRY_SIZE(args->size);
+	if (buffer == NULL ||
+		tx_rt->buffer_used + size > tx_rt->buffer_capacity)
+		return -1;
+
+	const struct pmem_ops *p_ops = &args->pop->p_ops;
+	struct tx_undo_buffer_entry *entry = (struct tx_undo_buffer_entry *)
+		&buffer->data[tx_rt->buffer_used];
+	void *src = OBJ_OFF_TO_PTR(args->pop, args->offset);
+
+	VALGRIND_ADD_TO_TX(entry, size);
+
+	/*
+	 * The entry that follows might be a leftover of an earlier generation
+	 * with a matching generation number in its data, so it's invalidated
+	 * before this entry becomes valid.
+	 */
+	size_t next = tx_rt->buffer_used + size;
+	if (next + sizeof(*entry) <= tx_rt->buffer_capacity) {
+		struct tx_undo_buffer_entry *n =
+			(struct tx_undo_buffer_entry *)&buffer->data[next];
+		VALGRIND_ADD_TO_TX(&n->generation, sizeof(n->generation));
+		n->generation = 0;
+		pmemops_flush(p_ops, &n->generation, sizeof(n->generation));
+		VALGRIND_REMOVE_FROM_TX(&n->generation,
+			sizeof(n->generation));
+	}
+
+	entry->offset = args->offset;
+	entry->size = args->size;
+	pmemops_flush(p_ops, &entry->offset,
+		sizeof(entry->offset) + sizeof(entry->size));
+
+	/* this isn't transactional so we have to keep the order */
+	VALGRIND_ADD_TO_TX(src, args->size);
+
+	pmemops_memcpy_persist(p_ops, entry->data, src, args->size);
+
+	entry->generation = buffer->generation;
+	pmemops_persist(p_ops, &entry->generation, sizeof(entry->generation));
+
+	VALGRIND_REMOVE_FROM_TX(entry, size);
+
+	tx_rt->buffer_used = next;
+
+	return 0;
+}
+
 /*
  * pmemobj_tx_add_large -- (internal) adds large memory range to undo log
  */
@@ -1512,6 +2205,15 @@ static int
 pmemobj_tx_add_large(struct tx_add_range_args *args)
 {
 	struct lane_tx_runtime *runtime = tx.section->runtime;
+
+	runtime->buffer_demand += TX_UNDO_ENTRY_SIZE(args->size);
+	if (tx_undo_buffer_push(&runtime->undo, args) == 0) {
+		runtime->stats.reused++;
+		return 0;
+	}
+
+	runtime->stats.allocated++;
+
 	struct pvector_context *undo = runtime->undo.ctx[UNDO_SET];
 	uint64_t *entry = pvector_push_back(undo);
 	if (entry == NULL) {
@@ -1522,7 +2224,7 @@ pmemobj_tx_add_large(struct tx_add_range_args *args)
 	/* insert snapshot to undo log */
 	int ret = pmalloc_construct(args->pop, entry,
 			args->size + sizeof(struct tx_range) + OBJ_OOB_SIZE,
-			constructor_tx_add_range, args);
+			constructor_tx_add_range, args, 0);
 
 	if (ret != 0) {
 		pvector_pop_back(undo, NULL);
@@ -1565,15 +2267,22 @@ constructor_tx_range_cache(void *ctx, void *ptr, size_t usable_size, void *arg)
 static struct tx_range_cache *
 pmemobj_tx_get_range_cache(PMEMobjpool *pop, struct pvector_context *undo)
 {
-	uint64_t last_cache = pvector_last(undo);
-
-	struct tx_range_cache *cache = NULL;
-	/* get the last element from the caches list */
-	if (last_cache != 0)
-		cache = OBJ_OFF_TO_PTR(pop, last_cache);
+	struct lane_tx_runtime *runtime = tx.section->runtime;
+	struct tx_range_cache *cache = runtime->cache;
 
 	/* verify if the cache exists and has at least one free slot */
-	if (cache == NULL || cache->range[MAX_CACHED_RANGES - 1].offset != 0) {
+	if (cache != NULL && runtime->cache_slot < MAX_CACHED_RANGES)
+		return cache;
+
+	if (runtime->ncaches < pvector_nvalues(undo)) {
+		/* reuse the next cache kept from the previous transactions */
+		uint64_t off = pvector_first(undo);
+		for (unsigned i = 0; i < runtime->ncaches; ++i)
+			off = pvector_next(undo);
+
+		cache = OBJ_OFF_TO_PTR(pop, off);
+		runtime->stats.reused++;
+	} else {
 		/* no existing cache, allocate a new one */
 		uint64_t *entry = pvector_push_back(undo);
 		if (entry == NULL) {
@@ -1582,7 +2291,7 @@ pmemobj_tx_get_range_cache(PMEMobjpool *pop, struct pvector_context *undo)
 		}
 		int err = pmalloc_construct(pop, entry,
 			sizeof(struct tx_range_cache) + OBJ_OOB_SIZE,
-			constructor_tx_range_cache, NULL);
+			constructor_tx_range_cache, NULL, 0);
 
 		if (err != 0) {
 			pvector_pop_back(undo, NULL);
@@ -1590,12 +2299,14 @@ pmemobj_tx_get_range_cache(PMEMobjpool *pop, struct pvector_context *undo)
 		}
 
 		cache = OBJ_OFF_TO_PTR(pop, *entry);
-
-		/* since the cache is new, we start the count from 0 */
-		struct lane_tx_runtime *runtime = tx.section->runtime;
-		runtime->cache_slot = 0;
+		runtime->stats.allocated++;
 	}
 
+	/* since the cache is new, we start the count from 0 */
+	runtime->cache = cache;
+	runtime->cache_slot = 0;
+	runtime->ncaches++;
+
 	return cache;
 }
 
@@ -1611,6 +2322,37 @@ pmemobj_tx_add_small(struct tx_add_range_args *args)
 	struct pvector_context *undo = runtime->undo.ctx[UNDO_SET_CACHE];
 	const struct pmem_ops *p_ops = &pop->p_ops;
 
+	void *src = OBJ_OFF_TO_PTR(pop, args->offset);
+
+	/*
+	 * A range that directly follows the previous snapshot is appended to
+	 * it if it still fits in the slot, the data is persisted before the
+	 * size is extended so the snapshot is valid at any point.
+	 */
+	if (runtime->cache_slot != 0) {
+		struct tx_range *prev = (struct tx_range *)
+			&runtime->cache->range[runtime->cache_slot - 1];
+		if (prev->offset + prev->size == args->offset &&
+			prev->size + args->size <= MAX_CACHED_RANGE_SIZE) {
+			VALGRIND_ADD_TO_TX(prev,
+				sizeof(struct tx_range) +
+				MAX_CACHED_RANGE_SIZE);
+			VALGRIND_ADD_TO_TX(src, args->size);
+
+			pmemops_memcpy_persist(p_ops, prev->data + prev->size,
+				src, args->size);
+			prev->size += args->size;
+			pmemops_persist(p_ops, &prev->size,
+				sizeof(prev->size));
+
+			VALGRIND_REMOVE_FROM_TX(prev,
+				sizeof(struct tx_range) +
+				MAX_CACHED_RANGE_SIZE);
+
+			return 0;
+		}
+	}
+
 	struct tx_range_cache *cache = pmemobj_tx_get_range_cache(pop, undo);
 	if (cache == NULL) {
 		ERR("Failed to create range cache");
@@ -1627,7 +2369,6 @@ pmemobj_tx_add_small(struct tx_add_range_args *args)
 		sizeof(struct tx_range) + MAX_CACHED_RANGE_SIZE);
 
 	/* this isn't transactional so we have to keep the order */
-	void *src = OBJ_OFF_TO_PTR(pop, args->offset);
 	VALGRIND_ADD_TO_TX(src, args->size);
 
 	pmemops_memcpy_persist(p_ops, range->data, src, args->size);
@@ -1644,6 +2385,46 @@ pmemobj_tx_add_small(struct tx_add_range_args *args)
 	return 0;
 }
 
+/*
+ * tx_ranges_insert -- (internal) adds a snapshotted range to the index of the
+ *	transaction
+ *
+ * The range is merged with the directly adjacent ranges of the same kind, so
+ * that a range which is already covered is always found with a single lookup,
+ * no matter in how many pieces it has been added.
+ */
+static int
+tx_ranges_insert(struct ctree *ranges, uint64_t offset, uint64_t size,
+	uint64_t flags)
+{
+	uint64_t end = offset + size;
+
+	uint64_t next = end;
+	uint64_t next_size_flags = ctree_find_le_unlocked(ranges, &next);
+	int merge_next = next == end &&
+		(next_size_flags & RANGE_FLAGS_MASK) == flags;
+	if (merge_next)
+		size += RANGE_GET_SIZE(next_size_flags);
+
+	uint64_t prev = offset - 1;
+	uint64_t prev_size_flags = ctree_find_le_unlocked(ranges, &prev);
+
+	int ret;
+	if (prev_size_flags != 0 &&
+		prev + RANGE_GET_SIZE(prev_size_flags) == offset &&
+		(prev_size_flags & RANGE_FLAGS_MASK) == flags) {
+		size += RANGE_GET_SIZE(prev_size_flags);
+		ret = ctree_update_unlocked(ranges, prev, size | flags);
+	} else {
+		ret = ctree_insert_unlocked(ranges, offset, size | flags);
+	}
+
+	if (ret == 0 && merge_next)
+		ctree_remove_unlocked(ranges, end, 1);
+
+	return ret;
+}
+
 /*
  * pmemobj_tx_add_common -- (internal) common code for adding persistent memory
  *				into the transaction
@@ -1719,8 +2500,8 @@ pmemobj_tx_add_common(struct tx_add_range_args *args)
 		if (ret != 0)
 			break;
 
-		ret = ctree_insert_unlocked(runtime->ranges, nargs.offset,
-				nargs.size | range_flags);
+		ret = tx_ranges_insert(runtime->ranges, nargs.offset,
+				nargs.size, range_flags);
 		if (ret != 0) {
 			if (ret == EEXIST)
 				FATAL("invalid state of ranges tree");
@@ -1884,6 +2665,487 @@ pmemobj_tx_xadd_range(PMEMoid oid, uint64_t hoff, size_t size, uint64_t flags)
 	return 0;
 }
 
+/*
+ * constructor_tx_redo_log -- (internal) persistent redo log constructor
+ */
+static int
+constructor_tx_redo_log(void *ctx, void *ptr, size_t usable_size, void *arg)
+{
+	LOG(3, NULL);
+	PMEMobjpool *pop = ctx;
+	const struct pmem_ops *p_ops = &pop->p_ops;
+
+	ASSERTne(ptr, NULL);
+
+	struct oob_header *oobh = OOB_HEADER_FROM_PTR(ptr);
+	VALGRIND_ADD_TO_TX(oobh, OBJ_OOB_SIZE + sizeof(struct redo_range_log));
+
+	oobh->size = OBJ_INTERNAL_OBJECT_MASK;
+	pmemops_flush(p_ops, &oobh->size, sizeof(oobh->size));
+
+	pmemops_memset_persist(p_ops, ptr, 0, sizeof(struct redo_range_log));
+
+	VALGRIND_REMOVE_FROM_TX(oobh,
+		OBJ_OOB_SIZE + sizeof(struct redo_range_log));
+
+	return 0;
+}
+
+/*
+ * tx_get_undo_stats -- sums up the statistics of the undo buffers of all lanes
+ */
+void
+tx_get_undo_stats(PMEMobjpool *pop, struct tx_undo_stats *stats)
+{
+	memset(stats, 0, sizeof(*stats));
+
+	for (unsigned i = 0; i < pop->nlanes; ++i) {
+		struct lane_tx_runtime *lane = pop->lanes_desc.lane[i]
+			.sections[LANE_SECTION_TRANSACTION].runtime;
+		if (lane == NULL)
+			continue;
+
+		stats->reused += lane->stats.reused;
+		stats->allocated += lane->stats.allocated;
+		stats->grows += lane->stats.grows;
+		stats->shrinks += lane->stats.shrinks;
+	}
+}
+
+/*
+ * tx_redo_reserve -- (internal) makes sure that both the volatile buffer and
+ *	the persistent redo log can hold the given number of bytes of entries
+ */
+static int
+tx_redo_reserve(PMEMobjpool *pop, struct lane_tx_runtime *lane,
+	struct lane_tx_layout *layout, size_t size)
+{
+	struct tx_redo_buffer *buf = &lane->redo;
+	if (size > buf->capacity) {
+		size_t capacity = buf->capacity * 2;
+		if (capacity < size)
+			capacity = size;
+		if (capacity < TX_REDO_LOG_MIN_SIZE)
+			capacity = TX_REDO_LOG_MIN_SIZE;
+
+		char *data = Realloc(buf->data, capacity);
+		if (data == NULL) {
+			ERR("!Realloc");
+			return -1;
+		}
+
+		buf->data = data;
+		buf->capacity = capacity;
+	}
+
+	if (size <= tx_redo_log_capacity(pop, layout->redo_log))
+		return 0;
+
+	/*
+	 * The persistent log holds no valid entries outside of the commit,
+	 * so it can be simply replaced by a larger one.
+	 */
+	if (layout->redo_log != 0)
+		pfree(pop, &layout->redo_log);
+	else if (obj_incompat_enable(pop, OBJ_INCOMPAT_TX_REDO_LOG) != 0)
+		return -1; /* older versions wouldn't recover the log */
+
+	return pmalloc_construct(pop, &layout->redo_log,
+		buf->capacity + sizeof(struct redo_range_log) + OBJ_OOB_SIZE,
+		constructor_tx_redo_log, NULL, 0);
+}
+
+/*
+ * pmemobj_tx_write_common -- (internal) common code for buffering writes in
+ *	the redo log
+ */
+static int
+pmemobj_tx_write_common(struct tx_write_args *args)
+{
+	LOG(15, NULL);
+
+	if (args->size > PMEMOBJ_MAX_ALLOC_SIZE) {
+		ERR("write size too large");
+		return obj_tx_abort_err(EINVAL);
+	}
+
+	uint64_t heap_end = args->pop->heap_offset + args->pop->heap_size;
+	if (args->offset < args->pop->heap_offset ||
+		args->offset > heap_end ||
+		args->size > heap_end - args->offset) {
+		ERR("object outside of heap");
+		return obj_tx_abort_err(EINVAL);
+	}
+
+	if (args->size == 0)
+		return 0;
+
+	struct lane_tx_runtime *lane = tx.section->runtime;
+	struct lane_tx_layout *layout =
+		(struct lane_tx_layout *)tx.section->layout;
+	size_t entry_size = REDO_RANGE_SIZE(args->size);
+
+	if (tx_redo_reserve(args->pop, lane, layout,
+			lane->redo.size + entry_size)) {
+		ERR("cannot reserve the redo log");
+		return obj_tx_abort_err(errno);
+	}
+
+	struct redo_range *r =
+		(struct redo_range *)(lane->redo.data + lane->redo.size);
+	r->offset = args->offset;
+	r->size = args->size;
+	memcpy(r->data, args->src, args->size);
+	memset(r->data + args->size, 0,
+		entry_size - sizeof(*r) - args->size);
+
+	lane->redo.size += entry_size;
+
+	return 0;
+}
+
+/*
+ * pmemobj_tx_write -- buffers a write to the object in the redo log
+ */
+int
+pmemobj_tx_write(PMEMoid oid, uint64_t off, const void *src, size_t size)
+{
+	LOG(3, NULL);
+
+	ASSERT_IN_TX();
+	ASSERT_TX_STAGE_WORK();
+
+	struct lane_tx_runtime *lane =
+		(struct lane_tx_runtime *)tx.section->runtime;
+
+	if (oid.pool_uuid_lo != lane->pop->uuid_lo) {
+		ERR("invalid pool uuid");
+		return obj_tx_abort_err(EINVAL);
+	}
+	ASSERT(OBJ_OID_IS_VALID(lane->pop, oid));
+
+	if (off > UINT64_MAX - oid.off) {
+		ERR("offset overflow");
+		return obj_tx_abort_err(EINVAL);
+	}
+
+	struct tx_write_args args = {
+		.pop = lane->pop,
+		.offset = oid.off + off,
+		.size = size,
+		.src = src,
+	};
+
+	return pmemobj_tx_write_common(&args);
+}
+
+/*
+ * pmemobj_tx_write_direct -- buffers a write to the given persistent memory
+ *	range in the redo log
+ */
+int
+pmemobj_tx_write_direct(void *dest, const void *src, size_t size)
+{
+	LOG(3, NULL);
+
+	ASSERT_IN_TX();
+	ASSERT_TX_STAGE_WORK();
+
+	struct lane_tx_runtime *lane =
+		(struct lane_tx_runtime *)tx.section->runtime;
+
+	if (!OBJ_PTR_FROM_POOL(lane->pop, dest)) {
+		ERR("object outside of pool");
+		return obj_tx_abort_err(EINVAL);
+	}
+
+	struct tx_write_args args = {
+		.pop = lane->pop,
+		.offset = (uint64_t)((char *)dest - (char *)lane->pop),
+		.size = size,
+		.src = src,
+	};
+
+	return pmemobj_tx_write_common(&args);
+}
+
+/*
+ * tx_publish_slot -- (internal) slot of the publication list, holds a word
+ *	transaction until one of the publishing threads commits it
+ */
+struct tx_publish_slot {
+	unsigned state; /* enum tx_publish_state */
+	int result;
+	const struct pobj_tx_word *words;
+	size_t nwords;
+
+	/* avoid false sharing between the publishing threads */
+	char padding[TX_PUBLISH_SLOT_SIZE - 2 * sizeof(unsigned) -
+		sizeof(void *) - sizeof(size_t)];
+};
+
+/*
+ * tx_combiner -- publication list of the pool, the thread which takes
+ *	the lock commits all of the posted transactions at once
+ */
+struct tx_combiner {
+	unsigned locked;
+	char padding[TX_PUBLISH_SLOT_SIZE - sizeof(unsigned)];
+	struct tx_publish_slot slots[TX_PUBLISH_SLOTS];
+};
+
+static unsigned Publish_next_slot;
+static __thread unsigned Publish_slot = UINT_MAX;
+
+/*
+ * tx_combiner_get -- (internal) returns the publication list of the pool,
+ *	creates it on the first use
+ */
+static struct tx_combiner *
+tx_combiner_get(PMEMobjpool *pop)
+{
+	struct tx_combiner *c = pop->tx_combiner;
+	if (c != NULL)
+		return c;
+
+	c = Zalloc(sizeof(*c));
+	if (c == NULL) {
+		ERR("!Zalloc");
+		return NULL;
+	}
+
+	if (!__sync_bool_compare_and_swap(&pop->tx_combiner, NULL, c)) {
+		Free(c);
+		c = pop->tx_combiner;
+	}
+
+	return c;
+}
+
+/*
+ * tx_combiner_cleanup -- deletes the publication list of the pool
+ */
+void
+tx_combiner_cleanup(PMEMobjpool *pop)
+{
+	LOG(3, "pop %p", pop);
+
+	Free(pop->tx_combiner);
+	pop->tx_combiner = NULL;
+}
+
+/*
+ * tx_publish_claim -- (internal) takes a free slot of the publication list,
+ *	starting from the one the thread used the last time
+ */
+static struct tx_publish_slot *
+tx_publish_claim(struct tx_combiner *c)
+{
+	if (Publish_slot == UINT_MAX)
+		Publish_slot = __sync_fetch_and_add(&Publish_next_slot, 1) %
+			TX_PUBLISH_SLOTS;
+
+	unsigned i = Publish_slot;
+	for (;;) {
+		struct tx_publish_slot *s = &c->slots[i];
+		if (s->state == TX_PUBLISH_FREE &&
+			__sync_bool_compare_and_swap(&s->state,
+				TX_PUBLISH_FREE, TX_PUBLISH_CLAIMED)) {
+			Publish_slot = i;
+			return s;
+		}
+
+		i = (i + 1) % TX_PUBLISH_SLOTS;
+		if (i == Publish_slot)
+			sched_yield();
+	}
+}
+
+/*
+ * tx_publish_check -- (internal) verifies that all of the words of
+ *	the posted transaction lie within the heap
+ */
+static int
+tx_publish_check(PMEMobjpool *pop, const struct tx_publish_slot *s)
+{
+	for (size_t i = 0; i < s->nwords; ++i) {
+		uint64_t offset = (uint64_t)((uintptr_t)s->words[i].ptr -
+			(uintptr_t)pop);
+
+		if (!OBJ_PTR_FROM_POOL(pop, s->words[i].ptr) ||
+			offset < pop->heap_offset ||
+			offset + sizeof(uint64_t) >
+			pop->heap_offset + pop->heap_size) {
+			ERR("word outside of heap");
+			return EINVAL;
+		}
+	}
+
+	return 0;
+}
+
+/*
+ * tx_publish_done -- (internal) hands the result over to the thread which
+ *	posted the transaction
+ */
+static void
+tx_publish_done(struct tx_publish_slot *s, int result)
+{
+	s->result = result;
+	__sync_synchronize();
+	s->state = TX_PUBLISH_DONE;
+}
+
+/*
+ * tx_combine -- (internal) commits all of the posted transactions with
+ *	a single standalone redo log
+ */
+static void
+tx_combine(PMEMobjpool *pop, struct tx_combiner *c)
+{
+	LOG(15, NULL);
+
+	struct lane_section *section;
+	lane_hold(pop, &section, LANE_SECTION_TRANSACTION);
+
+	struct lane_tx_runtime *lane = section->runtime;
+	struct lane_tx_layout *layout =
+		(struct lane_tx_layout *)section->layout;
+	ASSERTeq(lane->redo.size, 0);
+
+	struct tx_publish_slot *batch[TX_PUBLISH_SLOTS];
+	unsigned nbatch = 0;
+	const size_t entry_size = REDO_RANGE_SIZE(sizeof(uint64_t));
+
+	for (unsigned i = 0; i < TX_PUBLISH_SLOTS; ++i) {
+		struct tx_publish_slot *s = &c->slots[i];
+		if (s->state != TX_PUBLISH_POSTED)
+			continue;
+
+		/* the words must be read after the state */
+		__sync_synchronize();
+
+		int err = tx_publish_check(pop, s);
+		if (err != 0) {
+			tx_publish_done(s, err);
+			continue;
+		}
+
+		if (tx_redo_reserve(pop, lane, layout,
+				lane->redo.size + s->nwords * entry_size)) {
+			/*
+			 * The transaction might still fit into a batch of
+			 * its own, leave it for the next combiner.
+			 */
+			if (nbatch != 0)
+				continue;
+
+			ERR("cannot reserve the redo log");
+			tx_publish_done(s, errno);
+			continue;
+		}
+
+		for (size_t w = 0; w < s->nwords; ++w) {
+			struct redo_range *r = (struct redo_range *)
+				(lane->redo.data + lane->redo.size);
+			r->offset = (uint64_t)((uintptr_t)s->words[w].ptr -
+				(uintptr_t)pop);
+			r->size = sizeof(uint64_t);
+			memcpy(r->data, &s->words[w].value, sizeof(uint64_t));
+
+			lane->redo.size += entry_size;
+		}
+
+		batch[nbatch++] = s;
+	}
+
+	if (nbatch != 0) {
+		VALGRIND_START_TX;
+
+		/*
+		 * The redo log alone is the commit point of the whole batch,
+		 * the transaction state of the lane is never touched.
+		 */
+		struct redo_range_log *log =
+			OBJ_OFF_TO_PTR(pop, layout->redo_log);
+		redo_range_log_store(pop->redo, log, lane->redo.data,
+			lane->redo.size, TX_REDO_LOG_STANDALONE);
+		lane->redo.size = 0;
+
+		pmemops_drain(&pop->p_ops);
+
+		tx_post_commit_redo(pop, log);
+
+		VALGRIND_END_TX;
+	}
+
+	lane_release(pop);
+
+	for (unsigned i = 0; i < nbatch; ++i)
+		tx_publish_done(batch[i], 0);
+}
+
+/*
+ * pmemobj_tx_publish -- atomically writes the words, concurrent calls are
+ *	combined into a single redo log
+ */
+int
+pmemobj_tx_publish(PMEMobjpool *pop, const struct pobj_tx_word *words,
+	size_t nwords)
+{
+	LOG(3, "pop %p words %p nwords %zu", pop, words, nwords);
+
+	if (tx.stage != TX_STAGE_NONE) {
+		ERR("cannot publish a transaction within a transaction");
+		errno = EINVAL;
+		return EINVAL;
+	}
+
+	if (nwords == 0)
+		return 0;
+
+	if (nwords > PMEMOBJ_MAX_ALLOC_SIZE / sizeof(uint64_t)) {
+		ERR("too many words");
+		errno = EINVAL;
+		return EINVAL;
+	}
+
+	struct tx_combiner *c = tx_combiner_get(pop);
+	if (c == NULL) {
+		errno = ENOMEM;
+		return ENOMEM;
+	}
+
+	struct tx_publish_slot *s = tx_publish_claim(c);
+	s->words = words;
+	s->nwords = nwords;
+	__sync_synchronize();
+	s->state = TX_PUBLISH_POSTED;
+
+	for (unsigned spins = 1; ; ++spins) {
+		__sync_synchronize();
+		if (s->state == TX_PUBLISH_DONE)
+			break;
+
+		if (c->locked == 0 &&
+			__sync_bool_compare_and_swap(&c->locked, 0, 1)) {
+			tx_combine(pop, c);
+			__sync_lock_release(&c->locked);
+		} else if (spins % TX_PUBLISH_SPINS == 0) {
+			sched_yield();
+		}
+	}
+
+	int ret = s->result;
+	__sync_synchronize();
+	s->state = TX_PUBLISH_FREE;
+
+	if (ret != 0)
+		errno = ret;
+
+	return ret;
+}
+
 /*
  * pmemobj_tx_alloc -- allocates a new object
  */
@@ -2073,7 +3335,7 @@ pmemobj_tx_free(PMEMoid oid)
 				OPERATION_SET);
 
 		pmalloc_operation(&pop->heap, *entry_offset,
-			entry_offset, 0, NULL, NULL, &ctx);
+			entry_offset, 0, NULL, NULL, 0, &ctx);
 
 		pmalloc_redo_release(pop);
 	}
@@ -2104,6 +3366,7 @@ lane_transaction_destroy_rt(PMEMobjpool *pop, void *rt)
 {
 	struct lane_tx_runtime *lane = rt;
 	tx_destroy_undo_runtime(&lane->undo);
+	Free(lane->redo.data);
 	Free(lane);
 }
 
@@ -2117,15 +3380,34 @@ lane_transaction_recovery(PMEMobjpool *pop, void *data, unsigned length)
 	int ret = 0;
 	ASSERT(sizeof(*layout) <= length);
 
+	struct redo_range_log *redo = tx_redo_log_get(pop, layout);
+
 	if (layout->state == TX_STATE_COMMITTED) {
 		/*
 		 * The transaction has been committed so we have to
-		 * process the undo log, do the post commit phase
-		 * and clear the transaction state.
+		 * replay the redo log, process the undo log, do the post
+		 * commit phase and clear the transaction state.
 		 */
+		if (redo != NULL)
+			tx_post_commit_redo(pop, redo);
+
 		tx_post_commit(pop, layout, 1 /* recovery */);
 		tx_set_state(pop, layout, TX_STATE_NONE);
 	} else {
+		/*
+		 * A standalone redo log is committed as soon as it is
+		 * completely stored, any other log belongs to a transaction
+		 * that didn't reach its commit point and is discarded.
+		 */
+		if (redo != NULL && (redo->flags & TX_REDO_LOG_STANDALONE)) {
+			tx_post_commit_redo(pop, redo);
+		} else if (layout->redo_log != 0) {
+			struct redo_range_log *log =
+				OBJ_OFF_TO_PTR(pop, layout->redo_log);
+			if (log->size != 0)
+				redo_range_log_clear(pop->redo, log);
+		}
+
 		/* process undo log and restore all operations */
 		tx_abort(pop, NULL, layout, 1 /* recovery */);
 	}
@@ -2133,6 +3415,58 @@ lane_transaction_recovery(PMEMobjpool *pop, void *data, unsigned length)
 	return ret;
 }
 
+/*
+ * lane_transaction_need_recovery -- checks if the transaction lane section has
+ *	to be recovered
+ *
+ * The section of a lane whose last transaction has finished has no committed
+ * state, no redo log entries and no undo log entries - the range caches are
+ * cleared and the entries of the large snapshots buffer are invalidated.
+ */
+static int
+lane_transaction_need_recovery(PMEMobjpool *pop, void *data, unsigned length)
+{
+	struct lane_tx_layout *layout = data;
+	ASSERT(sizeof(*layout) <= length);
+
+	if (layout->state != TX_STATE_NONE)
+		return 1;
+
+	if (layout->redo_log != 0) {
+		struct redo_range_log *log =
+			OBJ_OFF_TO_PTR(pop, layout->redo_log);
+		if (log->size != 0)
+			return 1;
+	}
+
+	struct tx_undo_runtime tx_rt = { .ctx = {NULL, } };
+	if (tx_rebuild_undo_runtime(pop, layout, &tx_rt) != 0)
+		return 1; /* let the recovery report it */
+
+	int ret = pvector_first(tx_rt.ctx[UNDO_ALLOC]) != 0 ||
+		pvector_first(tx_rt.ctx[UNDO_FREE]) != 0 ||
+		pvector_first(tx_rt.ctx[UNDO_SET]) != 0;
+
+	uint64_t off;
+	struct pvector_context *ctx = tx_rt.ctx[UNDO_SET_CACHE];
+	for (off = pvector_first(ctx); off != 0 && !ret;
+			off = pvector_next(ctx)) {
+		struct tx_range_cache *cache = OBJ_OFF_TO_PTR(pop, off);
+		ret = cache->range[0].offset != 0;
+	}
+
+	struct tx_undo_buffer_entry *entry;
+	if (!ret && tx_rt.buffer != NULL &&
+			tx_rt.buffer_capacity >= sizeof(*entry)) {
+		entry = (struct tx_undo_buffer_entry *)tx_rt.buffer->data;
+		ret = entry->generation == tx_rt.buffer->generation;
+	}
+
+	tx_destroy_undo_runtime(&tx_rt);
+
+	return ret;
+}
+
 /*
  * lane_transaction_check -- consistency check of transaction lane section
  */
@@ -2166,6 +3500,7 @@ static struct section_operations transaction_ops = {
 	.construct_rt = lane_transaction_construct_rt,
 	.destroy_rt = lane_transaction_destroy_rt,
 	.recover = lane_transaction_recovery,
+	.need_recovery = lane_transaction_need_recovery,
 	.check = lane_transaction_check,
 	.boot = lane_transaction_boot
 };
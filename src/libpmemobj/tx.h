@@ -67,6 +67,24 @@ struct tx_range_cache {
 	} range[MAX_CACHED_RANGES];
 };
 
+/*
+ * Persistent buffer of large snapshots, reused by consecutive transactions of
+ * a lane. Only the consecutive entries of the current generation are valid,
+ * so the buffer is reset by incrementing the generation.
+ */
+struct tx_undo_buffer {
+	uint64_t generation;
+	uint64_t unused;
+	uint8_t data[];
+};
+
+struct tx_undo_buffer_entry {
+	uint64_t generation;
+	uint64_t offset; /* compatible with struct tx_range */
+	uint64_t size;
+	uint8_t data[];
+};
+
 enum undo_types {
 	UNDO_ALLOC,
 	UNDO_FREE,
@@ -79,8 +97,24 @@ enum undo_types {
 struct lane_tx_layout {
 	uint64_t state;
 	struct pvector undo_log[MAX_UNDO_TYPES];
+	uint64_t redo_log; /* offset of the redo range log object */
+	uint64_t undo_buffer; /* offset of the large snapshots buffer */
 };
 
+/*
+ * Statistics of the reusable undo log buffers.
+ */
+struct tx_undo_stats {
+	uint64_t reused; /* snapshot buffers reused from earlier transactions */
+	uint64_t allocated; /* snapshot buffers allocated from the heap */
+	uint64_t grows; /* enlargements of the large snapshots buffer */
+	uint64_t shrinks; /* reductions and releases of that buffer */
+};
+
+void tx_get_undo_stats(PMEMobjpool *pop, struct tx_undo_stats *stats);
+
+void tx_combiner_cleanup(PMEMobjpool *pop);
+
 /*
  * Returns the current transaction's pool handle, NULL if not within
  * a transaction.
@@ -0,0 +1,382 @@
+/*
+ * Copyright 2016, Intel Corporation
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in
+ *       the documentation and/or other materials provided with the
+ *       distribution.
+ *
+ *     * Neither the name of the copyright holder nor the names of its
+ *       contributors may be used to endorse or promote products derived
+ *       from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+/*
+ * type_index.c -- volatile index of objects by their type numbers
+ *
+ * Each type number maps to a crit-bit tree of the data offsets of all user
+ * objects of that type, so the objects of a single type can be found without
+ * walking the whole heap. The index is built on the first use by a parallel
+ * walk of the heap and from then on every allocator operation updates it.
+ *
+ * Allocator operations hold the index lock for reading for their whole
+ * duration, the walk which builds the index holds it for writing, so it never
+ * observes an operation that is only partially done.
+ */
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdlib.h>
+
+#include "cuckoo.h"
+#include "numa.h"
+#include "out.h"
+#include "sys_util.h"
+#include "type_index.h"
+
+/* maximal number of threads which build the index */
+#define TYPE_INDEX_MAX_THREADS 16
+
+struct type_index {
+	pthread_rwlock_t lock; /* taken for writing only to build the index */
+	int built;
+	int invalid; /* the index failed to track some of the objects */
+
+	pthread_mutex_t types_lock; /* protects the map and the array below */
+	struct cuckoo *types; /* type number -> tree of data offsets */
+	struct ctree **trees; /* all of the trees, for the cleanup */
+	size_t ntrees;
+};
+
+/*
+ * type_index_new -- creates a new, not yet built, type index
+ */
+struct type_index *
+type_index_new(void)
+{
+	struct type_index *ti = Malloc(sizeof(*ti));
+	if (ti == NULL) {
+		ERR("!Malloc");
+		return NULL;
+	}
+
+	if ((ti->types = cuckoo_new()) == NULL)
+		goto error_cuckoo;
+
+	if ((errno = pthread_rwlock_init(&ti->lock, NULL)) != 0) {
+		ERR("!pthread_rwlock_init");
+		goto error_lock;
+	}
+
+	util_mutex_init(&ti->types_lock, NULL);
+
+	ti->built = 0;
+	ti->invalid = 0;
+	ti->trees = NULL;
+	ti->ntrees = 0;
+
+	return ti;
+
+error_lock:
+	cuckoo_delete(ti->types);
+error_cuckoo:
+	Free(ti);
+	return NULL;
+}
+
+/*
+ * type_index_delete -- deletes the type index and all of its trees
+ */
+void
+type_index_delete(struct type_index *ti)
+{
+	for (size_t i = 0; i < ti->ntrees; ++i)
+		ctree_delete(ti->trees[i]);
+
+	Free(ti->trees);
+	cuckoo_delete(ti->types);
+	util_mutex_destroy(&ti->types_lock);
+	pthread_rwlock_destroy(&ti->lock);
+	Free(ti);
+}
+
+/*
+ * type_index_hold -- protects the index from being built for the duration
+ *	of an allocator operation
+ */
+void
+type_index_hold(struct type_index *ti)
+{
+	if ((errno = pthread_rwlock_rdlock(&ti->lock)) != 0)
+		FATAL("!pthread_rwlock_rdlock");
+}
+
+/*
+ * type_index_release -- ends an allocator operation
+ */
+void
+type_index_release(struct type_index *ti)
+{
+	if ((errno = pthread_rwlock_unlock(&ti->lock)) != 0)
+		FATAL("!pthread_rwlock_unlock");
+}
+
+/*
+ * type_index_invalidate -- marks the index as unable to track all of
+ *	the objects, which makes its users fall back to walking the heap
+ */
+void
+type_index_invalidate(struct type_index *ti)
+{
+	ti->invalid = 1;
+}
+
+/*
+ * type_index_type_num -- (internal) returns the type number of the object,
+ *	-1 for internal objects which aren't indexed
+ */
+static int
+type_index_type_num(PMEMobjpool *pop, uint64_t off, uint64_t *type_num)
+{
+	if (palloc_is_headerless(&pop->heap, off)) {
+		*type_num = palloc_headerless_type_num(&pop->heap, off);
+		return 0;
+	}
+
+	struct oob_header *oobh = OOB_HEADER_FROM_OFF(pop, off);
+	if (OBJ_IS_INTERNAL(oobh))
+		return -1;
+
+	*type_num = oobh->type_num;
+	return 0;
+}
+
+/*
+ * type_index_tree -- (internal) returns the tree of the type, creates it if
+ *	'create' is set and the type has none yet
+ */
+static struct ctree *
+type_index_tree(struct type_index *ti, uint64_t type_num, int create)
+{
+	util_mutex_lock(&ti->types_lock);
+
+	struct ctree *t = cuckoo_get(ti->types, type_num);
+	if (t != NULL || !create)
+		goto out;
+
+	struct ctree **trees = Realloc(ti->trees,
+		(ti->ntrees + 1) * sizeof(*trees));
+	if (trees == NULL) {
+		ERR("!Realloc");
+		goto out;
+	}
+	ti->trees = trees;
+
+	if ((t = ctree_new()) == NULL)
+		goto out;
+
+	if (cuckoo_insert(ti->types, type_num, t) != 0) {
+		ctree_delete(t);
+		t = NULL;
+		goto out;
+	}
+
+	ti->trees[ti->ntrees++] = t;
+
+out:
+	util_mutex_unlock(&ti->types_lock);
+	return t;
+}
+
+/*
+ * type_index_add -- (internal) adds the object to the tree of its type
+ */
+static void
+type_index_add(PMEMobjpool *pop, struct type_index *ti, uint64_t off,
+	struct ctree **last, uint64_t *last_type)
+{
+	uint64_t type_num;
+	if (type_index_type_num(pop, off, &type_num) != 0)
+		return;
+
+	struct ctree *t = *last;
+	if (t == NULL || *last_type != type_num) {
+		t = type_index_tree(ti, type_num, 1);
+		if (t == NULL) {
+			type_index_invalidate(ti);
+			return;
+		}
+
+		*last = t;
+		*last_type = type_num;
+	}
+
+	int ret = ctree_insert(t, off, off);
+	if (ret != 0 && ret != EEXIST)
+		type_index_invalidate(ti);
+}
+
+/*
+ * type_index_insert -- adds a newly allocated object to the built index,
+ *	must be called with the index held
+ */
+void
+type_index_insert(PMEMobjpool *pop, struct type_index *ti, uint64_t off)
+{
+	if (!ti->built)
+		return;
+
+	struct ctree *t = NULL;
+	uint64_t type_num = 0;
+	type_index_add(pop, ti, off, &t, &type_num);
+}
+
+/*
+ * type_index_remove -- removes an object which is about to be freed from
+ *	the built index, must be called with the index held
+ */
+void
+type_index_remove(PMEMobjpool *pop, struct type_index *ti, uint64_t off)
+{
+	if (!ti->built)
+		return;
+
+	uint64_t type_num;
+	if (type_index_type_num(pop, off, &type_num) != 0)
+		return;
+
+	struct ctree *t = type_index_tree(ti, type_num, 0);
+	if (t != NULL)
+		ctree_remove(t, off, 1);
+}
+
+struct type_index_build {
+	PMEMobjpool *pop;
+	struct type_index *ti;
+	unsigned part;
+	unsigned nparts;
+};
+
+/*
+ * type_index_build_worker -- (internal) indexes the objects of one part of
+ *	the heap
+ */
+static void *
+type_index_build_worker(void *arg)
+{
+	struct type_index_build *b = arg;
+
+	struct palloc_cursor cur;
+	struct palloc_object obj;
+	palloc_cursor_init(&b->pop->heap, &cur, b->part, b->nparts);
+
+	struct ctree *t = NULL;
+	uint64_t type_num = 0;
+	while (palloc_cursor_next(&b->pop->heap, &cur, &obj))
+		type_index_add(b->pop, b->ti, obj.off, &t, &type_num);
+
+	return NULL;
+}
+
+/*
+ * type_index_nthreads -- (internal) returns the number of threads which
+ *	build the index
+ */
+static unsigned
+type_index_nthreads(void)
+{
+	unsigned nthreads = util_numa_ncpus_total();
+	if (nthreads > TYPE_INDEX_MAX_THREADS)
+		nthreads = TYPE_INDEX_MAX_THREADS;
+
+	return nthreads == 0 ? 1 : nthreads;
+}
+
+/*
+ * type_index_build -- (internal) walks the heap in parallel and indexes all
+ *	of its objects, must be called with the index locked for writing
+ */
+static void
+type_index_build(PMEMobjpool *pop, struct type_index *ti)
+{
+	unsigned nthreads = type_index_nthreads();
+
+	LOG(4, "type index threads %u", nthreads);
+
+	struct type_index_build b[TYPE_INDEX_MAX_THREADS];
+	pthread_t threads[TYPE_INDEX_MAX_THREADS];
+	unsigned nstarted = 0;
+
+	for (unsigned i = 0; i < nthreads; ++i) {
+		b[i].pop = pop;
+		b[i].ti = ti;
+		b[i].part = i;
+		b[i].nparts = nthreads;
+	}
+
+	/* the calling thread indexes the first part itself */
+	for (unsigned i = 1; i < nthreads; ++i) {
+		if (pthread_create(&threads[nstarted], NULL,
+				type_index_build_worker, &b[i]) != 0) {
+			/* the remaining parts are indexed by this thread */
+			type_index_build_worker(&b[i]);
+			continue;
+		}
+		nstarted++;
+	}
+
+	type_index_build_worker(&b[0]);
+
+	for (unsigned i = 0; i < nstarted; ++i)
+		pthread_join(threads[i], NULL);
+
+	ti->built = 1;
+}
+
+/*
+ * type_index_get -- returns the tree of the objects of the given type, NULL
+ *	if there are none, builds the index on the first use
+ *
+ * Returns -1 if the index can't be used and the heap has to be walked instead.
+ */
+int
+type_index_get(PMEMobjpool *pop, struct type_index *ti, uint64_t type_num,
+	struct ctree **objects)
+{
+	if (!ti->built) {
+		if ((errno = pthread_rwlock_wrlock(&ti->lock)) != 0)
+			FATAL("!pthread_rwlock_wrlock");
+
+		if (!ti->built)
+			type_index_build(pop, ti);
+
+		type_index_release(ti);
+	}
+
+	if (ti->invalid)
+		return -1;
+
+	*objects = type_index_tree(ti, type_num, 0);
+
+	return 0;
+}
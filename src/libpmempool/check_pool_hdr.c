@@ -246,7 +246,9 @@ pool_hdr_default_check(PMEMpoolcheck *ppc, union location *loc)
 			def_hdr.compat_features);
 	}
 
-	if (loc->hdr.incompat_features != def_hdr.incompat_features) {
+	uint32_t incompat_supported =
+		pool_hdr_incompat_supported(ppc->pool->params.type);
+	if (loc->hdr.incompat_features & ~incompat_supported) {
 		CHECK_ASK(ppc, Q_DEFAULT_INCOMPAT_FEATURES,
 			"%spool_hdr.incompat_features is not valid.|Do you "
 			"want to set it to default value 0x%x?", loc->prefix,
@@ -949,6 +949,25 @@ pool_hdr_default(enum pool_type type, struct pool_hdr *hdrp)
 	}
 }
 
+/*
+ * pool_hdr_incompat_supported -- return the mask of incompat features which
+ *	a pool of the given type may have
+ */
+uint32_t
+pool_hdr_incompat_supported(enum pool_type type)
+{
+	switch (type) {
+	case POOL_TYPE_LOG:
+		return LOG_FORMAT_INCOMPAT;
+	case POOL_TYPE_BLK:
+		return BLK_FORMAT_INCOMPAT;
+	case POOL_TYPE_OBJ:
+		return OBJ_FORMAT_INCOMPAT_SUPPORTED;
+	default:
+		return 0;
+	}
+}
+
 /*
  * pool_hdr_get_type -- return pool type based on pool header data
  */
@@ -137,6 +137,7 @@ int pool_set_file_map_headers(struct pool_set_file *file, int rdonly, int prv);
 void pool_set_file_unmap_headers(struct pool_set_file *file);
 
 void pool_hdr_default(enum pool_type type, struct pool_hdr *hdrp);
+uint32_t pool_hdr_incompat_supported(enum pool_type type);
 enum pool_type pool_hdr_get_type(const struct pool_hdr *hdrp);
 enum pool_type pool_set_type(struct pool_set *set);
 
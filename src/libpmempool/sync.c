@@ -317,6 +317,19 @@ copy_data_to_broken_parts(struct pool_set *set, unsigned healthy_replica,
 	/* get pool size from healthy replica */
 	size_t poolsize = set->poolsize;
 
+	/* local copies run in the background, until all parts are started */
+	unsigned nparts = 0;
+	for (unsigned r = 0; r < set_hs->nreplicas; ++r)
+		nparts += REP(set, r)->nparts;
+
+	PMEMasync **copies = Malloc(nparts * sizeof(*copies));
+	if (copies == NULL) {
+		ERR("!Malloc");
+		return -1;
+	}
+	unsigned ncopies = 0;
+	int result = 0;
+
 	for (unsigned r = 0; r < set_hs->nreplicas; ++r) {
 		/* skip unbroken and consistent replicas */
 		if (replica_is_replica_healthy(r, set_hs))
@@ -358,7 +371,8 @@ copy_data_to_broken_parts(struct pool_set *set, unsigned healthy_replica,
 						"failed -- '%s' on '%s'",
 						rep->remote->pool_desc,
 						rep->remote->node_addr);
-					return -1;
+					result = -1;
+					goto out;
 				}
 			} else if (rep_h->remote) {
 				int ret = Rpmem_read(rep_h->remote->rpp,
@@ -369,7 +383,8 @@ copy_data_to_broken_parts(struct pool_set *set, unsigned healthy_replica,
 						"failed -- '%s' on '%s'",
 						rep_h->remote->pool_desc,
 						rep_h->remote->node_addr);
-					return -1;
+					result = -1;
+					goto out;
 				}
 			} else {
 				if (off + len > poolsize)
@@ -379,12 +394,30 @@ copy_data_to_broken_parts(struct pool_set *set, unsigned healthy_replica,
 					ADDR_SUM(rep_h->part[0].addr, off);
 
 				/* copy all data */
-				memcpy(dst_addr, src_addr, len);
-				PERSIST_GENERIC(part->is_dax, dst_addr, len);
+				PMEMasync *copy = pmem_memcpy_async(dst_addr,
+						src_addr, len, part->is_dax ?
+						0 : PMEM_ASYNC_NOPMEM);
+				if (copy == NULL) {
+					LOG(1, "!pmem_memcpy_async");
+					result = -1;
+					goto out;
+				}
+				copies[ncopies++] = copy;
 			}
 		}
 	}
-	return 0;
+
+out:
+	/* all copies have to be waited for, even if one of them failed */
+	for (unsigned i = 0; i < ncopies; ++i) {
+		if (pmem_async_wait(copies[i])) {
+			LOG(1, "!copying data to part failed");
+			result = -1;
+		}
+	}
+
+	Free(copies);
+	return result;
 }
 
 /*
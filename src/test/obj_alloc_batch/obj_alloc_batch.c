@@ -0,0 +1,292 @@
+/*
+ * Copyright 2016, Intel Corporation
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in
+ *       the documentation and/or other materials provided with the
+ *       distribution.
+ *
+ *     * Neither the name of the copyright holder nor the names of its
+ *       contributors may be used to endorse or promote products derived
+ *       from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * obj_alloc_batch.c -- unit test for pmemobj_alloc_batch and pmemobj_free_batch
+ */
+
+#include "unittest.h"
+
+#define LAYOUT_NAME "alloc_batch"
+
+#define NOBJS 1000
+#define NROOT_OBJS 100
+#define TYPE_NUM 1
+#define HUGE_SIZE (300 * 1024)
+
+#define SMALL_UNIT 32
+#define SMALL_TYPE 3
+
+struct root {
+	PMEMoid oids[NROOT_OBJS];
+};
+
+struct carg {
+	int ncalls; /* number of constructor calls so far */
+	int fail_at; /* call that is to fail, or -1 */
+};
+
+/*
+ * construct -- numbers the objects in the order of allocation
+ */
+static int
+construct(PMEMobjpool *pop, void *ptr, void *arg)
+{
+	struct carg *carg = arg;
+	if (carg->ncalls == carg->fail_at)
+		return -1;
+
+	int *n = ptr;
+	*n = carg->ncalls++;
+	pmemobj_persist(pop, n, sizeof(*n));
+
+	return 0;
+}
+
+/*
+ * count_objects -- returns the number of objects in the pool
+ */
+static int
+count_objects(PMEMobjpool *pop)
+{
+	int n = 0;
+	PMEMoid oid;
+	POBJ_FOREACH(pop, oid)
+		n++;
+
+	return n;
+}
+
+/*
+ * check_objects -- verifies the contents of batch-allocated objects
+ */
+static void
+check_objects(PMEMoid *oids, const size_t *sizes, int n)
+{
+	for (int i = 0; i < n; ++i) {
+		UT_ASSERT(!OID_IS_NULL(oids[i]));
+		UT_ASSERTeq(pmemobj_type_num(oids[i]), TYPE_NUM);
+		UT_ASSERT(pmemobj_alloc_usable_size(oids[i]) >= sizes[i]);
+		UT_ASSERTeq(*(int *)pmemobj_direct(oids[i]), i);
+	}
+}
+
+/*
+ * test_invalid -- checks that invalid batches are rejected
+ */
+static void
+test_invalid(PMEMobjpool *pop)
+{
+	PMEMoid oids[2];
+	size_t sizes[2] = {64, 0};
+
+	/* allocation with size 0 */
+	UT_ASSERTeq(pmemobj_alloc_batch(pop, oids, sizes, 2, TYPE_NUM, 0,
+		NULL, NULL), -1);
+	UT_ASSERTeq(errno, EINVAL);
+
+	/* unknown flags */
+	UT_ASSERTeq(pmemobj_alloc_batch(pop, oids, sizes, 1, TYPE_NUM,
+		POBJ_XALLOC_NO_FLUSH, NULL, NULL), -1);
+	UT_ASSERTeq(errno, EINVAL);
+
+	/* too large */
+	sizes[1] = PMEMOBJ_MAX_ALLOC_SIZE + 1;
+	UT_ASSERTeq(pmemobj_alloc_batch(pop, oids, sizes, 2, TYPE_NUM, 0,
+		NULL, NULL), -1);
+	UT_ASSERTeq(errno, ENOMEM);
+
+	UT_ASSERTeq(count_objects(pop), 0);
+}
+
+/*
+ * test_volatile -- allocates objects with handles in volatile memory
+ */
+static void
+test_volatile(PMEMobjpool *pop)
+{
+	static PMEMoid oids[NOBJS];
+	static size_t sizes[NOBJS];
+
+	for (int i = 0; i < NOBJS; ++i) {
+		if (i % 250 == 249)
+			sizes[i] = HUGE_SIZE;
+		else
+			sizes[i] = sizeof(int) + (size_t)(i % 8) * 64;
+	}
+
+	struct carg carg = {0, -1};
+	UT_ASSERTeq(pmemobj_alloc_batch(pop, oids, sizes, NOBJS, TYPE_NUM, 0,
+		construct, &carg), 0);
+	UT_ASSERTeq(carg.ncalls, NOBJS);
+
+	check_objects(oids, sizes, NOBJS);
+	UT_ASSERTeq(count_objects(pop), NOBJS);
+
+	/* null handles are skipped */
+	pmemobj_free(&oids[1]);
+	pmemobj_free_batch(oids, NOBJS);
+
+	for (int i = 0; i < NOBJS; ++i)
+		UT_ASSERT(OID_IS_NULL(oids[i]));
+	UT_ASSERTeq(count_objects(pop), 0);
+}
+
+/*
+ * test_persistent -- allocates objects with handles in the pool and checks
+ *	them after the pool is reopened
+ */
+static void
+test_persistent(PMEMobjpool *pop, const char *path)
+{
+	size_t sizes[NROOT_OBJS];
+	for (int i = 0; i < NROOT_OBJS; ++i)
+		sizes[i] = sizeof(int) + (size_t)i;
+
+	struct root *root = pmemobj_direct(pmemobj_root(pop,
+		sizeof(struct root)));
+	struct carg carg = {0, -1};
+	UT_ASSERTeq(pmemobj_alloc_batch(pop, root->oids, sizes,
+		NROOT_OBJS, TYPE_NUM, POBJ_XALLOC_ZERO, construct, &carg), 0);
+
+	pmemobj_close(pop);
+
+	if ((pop = pmemobj_open(path, LAYOUT_NAME)) == NULL)
+		UT_FATAL("!pmemobj_open: %s", path);
+
+	root = pmemobj_direct(pmemobj_root(pop, sizeof(struct root)));
+	check_objects(root->oids, sizes, NROOT_OBJS);
+	UT_ASSERTeq(count_objects(pop), NROOT_OBJS);
+
+	pmemobj_free_batch(root->oids, NROOT_OBJS);
+
+	for (int i = 0; i < NROOT_OBJS; ++i)
+		UT_ASSERT(OID_IS_NULL(root->oids[i]));
+	UT_ASSERTeq(count_objects(pop), 0);
+
+	pmemobj_close(pop);
+}
+
+/*
+ * test_failure -- checks that a failed batch doesn't leave any objects behind
+ */
+static void
+test_failure(PMEMobjpool *pop)
+{
+	static PMEMoid oids[NOBJS];
+	static size_t sizes[NOBJS];
+	for (int i = 0; i < NOBJS; ++i) {
+		sizes[i] = 128;
+		oids[i].pool_uuid_lo = 0;
+		oids[i].off = 1;
+	}
+
+	/* the constructor cancels one of the allocations */
+	struct carg carg = {0, NOBJS / 2};
+	UT_ASSERTeq(pmemobj_alloc_batch(pop, oids, sizes, NOBJS, TYPE_NUM, 0,
+		construct, &carg), -1);
+	UT_ASSERTeq(errno, ECANCELED);
+
+	for (int i = 0; i < NOBJS / 2; ++i)
+		UT_ASSERT(OID_IS_NULL(oids[i]));
+	for (int i = NOBJS / 2; i < NOBJS; ++i)
+		UT_ASSERTeq(oids[i].off, 1);
+	UT_ASSERTeq(count_objects(pop), 0);
+
+	/* the pool runs out of memory */
+	for (int i = 0; i < NOBJS; ++i)
+		sizes[i] = HUGE_SIZE;
+
+	UT_ASSERTeq(pmemobj_alloc_batch(pop, oids, sizes, NOBJS, TYPE_NUM, 0,
+		NULL, NULL), -1);
+	UT_ASSERTeq(errno, ENOMEM);
+	UT_ASSERTeq(count_objects(pop), 0);
+}
+
+/*
+ * test_headerless -- allocates a batch of objects from a header-less class
+ */
+static void
+test_headerless(PMEMobjpool *pop)
+{
+	struct pobj_alloc_class_desc desc = {SMALL_UNIT, 0, 0,
+		POBJ_HEADER_NONE, SMALL_TYPE, 0};
+	UT_ASSERTeq(pmemobj_alloc_class_new(pop, &desc), 0);
+
+	static PMEMoid oids[NOBJS];
+	static size_t sizes[NOBJS];
+	for (int i = 0; i < NOBJS; ++i)
+		sizes[i] = SMALL_UNIT;
+
+	/* the type number must match the one of the class */
+	UT_ASSERTeq(pmemobj_alloc_batch(pop, oids, sizes, NOBJS, TYPE_NUM,
+		POBJ_CLASS_ID(desc.class_id), NULL, NULL), -1);
+	UT_ASSERTeq(errno, EINVAL);
+
+	UT_ASSERTeq(pmemobj_alloc_batch(pop, oids, sizes, NOBJS, SMALL_TYPE,
+		POBJ_XALLOC_ZERO | POBJ_CLASS_ID(desc.class_id),
+		NULL, NULL), 0);
+
+	for (int i = 0; i < NOBJS; ++i) {
+		UT_ASSERTeq(pmemobj_type_num(oids[i]), SMALL_TYPE);
+		UT_ASSERTeq(pmemobj_alloc_usable_size(oids[i]), SMALL_UNIT);
+		UT_ASSERTeq(*(uint64_t *)pmemobj_direct(oids[i]), 0);
+	}
+	UT_ASSERTeq(count_objects(pop), NOBJS);
+
+	pmemobj_free_batch(oids, NOBJS);
+	UT_ASSERTeq(count_objects(pop), 0);
+}
+
+int
+main(int argc, char *argv[])
+{
+	START(argc, argv, "obj_alloc_batch");
+
+	if (argc != 2)
+		UT_FATAL("usage: %s file-name", argv[0]);
+
+	const char *path = argv[1];
+
+	PMEMobjpool *pop;
+	if ((pop = pmemobj_create(path, LAYOUT_NAME, PMEMOBJ_MIN_POOL,
+			S_IWUSR | S_IRUSR)) == NULL)
+		UT_FATAL("!pmemobj_create: %s", path);
+
+	test_invalid(pop);
+	test_volatile(pop);
+	test_failure(pop);
+	test_headerless(pop);
+	test_persistent(pop, path);
+
+	DONE(NULL);
+}
@@ -0,0 +1,311 @@
+/*
+ * Copyright 2016, Intel Corporation
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in
+ *       the documentation and/or other materials provided with the
+ *       distribution.
+ *
+ *     * Neither the name of the copyright holder nor the names of its
+ *       contributors may be used to endorse or promote products derived
+ *       from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * obj_alloc_class.c -- unit test for user-defined allocation classes
+ */
+
+#include "unittest.h"
+
+#define LAYOUT_NAME "alloc_class"
+
+/* size of the object header stored in every allocation unit */
+#define HEADER_SIZE 64
+
+#define NODE_SIZE 72
+#define NODE_UNIT (NODE_SIZE + HEADER_SIZE)
+#define NNODES 100
+
+#define SMALL_UNIT 32
+#define SMALL_TYPE 3
+#define NSMALL 1000
+
+#define INVALID_CLASS_ID 255
+
+/* unit size of the smallest of the built-in classes */
+#define BUILTIN_UNIT 128
+
+/*
+ * test_invalid -- checks that invalid classes are rejected
+ */
+static void
+test_invalid(PMEMobjpool *pop)
+{
+	struct pobj_alloc_class_desc desc = {0, 0, 0, 0};
+
+	/* unit size not a multiple of 8 */
+	desc.unit_size = 100;
+	UT_ASSERTeq(pmemobj_alloc_class_new(pop, &desc), -1);
+	UT_ASSERTeq(errno, EINVAL);
+
+	/* too small to be tracked by the run bitmap */
+	desc.unit_size = 8;
+	UT_ASSERTeq(pmemobj_alloc_class_new(pop, &desc), -1);
+	UT_ASSERTeq(errno, EINVAL);
+
+	/* larger than the largest run class */
+	desc.unit_size = 1024 * 1024;
+	UT_ASSERTeq(pmemobj_alloc_class_new(pop, &desc), -1);
+	UT_ASSERTeq(errno, EINVAL);
+
+	/* alignment not a power of two */
+	desc.unit_size = NODE_UNIT;
+	desc.alignment = 24;
+	UT_ASSERTeq(pmemobj_alloc_class_new(pop, &desc), -1);
+	UT_ASSERTeq(errno, EINVAL);
+
+	/* alignment not a divisor of the unit size */
+	desc.alignment = 16;
+	UT_ASSERTeq(pmemobj_alloc_class_new(pop, &desc), -1);
+	UT_ASSERTeq(errno, EINVAL);
+
+	/* runs larger than a chunk */
+	desc.alignment = 0;
+	desc.run_chunks = 2;
+	UT_ASSERTeq(pmemobj_alloc_class_new(pop, &desc), -1);
+	UT_ASSERTeq(errno, ENOTSUP);
+
+	/* class that doesn't exist */
+	PMEMoid oid;
+	UT_ASSERTeq(pmemobj_xalloc(pop, &oid, NODE_SIZE, 0,
+		POBJ_CLASS_ID(INVALID_CLASS_ID), NULL, NULL), -1);
+	UT_ASSERTeq(errno, EINVAL);
+
+	/* unknown flags */
+	UT_ASSERTeq(pmemobj_xalloc(pop, &oid, NODE_SIZE, 0,
+		POBJ_XALLOC_NO_FLUSH, NULL, NULL), -1);
+	UT_ASSERTeq(errno, EINVAL);
+}
+
+/*
+ * test_alloc -- allocates objects from a user-defined class
+ */
+static void
+test_alloc(PMEMobjpool *pop, PMEMoid *nodes)
+{
+	struct pobj_alloc_class_desc desc = {NODE_UNIT, 8, 1, 0};
+	UT_ASSERTeq(pmemobj_alloc_class_new(pop, &desc), 0);
+	UT_ASSERTne(desc.class_id, 0);
+
+	/* the same unit size results in the same class */
+	struct pobj_alloc_class_desc desc2 = {NODE_UNIT, 0, 0, 0};
+	UT_ASSERTeq(pmemobj_alloc_class_new(pop, &desc2), 0);
+	UT_ASSERTeq(desc.class_id, desc2.class_id);
+
+	for (int i = 0; i < NNODES; ++i) {
+		int ret = pmemobj_xalloc(pop, &nodes[i], NODE_SIZE, 1,
+			POBJ_XALLOC_ZERO | POBJ_CLASS_ID(desc.class_id),
+			NULL, NULL);
+		UT_ASSERTeq(ret, 0);
+
+		/* no internal fragmentation */
+		UT_ASSERTeq(pmemobj_alloc_usable_size(nodes[i]), NODE_SIZE);
+		UT_ASSERTeq(nodes[i].off % 8, 0);
+
+		char *p = pmemobj_direct(nodes[i]);
+		for (int j = 0; j < NODE_SIZE; ++j)
+			UT_ASSERTeq(p[j], 0);
+	}
+
+	/* the object doesn't fit in the maximum number of units of a class */
+	PMEMoid oid;
+	UT_ASSERTeq(pmemobj_xalloc(pop, &oid, NODE_UNIT * 8, 1,
+		POBJ_CLASS_ID(desc.class_id), NULL, NULL), -1);
+	UT_ASSERTeq(errno, EINVAL);
+
+	TX_BEGIN(pop) {
+		oid = pmemobj_tx_xalloc(NODE_SIZE, 2,
+			POBJ_CLASS_ID(desc.class_id));
+		UT_ASSERTeq(pmemobj_alloc_usable_size(oid), NODE_SIZE);
+	} TX_ONABORT {
+		UT_ASSERT(0);
+	} TX_END
+
+	pmemobj_free(&oid);
+
+	/* a built-in class can be registered too, its id is never 0 */
+	struct pobj_alloc_class_desc builtin = {BUILTIN_UNIT, 0, 0, 0};
+	UT_ASSERTeq(pmemobj_alloc_class_new(pop, &builtin), 0);
+	UT_ASSERTne(builtin.class_id, 0);
+	UT_ASSERTne(builtin.class_id, desc.class_id);
+
+	UT_ASSERTeq(pmemobj_xalloc(pop, &oid, BUILTIN_UNIT - HEADER_SIZE, 2,
+		POBJ_CLASS_ID(builtin.class_id), NULL, NULL), 0);
+	UT_ASSERTeq(pmemobj_alloc_usable_size(oid),
+		BUILTIN_UNIT - HEADER_SIZE);
+
+	pmemobj_free(&oid);
+}
+
+/*
+ * test_headerless -- allocates objects from a class without object headers
+ */
+static void
+test_headerless(PMEMobjpool *pop)
+{
+	struct pobj_alloc_class_desc desc = {SMALL_UNIT, 0, 0,
+		POBJ_HEADER_NONE, SMALL_TYPE, 0};
+
+	/* invalid header type */
+	desc.header_type = (enum pobj_header_type)2;
+	UT_ASSERTeq(pmemobj_alloc_class_new(pop, &desc), -1);
+	UT_ASSERTeq(errno, EINVAL);
+
+	desc.header_type = POBJ_HEADER_NONE;
+	UT_ASSERTeq(pmemobj_alloc_class_new(pop, &desc), 0);
+	UT_ASSERTne(desc.class_id, 0);
+
+	PMEMoid oid;
+	for (int i = 0; i < NSMALL; ++i) {
+		int ret = pmemobj_xalloc(pop, &oid, SMALL_UNIT, SMALL_TYPE,
+			POBJ_XALLOC_ZERO | POBJ_CLASS_ID(desc.class_id),
+			NULL, NULL);
+		UT_ASSERTeq(ret, 0);
+
+		UT_ASSERTeq(pmemobj_type_num(oid), SMALL_TYPE);
+		UT_ASSERTeq(pmemobj_alloc_usable_size(oid), SMALL_UNIT);
+
+		char *p = pmemobj_direct(oid);
+		for (int j = 0; j < SMALL_UNIT; ++j)
+			UT_ASSERTeq(p[j], 0);
+		pmemobj_memset_persist(pop, p, i & 0xff, SMALL_UNIT);
+	}
+
+	/* the type number must match the one of the class */
+	UT_ASSERTeq(pmemobj_xalloc(pop, &oid, SMALL_UNIT, SMALL_TYPE + 1,
+		POBJ_CLASS_ID(desc.class_id), NULL, NULL), -1);
+	UT_ASSERTeq(errno, EINVAL);
+
+	/* objects are exactly one unit */
+	UT_ASSERTeq(pmemobj_xalloc(pop, &oid, SMALL_UNIT * 2, SMALL_TYPE,
+		POBJ_CLASS_ID(desc.class_id), NULL, NULL), -1);
+	UT_ASSERTeq(errno, EINVAL);
+
+	UT_ASSERTeq(pmemobj_xalloc(pop, &oid, SMALL_UNIT, SMALL_TYPE,
+		POBJ_CLASS_ID(desc.class_id), NULL, NULL), 0);
+
+	/* header-less objects cannot be resized */
+	UT_ASSERTeq(pmemobj_realloc(pop, &oid, SMALL_UNIT * 2, SMALL_TYPE),
+		-1);
+	UT_ASSERTeq(errno, ENOTSUP);
+
+	/* but can be snapshotted and freed in a transaction */
+	TX_BEGIN(pop) {
+		pmemobj_tx_add_range(oid, 0, SMALL_UNIT);
+		memset(pmemobj_direct(oid), 0xc, SMALL_UNIT);
+		pmemobj_tx_free(oid);
+	} TX_ONABORT {
+		UT_ASSERT(0);
+	} TX_END
+
+	/* and cannot be allocated transactionally */
+	TX_BEGIN(pop) {
+		pmemobj_tx_xalloc(SMALL_UNIT, SMALL_TYPE,
+			POBJ_CLASS_ID(desc.class_id));
+		UT_ASSERT(0);
+	} TX_ONCOMMIT {
+		UT_ASSERT(0);
+	} TX_END
+	UT_ASSERTeq(errno, EINVAL);
+}
+
+/*
+ * test_free -- frees the objects allocated in the previous incarnation
+ */
+static void
+test_free(PMEMobjpool *pop)
+{
+	int n = 0;
+	int nsmall = 0;
+	PMEMoid oid;
+	PMEMoid next;
+	POBJ_FOREACH_SAFE(pop, oid, next) {
+		if (pmemobj_type_num(oid) == SMALL_TYPE) {
+			UT_ASSERTeq(pmemobj_alloc_usable_size(oid),
+				SMALL_UNIT);
+			nsmall++;
+		} else {
+			UT_ASSERTeq(pmemobj_type_num(oid), 1);
+			UT_ASSERTeq(pmemobj_alloc_usable_size(oid),
+				NODE_SIZE);
+			n++;
+		}
+		pmemobj_free(&oid);
+	}
+
+	UT_ASSERTeq(n, NNODES);
+	UT_ASSERTeq(nsmall, NSMALL);
+}
+
+int
+main(int argc, char *argv[])
+{
+	START(argc, argv, "obj_alloc_class");
+
+	if (argc < 2 || argc > 3 || (argc == 3 && strcmp(argv[2], "o")))
+		UT_FATAL("usage: %s file-name [o]", argv[0]);
+
+	const char *path = argv[1];
+
+	PMEMobjpool *pop;
+
+	/* only check whether the pool can be opened */
+	if (argc == 3) {
+		if ((pop = pmemobj_open(path, LAYOUT_NAME)) == NULL)
+			UT_OUT("!%s: pmemobj_open", path);
+		else
+			pmemobj_close(pop);
+
+		DONE(NULL);
+	}
+
+	if ((pop = pmemobj_create(path, LAYOUT_NAME, PMEMOBJ_MIN_POOL,
+			S_IWUSR | S_IRUSR)) == NULL)
+		UT_FATAL("!pmemobj_create: %s", path);
+
+	PMEMoid nodes[NNODES];
+
+	test_invalid(pop);
+	test_alloc(pop, nodes);
+	test_headerless(pop);
+
+	pmemobj_close(pop);
+
+	if ((pop = pmemobj_open(path, LAYOUT_NAME)) == NULL)
+		UT_FATAL("!pmemobj_open: %s", path);
+
+	test_free(pop);
+
+	pmemobj_close(pop);
+
+	DONE(NULL);
+}
@@ -135,6 +135,12 @@ test_ctree_find()
 	k = TEST_VAL_B;
 	UT_ASSERT(ctree_find_le(t, &k) == TEST_VAL_B);
 
+	/* update existing and missing keys */
+	UT_ASSERT(ctree_update_unlocked(t, TEST_VAL_A, TEST_VAL_C) == 0);
+	k = TEST_VAL_A;
+	UT_ASSERT(ctree_find_le(t, &k) == TEST_VAL_C);
+	UT_ASSERT(ctree_update_unlocked(t, TEST_VAL_C, TEST_VAL_C) == ENOENT);
+
 	ctree_delete(t);
 }
 
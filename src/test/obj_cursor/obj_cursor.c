@@ -0,0 +1,310 @@
+/*
+ * Copyright 2016, Intel Corporation
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in
+ *       the documentation and/or other materials provided with the
+ *       distribution.
+ *
+ *     * Neither the name of the copyright holder nor the names of its
+ *       contributors may be used to endorse or promote products derived
+ *       from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * obj_cursor.c -- unit test for pmemobj_cursor_new, pmemobj_cursor_next and
+ *	pmemobj_cursor_delete
+ */
+#include <stdlib.h>
+
+#include "unittest.h"
+
+#define LAYOUT_NAME "obj_cursor"
+
+#define POOL_SIZE (64 * 1024 * 1024)
+#define NTYPES 3
+#define NSMALL 20000
+#define NHUGE 16
+#define HUGE_SIZE (300 * 1024)
+#define HEADERLESS_UNIT 32
+#define HEADERLESS_TYPE 7
+#define NHEADERLESS 5000
+#define NMODIFIED 64
+#define MAX_OBJECTS (NSMALL + NHUGE + NHEADERLESS + NMODIFIED)
+#define MAX_PARTS 8
+
+struct objects {
+	uint64_t off[MAX_OBJECTS];
+	unsigned n;
+};
+
+/*
+ * cmp_off -- compares two offsets for qsort
+ */
+static int
+cmp_off(const void *a, const void *b)
+{
+	uint64_t l = *(const uint64_t *)a;
+	uint64_t r = *(const uint64_t *)b;
+
+	return l < r ? -1 : l > r;
+}
+
+/*
+ * fill_pool -- allocates objects of different sizes, types and classes and
+ *	frees some of them
+ */
+static void
+fill_pool(PMEMobjpool *pop)
+{
+	PMEMoid oid;
+	for (int i = 0; i < NSMALL; ++i) {
+		size_t size = 16 + (size_t)(i % 37) * 24;
+		UT_ASSERTeq(pmemobj_alloc(pop, &oid, size,
+			(uint64_t)(i % NTYPES), NULL, NULL), 0);
+		if (i % 5 == 0)
+			pmemobj_free(&oid);
+	}
+
+	for (int i = 0; i < NHUGE; ++i) {
+		size_t size = HUGE_SIZE * (size_t)(i + 1);
+		UT_ASSERTeq(pmemobj_alloc(pop, &oid, size,
+			(uint64_t)(i % NTYPES), NULL, NULL), 0);
+		if (i % 3 == 0)
+			pmemobj_free(&oid);
+	}
+
+	struct pobj_alloc_class_desc desc = {HEADERLESS_UNIT, 0, 0,
+		POBJ_HEADER_NONE, HEADERLESS_TYPE, 0};
+	UT_ASSERTeq(pmemobj_alloc_class_new(pop, &desc), 0);
+
+	for (int i = 0; i < NHEADERLESS; ++i) {
+		UT_ASSERTeq(pmemobj_xalloc(pop, &oid, HEADERLESS_UNIT,
+			HEADERLESS_TYPE, POBJ_CLASS_ID(desc.class_id),
+			NULL, NULL), 0);
+		if (i % 7 == 0)
+			pmemobj_free(&oid);
+	}
+}
+
+/*
+ * collect_foreach -- collects the objects of the given type with
+ *	POBJ_FOREACH, which is the reference iteration
+ */
+static void
+collect_foreach(PMEMobjpool *pop, uint64_t type_num, struct objects *objs)
+{
+	objs->n = 0;
+
+	PMEMoid oid;
+	POBJ_FOREACH(pop, oid) {
+		if (type_num != POBJ_CURSOR_ANY_TYPE &&
+			pmemobj_type_num(oid) != type_num)
+			continue;
+
+		UT_ASSERT(objs->n < MAX_OBJECTS);
+		objs->off[objs->n++] = oid.off;
+	}
+}
+
+struct scan_args {
+	PMEMobjpool *pop;
+	uint64_t type_num;
+	unsigned part;
+	unsigned nparts;
+	struct objects objs;
+};
+
+/*
+ * scan_part -- collects the objects of a single part of the pool
+ */
+static void *
+scan_part(void *arg)
+{
+	struct scan_args *a = arg;
+	a->objs.n = 0;
+
+	struct pobj_cursor *c = pmemobj_cursor_new(a->pop, a->type_num,
+		a->part, a->nparts);
+	UT_ASSERTne(c, NULL);
+
+	PMEMoid oid;
+	while (!OID_IS_NULL(oid = pmemobj_cursor_next(c))) {
+		if (a->type_num != POBJ_CURSOR_ANY_TYPE)
+			UT_ASSERTeq(pmemobj_type_num(oid), a->type_num);
+
+		UT_ASSERT(a->objs.n < MAX_OBJECTS);
+		a->objs.off[a->objs.n++] = oid.off;
+	}
+
+	/* the cursor stays at the end */
+	UT_ASSERT(OID_IS_NULL(pmemobj_cursor_next(c)));
+
+	pmemobj_cursor_delete(c);
+
+	return NULL;
+}
+
+/*
+ * test_scan -- compares the objects found by cursors of all parts, scanned
+ *	in parallel, with the reference iteration
+ */
+static void
+test_scan(PMEMobjpool *pop, uint64_t type_num, unsigned nparts,
+	struct objects *expected, struct scan_args *args)
+{
+	pthread_t threads[MAX_PARTS];
+	for (unsigned i = 0; i < nparts; ++i) {
+		args[i].pop = pop;
+		args[i].type_num = type_num;
+		args[i].part = i;
+		args[i].nparts = nparts;
+		PTHREAD_CREATE(&threads[i], NULL, scan_part, &args[i]);
+	}
+
+	for (unsigned i = 0; i < nparts; ++i)
+		PTHREAD_JOIN(threads[i], NULL);
+
+	static struct objects found;
+	found.n = 0;
+	for (unsigned i = 0; i < nparts; ++i) {
+		memcpy(&found.off[found.n], args[i].objs.off,
+			args[i].objs.n * sizeof(uint64_t));
+		found.n += args[i].objs.n;
+	}
+
+	/* every object is visited exactly once */
+	UT_ASSERTeq(found.n, expected->n);
+	qsort(found.off, found.n, sizeof(uint64_t), cmp_off);
+	qsort(expected->off, expected->n, sizeof(uint64_t), cmp_off);
+	UT_ASSERTeq(memcmp(found.off, expected->off,
+		found.n * sizeof(uint64_t)), 0);
+}
+
+/*
+ * test_all_scans -- compares the cursors of all of the tested types and
+ *	numbers of parts with the reference iteration
+ */
+static void
+test_all_scans(PMEMobjpool *pop, struct objects *expected,
+	struct scan_args *args)
+{
+	uint64_t types[] = {POBJ_CURSOR_ANY_TYPE, 1, 2, HEADERLESS_TYPE,
+		100};
+	unsigned nparts[] = {1, 2, 3, MAX_PARTS};
+
+	for (unsigned t = 0; t < sizeof(types) / sizeof(types[0]); ++t) {
+		collect_foreach(pop, types[t], expected);
+
+		for (unsigned p = 0; p < sizeof(nparts) / sizeof(nparts[0]);
+				++p)
+			test_scan(pop, types[t], nparts[p], expected, args);
+	}
+}
+
+/*
+ * modify_pool -- allocates, reallocates and frees objects of the indexed
+ *	pool
+ */
+static void
+modify_pool(PMEMobjpool *pop)
+{
+	struct objects objs;
+	collect_foreach(pop, 1, &objs);
+
+	/* moves every third object to another type */
+	for (unsigned i = 0; i < objs.n; i += 3) {
+		PMEMoid oid = pmemobj_oid((char *)pop + objs.off[i]);
+		UT_ASSERTeq(pmemobj_realloc(pop, &oid, 2048, 2), 0);
+	}
+
+	PMEMoid oids[NMODIFIED];
+	size_t sizes[NMODIFIED];
+	for (int i = 0; i < NMODIFIED; ++i)
+		sizes[i] = 64;
+	UT_ASSERTeq(pmemobj_alloc_batch(pop, oids, sizes, NMODIFIED, 1, 0, NULL,
+		NULL), 0);
+	pmemobj_free_batch(oids, NMODIFIED / 2);
+
+	TX_BEGIN(pop) {
+		pmemobj_tx_alloc(128, 1);
+		pmemobj_tx_free(oids[NMODIFIED - 1]);
+	} TX_END
+
+	TX_BEGIN(pop) {
+		pmemobj_tx_alloc(128, 1);
+		pmemobj_tx_free(oids[NMODIFIED - 2]);
+		pmemobj_tx_abort(ECANCELED);
+	} TX_END
+}
+
+int
+main(int argc, char *argv[])
+{
+	START(argc, argv, "obj_cursor");
+
+	if (argc != 2)
+		UT_FATAL("usage: %s file-name", argv[0]);
+
+	const char *path = argv[1];
+
+	PMEMobjpool *pop;
+	if ((pop = pmemobj_create(path, LAYOUT_NAME, POOL_SIZE,
+			S_IWUSR | S_IRUSR)) == NULL)
+		UT_FATAL("!pmemobj_create: %s", path);
+
+	/* an empty pool */
+	struct pobj_cursor *c = pmemobj_cursor_new(pop,
+		POBJ_CURSOR_ANY_TYPE, 0, 1);
+	UT_ASSERTne(c, NULL);
+	UT_ASSERT(OID_IS_NULL(pmemobj_cursor_next(c)));
+	pmemobj_cursor_delete(c);
+
+	/* invalid parts */
+	UT_ASSERTeq(pmemobj_cursor_new(pop, POBJ_CURSOR_ANY_TYPE, 0, 0), NULL);
+	UT_ASSERTeq(errno, EINVAL);
+	UT_ASSERTeq(pmemobj_cursor_new(pop, POBJ_CURSOR_ANY_TYPE, 2, 2), NULL);
+	UT_ASSERTeq(errno, EINVAL);
+
+	fill_pool(pop);
+
+	struct objects *expected = MALLOC(sizeof(*expected));
+	struct scan_args *args = MALLOC(sizeof(*args) * MAX_PARTS);
+
+	test_all_scans(pop, expected, args);
+
+	/* the index is built by the first typed cursor */
+	UT_ASSERTeq(pmemobj_type_index_enable(pop), 0);
+	UT_ASSERTeq(pmemobj_type_index_enable(pop), 0);
+	test_all_scans(pop, expected, args);
+
+	/* and maintained by all allocations and frees */
+	modify_pool(pop);
+	test_all_scans(pop, expected, args);
+
+	FREE(args);
+	FREE(expected);
+
+	pmemobj_close(pop);
+
+	DONE(NULL);
+}
@@ -60,6 +60,41 @@ struct mock_pop {
 
 static int construct_fail;
 
+/*
+ * Mocked NUMA topology, the real one is used while Mock_nnodes is 0
+ */
+static unsigned Mock_nnodes;
+static unsigned Mock_ncpus[MAX_MOCK_LANES];
+static unsigned Mock_node;
+
+FUNC_MOCK(util_numa_nnodes, unsigned, void)
+	FUNC_MOCK_RUN_DEFAULT {
+		if (Mock_nnodes == 0)
+			return _FUNC_REAL(util_numa_nnodes)();
+
+		return Mock_nnodes;
+	}
+FUNC_MOCK_END
+
+FUNC_MOCK(util_numa_ncpus, unsigned, unsigned node)
+	FUNC_MOCK_RUN_DEFAULT {
+		if (Mock_nnodes == 0)
+			return _FUNC_REAL(util_numa_ncpus)(node);
+
+		UT_ASSERT(node < Mock_nnodes);
+		return Mock_ncpus[node];
+	}
+FUNC_MOCK_END
+
+FUNC_MOCK(util_numa_node, unsigned, void)
+	FUNC_MOCK_RUN_DEFAULT {
+		if (Mock_nnodes == 0)
+			return _FUNC_REAL(util_numa_node)();
+
+		return Mock_node;
+	}
+FUNC_MOCK_END
+
 static void *
 lane_noop_construct_rt(PMEMobjpool *pop)
 {
@@ -226,17 +261,26 @@ test_lane_hold_release()
 		}
 	};
 
+	struct lane_node mock_node = {
+		.first = 0,
+		.nlanes = 1,
+		.next_lane_idx = 0
+	};
+
 	struct mock_pop pop = {
 		.p = {
 			.nlanes = 1,
 			.lanes_desc = {
 					.runtime_nlanes = 1,
 					.lane = &mock_lane,
-					.next_lane_idx = 0
+					.nnodes = 1,
+					.nodes = &mock_node
 			}
 		}
 	};
 	pop.p.lanes_desc.lane_locks = CALLOC(OBJ_NLANES, sizeof(uint64_t));
+	pop.p.lanes_desc.stats = CALLOC(OBJ_NLANES,
+		sizeof(struct lane_stats_line));
 	pop.p.lanes_offset = (uint64_t)&pop.l - (uint64_t)&pop.p;
 	base_ptr = &pop.p;
 
@@ -262,9 +306,100 @@ test_lane_hold_release()
 
 	SIGACTION(SIGABRT, &old, NULL);
 
+	FREE(pop.p.lanes_desc.stats);
 	FREE(pop.p.lanes_desc.lane_locks);
 }
 
+/*
+ * test_lane_nodes -- the lanes are split between the NUMA nodes and the lanes
+ *	of the other nodes are taken if all the local ones are held
+ */
+static void
+test_lane_nodes(void)
+{
+	struct mock_pop pop = {
+		.p = {
+			.nlanes = MAX_MOCK_LANES,
+			.lanes_desc = {
+				.runtime_nlanes = MAX_MOCK_LANES
+			}
+		}
+	};
+	base_ptr = &pop.p;
+
+	pop.p.lanes_offset = (uint64_t)&pop.l - (uint64_t)&pop.p;
+
+	UT_ASSERTeq(lane_boot(&pop.p), 0);
+
+	struct lane_descriptor *desc = &pop.p.lanes_desc;
+	unsigned nlanes = 0;
+	for (unsigned n = 0; n < desc->nnodes; ++n) {
+		UT_ASSERTeq(desc->nodes[n].first, nlanes);
+		nlanes += desc->nodes[n].nlanes;
+	}
+	UT_ASSERTeq(nlanes, MAX_MOCK_LANES);
+
+	UT_ASSERT(lane_hold(&pop.p, NULL, LANE_ID) < MAX_MOCK_LANES);
+	lane_release(&pop.p);
+
+	/* all the other lanes are held, wherever the thread runs */
+	for (unsigned i = 0; i < MAX_MOCK_LANES - 1; ++i)
+		desc->lane_locks[i] = 1;
+
+	UT_ASSERTeq(lane_hold(&pop.p, NULL, LANE_ID), MAX_MOCK_LANES - 1);
+	lane_release(&pop.p);
+
+	for (unsigned i = 0; i < MAX_MOCK_LANES - 1; ++i)
+		desc->lane_locks[i] = 0;
+
+	struct lane_stats stats;
+	lane_get_stats(&pop.p, &stats);
+	UT_ASSERTeq(stats.local_hits + stats.remote_hits, 2);
+
+	lane_cleanup(&pop.p);
+
+	/* two nodes, the second one with three times as many processors */
+	Mock_nnodes = 2;
+	Mock_ncpus[0] = 1;
+	Mock_ncpus[1] = 3;
+	Mock_node = 0;
+
+	UT_ASSERTeq(lane_boot(&pop.p), 0);
+
+	UT_ASSERTeq(desc->nnodes, 2);
+	UT_ASSERTeq(desc->nodes[0].first, 0);
+	UT_ASSERTeq(desc->nodes[0].nlanes, 1);
+	UT_ASSERTeq(desc->nodes[1].first, 1);
+	UT_ASSERTeq(desc->nodes[1].nlanes, MAX_MOCK_LANES - 1);
+
+	UT_ASSERTeq(lane_hold(&pop.p, NULL, LANE_ID), 0);
+	lane_release(&pop.p);
+
+	/* the only local lane is held, so one of the other node is stolen */
+	desc->lane_locks[0] = 1;
+	UT_ASSERTeq(lane_hold(&pop.p, NULL, LANE_ID), 1);
+	lane_release(&pop.p);
+	desc->lane_locks[0] = 0;
+
+	/* the thread moved to the second node */
+	Mock_node = 1;
+	UT_ASSERTeq(lane_hold(&pop.p, NULL, LANE_ID), 1);
+	lane_release(&pop.p);
+
+	/* and back to the first one */
+	Mock_node = 0;
+	UT_ASSERTeq(lane_hold(&pop.p, NULL, LANE_ID), 0);
+	lane_release(&pop.p);
+
+	lane_get_stats(&pop.p, &stats);
+	UT_ASSERTeq(stats.local_hits, 3);
+	UT_ASSERTeq(stats.remote_hits, 1);
+
+	lane_cleanup(&pop.p);
+
+	Mock_nnodes = 0;
+}
+
 static void
 test_lane_sizes(void)
 {
@@ -368,6 +503,76 @@ test_lane_cleanup_in_separate_thread(void)
 	UT_ASSERTeq(pop.p.lanes_desc.lane_locks, NULL);
 }
 
+#define CONTENTION_NLANES 2
+#define CONTENTION_NTHREADS 16
+#define CONTENTION_NOPS 10000
+
+static unsigned Lane_users[CONTENTION_NLANES];
+
+/*
+ * test_contention_thread -- holds the lanes in a loop and checks that nobody
+ *	else uses them at the same time
+ */
+static void *
+test_contention_thread(void *arg)
+{
+	PMEMobjpool *pop = arg;
+
+	for (unsigned i = 0; i < CONTENTION_NOPS; ++i) {
+		unsigned idx = lane_hold(pop, NULL, LANE_ID);
+		UT_ASSERT(idx < CONTENTION_NLANES);
+		UT_ASSERTeq(__sync_fetch_and_add(&Lane_users[idx], 1), 0);
+
+		if (i % 16 == 0)
+			sched_yield();
+
+		UT_ASSERTeq(__sync_fetch_and_sub(&Lane_users[idx], 1), 1);
+		lane_release(pop);
+	}
+
+	return NULL;
+}
+
+/*
+ * test_lane_contention -- many more threads than lanes, the threads which
+ *	can't get a lane have to sleep until one is released
+ */
+static void
+test_lane_contention(void)
+{
+	struct mock_pop pop = {
+		.p = {
+			.nlanes = MAX_MOCK_LANES,
+			.lanes_desc = {
+				.runtime_nlanes = CONTENTION_NLANES
+			}
+		}
+	};
+	base_ptr = &pop.p;
+
+	pop.p.lanes_offset = (uint64_t)&pop.l - (uint64_t)&pop.p;
+
+	lane_info_boot();
+	UT_ASSERTeq(lane_boot(&pop.p), 0);
+
+	pthread_t threads[CONTENTION_NTHREADS];
+	for (int i = 0; i < CONTENTION_NTHREADS; ++i)
+		PTHREAD_CREATE(&threads[i], NULL, test_contention_thread,
+			&pop.p);
+
+	for (int i = 0; i < CONTENTION_NTHREADS; ++i)
+		PTHREAD_JOIN(threads[i], NULL);
+
+	UT_ASSERTeq(pop.p.lanes_desc.lane_waiters, 0);
+
+	struct lane_stats stats;
+	lane_get_stats(&pop.p, &stats);
+	UT_ASSERTeq(stats.local_hits + stats.remote_hits,
+		CONTENTION_NTHREADS * CONTENTION_NOPS);
+
+	lane_cleanup(&pop.p);
+}
+
 static void
 usage(const char *app)
 {
@@ -390,12 +595,14 @@ main(int argc, char *argv[])
 		test_lane_recovery_check_ok();
 		test_lane_recovery_check_fail();
 		test_lane_hold_release();
+		test_lane_nodes();
 		test_lane_sizes();
 		break;
 	case 'm':
 		/* multithreaded scenarios */
 		test_lane_info_destroy_in_separate_thread();
 		test_lane_cleanup_in_separate_thread();
+		test_lane_contention();
 		break;
 	default:
 		usage(argv[0]);
@@ -64,10 +64,12 @@
 #define SIZEOF_PVECTOR_V3 (224)
 #define SIZEOF_TX_RANGE_META_V3 (16)
 #define SIZEOF_TX_RANGE_CACHE_V3 (8112)
+#define SIZEOF_TX_UNDO_BUFFER_V3 (16)
+#define SIZEOF_TX_UNDO_BUFFER_ENTRY_V3 (24)
 #define SIZEOF_REDO_LOG_V3 (16)
 #define SIZEOF_LANE_LIST_LAYOUT_V3 (1024 - 8)
-#define SIZEOF_LANE_ALLOC_LAYOUT_V3 (10 * SIZEOF_REDO_LOG_V3)
-#define SIZEOF_LANE_TX_LAYOUT_V3 (8 + (4 * SIZEOF_PVECTOR_V3))
+#define SIZEOF_LANE_ALLOC_LAYOUT_V3 (10 * SIZEOF_REDO_LOG_V3 + 8)
+#define SIZEOF_LANE_TX_LAYOUT_V3 (8 + (4 * SIZEOF_PVECTOR_V3) + 8 + 8)
 
 POBJ_LAYOUT_BEGIN(layout);
 POBJ_LAYOUT_ROOT(layout, struct foo);
@@ -198,6 +200,7 @@ main(int argc, char *argv[])
 
 	ASSERT_ALIGNED_BEGIN(struct lane_alloc_layout);
 	ASSERT_ALIGNED_FIELD(struct lane_alloc_layout, redo);
+	ASSERT_ALIGNED_FIELD(struct lane_alloc_layout, redo_ext);
 	ASSERT_ALIGNED_CHECK(struct lane_alloc_layout);
 	UT_COMPILE_ERROR_ON(sizeof(struct lane_alloc_layout) >
 		sizeof(struct lane_section_layout));
@@ -207,6 +210,8 @@ main(int argc, char *argv[])
 	ASSERT_ALIGNED_BEGIN(struct lane_tx_layout);
 	ASSERT_ALIGNED_FIELD(struct lane_tx_layout, state);
 	ASSERT_ALIGNED_FIELD(struct lane_tx_layout, undo_log);
+	ASSERT_ALIGNED_FIELD(struct lane_tx_layout, redo_log);
+	ASSERT_ALIGNED_FIELD(struct lane_tx_layout, undo_buffer);
 	ASSERT_ALIGNED_CHECK(struct lane_tx_layout);
 	UT_COMPILE_ERROR_ON(sizeof(struct lane_tx_layout) >
 		sizeof(struct lane_section_layout));
@@ -245,5 +250,20 @@ main(int argc, char *argv[])
 	UT_COMPILE_ERROR_ON(sizeof(struct tx_range_cache) !=
 		SIZEOF_TX_RANGE_CACHE_V3);
 
+	ASSERT_ALIGNED_BEGIN(struct tx_undo_buffer);
+	ASSERT_ALIGNED_FIELD(struct tx_undo_buffer, generation);
+	ASSERT_ALIGNED_FIELD(struct tx_undo_buffer, unused);
+	ASSERT_ALIGNED_CHECK(struct tx_undo_buffer);
+	UT_COMPILE_ERROR_ON(sizeof(struct tx_undo_buffer) !=
+		SIZEOF_TX_UNDO_BUFFER_V3);
+
+	ASSERT_ALIGNED_BEGIN(struct tx_undo_buffer_entry);
+	ASSERT_ALIGNED_FIELD(struct tx_undo_buffer_entry, generation);
+	ASSERT_ALIGNED_FIELD(struct tx_undo_buffer_entry, offset);
+	ASSERT_ALIGNED_FIELD(struct tx_undo_buffer_entry, size);
+	ASSERT_ALIGNED_CHECK(struct tx_undo_buffer_entry);
+	UT_COMPILE_ERROR_ON(sizeof(struct tx_undo_buffer_entry) !=
+		SIZEOF_TX_UNDO_BUFFER_ENTRY_V3);
+
 	DONE(NULL);
 }
@@ -97,7 +97,7 @@ FUNC_MOCK_END
  * Prints the id of allocated struct oob_item for tracking purposes.
  */
 FUNC_MOCK(pmalloc_construct, int, PMEMobjpool *pop, uint64_t *off,
-	size_t size, palloc_constr constructor, void *arg)
+	size_t size, palloc_constr constructor, void *arg, uint16_t class_id)
 	FUNC_MOCK_RUN_DEFAULT {
 		struct pmem_ops *p_ops = &Pop->p_ops;
 		size = 2 * (size - OOB_OFF) + OOB_OFF;
@@ -46,6 +46,7 @@
 #ifndef WRAP_REAL
 #define pmem_persist __wrap_pmem_persist
 #define pmem_flush __wrap_pmem_flush
+#define pmem_flushv __wrap_pmem_flushv
 #define pmem_drain __wrap_pmem_drain
 #define pmem_msync __wrap_pmem_msync
 #endif
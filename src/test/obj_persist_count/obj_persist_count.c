@@ -43,6 +43,7 @@ static struct {
 	int n_persist;
 	int n_msync;
 	int n_flush;
+	int n_flushv;
 	int n_drain;
 } ops_counter;
 
@@ -67,6 +68,13 @@ FUNC_MOCK(pmem_flush, void, const void *addr, size_t len)
 	}
 FUNC_MOCK_END
 
+FUNC_MOCK(pmem_flushv, void, const struct iovec *iov, int iovcnt)
+	FUNC_MOCK_RUN_DEFAULT {
+		ops_counter.n_flushv++;
+		_FUNC_REAL(pmem_flushv)(iov, iovcnt);
+	}
+FUNC_MOCK_END
+
 FUNC_MOCK(pmem_drain, void, void)
 	FUNC_MOCK_RUN_DEFAULT {
 		ops_counter.n_drain++;
@@ -90,9 +98,10 @@ reset_counters(void)
 static void
 print_reset_counters(const char *task)
 {
-	UT_OUT("%d\t;%d\t;%d\t;%d\t;%s",
+	UT_OUT("%d\t;%d\t;%d\t;%d\t;%d\t;%s",
 		ops_counter.n_persist, ops_counter.n_msync,
-		ops_counter.n_flush, ops_counter.n_drain, task);
+		ops_counter.n_flush, ops_counter.n_flushv,
+		ops_counter.n_drain, task);
 
 	reset_counters();
 }
@@ -120,7 +129,7 @@ main(int argc, char *argv[])
 			PMEMOBJ_MIN_POOL, S_IWUSR | S_IRUSR)) == NULL)
 		UT_FATAL("!pmemobj_create: %s", path);
 
-	UT_OUT("persist\t;msync\t;flush\t;drain\t;task");
+	UT_OUT("persist\t;msync\t;flush\t;flushv\t;drain\t;task");
 
 	print_reset_counters("pool_create");
 
@@ -42,6 +42,10 @@
 #define TEST_ALLOC_SIZE (131072 - 64) /* last unit size */
 #define LAYOUT_NAME "oom_mt"
 
+#define TEST_SMALL_ALLOC_SIZE 64
+#define SMALL_ALLOCS 100
+#define SHORT_LIVED_THREADS 64
+
 int allocated;
 PMEMobjpool *pop;
 
@@ -59,6 +63,27 @@ oom_worker(void *arg)
 	return NULL;
 }
 
+/*
+ * small_worker -- allocates and frees small objects, so that the thread exits
+ *	with its allocation magazines full
+ */
+static void *
+small_worker(void *arg)
+{
+	PMEMoid oids[SMALL_ALLOCS];
+
+	for (int i = 0; i < SMALL_ALLOCS; ++i) {
+		int ret = pmemobj_alloc(pop, &oids[i], TEST_SMALL_ALLOC_SIZE,
+				0, NULL, NULL);
+		UT_ASSERTeq(ret, 0);
+	}
+
+	for (int i = 0; i < SMALL_ALLOCS; ++i)
+		pmemobj_free(&oids[i]);
+
+	return NULL;
+}
+
 int
 main(int argc, char *argv[])
 {
@@ -84,6 +109,21 @@ main(int argc, char *argv[])
 
 	UT_ASSERTeq(first_thread_allocated, allocated);
 
+	/*
+	 * The memory blocks cached by the threads that have exited must be
+	 * given back, so that their runs can be reused for large objects.
+	 */
+	pthread_t small[SHORT_LIVED_THREADS];
+	for (int i = 0; i < SHORT_LIVED_THREADS; ++i)
+		pthread_create(&small[i], NULL, small_worker, NULL);
+	for (int i = 0; i < SHORT_LIVED_THREADS; ++i)
+		pthread_join(small[i], NULL);
+
+	pthread_create(&t, NULL, oom_worker, NULL);
+	pthread_join(t, NULL);
+
+	UT_ASSERTeq(first_thread_allocated, allocated);
+
 	pmemobj_close(pop);
 
 	DONE(NULL);
@@ -39,6 +39,34 @@
 #define LAYOUT_NAME "pool_lookup"
 
 #define ALLOC_SIZE 100
+#define NTHREADS 4
+
+/*
+ * arguments of the threads looking up the last pool, while the other ones
+ * are being closed
+ */
+struct lookup_args {
+	PMEMobjpool *pop;
+	void *middle;
+	volatile int stop;
+};
+
+/*
+ * lookup_worker -- looks up the same pool until it's stopped
+ */
+static void *
+lookup_worker(void *arg)
+{
+	struct lookup_args *a = arg;
+
+	while (!a->stop) {
+		UT_ASSERTeq(pmemobj_pool_by_ptr(a->middle), a->pop);
+		UT_ASSERTeq(pmemobj_oid(a->middle).pool_uuid_lo,
+			pmemobj_oid(a->pop).pool_uuid_lo);
+	}
+
+	return NULL;
+}
 
 int
 main(int argc, char *argv[])
@@ -101,7 +129,22 @@ main(int argc, char *argv[])
 	UT_ASSERTeq(pmemobj_pool_by_ptr(NULL), NULL);
 	UT_ASSERTeq(pmemobj_pool_by_ptr((void *)0xCBA), NULL);
 
+	struct lookup_args args;
+	args.pop = pops[npools - 1];
+	args.middle = (char *)args.pop + (PMEMOBJ_MIN_POOL / 2);
+	args.stop = 0;
+
+	pthread_t threads[NTHREADS];
+	for (int t = 0; t < NTHREADS; ++t)
+		PTHREAD_CREATE(&threads[t], NULL, lookup_worker, &args);
+
 	for (int i = 0; i < npools; ++i) {
+		if (i == npools - 1) {
+			args.stop = 1;
+			for (int t = 0; t < NTHREADS; ++t)
+				PTHREAD_JOIN(threads[t], NULL);
+		}
+
 		void *before_pool = (char *)pops[i] - 1;
 		void *after_pool = (char *)pops[i] + PMEMOBJ_MIN_POOL + 1;
 		void *edge = (char *)pops[i] + PMEMOBJ_MIN_POOL;
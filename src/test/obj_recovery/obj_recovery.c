@@ -44,13 +44,49 @@ struct foo {
 	int bar;
 };
 
+#define NTHREADS 32
+
 struct root {
 	PMEMmutex lock;
 	TOID(struct foo) foo;
+	TOID(struct foo) foos[NTHREADS];
 };
 
 #define BAR_VALUE 5
 
+static PMEMobjpool *Pop;
+static unsigned Nstarted;
+
+/* held by the main thread until the crash */
+static pthread_mutex_t Crash_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/*
+ * crash_worker -- (internal) modifies an object in a transaction which
+ *	never finishes
+ */
+static void *
+crash_worker(void *arg)
+{
+	unsigned i = (unsigned)(uintptr_t)arg;
+	TOID(struct root) root = POBJ_ROOT(Pop, struct root);
+
+	TX_BEGIN(Pop) {
+		TX_ADD_FIELD(root, foos[i]);
+		TX_FREE(D_RW(root)->foos[i]);
+
+		TOID(struct foo) f = TX_NEW(struct foo);
+		D_RW(f)->bar = BAR_VALUE * 2;
+		D_RW(root)->foos[i] = f;
+
+		__sync_fetch_and_add(&Nstarted, 1);
+
+		/* wait for the crash */
+		pthread_mutex_lock(&Crash_lock);
+	} TX_END
+
+	return NULL;
+}
+
 int
 main(int argc, char *argv[])
 {
@@ -61,14 +97,14 @@ main(int argc, char *argv[])
 
 	if (argc != 5)
 		UT_FATAL("usage: %s [file] [lock: y/n] "
-			"[cmd: c/o] [type: n/f/s]",
+			"[cmd: c/o] [type: n/f/s/m]",
 			argv[0]);
 
 	const char *path = argv[1];
 
 	PMEMobjpool *pop = NULL;
 	int exists = argv[3][0] == 'o';
-	enum { TEST_NEW, TEST_FREE, TEST_SET } type;
+	enum { TEST_NEW, TEST_FREE, TEST_SET, TEST_MT } type;
 
 	if (argv[4][0] == 'n')
 		type = TEST_NEW;
@@ -76,6 +112,8 @@ main(int argc, char *argv[])
 		type = TEST_FREE;
 	else if (argv[4][0] == 's')
 		type = TEST_SET;
+	else if (argv[4][0] == 'm')
+		type = TEST_MT;
 	else
 		UT_FATAL("invalid type");
 
@@ -132,6 +170,35 @@ main(int argc, char *argv[])
 		} else {
 			UT_ASSERT(TOID_IS_NULL(D_RW(root)->foo));
 		}
+	} else if (type == TEST_MT) {
+		if (!exists) {
+			TX_BEGIN(pop) {
+				TX_ADD(root);
+
+				for (int i = 0; i < NTHREADS; ++i) {
+					TOID(struct foo) f = TX_NEW(struct foo);
+					D_RW(f)->bar = BAR_VALUE;
+					D_RW(root)->foos[i] = f;
+				}
+			} TX_END
+
+			/* each thread holds a different lane */
+			Pop = pop;
+			pthread_mutex_lock(&Crash_lock);
+			pthread_t threads[NTHREADS];
+			for (unsigned i = 0; i < NTHREADS; ++i)
+				PTHREAD_CREATE(&threads[i], NULL, crash_worker,
+					(void *)(uintptr_t)i);
+
+			while (__sync_fetch_and_add(&Nstarted, 0) != NTHREADS)
+				sched_yield();
+
+			exit(0); /* simulate a crash */
+		} else {
+			for (int i = 0; i < NTHREADS; ++i)
+				UT_ASSERTeq(D_RO(D_RO(root)->foos[i])->bar,
+					BAR_VALUE);
+		}
 	} else { /* TEST_FREE */
 		if (!exists) {
 			TX_BEGIN_PARAM(pop, lock_type, lock) {
@@ -33,7 +33,7 @@
 /*
  * obj_redo_log.c -- unit test for redo log
  *
- * usage: obj_redo_log <redo_log_size> [sfrePR][:offset[:value]]
+ * usage: obj_redo_log <redo_log_size> [sfFrePRCXcL][:offset[:value]]
  *
  * s:<index>:<offset>:<value> - store <value> at <offset>
  * f:<index>:<offset>:<value> - store last <value> at <offset>
@@ -43,6 +43,11 @@
  * P                          - process redo log
  * R                          - recovery
  * C                          - check  consistency of redo log
+ * X:<nentries>:<offset>:<ext_nentries> - start storing the redo log in
+ *                              <nentries> entries, which continues in the
+ *                              extension of <ext_nentries> at <offset>
+ * c:<offset>:<value>         - store <value> at <offset> in the next entry
+ * L                          - set the last entry stored with 'c' as the last
  *
  * <offset> and <value> must be in hex
  * <index> must be in dec
@@ -63,7 +68,7 @@
 #include "unittest.h"
 
 #define FATAL_USAGE()	UT_FATAL("usage: obj_redo_log <fname> <redo_log_size> "\
-		"[sfFrePRC][<index>:<offset>:<value>]\n")
+		"[sfFrePRCXcL][<index>:<offset>:<value>]\n")
 
 #define PMEMOBJ_POOL_HDR_SIZE	8192
 
@@ -188,11 +193,15 @@ main(int argc, char *argv[])
 	struct redo_log *redo =
 		(struct redo_log *)((char *)pop->addr + PMEMOBJ_POOL_HDR_SIZE);
 
+	struct redo_log_cursor cur;
+	redo_log_cursor_init(&cur, redo, redo_cnt, 0);
+
 	uint64_t offset;
 	uint64_t value;
 	int i;
 	int ret;
 	size_t index;
+	size_t nentries;
 	for (i = 3; i < argc; i++) {
 		char *arg = argv[i];
 		UT_ASSERTne(arg, NULL);
@@ -256,6 +265,29 @@ main(int argc, char *argv[])
 		case 'n':
 			UT_OUT("n:%ld", redo_log_nflags(redo, redo_cnt));
 			break;
+		case 'X':
+			if (sscanf(arg, "X:%zd:0x%zx:%zd",
+					&index, &offset, &nentries) != 3)
+				FATAL_USAGE();
+			UT_OUT("X:%ld:0x%08lx:%ld", index, offset, nentries);
+
+			struct redo_log_ext *ext = (struct redo_log_ext *)
+				((uintptr_t)pop->addr + offset);
+			ext->nentries = nentries;
+			pmemops_persist(&pop->p_ops, ext, sizeof(*ext));
+
+			redo_log_cursor_init(&cur, redo, index, offset);
+			break;
+		case 'c':
+			if (sscanf(arg, "c:0x%zx:0x%zx", &offset, &value) != 2)
+				FATAL_USAGE();
+			UT_OUT("c:0x%08lx:0x%08lx", offset, value);
+			redo_log_cursor_store(pop->redo, &cur, offset, value);
+			break;
+		case 'L':
+			redo_log_cursor_set_last(pop->redo, &cur);
+			UT_OUT("L");
+			break;
 		default:
 			FATAL_USAGE();
 		}
@@ -48,7 +48,8 @@
 #define NANO_PER_ONE 1000000000LL
 #define TIMEOUT (NANO_PER_ONE / 1000LL)
 
-#define FATAL_USAGE() UT_FATAL("usage: obj_sync [mrc] <num_threads> <runs>\n")
+#define FATAL_USAGE()\
+	UT_FATAL("usage: obj_sync [mrctsb] <num_threads> <runs>\n")
 
 /* posix thread worker typedef */
 typedef void *(*worker)(void *);
@@ -62,6 +63,8 @@ static struct mock_obj {
 	PMEMmutex mutex_locked;
 	PMEMcond cond;
 	PMEMrwlock rwlock;
+	PMEMspinmutex spinmutex;
+	PMEMbiasrwlock biasrwlock;
 	int check_data;
 	uint8_t data[DATA_SIZE];
 } *Test_obj;
@@ -220,6 +223,79 @@ rwlock_check_worker(void *arg)
 	return NULL;
 }
 
+/*
+ * spinmutex_write_worker -- (internal) write data with adaptive mutex
+ */
+static void *
+spinmutex_write_worker(void *arg)
+{
+	if (pmemobj_spinmutex_lock(&Mock_pop, &Test_obj->spinmutex)) {
+		UT_ERR("pmemobj_spinmutex_lock");
+		return NULL;
+	}
+	memset(Test_obj->data, (int)(uintptr_t)arg, DATA_SIZE);
+	if (pmemobj_spinmutex_unlock(&Mock_pop, &Test_obj->spinmutex))
+		UT_ERR("pmemobj_spinmutex_unlock");
+
+	return NULL;
+}
+
+/*
+ * spinmutex_check_worker -- (internal) check consistency with adaptive mutex
+ */
+static void *
+spinmutex_check_worker(void *arg)
+{
+	if (pmemobj_spinmutex_lock(&Mock_pop, &Test_obj->spinmutex)) {
+		UT_ERR("pmemobj_spinmutex_lock");
+		return NULL;
+	}
+	uint8_t val = Test_obj->data[0];
+	for (int i = 1; i < DATA_SIZE; i++)
+		UT_ASSERTeq(Test_obj->data[i], val);
+	if (pmemobj_spinmutex_unlock(&Mock_pop, &Test_obj->spinmutex))
+		UT_ERR("pmemobj_spinmutex_unlock");
+
+	return NULL;
+}
+
+/*
+ * biasrwlock_write_worker -- (internal) write data with reader-biased rwlock
+ */
+static void *
+biasrwlock_write_worker(void *arg)
+{
+	if (pmemobj_biasrwlock_wrlock(&Mock_pop, &Test_obj->biasrwlock)) {
+		UT_ERR("pmemobj_biasrwlock_wrlock");
+		return NULL;
+	}
+	memset(Test_obj->data, (int)(uintptr_t)arg, DATA_SIZE);
+	if (pmemobj_biasrwlock_unlock(&Mock_pop, &Test_obj->biasrwlock))
+		UT_ERR("pmemobj_biasrwlock_unlock");
+
+	return NULL;
+}
+
+/*
+ * biasrwlock_check_worker -- (internal) check consistency with reader-biased
+ *	rwlock
+ */
+static void *
+biasrwlock_check_worker(void *arg)
+{
+	if (pmemobj_biasrwlock_rdlock(&Mock_pop, &Test_obj->biasrwlock)) {
+		UT_ERR("pmemobj_biasrwlock_rdlock");
+		return NULL;
+	}
+	uint8_t val = Test_obj->data[0];
+	for (int i = 1; i < DATA_SIZE; i++)
+		UT_ASSERTeq(Test_obj->data[i], val);
+	if (pmemobj_biasrwlock_unlock(&Mock_pop, &Test_obj->biasrwlock))
+		UT_ERR("pmemobj_biasrwlock_unlock");
+
+	return NULL;
+}
+
 /*
  * timed_write_worker -- (internal) intentionally doing nothing
  */
@@ -315,6 +391,14 @@ cleanup(char test_type)
 			pthread_mutex_destroy(&((PMEMmutex_internal *)
 				&(Test_obj->mutex))->pmemmutex.mutex);
 			break;
+		case 's':
+			pthread_mutex_destroy(&((PMEMspinmutex_internal *)
+				&(Test_obj->spinmutex))->
+				pmemspinmutex.spinmutex.mutex);
+			break;
+		case 'b':
+			/* nothing to release */
+			break;
 		default:
 			FATAL_USAGE();
 	}
@@ -357,6 +441,14 @@ main(int argc, char *argv[])
 			writer = timed_write_worker;
 			checker = timed_check_worker;
 			break;
+		case 's':
+			writer = spinmutex_write_worker;
+			checker = spinmutex_check_worker;
+			break;
+		case 'b':
+			writer = biasrwlock_write_worker;
+			checker = biasrwlock_check_worker;
+			break;
 		default:
 			FATAL_USAGE();
 
@@ -383,6 +475,8 @@ main(int argc, char *argv[])
 	pmemobj_mutex_zero(&Mock_pop, &Test_obj->mutex_locked);
 	pmemobj_cond_zero(&Mock_pop, &Test_obj->cond);
 	pmemobj_rwlock_zero(&Mock_pop, &Test_obj->rwlock);
+	pmemobj_spinmutex_zero(&Mock_pop, &Test_obj->spinmutex);
+	pmemobj_biasrwlock_zero(&Mock_pop, &Test_obj->biasrwlock);
 	Test_obj->check_data = 0;
 	memset(&Test_obj->data, 0, DATA_SIZE);
 
@@ -49,6 +49,7 @@
 	(((MAX_CACHED_RANGE_SIZE + 16) * MAX_CACHED_RANGES) / sizeof(int))
 
 #define REOPEN_COUNT	10
+#define REUSE_COUNT	10
 
 enum type_number {
 	TYPE_OBJ,
@@ -547,6 +548,122 @@ do_tx_add_range_overlapping(PMEMobjpool *pop)
 	UT_ASSERT(util_is_zeroed(D_RO(obj)->data, OVERLAP_SIZE));
 }
 
+/*
+ * do_tx_add_range_adjacent -- call pmemobj_tx_add_range with adjacent ranges
+ */
+static void
+do_tx_add_range_adjacent(PMEMobjpool *pop)
+{
+	TOID(struct overlap_object) obj;
+	TOID_ASSIGN(obj, do_tx_zalloc(pop, 1));
+
+	/*
+	 * +-------
+	 * -+------
+	 * ...
+	 * ++++++++
+	 */
+	TX_BEGIN(pop) {
+		for (int i = 0; i < OVERLAP_SIZE; ++i) {
+			pmemobj_tx_add_range(obj.oid, (uint64_t)i, 1);
+			D_RW(obj)->data[i] = (uint8_t)(i + 1);
+		}
+
+		/* the whole range is already covered */
+		TX_ADD(obj);
+		memset(D_RW(obj)->data, 0xFF, OVERLAP_SIZE);
+
+		pmemobj_tx_abort(-1);
+	} TX_ONCOMMIT {
+		UT_ASSERT(0);
+	} TX_END
+
+	UT_ASSERT(util_is_zeroed(D_RO(obj)->data, OVERLAP_SIZE));
+
+	/*
+	 * ----++++
+	 * ++++----
+	 */
+	TX_BEGIN(pop) {
+		pmemobj_tx_add_range(obj.oid, 4, 4);
+		memset(D_RW(obj)->data + 4, 1, 4);
+
+		pmemobj_tx_add_range(obj.oid, 0, 4);
+		memset(D_RW(obj)->data, 2, 4);
+
+		pmemobj_tx_add_range(obj.oid, 0, 8);
+		memset(D_RW(obj)->data, 3, 8);
+	} TX_ONABORT {
+		UT_ASSERT(0);
+	} TX_END
+
+	for (int i = 0; i < 8; ++i)
+		UT_ASSERTeq(D_RO(obj)->data[i], 3);
+
+	TX_BEGIN(pop) {
+		for (int i = 0; i < OVERLAP_SIZE; ++i) {
+			pmemobj_tx_add_range(obj.oid, (uint64_t)i, 1);
+			D_RW(obj)->data[i] = (uint8_t)i;
+		}
+	} TX_ONABORT {
+		UT_ASSERT(0);
+	} TX_END
+
+	for (int i = 0; i < OVERLAP_SIZE; ++i)
+		UT_ASSERTeq(D_RO(obj)->data[i], i);
+}
+
+/*
+ * do_tx_add_range_reuse -- call pmemobj_tx_add_range with large ranges in
+ * many consecutive transactions
+ */
+static void
+do_tx_add_range_reuse(PMEMobjpool *pop)
+{
+	TOID(struct object) obj1;
+	TOID(struct object) obj2;
+	TOID_ASSIGN(obj1, do_tx_zalloc(pop, TYPE_OBJ));
+	TOID_ASSIGN(obj2, do_tx_zalloc(pop, TYPE_OBJ));
+
+	for (int i = 0; i < REUSE_COUNT; i++) {
+		TX_BEGIN(pop) {
+			TX_ADD(obj1);
+			D_RW(obj1)->value = TEST_VALUE_1;
+			pmemobj_memset_persist(pop, D_RW(obj1)->data, 0xFF,
+				DATA_SIZE);
+
+			TX_ADD_FIELD(obj2, data);
+			pmemobj_memset_persist(pop, D_RW(obj2)->data, 0xFF,
+				DATA_SIZE);
+
+			pmemobj_tx_abort(-1);
+		} TX_ONCOMMIT {
+			UT_ASSERT(0);
+		} TX_END
+
+		UT_ASSERTeq(D_RO(obj1)->value, (size_t)i);
+		UT_ASSERTeq(D_RO(obj1)->data[DATA_SIZE - 1], (char)i);
+		UT_ASSERTeq(D_RO(obj2)->data[0], (char)i);
+
+		TX_BEGIN(pop) {
+			TX_ADD(obj1);
+			D_RW(obj1)->value = (size_t)i + 1;
+			pmemobj_memset_persist(pop, D_RW(obj1)->data, i + 1,
+				DATA_SIZE);
+
+			TX_ADD_FIELD(obj2, data);
+			pmemobj_memset_persist(pop, D_RW(obj2)->data, i + 1,
+				DATA_SIZE);
+		} TX_ONABORT {
+			UT_ASSERT(0);
+		} TX_END
+
+		UT_ASSERTeq(D_RO(obj1)->value, (size_t)i + 1);
+		UT_ASSERTeq(D_RO(obj1)->data[0], (char)(i + 1));
+		UT_ASSERTeq(D_RO(obj2)->data[DATA_SIZE - 1], (char)(i + 1));
+	}
+}
+
 /*
  * do_tx_add_range_reopen -- check for persistent memory leak in undo log set
  */
@@ -633,6 +750,10 @@ main(int argc, char *argv[])
 		VALGRIND_WRITE_STATS;
 		do_tx_add_range_overlapping(pop);
 		VALGRIND_WRITE_STATS;
+		do_tx_add_range_adjacent(pop);
+		VALGRIND_WRITE_STATS;
+		do_tx_add_range_reuse(pop);
+		VALGRIND_WRITE_STATS;
 		do_tx_add_range_too_large(pop);
 		VALGRIND_WRITE_STATS;
 		do_tx_xadd_range_commit(pop);
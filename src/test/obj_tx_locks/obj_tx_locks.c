@@ -38,6 +38,8 @@
 #define LAYOUT_NAME "direct"
 
 #define NUM_LOCKS 2
+#define NUM_MANY_LOCKS 40
+#define NUM_ORDER_ITERATIONS 100
 #define NUM_THREADS 10
 #define TEST_VALUE_A 5
 #define TEST_VALUE_B 10
@@ -53,10 +55,16 @@
 		&(mutexes)[0], TX_LOCK_MUTEX, &(mutexes)[1], TX_LOCK_RWLOCK,\
 		&(rwlocks)[0], TX_LOCK_RWLOCK, &(rwlocks)[1], TX_LOCK_NONE)
 
+#define BEGIN_TX_REVERSED(pop, mutexes, rwlocks)\
+		TX_BEGIN_PARAM((pop), TX_PARAM_RWLOCK,\
+		&(rwlocks)[1], TX_PARAM_RWLOCK, &(rwlocks)[0], TX_PARAM_MUTEX,\
+		&(mutexes)[1], TX_PARAM_MUTEX, &(mutexes)[0], TX_PARAM_NONE)
+
 static struct transaction_data {
 	PMEMobjpool *pop;
 	PMEMmutex *mutexes;
 	PMEMrwlock *rwlocks;
+	PMEMmutex *many_mutexes;
 	int a;
 	int b;
 	int c;
@@ -195,6 +203,78 @@ do_aborted_nested_tx(void *arg)
 	return NULL;
 }
 
+/*
+ * do_many_locks_tx -- (internal) thread-friendly transaction which takes
+ *	more locks than fit in the lane, some of them more than once
+ */
+static void *
+do_many_locks_tx(void *arg)
+{
+	struct transaction_data *data = arg;
+
+	TX_BEGIN(data->pop) {
+		for (int i = 0; i < NUM_MANY_LOCKS; ++i)
+			UT_ASSERTeq(pmemobj_tx_lock(TX_PARAM_MUTEX,
+				&data->many_mutexes[i]), 0);
+
+		for (int i = NUM_MANY_LOCKS - 1; i >= 0; --i)
+			UT_ASSERTeq(pmemobj_tx_lock(TX_PARAM_MUTEX,
+				&data->many_mutexes[i]), 0);
+
+		TX_BEGIN_PARAM(data->pop, TX_PARAM_MUTEX,
+			&data->many_mutexes[NUM_MANY_LOCKS - 1],
+			TX_PARAM_MUTEX, &data->many_mutexes[0],
+			TX_PARAM_NONE) {
+			data->a = TEST_VALUE_A;
+		} TX_END
+	} TX_ONCOMMIT {
+		data->b = TEST_VALUE_B;
+	} TX_ONABORT { /* not called */
+		UT_ASSERT(0);
+	} TX_FINALLY {
+		data->c = TEST_VALUE_C;
+	} TX_END
+
+	return NULL;
+}
+
+/*
+ * do_ordered_tx -- (internal) thread-friendly transactions which declare
+ *	the same locks in different orders
+ */
+static void *
+do_ordered_tx(void *arg)
+{
+	struct transaction_data *data = arg;
+
+	for (int i = 0; i < NUM_ORDER_ITERATIONS; ++i) {
+		if (i % 2) {
+			BEGIN_TX(data->pop, data->mutexes, data->rwlocks) {
+				data->a = TEST_VALUE_A;
+			} TX_END
+		} else {
+			BEGIN_TX_REVERSED(data->pop, data->mutexes,
+				data->rwlocks) {
+				data->a = TEST_VALUE_A;
+			} TX_END
+		}
+	}
+
+	return NULL;
+}
+
+/*
+ * check_unlocked -- (internal) verifies that none of the locks is held
+ */
+static void
+check_unlocked(PMEMobjpool *pop, PMEMmutex *mutexes, int nmutexes)
+{
+	for (int i = 0; i < nmutexes; ++i) {
+		UT_ASSERTeq(pmemobj_mutex_trylock(pop, &mutexes[i]), 0);
+		UT_ASSERTeq(pmemobj_mutex_unlock(pop, &mutexes[i]), 0);
+	}
+}
+
 static void
 run_mt_test(void *(*worker)(void *), void *arg)
 {
@@ -228,6 +308,7 @@ main(int argc, char *argv[])
 
 	test_obj.mutexes = CALLOC(NUM_LOCKS, sizeof(PMEMmutex));
 	test_obj.rwlocks = CALLOC(NUM_LOCKS, sizeof(PMEMrwlock));
+	test_obj.many_mutexes = CALLOC(NUM_MANY_LOCKS, sizeof(PMEMmutex));
 
 	if (multithread) {
 		run_mt_test(do_tx, &test_obj);
@@ -289,6 +370,31 @@ main(int argc, char *argv[])
 	UT_ASSERT(test_obj.b == TEST_VALUE_B);
 	UT_ASSERT(test_obj.c == TEST_VALUE_C);
 
+	test_obj.a = test_obj.b = test_obj.c = 0;
+	if (multithread) {
+		run_mt_test(do_many_locks_tx, &test_obj);
+	} else {
+		do_many_locks_tx(&test_obj);
+		do_many_locks_tx(&test_obj);
+	}
+
+	UT_ASSERT(test_obj.a == TEST_VALUE_A);
+	UT_ASSERT(test_obj.b == TEST_VALUE_B);
+	UT_ASSERT(test_obj.c == TEST_VALUE_C);
+	check_unlocked(test_obj.pop, test_obj.many_mutexes, NUM_MANY_LOCKS);
+
+	if (multithread) {
+		run_mt_test(do_ordered_tx, &test_obj);
+	} else {
+		do_ordered_tx(&test_obj);
+	}
+
+	check_unlocked(test_obj.pop, test_obj.mutexes, NUM_LOCKS);
+
+	FREE(test_obj.many_mutexes);
+	FREE(test_obj.rwlocks);
+	FREE(test_obj.mutexes);
+
 	pmemobj_close(test_obj.pop);
 
 	DONE(NULL);
@@ -0,0 +1,477 @@
+/*
+ * Copyright 2016, Intel Corporation
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in
+ *       the documentation and/or other materials provided with the
+ *       distribution.
+ *
+ *     * Neither the name of the copyright holder nor the names of its
+ *       contributors may be used to endorse or promote products derived
+ *       from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * obj_tx_redo.c -- unit test for redo log transactions
+ */
+#include <string.h>
+
+#include "unittest.h"
+#include "redo.h"
+
+#define LAYOUT_NAME "tx_redo"
+
+#define DATA_SIZE 256
+#define LARGE_SIZE (64 * 1024)
+#define NWRITES 1000
+#define NTHREADS 8
+#define NPUBLISHES 200
+
+struct object {
+	uint64_t value;
+	uint64_t other;
+	char data[DATA_SIZE];
+};
+
+TOID_DECLARE(struct object, 1);
+
+#define CRASH_VALUE 5
+#define CRASH_OTHER 6
+
+static struct object *Crash_obj; /* crash once the log of it is stored */
+
+#ifndef _WIN32
+FUNC_MOCK(redo_range_log_apply, void, const struct redo_ctx *ctx,
+	const struct redo_range_log *log)
+	FUNC_MOCK_RUN_DEFAULT {
+		if (Crash_obj != NULL) {
+			/* the log is stored, but none of the writes applied */
+			UT_ASSERTeq(Crash_obj->value, 0);
+			UT_ASSERTeq(Crash_obj->other, 0);
+			exit(0); /* simulate a crash */
+		}
+		_FUNC_REAL(redo_range_log_apply)(ctx, log);
+	}
+FUNC_MOCK_END
+#endif
+
+/*
+ * test_commit -- writes become visible only after the commit
+ */
+static void
+test_commit(PMEMobjpool *pop, TOID(struct object) obj)
+{
+	uint64_t value = 1;
+
+	TX_BEGIN(pop) {
+		UT_ASSERTeq(pmemobj_tx_write(obj.oid, 0, &value,
+			sizeof(value)), 0);
+
+		/* the object is modified on commit */
+		UT_ASSERTeq(D_RO(obj)->value, 0);
+
+		char data[DATA_SIZE];
+		memset(data, 0xab, sizeof(data));
+		UT_ASSERTeq(pmemobj_tx_write_direct(D_RW(obj)->data, data,
+			sizeof(data)), 0);
+	} TX_ONABORT {
+		UT_ASSERT(0);
+	} TX_END
+
+	UT_ASSERTeq(D_RO(obj)->value, 1);
+	for (int i = 0; i < DATA_SIZE; ++i)
+		UT_ASSERTeq((unsigned char)D_RO(obj)->data[i], 0xab);
+}
+
+/*
+ * test_abort -- writes are discarded on abort
+ */
+static void
+test_abort(PMEMobjpool *pop, TOID(struct object) obj)
+{
+	uint64_t value = 2;
+
+	TX_BEGIN(pop) {
+		pmemobj_tx_write(obj.oid, 0, &value, sizeof(value));
+		pmemobj_tx_abort(ECANCELED);
+	} TX_ONCOMMIT {
+		UT_ASSERT(0);
+	} TX_END
+
+	UT_ASSERTeq(D_RO(obj)->value, 1);
+
+	/* inner abort discards the writes of the outer transaction */
+	TX_BEGIN(pop) {
+		pmemobj_tx_write(obj.oid, 0, &value, sizeof(value));
+		TX_BEGIN(pop) {
+			pmemobj_tx_abort(ECANCELED);
+		} TX_END
+	} TX_ONCOMMIT {
+		UT_ASSERT(0);
+	} TX_END
+
+	UT_ASSERTeq(D_RO(obj)->value, 1);
+
+	/* writes outside of the heap abort the transaction */
+	TX_BEGIN(pop) {
+		pmemobj_tx_write_direct(&value, &value, sizeof(value));
+	} TX_ONCOMMIT {
+		UT_ASSERT(0);
+	} TX_END
+	UT_ASSERTeq(errno, EINVAL);
+}
+
+/*
+ * test_overlap -- later writes to the same range win
+ */
+static void
+test_overlap(PMEMobjpool *pop, TOID(struct object) obj)
+{
+	TX_BEGIN(pop) {
+		for (uint64_t i = 0; i < NWRITES; ++i)
+			pmemobj_tx_write_direct(&D_RW(obj)->value, &i,
+				sizeof(i));
+
+		/* partially overlapping write */
+		char c = 0x11;
+		pmemobj_tx_write_direct(&D_RW(obj)->data[1], &c, sizeof(c));
+		char data[2] = {0x22, 0x22};
+		pmemobj_tx_write_direct(&D_RW(obj)->data[0], data,
+			sizeof(data));
+	} TX_ONABORT {
+		UT_ASSERT(0);
+	} TX_END
+
+	UT_ASSERTeq(D_RO(obj)->value, NWRITES - 1);
+	UT_ASSERTeq(D_RO(obj)->data[0], 0x22);
+	UT_ASSERTeq(D_RO(obj)->data[1], 0x22);
+	UT_ASSERTeq((unsigned char)D_RO(obj)->data[2], 0xab);
+}
+
+/*
+ * test_mixed -- redo log writes combined with undo log snapshots and
+ * allocations in a single transaction
+ */
+static void
+test_mixed(PMEMobjpool *pop, TOID(struct object) obj)
+{
+	TOID(struct object) nobj;
+	uint64_t value = 3;
+
+	TX_BEGIN(pop) {
+		TX_ADD_FIELD(obj, other);
+		D_RW(obj)->other = 4;
+
+		nobj = TX_ZNEW(struct object);
+		pmemobj_tx_write_direct(&D_RW(nobj)->value, &value,
+			sizeof(value));
+		pmemobj_tx_write_direct(&D_RW(obj)->value, &value,
+			sizeof(value));
+	} TX_ONABORT {
+		UT_ASSERT(0);
+	} TX_END
+
+	UT_ASSERTeq(D_RO(obj)->value, 3);
+	UT_ASSERTeq(D_RO(obj)->other, 4);
+	UT_ASSERTeq(D_RO(nobj)->value, 3);
+
+	value = 5;
+	TX_BEGIN(pop) {
+		TX_ADD_FIELD(obj, other);
+		D_RW(obj)->other = 6;
+		pmemobj_tx_write_direct(&D_RW(obj)->value, &value,
+			sizeof(value));
+		TX_FREE(nobj);
+		pmemobj_tx_abort(ECANCELED);
+	} TX_ONCOMMIT {
+		UT_ASSERT(0);
+	} TX_END
+
+	UT_ASSERTeq(D_RO(obj)->value, 3);
+	UT_ASSERTeq(D_RO(obj)->other, 4);
+	UT_ASSERTeq(D_RO(nobj)->value, 3);
+
+	TX_BEGIN(pop) {
+		TX_FREE(nobj);
+	} TX_END
+}
+
+/*
+ * test_large -- writes that don't fit in the initial redo log
+ */
+static void
+test_large(PMEMobjpool *pop)
+{
+	PMEMoid oid;
+	UT_ASSERTeq(pmemobj_zalloc(pop, &oid, LARGE_SIZE, 2), 0);
+
+	char *buf = MALLOC(LARGE_SIZE);
+	for (int i = 0; i < LARGE_SIZE; ++i)
+		buf[i] = (char)i;
+
+	TX_BEGIN(pop) {
+		for (int i = 0; i < 4; ++i)
+			pmemobj_tx_write(oid, 0, buf, LARGE_SIZE);
+	} TX_ONABORT {
+		UT_ASSERT(0);
+	} TX_END
+
+	UT_ASSERTeq(memcmp(pmemobj_direct(oid), buf, LARGE_SIZE), 0);
+
+	FREE(buf);
+	pmemobj_free(&oid);
+}
+
+/*
+ * test_publish -- published words are written atomically and invalid ones
+ *	fail only their own transaction
+ */
+static void
+test_publish(PMEMobjpool *pop, TOID(struct object) obj)
+{
+	UT_ASSERTeq(pmemobj_tx_publish(pop, NULL, 0), 0);
+
+	struct pobj_tx_word words[2] = {
+		{&D_RW(obj)->value, 3},
+		{&D_RW(obj)->other, 4},
+	};
+	UT_ASSERTeq(pmemobj_tx_publish(pop, words, 2), 0);
+	UT_ASSERTeq(D_RO(obj)->value, 3);
+	UT_ASSERTeq(D_RO(obj)->other, 4);
+
+	/* a word outside of the heap fails the whole transaction */
+	uint64_t outside;
+	struct pobj_tx_word invalid[2] = {
+		{&D_RW(obj)->value, 5},
+		{&outside, 5},
+	};
+	UT_ASSERTeq(pmemobj_tx_publish(pop, invalid, 2), EINVAL);
+	UT_ASSERTeq(errno, EINVAL);
+	UT_ASSERTeq(D_RO(obj)->value, 3);
+
+	/* published transactions can't be nested */
+	TX_BEGIN(pop) {
+		UT_ASSERTeq(pmemobj_tx_publish(pop, words, 2), EINVAL);
+	} TX_ONABORT {
+		UT_ASSERT(0);
+	} TX_END
+}
+
+struct publish_args {
+	PMEMobjpool *pop;
+	uint64_t *words; /* pair of words of the thread */
+	int fail; /* every other transaction contains an invalid word */
+};
+
+/*
+ * publish_worker -- publishes transactions concurrently with other threads
+ */
+static void *
+publish_worker(void *arg)
+{
+	struct publish_args *a = arg;
+	uint64_t outside = 0;
+
+	for (uint64_t i = 1; i <= NPUBLISHES; ++i) {
+		struct pobj_tx_word words[2] = {
+			{&a->words[0], i},
+			{&a->words[1], i},
+		};
+
+		if (a->fail && i % 2 == 0) {
+			words[1].ptr = &outside;
+			UT_ASSERTeq(pmemobj_tx_publish(a->pop, words, 2),
+				EINVAL);
+		} else {
+			UT_ASSERTeq(pmemobj_tx_publish(a->pop, words, 2), 0);
+		}
+
+		UT_ASSERTeq(a->words[0], a->words[1]);
+	}
+
+	return NULL;
+}
+
+/*
+ * test_publish_mt -- transactions published by many threads at once
+ */
+static void
+test_publish_mt(PMEMobjpool *pop)
+{
+	PMEMoid oid;
+	UT_ASSERTeq(pmemobj_zalloc(pop, &oid,
+		2 * NTHREADS * sizeof(uint64_t), 2), 0);
+	uint64_t *words = pmemobj_direct(oid);
+
+	pthread_t threads[NTHREADS];
+	struct publish_args args[NTHREADS];
+	for (int i = 0; i < NTHREADS; ++i) {
+		args[i].pop = pop;
+		args[i].words = &words[2 * i];
+		args[i].fail = i % 2;
+		PTHREAD_CREATE(&threads[i], NULL, publish_worker, &args[i]);
+	}
+
+	for (int i = 0; i < NTHREADS; ++i)
+		PTHREAD_JOIN(threads[i], NULL);
+
+	for (int i = 0; i < NTHREADS; ++i) {
+		uint64_t expected = args[i].fail ?
+			NPUBLISHES - 1 : NPUBLISHES;
+		UT_ASSERTeq(words[2 * i], expected);
+		UT_ASSERTeq(words[2 * i + 1], expected);
+	}
+
+	pmemobj_free(&oid);
+}
+
+/*
+ * test_crash -- stops right after the redo log of a transaction is stored
+ */
+static void
+test_crash(PMEMobjpool *pop)
+{
+	TOID(struct object) obj;
+	POBJ_ZNEW(pop, &obj, struct object);
+
+	uint64_t value = CRASH_VALUE;
+	uint64_t other = CRASH_OTHER;
+
+	TX_BEGIN(pop) {
+		pmemobj_tx_write(obj.oid, 0, &value, sizeof(value));
+		pmemobj_tx_write_direct(&D_RW(obj)->other, &other,
+			sizeof(other));
+
+		/* the offset of the write cannot wrap around */
+		TX_BEGIN(pop) {
+			pmemobj_tx_write(obj.oid, UINT64_MAX, &value,
+				sizeof(value));
+		} TX_ONCOMMIT {
+			UT_ASSERT(0);
+		} TX_END
+	} TX_ONCOMMIT {
+		UT_ASSERT(0);
+	} TX_END
+	UT_ASSERTeq(errno, EINVAL);
+
+	TX_BEGIN(pop) {
+		pmemobj_tx_write(obj.oid, 0, &value, sizeof(value));
+		pmemobj_tx_write_direct(&D_RW(obj)->other, &other,
+			sizeof(other));
+		Crash_obj = D_RW(obj);
+	} TX_END
+
+	/* if we get here, something is wrong with function mocking */
+	UT_ASSERT(0);
+}
+
+/*
+ * test_recovered -- checks that the stored redo log is applied on open
+ */
+static void
+test_recovered(PMEMobjpool *pop)
+{
+	TOID(struct object) obj;
+	TOID_ASSIGN(obj, POBJ_FIRST_TYPE_NUM(pop, 1));
+	UT_ASSERTeq(D_RO(obj)->value, CRASH_VALUE);
+	UT_ASSERTeq(D_RO(obj)->other, CRASH_OTHER);
+
+	/* the lane is usable again */
+	uint64_t value = CRASH_VALUE + 1;
+	TX_BEGIN(pop) {
+		pmemobj_tx_write(obj.oid, 0, &value, sizeof(value));
+	} TX_ONABORT {
+		UT_ASSERT(0);
+	} TX_END
+	UT_ASSERTeq(D_RO(obj)->value, CRASH_VALUE + 1);
+}
+
+int
+main(int argc, char *argv[])
+{
+	START(argc, argv, "obj_tx_redo");
+
+	if (argc < 2 || argc > 3 ||
+		(argc == 3 && strcmp(argv[2], "c") && strcmp(argv[2], "o")))
+		UT_FATAL("usage: %s file-name [c|o]", argv[0]);
+
+	const char *path = argv[1];
+
+	PMEMobjpool *pop;
+
+	/* crash in the middle of a commit and recover on the next open */
+	if (argc == 3) {
+		if (argv[2][0] == 'c') {
+			if ((pop = pmemobj_create(path, LAYOUT_NAME,
+					PMEMOBJ_MIN_POOL,
+					S_IWUSR | S_IRUSR)) == NULL)
+				UT_FATAL("!pmemobj_create: %s", path);
+
+			test_crash(pop);
+		} else {
+			if ((pop = pmemobj_open(path, LAYOUT_NAME)) == NULL)
+				UT_FATAL("!pmemobj_open: %s", path);
+
+			test_recovered(pop);
+			pmemobj_close(pop);
+		}
+
+		DONE(NULL);
+	}
+
+	if ((pop = pmemobj_create(path, LAYOUT_NAME, PMEMOBJ_MIN_POOL,
+			S_IWUSR | S_IRUSR)) == NULL)
+		UT_FATAL("!pmemobj_create: %s", path);
+
+	TOID(struct object) obj;
+	POBJ_ZNEW(pop, &obj, struct object);
+
+	test_commit(pop, obj);
+	test_abort(pop, obj);
+	test_overlap(pop, obj);
+	test_mixed(pop, obj);
+	test_large(pop);
+	test_publish(pop, obj);
+	test_publish_mt(pop);
+
+	pmemobj_close(pop);
+
+	if ((pop = pmemobj_open(path, LAYOUT_NAME)) == NULL)
+		UT_FATAL("!pmemobj_open: %s", path);
+
+	/* the redo logs are internal objects */
+	int n = 0;
+	PMEMoid oid;
+	POBJ_FOREACH(pop, oid) {
+		UT_ASSERTeq(pmemobj_type_num(oid), 1);
+		n++;
+	}
+	UT_ASSERTeq(n, 1);
+
+	TOID_ASSIGN(obj, POBJ_FIRST_TYPE_NUM(pop, 1));
+	UT_ASSERTeq(D_RO(obj)->value, 3);
+	UT_ASSERTeq(D_RO(obj)->other, 4);
+
+	pmemobj_close(pop);
+
+	DONE(NULL);
+}
@@ -0,0 +1,102 @@
+/*
+ * Copyright 2016, Intel Corporation
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in
+ *       the documentation and/or other materials provided with the
+ *       distribution.
+ *
+ *     * Neither the name of the copyright holder nor the names of its
+ *       contributors may be used to endorse or promote products derived
+ *       from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * pmem_flushv.c -- unit test for pmem_flushv() and pmem_persistv()
+ *
+ * usage: pmem_flushv
+ *
+ * The flushed ranges are verified by the test script, using the
+ * debug log of the flush functions.
+ */
+
+#include "unittest.h"
+
+#define CACHELINE 64
+#define NRANGES 100 /* more than pmem_flushv() sorts on the stack */
+
+/*
+ * set_iov -- fill in one element of the vector
+ */
+static void
+set_iov(struct iovec *iov, char *base, size_t off, size_t len)
+{
+	iov->iov_base = base + off;
+	iov->iov_len = len;
+}
+
+int
+main(int argc, char *argv[])
+{
+	START(argc, argv, "pmem_flushv");
+
+	char *buf = MEMALIGN(CACHELINE, NRANGES * CACHELINE);
+	memset(buf, 0, NRANGES * CACHELINE);
+
+	struct iovec iov[NRANGES];
+
+	/* unsorted, overlapping ranges -- one flush of two cache lines */
+	set_iov(&iov[0], buf, 100, 10);
+	set_iov(&iov[1], buf, 0, 8);
+	set_iov(&iov[2], buf, 60, 8);
+	pmem_flushv(iov, 3);
+
+	/* disjoint ranges -- two flushes */
+	set_iov(&iov[0], buf, 256, 1);
+	set_iov(&iov[1], buf, 0, 1);
+	pmem_flushv(iov, 2);
+
+	/* empty ranges and vectors -- no flush */
+	set_iov(&iov[0], buf, 0, 0);
+	pmem_flushv(iov, 1);
+	pmem_flushv(iov, 0);
+
+	/* adjacent ranges -- one flush */
+	set_iov(&iov[0], buf, CACHELINE, CACHELINE);
+	set_iov(&iov[1], buf, 0, CACHELINE);
+	pmem_flushv(iov, 2);
+
+	/* long vector in reverse order -- one flush */
+	for (size_t i = 0; i < NRANGES; i++)
+		set_iov(&iov[i], buf, (NRANGES - 1 - i) * CACHELINE,
+				CACHELINE);
+	pmem_flushv(iov, NRANGES);
+
+	/* duplicated ranges -- one flush */
+	for (size_t i = 0; i < 3; i++)
+		set_iov(&iov[i], buf, 0, CACHELINE);
+	pmem_persistv(iov, 3);
+
+	ALIGNED_FREE(buf);
+
+	DONE(NULL);
+}
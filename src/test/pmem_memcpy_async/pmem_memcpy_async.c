@@ -0,0 +1,156 @@
+/*
+ * Copyright 2016, Intel Corporation
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in
+ *       the documentation and/or other materials provided with the
+ *       distribution.
+ *
+ *     * Neither the name of the copyright holder nor the names of its
+ *       contributors may be used to endorse or promote products derived
+ *       from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * pmem_memcpy_async.c -- unit test for pmem_memcpy_async
+ *
+ * usage: pmem_memcpy_async file
+ *
+ * The file has to be at least 16MB long.
+ */
+
+#include "unittest.h"
+
+#define MB (1 << 20)
+#define SRC_SIZE (8 * MB)
+#define DEST_OFF 7
+
+/*
+ * copy_and_check -- copy len bytes and verify the destination
+ */
+static void
+copy_and_check(char *dest, const char *src, size_t len, unsigned flags)
+{
+	memset(dest, 0, len + 1);
+
+	PMEMasync *async = pmem_memcpy_async(dest, src, len, flags);
+	UT_ASSERTne(async, NULL);
+
+	UT_ASSERTeq(pmem_async_wait(async), 0);
+
+	UT_ASSERTeq(memcmp(dest, src, len), 0);
+	UT_ASSERTeq(dest[len], 0);
+}
+
+#ifndef _WIN32
+/*
+ * test_fork -- copy in a child of a process which already used the workers
+ *
+ * The child has to start its own workers and must not wait for the ones of
+ * the parent when it exits.
+ */
+static void
+test_fork(char *dest, const char *src, unsigned flags)
+{
+	pid_t pid = fork();
+	if (pid < 0)
+		UT_FATAL("!fork");
+
+	if (pid == 0) {
+		copy_and_check(dest, src, 3 * MB + 123, flags);
+		exit(0);
+	}
+
+	int status;
+	if (waitpid(pid, &status, 0) < 0)
+		UT_FATAL("!waitpid");
+
+	UT_ASSERT(WIFEXITED(status));
+	UT_ASSERTeq(WEXITSTATUS(status), 0);
+
+	copy_and_check(dest, src, 3 * MB + 123, flags);
+}
+#endif
+
+int
+main(int argc, char *argv[])
+{
+	START(argc, argv, "pmem_memcpy_async");
+
+	if (argc != 2)
+		UT_FATAL("usage: %s file", argv[0]);
+
+	size_t mapped_len;
+	int is_pmem;
+	char *dest = pmem_map_file(argv[1], 0, 0, 0, &mapped_len, &is_pmem);
+	if (dest == NULL)
+		UT_FATAL("!could not map file: %s", argv[1]);
+
+	UT_ASSERT(mapped_len >= 2 * SRC_SIZE);
+
+	unsigned flags = is_pmem ? 0 : PMEM_ASYNC_NOPMEM;
+
+	char *src = MALLOC(SRC_SIZE);
+	for (size_t i = 0; i < SRC_SIZE; i++)
+		src[i] = (char)(i * 31 + i / 4096);
+
+	/* empty, single chunk and multi-chunk copies */
+	size_t lens[] = {0, 1, 4096, MB, MB + 1, 3 * MB + 123,
+			SRC_SIZE - DEST_OFF - 1};
+	for (size_t i = 0; i < sizeof(lens) / sizeof(lens[0]); i++)
+		copy_and_check(dest + DEST_OFF, src, lens[i], flags);
+
+	/* two copies in flight at the same time, polled until completed */
+	memset(dest, 0, 2 * SRC_SIZE);
+	PMEMasync *a1 = pmem_memcpy_async(dest, src, SRC_SIZE, flags);
+	PMEMasync *a2 = pmem_memcpy_async(dest + SRC_SIZE, src, SRC_SIZE,
+			flags);
+	UT_ASSERTne(a1, NULL);
+	UT_ASSERTne(a2, NULL);
+
+	/* without workers the copies complete only in pmem_async_wait() */
+	char *threads = getenv("PMEM_ASYNC_THREADS");
+	if (threads == NULL || atoi(threads) != 0) {
+		while (!pmem_async_poll(a1) || !pmem_async_poll(a2))
+			;
+	}
+
+	UT_ASSERTeq(pmem_async_wait(a2), 0);
+	UT_ASSERTeq(pmem_async_wait(a1), 0);
+	UT_ASSERTeq(memcmp(dest, src, SRC_SIZE), 0);
+	UT_ASSERTeq(memcmp(dest + SRC_SIZE, src, SRC_SIZE), 0);
+
+	/* invalid flags */
+	errno = 0;
+	UT_ASSERTeq(pmem_memcpy_async(dest, src, 1, ~PMEM_ASYNC_ALL_FLAGS),
+			NULL);
+	UT_ASSERTeq(errno, EINVAL);
+
+#ifndef _WIN32
+	test_fork(dest + DEST_OFF, src, flags);
+#endif
+
+	FREE(src);
+	UT_ASSERTeq(pmem_unmap(dest, mapped_len), 0);
+
+	DONE(NULL);
+}
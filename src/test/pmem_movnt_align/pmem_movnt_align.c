@@ -33,12 +33,14 @@
 /*
  * pmem_movnt_align.c -- unit test for functions with non-temporal stores
  *
- * usage: pmem_movnt_align [C|F|B|S]
+ * usage: pmem_movnt_align [C|F|B|S]...
  *
  * C - pmem_memcpy_persist()
  * B - pmem_memmove_persist() in backward direction
  * F - pmem_memmove_persist() in forward direction
  * S - pmem_memset_persist()
+ *
+ * Several types may be given at once, they are checked in the given order.
  */
 
 #include <stdio.h>
@@ -103,16 +105,12 @@ check_memset(void *dest, size_t len)
 	free(buff);
 }
 
-int
-main(int argc, char *argv[])
+/*
+ * check_type -- run all the alignment checks for the given type of operation
+ */
+static void
+check_type(char type)
 {
-	START(argc, argv, "pmem_movnt_align");
-
-	if (argc != 2)
-		UT_FATAL("usage: %s type", argv[0]);
-
-	char type = argv[1][0];
-
 	char *src, *dst;
 
 	size_t s;
@@ -226,6 +224,18 @@ main(int argc, char *argv[])
 		UT_FATAL("!wrong type of test");
 		break;
 	}
+}
+
+int
+main(int argc, char *argv[])
+{
+	START(argc, argv, "pmem_movnt_align");
+
+	if (argc != 2)
+		UT_FATAL("usage: %s type", argv[0]);
+
+	for (const char *type = argv[1]; *type != '\0'; type++)
+		check_type(*type);
 
 	DONE(NULL);
 }
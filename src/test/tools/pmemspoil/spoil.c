@@ -1135,6 +1135,7 @@ pmemspoil_process_sec_allocator(struct pmemspoil *psp,
 	PROCESS_BEGIN(psp, pfp) {
 		PROCESS(redo_log, &sec->redo[PROCESS_INDEX],
 			ALLOC_REDO_LOG_SIZE, struct redo_log *);
+		PROCESS_FIELD(sec, redo_ext, uint64_t);
 	} PROCESS_END
 
 	return PROCESS_RET;
@@ -1171,6 +1172,8 @@ pmemspoil_process_sec_tx(struct pmemspoil *psp,
 			&sec->undo_log[UNDO_SET], 1);
 		PROCESS_NAME("undo_free", vector,
 			&sec->undo_log[UNDO_FREE], 1);
+		PROCESS_FIELD(sec, redo_log, uint64_t);
+		PROCESS_FIELD(sec, undo_buffer, uint64_t);
 	} PROCESS_END
 
 	return PROCESS_RET;
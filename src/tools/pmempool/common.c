@@ -1188,6 +1188,7 @@ util_heap_max_zone(size_t size)
 
 /*
  * util_heap_get_bitmap_params -- return bitmap parameters of given block size
+ *	and kind of run
  *
  * The function returns the following values:
  * - number of allocations
@@ -1195,11 +1196,13 @@ util_heap_max_zone(size_t size)
  * - initial value of last used entry
  */
 int
-util_heap_get_bitmap_params(uint64_t block_size, uint64_t *nallocsp,
-		uint64_t *nvalsp, uint64_t *last_valp)
+util_heap_get_bitmap_params(uint64_t block_size, int headerless,
+		uint64_t *nallocsp, uint64_t *nvalsp, uint64_t *last_valp)
 {
-	assert(RUNSIZE / block_size <= UINT32_MAX);
-	uint32_t nallocs = (uint32_t)(RUNSIZE / block_size);
+	uint64_t nallocs64 = headerless ?
+		RUN_HEADERLESS_NALLOCS(block_size) : RUN_NALLOCS(block_size);
+	assert(nallocs64 <= UINT32_MAX);
+	uint32_t nallocs = (uint32_t)nallocs64;
 
 	assert(nallocs <= RUN_BITMAP_SIZE);
 	unsigned unused_bits = RUN_BITMAP_SIZE - nallocs;
@@ -1215,7 +1218,9 @@ util_heap_get_bitmap_params(uint64_t block_size, uint64_t *nallocsp,
 	uint64_t last_val = unused_bits ? (((1ULL << unused_bits) - 1ULL) <<
 				(BITS_PER_VALUE - unused_bits)) : 0;
 
-	if (nvals >= MAX_BITMAP_VALUES || nvals == 0)
+	/* only the runs of header-less blocks may fill the whole bitmap */
+	if (nvals > MAX_BITMAP_VALUES || nvals == 0 ||
+		(!headerless && nvals == MAX_BITMAP_VALUES))
 		return -1;
 
 	if (nallocsp)
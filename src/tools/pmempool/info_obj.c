@@ -119,16 +119,36 @@ lane_need_recovery_tx(struct pmem_info *pip,
 		set_cache = (range->offset && range->size);
 	}
 
+	int redo = 0;
+
+	if (section->redo_log != 0) {
+		struct redo_range_log *log =
+			OFF_TO_PTR(pip->obj.pop, section->redo_log);
+
+		redo = log->size != 0;
+	}
+
+	int undo_buffer = 0;
+
+	if (section->undo_buffer != 0) {
+		struct tx_undo_buffer *buffer =
+			OFF_TO_PTR(pip->obj.pop, section->undo_buffer);
+		struct tx_undo_buffer_entry *entry =
+			(struct tx_undo_buffer_entry *)buffer->data;
+
+		undo_buffer = entry->generation == buffer->generation;
+	}
+
 	/*
 	 * The transaction section needs recovery
 	 * if state is not committed and
-	 * any undo log not empty
+	 * any undo log not empty, or if the redo log is not empty
 	 */
-	return section->state == TX_STATE_NONE &&
+	return redo || (section->state == TX_STATE_NONE &&
 		(!PVECTOR_EMPTY(section->undo_log[UNDO_ALLOC]) ||
 		!PVECTOR_EMPTY(section->undo_log[UNDO_FREE]) ||
 		!PVECTOR_EMPTY(section->undo_log[UNDO_SET]) ||
-		set_cache);
+		set_cache || undo_buffer));
 }
 
 /*
@@ -178,9 +198,11 @@ heap_class_to_size(int class)
  * get_bitmap_size -- get number of used bits in chunk run's bitmap
  */
 static uint32_t
-get_bitmap_size(struct chunk_run *run)
+get_bitmap_size(struct chunk_header *hdr, struct chunk_run *run)
 {
-	uint64_t size = RUNSIZE / run->block_size;
+	uint64_t size = hdr->flags & CHUNK_FLAG_HEADERLESS ?
+		RUN_HEADERLESS_NALLOCS(run->block_size) :
+		RUN_NALLOCS(run->block_size);
 	assert(size <= UINT32_MAX);
 	return (uint32_t)size;
 }
@@ -189,11 +211,13 @@ get_bitmap_size(struct chunk_run *run)
  * get_bitmap_reserved -- get number of reserved blocks in chunk run
  */
 static int
-get_bitmap_reserved(struct chunk_run *run, uint32_t *reserved)
+get_bitmap_reserved(struct chunk_header *hdr, struct chunk_run *run,
+	uint32_t *reserved)
 {
 	uint64_t nvals = 0;
 	uint64_t last_val = 0;
-	if (util_heap_get_bitmap_params(run->block_size, NULL, &nvals,
+	if (util_heap_get_bitmap_params(run->block_size,
+			hdr->flags & CHUNK_FLAG_HEADERLESS, NULL, &nvals,
 			&last_val))
 		return -1;
 
@@ -618,13 +642,57 @@ info_obj_object(struct pmem_info *pip, struct obj_header *objh,
 	outv_indent(v, -1);
 }
 
+/*
+ * info_obj_headerless_object -- print information about header-less object
+ */
+static void
+info_obj_headerless_object(struct pmem_info *pip, void *ptr, size_t size,
+	uint64_t type_num, uint64_t objid)
+{
+	if (!util_ranges_contain(&pip->args.ranges, objid))
+		return;
+
+	if (!util_ranges_contain(&pip->args.obj.type_ranges, type_num))
+		return;
+
+	pip->obj.stats.n_total_objects++;
+	pip->obj.stats.n_total_bytes += size;
+
+	struct pmem_obj_type_stats *type_stats =
+		pmem_obj_stats_get_type(&pip->obj.stats, type_num);
+
+	type_stats->n_objects++;
+	type_stats->n_bytes += size;
+
+	int v = pip->args.obj.vobjects;
+
+	outv_indent(v, 1);
+	outv_nl(v);
+	outv_field(v, "Object", "%lu", objid);
+	outv_field(v, "Offset", "0x%016lx", PTR_TO_OFF(pip->obj.pop, ptr));
+	outv_field(v, "Type Number", "0x%016lx", type_num);
+	outv_field(v, "Size", "%s", out_get_size_str(size, pip->args.human));
+	outv_hexdump(v && pip->args.vdata, ptr, size,
+			PTR_TO_OFF(pip->obj.pop, ptr), 1);
+	outv_indent(v, -1);
+}
+
 /*
  * info_obj_run_objects -- print information about objects from chunk run
  */
 static void
-info_obj_run_objects(struct pmem_info *pip, int v, struct chunk_run *run)
+info_obj_run_objects(struct pmem_info *pip, int v,
+	struct chunk_header *chunk_hdr, struct chunk_run *run)
 {
-	uint32_t bsize = get_bitmap_size(run);
+	/*
+	 * The blocks of header-less runs are always one unit and the type
+	 * number of all of them is stored at the end of the run's data.
+	 */
+	int headerless = (chunk_hdr->flags & CHUNK_FLAG_HEADERLESS) != 0;
+	uint64_t type_num = *(uint64_t *)&run->data[RUNSIZE -
+		RUN_TYPE_NUM_SIZE];
+
+	uint32_t bsize = get_bitmap_size(chunk_hdr, run);
 	uint32_t i = 0;
 	while (i < bsize) {
 		uint32_t nval = i / BITS_PER_VALUE;
@@ -636,6 +704,15 @@ info_obj_run_objects(struct pmem_info *pip, int v, struct chunk_run *run)
 			continue;
 		}
 
+		if (headerless) {
+			info_obj_headerless_object(pip,
+				&run->data[run->block_size * i],
+				run->block_size, type_num, pip->obj.objid);
+			pip->obj.objid++;
+			i++;
+			continue;
+		}
+
 		struct obj_header *objh =
 			(struct obj_header *)&run->data[run->block_size * i];
 
@@ -653,9 +730,10 @@ info_obj_run_objects(struct pmem_info *pip, int v, struct chunk_run *run)
  * info_obj_run_bitmap -- print chunk run's bitmap
  */
 static void
-info_obj_run_bitmap(int v, struct chunk_run *run)
+info_obj_run_bitmap(int v, struct chunk_header *chunk_hdr,
+	struct chunk_run *run)
 {
-	uint32_t bsize = get_bitmap_size(run);
+	uint32_t bsize = get_bitmap_size(chunk_hdr, run);
 
 	if (outv_check(v) && outv_check(VERBOSE_MAX)) {
 		/* print all values from bitmap for higher verbosity */
@@ -732,9 +810,9 @@ info_obj_chunk(struct pmem_info *pip, uint64_t c,
 					out_get_size_str(run->block_size,
 						pip->args.human));
 
-			uint32_t units = get_bitmap_size(run);
+			uint32_t units = get_bitmap_size(chunk_hdr, run);
 			uint32_t used = 0;
-			if (get_bitmap_reserved(run,  &used)) {
+			if (get_bitmap_reserved(chunk_hdr, run, &used)) {
 				outv_field(v, "Bitmap", "[error]");
 			} else {
 				stats->class_stats[class].n_units += units;
@@ -743,9 +821,10 @@ info_obj_chunk(struct pmem_info *pip, uint64_t c,
 				outv_field(v, "Bitmap", "%u / %u", used, units);
 			}
 
-			info_obj_run_bitmap(v && pip->args.obj.vbitmap, run);
+			info_obj_run_bitmap(v && pip->args.obj.vbitmap,
+					chunk_hdr, run);
 			info_obj_run_objects(pip, v && pip->args.obj.vobjects,
-					run);
+					chunk_hdr, run);
 		} else {
 			outv_field(v, "Block size", "%s [invalid!]",
 					out_get_size_str(run->block_size,
@@ -649,6 +649,10 @@ out_get_chunk_type_str(unsigned type)
 const char *
 out_get_chunk_flags(uint16_t flags)
 {
+	if (flags & CHUNK_FLAG_HEADERLESS)
+		return flags & CHUNK_FLAG_ZEROED ?
+			"zeroed header-less" : "header-less";
+
 	return flags & CHUNK_FLAG_ZEROED ? "zeroed" : "";
 }
 
@@ -111,6 +111,17 @@ __builtin_clzll(uint64_t val)
 		return 64;
 }
 
+__inline int
+__builtin_ctzll(uint64_t val)
+{
+	DWORD tz = 0;
+
+	if (BitScanForward64(&tz, val))
+		return (int)tz;
+	else
+		return 64;
+}
+
 __inline int
 __builtin_ffsll(long long val)
 {
@@ -138,6 +149,12 @@ __sync_fetch_and_add(volatile uint32_t *a, uint32_t val)
 	return InterlockedExchangeAdd(a, val);
 }
 
+__inline uint32_t
+__sync_fetch_and_sub(volatile uint32_t *a, uint32_t val)
+{
+	return InterlockedExchangeSubtract(a, val);
+}
+
 __inline uint64_t
 __sync_fetch_and_add64(volatile uint64_t *a, uint64_t val)
 {